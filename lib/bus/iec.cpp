@@ -323,6 +323,9 @@ IEC::BusState IEC::deviceListen(Data& iec_data)
 
 			if(c == IEC_UNLISTEN)
 			{
+				// Only the CR that ends the line, binary commands (P, M-W) can hold one
+				if(iec_data.content.size() && iec_data.content.back() == 0x0D)
+					iec_data.content.pop_back();
 				mstr::rtrimA0(iec_data.content);
 				Debug_printf(" [%s] (3F UNLISTEN)\r\n", iec_data.content.c_str());
 				break;
@@ -335,10 +338,7 @@ IEC::BusState IEC::deviceListen(Data& iec_data)
 				Debug_printv("IEC_CMD_MAX_LENGTH");
 				return BUS_ERROR;
 			}
-			if(c != 0x0D)
-			{
-				iec_data.content += (uint8_t)c;
-			}
+			iec_data.content += (uint8_t)c;
 		}
 	}
 
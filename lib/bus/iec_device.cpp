@@ -30,17 +30,37 @@ namespace
 	// Buffer for incoming and outgoing serial bytes and other stuff.
 	char serCmdIOBuf[MAX_BYTES_PER_REQUEST];
 
+	IEC::Data &iecData()
+	{
+		return *reinterpret_cast<IEC::Data *>(&serCmdIOBuf[sizeof(serCmdIOBuf) / 2]);
+	}
+
 } // unnamed namespace
 
-iecDevice::iecDevice(IEC &iec)
-	: m_iec(iec),
-	m_iec_data(*reinterpret_cast<IEC::Data *>(&serCmdIOBuf[sizeof(serCmdIOBuf) / 2])),
-	m_device(0)
+iecDevice* iecDevice::devices[31] = { nullptr };
+iecDevice* iecDevice::first = nullptr;
+
+iecDevice::iecDevice(IEC &iec, uint8_t device)
+	: device_id(device),
+	m_iec(iec),
+	m_iec_data(iecData()),
+	m_device(device)
 {
 	m_iec_data.content += '\0';
 	reset();
+
+	devices[device] = this;
+	if ( first == nullptr )
+		first = this;
 } // ctor
 
+iecDevice::~iecDevice()
+{
+	devices[device_id] = nullptr;
+	if ( first == this )
+		first = nullptr;
+} // dtor
+
 
 void iecDevice::reset(void)
 {
@@ -48,10 +68,22 @@ void iecDevice::reset(void)
 } // reset
 
 
-uint8_t iecDevice::service(void)
+void iecDevice::idle(void)
 {
-	iecDevice::DeviceState r = DEVICE_IDLE;
+	// Write out device settings once they stopped changing
+	for ( auto device : devices )
+	{
+		if ( device != nullptr )
+			device->m_device.service();
+	}
+
+	// Let go of what the filesystems keep for the next LOAD
+	MFSOwner::idle();
+} // idle
 
+
+uint8_t iecDevice::service(IEC &iec)
+{
 	//#ifdef HAS_RESET_LINE
 	//	if(m_iec.checkRESET()) {
 	//		// IEC reset line is in reset device state
@@ -68,9 +100,24 @@ uint8_t iecDevice::service(void)
 	//}
 
 	//	noInterrupts();
-	IEC::BusState bus_state = m_iec.service(m_iec_data);
+	IEC::Data &iec_data = iecData();
+	IEC::BusState bus_state = iec.service(iec_data);
 	//	interrupts();
 
+	// Straight to the device it is for, each one keeps its own state
+	iecDevice *device = first;
+	if ( iec_data.device < 31 && devices[iec_data.device] != nullptr )
+		device = devices[iec_data.device];
+
+	if ( device == nullptr )
+		return IEC::BUS_IDLE;
+
+	return device->process(bus_state);
+} // service
+
+
+uint8_t iecDevice::process(IEC::BusState bus_state)
+{
 
 	if (bus_state == IEC::BUS_ERROR)
 	{
@@ -150,7 +197,7 @@ uint8_t iecDevice::service(void)
 	//Debug_printv("mode[%d] command[%.2X] channel[%.2X] state[%d]", mode, m_iec_data.command, m_iec_data.channel, m_openState);
 
 	return bus_state;
-} // service
+} // process
 
 
 Channel iecDevice::channelSelect(IEC::Data &iec_data)
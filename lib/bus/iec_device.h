@@ -63,8 +63,25 @@ class Channel
 {
 public:
 	std::string url;
-	uint32_t cursor;
-	bool writing;
+	uint32_t cursor = 0;
+	bool writing = false;
+	uint8_t record_length = 0;	// REL file, cursor is the byte in it
+	std::string buffer;			// "#" channel, a block buffer with cursor as its pointer
+	uint16_t buffer_end = 0;	// TALK sends the buffer up to here
+
+	// File open on a data channel, kept from OPEN to CLOSE. cursor is the
+	// byte the computer gets next, data what was read ahead of it.
+	std::shared_ptr<MIStream> istream;
+	std::shared_ptr<MOStream> ostream;
+	std::string data;
+	size_t data_pos = 0;
+
+	// REL file, the record the cursor is in. It is written back once the
+	// cursor leaves it or the channel is closed.
+	std::string record;
+	int32_t record_number = -1;
+	bool record_dirty = false;
+	uint32_t record_end = 0;	// Size of the file with the records written
 };
 
 class iecDevice
@@ -80,10 +97,14 @@ public:
 
 	std::unordered_map<uint16_t, Channel> channels;
 
-	iecDevice(IEC &iec);
-	~iecDevice() {};
+	iecDevice(IEC &iec, uint8_t device);
+	~iecDevice();
 
-	uint8_t service(void);
+	// Reads what the computer sends and hands it to the device it is for
+	static uint8_t service(IEC &iec);
+
+	// Housekeeping of all devices while the bus is quiet
+	static void idle(void);
 	
 	virtual uint8_t command(IEC::Data &iec_data) = 0;
 	virtual uint8_t execute(IEC::Data &iec_data) = 0;
@@ -95,6 +116,9 @@ public:
 protected:
 	void reset(void);
 
+	// Carries out a command for this device
+	uint8_t process(IEC::BusState bus_state);
+
 	// handler helpers.
 	virtual void handleListenCommand(IEC::Data &iec_data) = 0;
 	virtual void handleListenData(void) = 0;
@@ -112,6 +136,12 @@ protected:
 	DeviceDB m_device;
 
 private:
+	// Devices by number, each one with its own channels, directory and
+	// settings. Enabled numbers without a device of their own go to the
+	// first one.
+	static iecDevice* devices[31];
+	static iecDevice* first;
+
 	Channel channelSelect(IEC::Data &iec_data);
 	bool channelClose(IEC::Data &iec_data, bool close_all = false);
 
@@ -201,6 +201,14 @@ bool CBMStandardSerial::sendByte(uint8_t data, bool signalEOI)
 	// to  accept  data.  What  happens  next  is  variable.
 	while(status(IEC_PIN_DATA) != RELEASED)
 	{
+		// The computer may stop taking bytes (UNTALK) instead, nothing of
+		// this one has gone out yet
+		if(status(IEC_PIN_ATN) == PULLED)
+		{
+			flags or_eq ATN_PULLED;
+			return false;
+		}
+
 		ESP.wdtFeed();
 	}
 
@@ -312,6 +320,7 @@ bool CBMStandardSerial::sendByte(uint8_t data, bool signalEOI)
 	if(timeoutWait(IEC_PIN_DATA, PULLED, TIMEOUT_Tf) == TIMED_OUT)
 	{
 		Debug_printv("Wait for listener to acknowledge byte received");
+		flags or_eq ERROR;
 		return false; // return error because timeout
 	}
 
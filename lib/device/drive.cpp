@@ -23,13 +23,14 @@
 #include "iec_device.h"
 #include "wrappers/iec_buffer.h"
 #include "wrappers/directory_stream.h"
+#include "media/cbm_image.h"
 
 using namespace CBM;
 using namespace Protocol;
 
 
-devDrive::devDrive(IEC &iec) :
-    iecDevice(iec),
+devDrive::devDrive(IEC &iec, uint8_t device) :
+    iecDevice(iec, device),
 	m_mfile(MFSOwner::File(""))
 {
 	reset();
@@ -40,7 +41,9 @@ void devDrive::reset(void)
 {
 	m_openState = O_NOTHING;
 	setDeviceStatus(73);
-	//m_device.reset();
+
+	// Don't lose settings that are still waiting to be written
+	m_device.save();
 } // reset
 
 
@@ -76,7 +79,11 @@ void devDrive::setDeviceStatus(int number, int track, int sector)
 	{
 		// 1 - FILES SCRATCHED - number scratched in track variable
 		case 1:
-			m_device_status = "01,FILES SCRATCHED,00,00";
+			m_device_status = mstr::format("01,FILES SCRATCHED,%.2d,00", track);
+			break;
+		// 2 - SELECTED PARTITION - partition number in track variable
+		case 2:
+			m_device_status = mstr::format("02,SELECTED PARTITION,%.2d,00", track);
 			break;
 		// 20 READ ERROR
 		case 20:
@@ -106,6 +113,10 @@ void devDrive::setDeviceStatus(int number, int track, int sector)
 		case 50:
 			m_device_status = "50,RECORD NOT PRESENT,00,00";
 			break;
+		// 51 OVERFLOW IN RECORD - more data than the record holds
+		case 51:
+			m_device_status = "51,OVERFLOW IN RECORD,00,00";
+			break;
 		// 60 WRITE FILE OPEN - trying to open for wrtiting a file that is open for writing
 		case 60:
 			m_device_status = "60,WRITE FILE OPEN,00,00";
@@ -122,9 +133,17 @@ void devDrive::setDeviceStatus(int number, int track, int sector)
 		case 63:
 			m_device_status = "63,FILE EXISTS,00,00";
 			break;
-		// 65 NO BLOCK - for B-A
+		// 65 NO BLOCK - for B-A, the next free block in track/sector
 		case 65:
-			m_device_status = "65,NO BLOCK,00,00";
+			m_device_status = mstr::format("65,NO BLOCK,%.2d,%.2d", track, sector);
+			break;
+		// 66 ILLEGAL TRACK OR SECTOR
+		case 66:
+			m_device_status = mstr::format("66,ILLEGAL TRACK OR SECTOR,%.2d,%.2d", track, sector);
+			break;
+		// 70 NO CHANNEL - nothing open on the channel given
+		case 70:
+			m_device_status = "70,NO CHANNEL,00,00";
 			break;
 		// 73 boot message: device name, rom version etc.
 		case 73:
@@ -183,7 +202,7 @@ MFile* devDrive::getPointed(MFile* urlFile) {
 	}
 };
 
-CommandPathTuple devDrive::parseLine(std::string command, size_t channel)
+CommandPathTuple devDrive::parseLine(std::string command, size_t channel, char type)
 {
 
 	Debug_printv("* PARSE INCOMING LINE *******************************");
@@ -191,7 +210,13 @@ CommandPathTuple devDrive::parseLine(std::string command, size_t channel)
 	Debug_printv("we are in              [%s]", m_mfile->url.c_str());
 	Debug_printv("unprocessed user input [%s]", command.c_str());
 
-	if (mstr::endsWith(command, "*"))
+	// '?' in a URL starts its query, it isn't a pattern
+	CBMPattern pattern;
+	if (channel != CMD_CHANNEL && command[0] != '$' && command.find("://") == std::string::npos &&
+		command.find_first_of("*?") != std::string::npos)
+		pattern.set(command);
+
+	if (pattern.wildcard())
 	{
 		// Find first program in listing
 		if (m_device.path().empty())
@@ -202,22 +227,22 @@ CommandPathTuple devDrive::parseLine(std::string command, size_t channel)
 		}
 		else
 		{
-			// Find first PRG file in current directory
+			// Find first file in current directory that matches, of the
+			// type asked for if there is one
+			m_mfile->rewindDirectory();
 			std::unique_ptr<MFile> entry(m_mfile->getNextFileInDir());
-			std::string match = mstr::dropLast(command, 1);
 			while ( entry != nullptr )
 			{
-				Debug_printv("match[%s] extension[%s]", match.c_str(), entry->extension.c_str());
-				if ( !mstr::startsWith(entry->extension, "prg") || (match.size() > 0 && !mstr::startsWith( entry->name, match.c_str() ))  )
-				{
-					entry.reset(m_mfile->getNextFileInDir());
-				}
-				else
-				{
+				char entry_type = entry->extension.size() ? toupper(entry->extension[0]) : 'P';
+				Debug_printv("name[%s] extension[%s]", entry->name.c_str(), entry->extension.c_str());
+				if ( !entry->isDirectory() && (!type || entry_type == type) && pattern.matches(entry->petsciiName(), entry_type) )
 					break;
-				}
+
+				entry.reset(m_mfile->getNextFileInDir());
 			}
-			command = entry->name;
+
+			if ( entry != nullptr )
+				command = entry->name;
 		}
 	}
 
@@ -283,7 +308,7 @@ CommandPathTuple devDrive::parseLine(std::string command, size_t channel)
 
 	Debug_printv("found command     [%s]", tuple.command.c_str());
 
-	if(guessedPath == "$")
+	if(guessedPath[0] == '$')
 	{
 		Debug_printv("get directory of [%s]", m_mfile->url.c_str());
 	}
@@ -306,11 +331,29 @@ void devDrive::changeDir(std::string url)
 	m_device.url(url);
 	m_mfile.reset(MFSOwner::File(url));
 	m_openState = O_DIR;
+	m_filter.clear();
 	Debug_printv("!!!! CD into [%s]", url.c_str());
 	Debug_printv("new current url: [%s]", m_mfile->url.c_str());
 	Debug_printv("LOAD $");
 }
 
+void devDrive::changePartition(std::string command)
+{
+	uint8_t number = ( command[1] == 'P' ) ? atoi(command.substr(2).c_str()) : (uint8_t)command[2];
+
+	// Partitions are the top directories of a partitioned image, so this
+	// is a CD to the root of the image we are in and into the partition
+	std::unique_ptr<MFile> partition(m_mfile->cd("/" + std::to_string(number)));
+	if ( number == 0 || partition == nullptr || !partition->isDirectory() )
+	{
+		setDeviceStatus(77);
+		return;
+	}
+
+	changeDir(partition->url);
+	setDeviceStatus(2, number);
+}
+
 void devDrive::prepareFileStream(std::string url)
 {
 	m_device.url(url);
@@ -323,9 +366,10 @@ void devDrive::prepareFileStream(std::string url)
 
 void devDrive::handleListenCommand(IEC::Data &iec_data)
 {
-	if (m_device.select(iec_data.device))
+	// Where this device was, the first time it is used
+	if (m_device.select(device_id))
 	{
-		Debug_printv("!!!! device changed: unit:%d current url: [%s]", m_device.id(), m_device.url().c_str());
+		Debug_printv("unit:%d current url: [%s]", m_device.id(), m_device.url().c_str());
 		m_mfile.reset(MFSOwner::File(m_device.url()));
 		Debug_printv("m_mfile[%s]", m_mfile->url.c_str());
 	}
@@ -342,13 +386,35 @@ void devDrive::handleListenCommand(IEC::Data &iec_data)
 		return;
 	}
 
-	// 1. obtain command and fullPath
-	auto commandAndPath = parseLine(iec_data.content, channel);
+	// DOS commands
+	if ( channel == CMD_CHANNEL && dosCommand(iec_data.content) )
+		return;
+
+	// Direct access channel for the block commands
+	if ( channel > 1 && channel < CMD_CHANNEL && iec_data.content[0] == '#' )
+	{
+		openBuffer(iec_data);
+		return;
+	}
+
+	// REL files stay open on their channel for records to be read and written
+	if ( channel > 1 && channel < CMD_CHANNEL && openRelative(iec_data) )
+		return;
+
+	// So do other files, read or written as the computer asks for it
+	if ( channel > 1 && channel < CMD_CHANNEL && openChannel(iec_data) )
+		return;
+
+	// 1. obtain command and fullPath, LOAD asks for a program
+	auto commandAndPath = parseLine(iec_data.content, channel, (channel == 0) ? 'P' : 0);
 	auto referencedPath = Meat::New<MFile>(commandAndPath.fullPath);
 
 	Debug_printv("command[%s]", commandAndPath.command.c_str());
 	if (mstr::startsWith(commandAndPath.command, "$"))
 	{
+		// "$:PATTERN=T" lists only what matches
+		size_t colon = commandAndPath.command.find(':');
+		m_filter.set(colon == std::string::npos ? "" : commandAndPath.command.substr(colon + 1));
 		m_openState = O_DIR;
 		Debug_printv("LOAD $");
 	}
@@ -402,6 +468,15 @@ void devDrive::handleListenCommand(IEC::Data &iec_data)
 			// Set File
 			prepareFileStream(referencedPath->url);
 		}
+		else if ( channel == CMD_CHANNEL )
+		{
+			setDeviceStatus(31);
+		}
+	}
+	else if ( channel == CMD_CHANNEL )
+	{
+		// Not a command this drive knows
+		setDeviceStatus(31);
 	}
 
 	//dumpState();
@@ -415,6 +490,23 @@ void devDrive::handleListenData()
 {
 	Debug_printv("[%s]", m_device.url().c_str());
 
+	auto rel = channels.find(m_iec_data.channel);
+	if ( rel != channels.end() && rel->second.buffer.size() )
+	{
+		saveBuffer(rel->second);
+		return;
+	}
+	if ( rel != channels.end() && rel->second.record_length )
+	{
+		saveRecord(rel->second);
+		return;
+	}
+	if ( rel != channels.end() && rel->second.ostream != nullptr )
+	{
+		saveChannel(rel->second);
+		return;
+	}
+
 	saveFile();
 } // handleListenData
 
@@ -423,6 +515,28 @@ void devDrive::handleTalk(byte chan)
 {
 	Debug_printv("channel[%d] openState[%d]", chan, m_openState);
 
+	auto rel = channels.find(chan);
+	if ( rel != channels.end() && rel->second.buffer.size() )
+	{
+		sendBuffer(rel->second);
+		return;
+	}
+	if ( rel != channels.end() && rel->second.record_length )
+	{
+		sendRecord(rel->second);
+		return;
+	}
+	if ( rel != channels.end() && rel->second.istream != nullptr )
+	{
+		// A read the computer broke off carries on from where it stopped
+		sendChannel(rel->second);
+
+		// LOADs aren't closed, let go of the file once all of it went out
+		if ( chan == 0 && rel->second.cursor >= rel->second.istream->size() )
+			rel->second.istream.reset();
+		return;
+	}
+
 	switch (m_openState)
 	{
 		case O_NOTHING:
@@ -435,7 +549,7 @@ void devDrive::handleTalk(byte chan)
 
 		case O_FILE:
 			// Send file
-			sendFile();
+			sendFile(channels[chan]);
 			break;
 
 		case O_DIR:
@@ -461,23 +575,31 @@ void devDrive::handleTalk(byte chan)
 void devDrive::handleOpen(IEC::Data &iec_data)
 {
 	Debug_printv("OPEN Named Channel (%.2d Device) (%.2d Channel)", iec_data.device, iec_data.channel);
-	auto channel = channels[iec_data.command];
+	auto &channel = channels[iec_data.channel];
 
-	// Are we writing?  Appending?
-	channels[iec_data.command].url = iec_data.content;
-	channels[iec_data.command].cursor = 0;
-	channels[iec_data.command].writing = 0;
+	// Opening a channel in use drops what was open on it
+	if ( channel.record_length )
+		closeRecord(channel);
+	channel = Channel();
+	channel.url = iec_data.content;
 } // handleOpen
 
 
 void devDrive::handleClose(IEC::Data &iec_data)
 {
 	Debug_printv("CLOSE Named Channel (%.2d Device) (%.2d Channel)", iec_data.device, iec_data.channel);
-	auto channel = channels[iec_data.command];
 
 	// If writing update BAM & Directory
+	auto rel = channels.find(iec_data.channel);
+	if ( rel != channels.end() && rel->second.record_length )
+		closeRecord(rel->second);
+
+	// Blocks the buffer was written to or allocated for go out with it
+	if ( rel != channels.end() && rel->second.buffer.size() && !m_mfile->flush() )
+		setDeviceStatus(26);
 
 	// Remove channel from map
+	channels.erase(iec_data.channel);
 
 } // handleClose
 
@@ -798,9 +920,10 @@ void devDrive::sendListing()
 		//Debug_printv("size[%d] name[%s]", entry->size(), entry->name.c_str());
 
 		std::string name = entry->petsciiName();
+		char type = toupper(extension[0]);
 		mstr::toPETSCII(extension);
 
-		if (entry->name[0]!='.' || m_show_hidden)
+		if ((entry->name[0]!='.' || m_show_hidden) && (m_filter.empty() || m_filter.matches(name, type)))
 		{
 			byte_count += sendLine(basicPtr, block_cnt, "%*s\"%s\"%*s %s", block_spc, "", name.c_str(), space_cnt, "", extension.c_str());
 		}
@@ -852,23 +975,9 @@ uint16_t devDrive::sendFooter(uint16_t &basicPtr, uint16_t blocks_free, uint16_t
 }
 
 
-void devDrive::sendFile()
+void devDrive::sendFile(Channel &channel)
 {
-	size_t i = 0;
-	bool success = true;
-
-	uint8_t b;
-	uint16_t bi = 0;
 	uint16_t load_address = 0;
-	uint16_t sys_address = 0;
-
-#ifdef DATA_STREAM
-	char ba[9];
-	ba[8] = '\0';
-#endif
-
-	// Update device database
-	m_device.save();
 
 	std::unique_ptr<MFile> file(MFSOwner::File(m_filename));
 
@@ -937,109 +1046,37 @@ void devDrive::sendFile()
 	}
 	else
 	{
-		std::unique_ptr<MIStream> istream(file->inputStream());
-
-		if( istream == nullptr )
+		// The stream stays with the channel, if the computer stops taking
+		// bytes the next TALK carries on from the last one it acknowledged
+		channel.istream.reset(file->inputStream());
+		channel.cursor = 0;
+		channel.data.clear();
+		channel.data_pos = 0;
+
+		if( channel.istream == nullptr )
 		{
 			sendFileNotFound();
 			return;
 		}
 
-		// Position file pointer
-		//istream->seek(m_device.position(m_iec_data.channel));
-
-
-		size_t len = istream->size();
-		size_t avail = istream->available();
+		size_t len = channel.istream->size();
 
 		// Get file load address
-		i = 2;
-		istream->read(&b, 1);
-		success = m_iec.send(b);
-		load_address = b & 0x00FF; // low byte
-		sys_address = b;
-		istream->read(&b, 1);
-		success = m_iec.send(b);
-		load_address = load_address | b << 8;  // high byte
-		sys_address += b * 256;
-
-		Debug_printv("len[%d] avail[%d] success[%d]", len, avail, success);
+		channel.data.resize(CHANNEL_READAHEAD);
+		channel.data.resize(channel.istream->read((uint8_t *)&channel.data[0], CHANNEL_READAHEAD));
+		if ( channel.data.size() > 1 )
+			load_address = (uint8_t)channel.data[0] | ((uint8_t)channel.data[1] << 8);
 
 		Debug_printf("sendFile: [%s] [$%.4X] (%d bytes)\r\n=================================\r\n", file->url.c_str(), load_address, len);
-		while( i < len && success )
-		{
-			success = istream->read(&b, 1);
-			// Debug_printv("b[%02X] success[%d]", b, success);
-			if (success)
-			{
-#ifdef DATA_STREAM
-				if (bi == 0)
-				{
-					Debug_printf(":%.4X ", load_address);
-					load_address += 8;
-				}
-#endif
-				if ( ++i == len )
-				{
-					success = m_iec.sendEOI(b); // indicate end of file.
-				}
-				else
-				{
-					success = m_iec.send(b);
-				}
+		sendChannel(channel);
+		Debug_printf("=================================\r\n%d of %d bytes sent\r\n", channel.cursor, len);
 
-#ifdef DATA_STREAM
-				// Show ASCII Data
-				if (b < 32 || b >= 127)
-				b = 46;
-
-				ba[bi++] = b;
-
-				if(bi == 8)
-				{
-					size_t t = (i * 100) / len;
-					Debug_printf(" %s (%d %d%%) [%d]\r\n", ba, i, t, avail - 1);
-					bi = 0;
-				}
-#else
-				size_t t = (i * 100) / len;
-				Debug_printf("Transferring %d%% [%d, %d]      \r", t, i, avail -1);
-#endif
-			}
-
-			// // Exit if ATN is PULLED while sending
-			// if ( m_iec.state() bitand atnFlag )
-			// {
-			// 	// TODO: If sending from a named channel save file pointer position
-			// 	setDeviceStatus(74);
-			// 	success = true;
-			// 	break;
-			// }
-
-			// Toggle LED
-			if (i % 50 == 0)
-			{
-				ledToggle(true);
-			}
-
-			avail = istream->available();
-			//i++;
-		}
-		istream->close();
-		Debug_printf("=================================\r\n%d of %d bytes sent [SYS%d]\r\n", i, len, sys_address);
-
-		//Debug_printv("len[%d] avail[%d] success[%d]", len, avail, success);		
+		if ( channel.cursor >= len )
+			channel.istream.reset();
 	}
 
 
 	ledON();
-
-	if (!success)
-	{
-		Debug_println("sendFile: Transfer aborted!");
-		// TODO: Send something to signal that there was an error to the C64
-		m_iec.sendEOI(0);
-	}
 } // sendFile
 
 
@@ -1142,6 +1179,776 @@ void devDrive::saveFile()
 } // saveFile
 
 
+bool devDrive::openChannel(IEC::Data &iec_data)
+{
+	// NAME,TYPE,MODE. The type picks SEQ/USR over PRG in the disk image a
+	// file is written to, and which files a wildcard NAME can match.
+	// Anywhere else the file is just NAME.
+	auto parts = mstr::split(iec_data.content, ',', 3);
+	char type = (parts.size() > 1 && parts[1].size()) ? toupper(parts[1][0]) : 0;
+	char mode = (parts.size() > 2 && parts[2].size()) ? toupper(parts[2][0]) : 'R';
+	if ( parts.size() == 2 && (type == 'R' || type == 'W') )
+	{
+		mode = type;
+		type = 0;
+	}
+
+	if ( parts[0].empty() || parts[0][0] == '$' || (mode != 'R' && mode != 'W') )
+		return false;
+
+	auto commandAndPath = parseLine(parts[0], iec_data.channel, type);
+	if ( commandAndPath.fullPath.empty() )
+		return false;
+
+	auto &channel = channels[iec_data.channel];
+	if ( mode == 'W' )
+	{
+		// A new file isn't there yet, ask the directory it goes into
+		std::string url = commandAndPath.fullPath;
+		std::unique_ptr<MFile> file(MFSOwner::File(url));
+		std::unique_ptr<MFile> folder(MFSOwner::File(url.substr(0, url.rfind('/'))));
+		if ( type && type != 'P' && folder->isBlock(1, 0) )
+		{
+			url += std::string(",") + type;
+			file.reset(MFSOwner::File(url));
+		}
+
+		channel.ostream.reset(file->outputStream());
+		if ( channel.ostream == nullptr || !channel.ostream->isOpen() )
+		{
+			Debug_printv("couldn't open [%s] for writing", url.c_str());
+			channel.ostream.reset();
+			setDeviceStatus(26);
+		}
+		return true;
+	}
+
+	std::unique_ptr<MFile> file(MFSOwner::File(commandAndPath.fullPath));
+	if ( file->isDirectory() )
+		return false;
+
+	channel.istream.reset(file->inputStream());
+	if ( channel.istream == nullptr )
+		setDeviceStatus(62);
+
+	// A REL file is read and written a record at a time through this stream
+	if ( channel.istream != nullptr && channel.istream->recordLength() )
+	{
+		channel.url = commandAndPath.fullPath;
+		channel.record_length = channel.istream->recordLength();
+		channel.record_end = channel.istream->size();
+	}
+
+	Debug_printv("channel[%d] url[%s] open[%d]", iec_data.channel, file->url.c_str(), channel.istream != nullptr);
+	return true;
+} // openChannel
+
+
+void devDrive::sendChannel(Channel &channel)
+{
+	size_t size = channel.istream->size();
+	if ( channel.cursor >= size )
+	{
+		m_iec.sendEOI('\x0D');
+		return;
+	}
+
+	// Read a block at a time, the computer may stop taking bytes anywhere
+	while ( channel.cursor < size )
+	{
+		if ( channel.data_pos >= channel.data.size() )
+		{
+			channel.data.resize(CHANNEL_READAHEAD);
+			channel.data.resize(channel.istream->read((uint8_t *)&channel.data[0], CHANNEL_READAHEAD));
+			channel.data_pos = 0;
+			if ( channel.data.empty() )
+				break;
+		}
+
+		// Only bytes the computer acknowledged count, the one it broke off
+		// goes out again first on the next TALK
+		uint8_t b = channel.data[channel.data_pos];
+		bool success = (channel.cursor + 1 == size) ? m_iec.sendEOI(b) : m_iec.send(b);
+		if ( !success )
+		{
+			if ( m_iec.state() bitand ATN_PULLED )
+			{
+				Debug_printv("ATN at [%d] of [%d]", channel.cursor, size);
+			}
+			else
+			{
+				Debug_printv("transfer aborted at [%d] of [%d]", channel.cursor, size);
+			}
+			break;
+		}
+
+		channel.data_pos++;
+		channel.cursor++;
+
+		// Toggle LED
+		if ( channel.cursor % 50 == 0 )
+			ledToggle(true);
+	}
+
+	ledON();
+} // sendChannel
+
+
+void devDrive::saveChannel(Channel &channel)
+{
+	uint8_t data[CHANNEL_READAHEAD];
+	size_t size = 0;
+	bool done = false;
+	do
+	{
+		data[size++] = m_iec.receive();
+
+		uint8_t f = m_iec.state();
+		done = (f bitand EOI_RECVD) or (f bitand ERROR);
+
+		if ( done || size == sizeof(data) )
+		{
+			if ( channel.ostream->write(data, size) != size )
+			{
+				Debug_printv("write failed at [%d]", channel.cursor);
+				setDeviceStatus(26);
+			}
+			channel.cursor += size;
+			size = 0;
+		}
+	} while ( not done );
+
+	ledON();
+} // saveChannel
+
+
+bool devDrive::openRelative(IEC::Data &iec_data)
+{
+	// "name,l,"+chr$(record length) creates one. An existing one opened by
+	// its name alone is picked up by openChannel.
+	auto parts = mstr::split(iec_data.content, ',', 3);
+	if ( parts.size() < 2 || parts[1].empty() || toupper(parts[1][0]) != 'L' )
+		return false;
+
+	uint8_t record_length = (parts.size() > 2 && parts[2].size()) ? parts[2][0] : 0;
+
+	auto commandAndPath = parseLine(parts[0], iec_data.channel, 'R');
+	if ( commandAndPath.fullPath.empty() )
+		return false;
+
+	std::unique_ptr<MFile> file(MFSOwner::File(commandAndPath.fullPath));
+	std::shared_ptr<MIStream> istream(file->inputStream());
+	if ( istream == nullptr && record_length )
+	{
+		std::unique_ptr<MFile> rel(MFSOwner::File(commandAndPath.fullPath + ",l," + std::to_string(record_length)));
+		std::unique_ptr<MOStream> ostream(rel->outputStream());
+		if ( ostream == nullptr || !ostream->isOpen() )
+		{
+			Debug_printv("couldn't create [%s]", rel->url.c_str());
+			setDeviceStatus(26);
+			return true;
+		}
+		ostream->close();
+
+		istream.reset(file->inputStream());
+	}
+
+	if ( istream == nullptr )
+	{
+		setDeviceStatus(62);
+		return true;
+	}
+	if ( istream->recordLength() == 0 )
+	{
+		Debug_printv("not a REL file [%s]", commandAndPath.fullPath.c_str());
+		setDeviceStatus(64);
+		return true;
+	}
+
+	// The stream stays open on the channel, it has the side sectors
+	auto &channel = channels[iec_data.channel];
+	channel.url = commandAndPath.fullPath;
+	channel.istream = istream;
+	channel.record_length = istream->recordLength();
+	channel.record_end = istream->size();
+
+	Debug_printv("REL [%s] record_length[%d] size[%d]", channel.url.c_str(), channel.record_length, channel.record_end);
+	return true;
+} // openRelative
+
+
+bool devDrive::loadRecord(Channel &channel)
+{
+	int32_t number = channel.cursor / channel.record_length;
+	uint32_t start = number * channel.record_length;
+	if ( number == channel.record_number )
+		return start < channel.record_end;
+
+	// The record that was being written goes back first
+	storeRecord(channel);
+
+	channel.record_number = number;
+	channel.record.assign(channel.record_length, '\0');
+	if ( start >= channel.record_end )
+		return false;
+
+	// Records written so far are read back from the image once they are
+	// in it, reading one after writing others costs a single flush
+	if ( channel.ostream != nullptr )
+	{
+		channel.ostream->close();
+		channel.ostream.reset();
+		channel.istream.reset();
+
+		std::unique_ptr<MFile> file(MFSOwner::File(channel.url));
+		channel.istream.reset(file->inputStream());
+	}
+
+	if ( channel.istream == nullptr || !channel.istream->seek(start) )
+		return false;
+
+	size_t size = 0;
+	while ( size < channel.record_length )
+	{
+		size_t length = channel.istream->read((uint8_t *)&channel.record[size], channel.record_length - size);
+		if ( length == 0 )
+			break;
+		size += length;
+	}
+
+	return true;
+} // loadRecord
+
+
+bool devDrive::storeRecord(Channel &channel)
+{
+	if ( !channel.record_dirty )
+		return true;
+
+	channel.record_dirty = false;
+
+	// Kept open until CLOSE, the records go to the image in one flush
+	if ( channel.ostream == nullptr )
+	{
+		std::unique_ptr<MFile> file(MFSOwner::File(channel.url));
+		channel.ostream.reset(file->outputStream());
+	}
+
+	uint32_t start = channel.record_number * channel.record_length;
+	if ( channel.ostream == nullptr || !channel.ostream->isOpen() || !channel.ostream->seek(start) ||
+		 channel.ostream->write((uint8_t *)channel.record.data(), channel.record_length) != channel.record_length )
+	{
+		Debug_printv("couldn't write record to [%s]", channel.url.c_str());
+		channel.ostream.reset();
+		setDeviceStatus(26);
+		return false;
+	}
+
+	return true;
+} // storeRecord
+
+
+void devDrive::closeRecord(Channel &channel)
+{
+	storeRecord(channel);
+
+	if ( channel.ostream != nullptr )
+		channel.ostream->close();
+	channel.ostream.reset();
+	channel.istream.reset();
+	channel.record_number = -1;
+} // closeRecord
+
+
+void devDrive::positionRecord(std::string command)
+{
+	// P, channel, record low, record high, offset. Record and offset count
+	// from 1, what's left out is 1
+	uint8_t chan = command.size() > 1 ? command[1] & 0x0F : 0;
+	uint16_t record = (command.size() > 2) ? (uint8_t)command[2] : 1;
+	if ( command.size() > 3 )
+		record |= (uint8_t)command[3] << 8;
+	uint8_t offset = (command.size() > 4) ? (uint8_t)command[4] : 1;
+
+	if ( record )
+		record--;
+	if ( offset )
+		offset--;
+
+	auto rel = channels.find(chan);
+	if ( rel == channels.end() || rel->second.record_length == 0 )
+	{
+		setDeviceStatus(70);
+		return;
+	}
+
+	auto &channel = rel->second;
+	if ( offset >= channel.record_length )
+	{
+		setDeviceStatus(51);
+		return;
+	}
+
+	channel.cursor = (record * channel.record_length) + offset;
+	Debug_printv("channel[%d] record[%d] offset[%d] cursor[%d]", chan, record + 1, offset + 1, channel.cursor);
+
+	// Past the end, writing the record will add it
+	if ( channel.cursor >= channel.record_end )
+		setDeviceStatus(50);
+} // positionRecord
+
+
+void devDrive::sendRecord(Channel &channel)
+{
+	if ( !loadRecord(channel) )
+	{
+		setDeviceStatus(50);
+		m_iec.sendEOI('\x0D');
+		return;
+	}
+
+	// Like DOS, the record ends at its last byte that isn't zero
+	size_t offset = channel.cursor % channel.record_length;
+	size_t size = channel.record_length;
+	while ( size > offset + 1 && channel.record[size - 1] == 0x00 )
+		size--;
+
+	Debug_printv("channel cursor[%d] size[%d]", channel.cursor, size - offset);
+	for ( size_t i = offset; i < size; i++ )
+	{
+		bool success = (i + 1 == size) ? m_iec.sendEOI(channel.record[i]) : m_iec.send(channel.record[i]);
+		if ( !success )
+			break;
+	}
+
+	// Next read gets the next record
+	channel.cursor = (channel.record_number + 1) * channel.record_length;
+	ledON();
+} // sendRecord
+
+
+void devDrive::saveRecord(Channel &channel)
+{
+	// Past the end it starts out empty and is added when it is written back
+	loadRecord(channel);
+
+	// What's left of the record is cleared, what doesn't fit is lost
+	size_t offset = channel.cursor % channel.record_length;
+	size_t size = 0;
+	bool done = false;
+	do
+	{
+		uint8_t b = m_iec.receive();
+		if ( offset + size < channel.record_length )
+			channel.record[offset + size] = b;
+		size++;
+
+		uint8_t f = m_iec.state();
+		done = (f bitand EOI_RECVD) or (f bitand ERROR);
+	} while ( not done );
+
+	if ( offset + size < channel.record_length )
+		std::fill(channel.record.begin() + offset + size, channel.record.end(), '\0');
+	if ( offset + size > channel.record_length )
+		setDeviceStatus(51);
+
+	Debug_printv("channel cursor[%d] size[%d]", channel.cursor, size);
+	channel.record_dirty = true;
+
+	// Writing past the end adds the records up to this one
+	channel.record_end = std::max(channel.record_end, (uint32_t)(channel.record_number + 1) * channel.record_length);
+	channel.cursor = (channel.record_number + 1) * channel.record_length;
+	ledON();
+} // saveRecord
+
+
+// The numbers after a block or user command, "U1:2 0 18 0", "B-P 2,1"
+static std::vector<uint8_t> commandParameters(std::string command)
+{
+	std::vector<uint8_t> parameters;
+
+	size_t pos = command.find(':');
+	if ( pos == std::string::npos )
+		pos = command.find_first_of(" ,\x1D");
+	if ( pos == std::string::npos )
+		return parameters;
+
+	int16_t value = -1;
+	for ( pos++; pos <= command.size(); pos++ )
+	{
+		char c = (pos < command.size()) ? command[pos] : ' ';
+		if ( isdigit(c) )
+		{
+			value = std::min(((value < 0) ? 0 : value * 10) + (c - '0'), 255);
+		}
+		else if ( value >= 0 )
+		{
+			parameters.push_back(value);
+			value = -1;
+		}
+	}
+
+	return parameters;
+}
+
+bool devDrive::dosCommand(std::string command)
+{
+	m_device_status.clear();
+
+	// Record position for the REL file open on another channel
+	if ( command[0] == 'P' && command.size() < 6 )
+	{
+		positionRecord(command);
+		return true;
+	}
+
+	// Partition change, "CP<n>" or "C" shift-P <n> in binary
+	if ( command.size() > 2 && command[0] == 'C' && (command[1] == 'P' || (uint8_t)command[1] == 0xD0) )
+	{
+		changePartition(command);
+		return true;
+	}
+
+	// The rest are text, an optional drive number after the command letter
+	mstr::rtrim(command);
+	size_t colon = command.find(':');
+	bool drive = (colon == 1) || (colon == 2 && isdigit(command[1]));
+
+	switch ( command[0] )
+	{
+		case 'U':
+			userCommand(command);
+			return true;
+
+		case 'B':
+			if ( command.size() < 3 || command[1] != '-' )
+				break;
+			blockCommand(command);
+			return true;
+
+		case 'S':
+			if ( !drive )
+				break;
+			scratchFiles(command.substr(colon + 1));
+			return true;
+
+		case 'R':
+			if ( !drive || command.find('=') == std::string::npos )
+				break;
+			renameFile(command.substr(colon + 1));
+			return true;
+
+		case 'I':
+			// "I", "I0", "I:" or "I0:"
+			if ( command.size() > 1 && !(drive && colon + 1 == command.size()) && !(command.size() == 2 && isdigit(command[1])) )
+				break;
+
+			// Read the disk again, after writing what the block commands changed
+			m_mfile->flush();
+			ImageBroker::dispose(m_mfile->url);
+			m_mfile.reset(MFSOwner::File(m_mfile->url));
+			return true;
+
+		// Memory commands, copy and new need a real drive
+		case 'M':
+			if ( command.size() < 3 || command[1] != '-' )
+				break;
+			setDeviceStatus(31);
+			return true;
+
+		case 'C':
+		case 'N':
+			if ( !drive )
+				break;
+			setDeviceStatus(31);
+			return true;
+	}
+
+	return false;
+} // dosCommand
+
+
+void devDrive::userCommand(std::string command)
+{
+	auto parameters = commandParameters(command);
+	uint8_t number = (command.size() > 1) ? command[1] & 0x0F : 0;
+
+	switch ( number )
+	{
+		// U1 (UA) block read, U2 (UB) block write
+		case 1:
+		case 2:
+			blockTransfer(number == 1 ? 'R' : 'W', parameters);
+			return;
+
+		// U9 (UI) and UJ reset, UI+/UI- only set the bus timing
+		case 9:
+		case 10:
+			if ( number == 9 && command.size() > 2 && (command[2] == '+' || command[2] == '-') )
+				return;
+
+			channels.clear();
+			reset();
+			return;
+
+		// U3-U8 run code in drive memory
+		default:
+			setDeviceStatus((number > 2 && number < 9) ? 89 : 31);
+			return;
+	}
+} // userCommand
+
+
+void devDrive::blockCommand(std::string command)
+{
+	auto parameters = commandParameters(command);
+
+	switch ( command[2] )
+	{
+		// B-R/B-W, like U1/U2 with the length in the first byte of the block
+		case 'R':
+		case 'W':
+			blockTransfer(tolower(command[2]), parameters);
+			return;
+
+		// B-P channel position
+		case 'P':
+		{
+			auto buffer = channels.find(parameters.size() ? parameters[0] : 0);
+			if ( parameters.size() < 2 )
+				setDeviceStatus(30);
+			else if ( buffer == channels.end() || buffer->second.buffer.empty() )
+				setDeviceStatus(70);
+			else
+				buffer->second.cursor = parameters[1];
+			return;
+		}
+
+		// B-A/B-F drive track sector
+		case 'A':
+		case 'F':
+		{
+			if ( parameters.size() < 3 )
+			{
+				setDeviceStatus(30);
+				return;
+			}
+
+			uint8_t track = parameters[1];
+			uint8_t sector = parameters[2];
+			if ( !m_mfile->isBlock(track, sector) )
+			{
+				setDeviceStatus(66, track, sector);
+			}
+			else if ( command[2] == 'F' )
+			{
+				if ( !m_mfile->freeBlock(track, sector) )
+					setDeviceStatus(26);
+			}
+			else if ( !m_mfile->allocateBlock(track, sector) )
+			{
+				// Moved to the next free block if it was in use
+				if ( track == parameters[1] && sector == parameters[2] )
+					setDeviceStatus(26);
+				else
+					setDeviceStatus(65, track, sector);
+			}
+			return;
+		}
+
+		// B-E runs the block in drive memory
+		case 'E':
+			setDeviceStatus(89);
+			return;
+
+		default:
+			setDeviceStatus(31);
+			return;
+	}
+} // blockCommand
+
+
+void devDrive::blockTransfer(char command, std::vector<uint8_t> &parameters)
+{
+	// channel drive track sector. Upper case is U1/U2 with the whole
+	// block, lower case B-R/B-W where the first byte is the length.
+	if ( parameters.size() < 4 )
+	{
+		setDeviceStatus(30);
+		return;
+	}
+
+	auto buffer = channels.find(parameters[0]);
+	if ( buffer == channels.end() || buffer->second.buffer.empty() )
+	{
+		setDeviceStatus(70);
+		return;
+	}
+
+	auto &channel = buffer->second;
+	uint8_t track = parameters[2];
+	uint8_t sector = parameters[3];
+	uint8_t *data = (uint8_t *)&channel.buffer[0];
+
+	if ( !m_mfile->isBlock(track, sector) )
+	{
+		setDeviceStatus(66, track, sector);
+		return;
+	}
+
+	Debug_printv("%c channel[%d] track[%d] sector[%d]", command, parameters[0], track, sector);
+	if ( toupper(command) == 'R' )
+	{
+		if ( !m_mfile->readBlock(track, sector, data) )
+		{
+			setDeviceStatus(74);
+			return;
+		}
+
+		channel.cursor = (command == 'r') ? 1 : 0;
+		channel.buffer_end = (command == 'r') ? data[0] + 1 : channel.buffer.size();
+	}
+	else
+	{
+		if ( command == 'w' )
+			data[0] = channel.cursor - 1;
+
+		if ( !m_mfile->writeBlock(track, sector, data) )
+		{
+			setDeviceStatus(26);
+			return;
+		}
+	}
+} // blockTransfer
+
+
+void devDrive::scratchFiles(std::string command)
+{
+	auto names = mstr::split(command, ',');
+	if ( names.empty() || names[0].empty() )
+	{
+		setDeviceStatus(34);
+		return;
+	}
+
+	uint8_t scratched = 0;
+	for ( auto &name : names )
+	{
+		CBMPattern pattern(name);
+		if ( pattern.wildcard() )
+		{
+			// Everything in the current directory that matches, collected
+			// first as removing changes the directory
+			std::vector<std::string> matched;
+			m_mfile->rewindDirectory();
+			std::unique_ptr<MFile> entry(m_mfile->getNextFileInDir());
+			while ( entry != nullptr )
+			{
+				char type = entry->extension.size() ? toupper(entry->extension[0]) : 0;
+				if ( !entry->isDirectory() && pattern.matches(entry->petsciiName(), type) )
+					matched.push_back(entry->url);
+
+				entry.reset(m_mfile->getNextFileInDir());
+			}
+
+			for ( auto &url : matched )
+			{
+				std::unique_ptr<MFile> file(MFSOwner::File(url));
+				if ( file->remove() )
+					scratched++;
+			}
+		}
+		else
+		{
+			mstr::toASCII(name);
+			std::unique_ptr<MFile> file(m_mfile->cd(name));
+			if ( file != nullptr && !file->isDirectory() && file->remove() )
+				scratched++;
+		}
+
+		Debug_printv("scratch [%s] scratched[%d]", name.c_str(), scratched);
+	}
+
+	setDeviceStatus(1, scratched);
+} // scratchFiles
+
+
+void devDrive::renameFile(std::string command)
+{
+	// NEW=OLD
+	auto names = mstr::split(command, '=', 2);
+	if ( names.size() < 2 || names[0].empty() || names[1].empty() )
+	{
+		setDeviceStatus(34);
+		return;
+	}
+
+	mstr::toASCII(names[0]);
+	mstr::toASCII(names[1]);
+	std::unique_ptr<MFile> to(m_mfile->cd(names[0]));
+	std::unique_ptr<MFile> from(m_mfile->cd(names[1]));
+
+	if ( from == nullptr || !from->exists() )
+		setDeviceStatus(62);
+	else if ( to == nullptr || !from->rename(to->path) )
+		setDeviceStatus(63);
+} // renameFile
+
+
+void devDrive::openBuffer(IEC::Data &iec_data)
+{
+	// "#" or "#<buffer>", any buffer will do. The pointer starts past the
+	// length byte of B-R and B-W.
+	auto &channel = channels[iec_data.channel];
+	channel.buffer.assign(256, '\0');
+	channel.buffer_end = channel.buffer.size();
+	channel.cursor = 1;
+
+	Debug_printv("buffer channel[%d]", iec_data.channel);
+} // openBuffer
+
+
+void devDrive::sendBuffer(Channel &channel)
+{
+	if ( channel.cursor >= channel.buffer_end )
+	{
+		m_iec.sendEOI('\x0D');
+		return;
+	}
+
+	// Only bytes the computer took move the pointer
+	while ( channel.cursor < channel.buffer_end )
+	{
+		uint8_t b = channel.buffer[channel.cursor];
+		bool success = (channel.cursor + 1 == channel.buffer_end) ? m_iec.sendEOI(b) : m_iec.send(b);
+		if ( !success )
+			break;
+
+		channel.cursor++;
+	}
+
+	ledON();
+} // sendBuffer
+
+
+void devDrive::saveBuffer(Channel &channel)
+{
+	// The pointer wraps around the buffer like the drive's does
+	bool done = false;
+	do
+	{
+		uint8_t b = m_iec.receive();
+		channel.buffer[channel.cursor] = b;
+		channel.cursor = (channel.cursor + 1) % channel.buffer.size();
+
+		uint8_t f = m_iec.state();
+		done = (f bitand EOI_RECVD) or (f bitand ERROR);
+	} while ( not done );
+
+	ledON();
+} // saveBuffer
+
+
 void devDrive::dumpState()
 {
 	Debug_println("");
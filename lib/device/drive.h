@@ -55,9 +55,13 @@
 #include "helpers.h"
 #include "utils.h"
 #include "string_utils.h"
+#include "cbm_pattern.h"
 
 //#include "doscmd.h"
 
+// Bytes read ahead of the computer on a data channel
+#define CHANNEL_READAHEAD 256
+
 enum OpenState
 {
 	O_NOTHING,		// Nothing to send / File not found error
@@ -71,7 +75,7 @@ enum OpenState
 class devDrive: public iecDevice
 {
 public:
-	devDrive(IEC &iec);
+	devDrive(IEC &iec, uint8_t device);
 	virtual ~devDrive() {};
 
  	virtual uint8_t command(IEC::Data &iec_data) { return 0; };
@@ -98,7 +102,9 @@ private:
 	bool m_show_hidden = false;
 	bool m_show_date = false;
 	bool m_show_load_address = false;
+	CBMPattern m_filter;	// "$:PATTERN=T", what the next listing shows
 	void changeDir(std::string url);
+	void changePartition(std::string command);
 	uint16_t sendHeader(uint16_t &basicPtr, std::string header, std::string id);
 	//uint16_t sendHeader(uint16_t &basicPtr, const char *format, ...);
 	uint16_t sendLine(uint16_t &basicPtr, uint16_t blocks, char *text);
@@ -109,16 +115,45 @@ private:
 	// File LOAD / SAVE
 	void prepareFileStream(std::string url);
 	MFile* getPointed(MFile* urlFile);
-	void sendFile();
+	void sendFile(Channel &channel);
 	void saveFile();
 
+	// Files open on data channels (2-14)
+	bool openChannel(IEC::Data &iec_data);
+	void sendChannel(Channel &channel);
+	void saveChannel(Channel &channel);
+
+	// REL files
+	bool openRelative(IEC::Data &iec_data);
+	bool loadRecord(Channel &channel);
+	bool storeRecord(Channel &channel);
+	void closeRecord(Channel &channel);
+	void positionRecord(std::string command);
+	void sendRecord(Channel &channel);
+	void saveRecord(Channel &channel);
+
+	// DOS commands on the command channel
+	bool dosCommand(std::string command);
+	void userCommand(std::string command);
+	void blockCommand(std::string command);
+	void scratchFiles(std::string command);
+	void renameFile(std::string command);
+
+	// Direct access ("#") channels for the block commands
+	void openBuffer(IEC::Data &iec_data);
+	void sendBuffer(Channel &channel);
+	void saveBuffer(Channel &channel);
+	void blockTransfer(char command, std::vector<uint8_t> &parameters);
+
 	// Device Status
 	std::string m_device_status = "";
 	void sendStatus(void);
 	void sendFileNotFound(void);
 	void setDeviceStatus(int number, int track=0, int sector=0);
 
-	CommandPathTuple parseLine(std::string commandLne, size_t channel);
+	// A wildcard name picks the first file of the type asked for, the
+	// first letter of it (",S" after the name or "=S" in it), 0 for any
+	CommandPathTuple parseLine(std::string commandLne, size_t channel, char type = 0);
 
 	// This is set after an open command and determines what to send next
 	byte m_openState;
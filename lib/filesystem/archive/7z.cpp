@@ -0,0 +1,952 @@
+#include "7z.h"
+
+#define SEVENZIP_SIGNATURE_SIZE 32
+
+// Property IDs
+#define SEVENZIP_END 0x00
+#define SEVENZIP_HEADER 0x01
+#define SEVENZIP_ARCHIVE_PROPERTIES 0x02
+#define SEVENZIP_ADDITIONAL_STREAMS 0x03
+#define SEVENZIP_MAIN_STREAMS 0x04
+#define SEVENZIP_FILES_INFO 0x05
+#define SEVENZIP_PACK_INFO 0x06
+#define SEVENZIP_UNPACK_INFO 0x07
+#define SEVENZIP_SUBSTREAMS_INFO 0x08
+#define SEVENZIP_SIZE 0x09
+#define SEVENZIP_CRC 0x0A
+#define SEVENZIP_FOLDER 0x0B
+#define SEVENZIP_UNPACK_SIZE 0x0C
+#define SEVENZIP_UNPACK_STREAMS 0x0D
+#define SEVENZIP_EMPTY_STREAM 0x0E
+#define SEVENZIP_EMPTY_FILE 0x0F
+#define SEVENZIP_NAME 0x11
+#define SEVENZIP_ENCODED_HEADER 0x17
+
+// Folder methods we can decode
+#define SEVENZIP_METHOD_COPY 0
+#define SEVENZIP_METHOD_LZMA 1
+#define SEVENZIP_METHOD_LZMA2 2
+#define SEVENZIP_METHOD_UNSUPPORTED 0xFF
+
+SevenZipIStream::Parked SevenZipIStream::parked;
+
+static inline uint32_t le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t le64(const uint8_t* p) {
+    return le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+/********************************************************
+ * Header reader
+ ********************************************************/
+
+class SevenZipReader {
+    const std::vector<uint8_t>& data;
+    size_t pos = 0;
+
+public:
+    bool error = false;
+
+    SevenZipReader(const std::vector<uint8_t>& d) : data(d) {};
+
+    size_t tell() { return pos; };
+    size_t size() { return data.size(); };
+
+    uint8_t byte() {
+        if(pos >= data.size()) {
+            error = true;
+            return 0;
+        }
+        return data[pos++];
+    }
+
+    // 7z NUMBER, the leading 1 bits of the first byte tell how many
+    // bytes follow, its remaining bits are the highest ones
+    uint64_t number() {
+        uint8_t first = byte();
+        uint8_t mask = 0x80;
+        uint64_t value = 0;
+
+        for(uint8_t i = 0; i < 8; i++) {
+            if((first & mask) == 0)
+                return value | ((uint64_t)(first & (mask - 1)) << (8 * i));
+            value |= (uint64_t)byte() << (8 * i);
+            mask >>= 1;
+        }
+        return value;
+    }
+
+    // A count that can't be larger than the header itself
+    size_t count() {
+        uint64_t value = number();
+        if(value > data.size()) {
+            error = true;
+            return 0;
+        }
+        return value;
+    }
+
+    void skip(uint64_t length) {
+        if(length > data.size() - pos) {
+            error = true;
+            pos = data.size();
+        }
+        else
+            pos += length;
+    }
+
+    void seek(size_t position) {
+        pos = std::min(position, data.size());
+    }
+
+    void bits(size_t count, std::vector<bool>& out) {
+        out.assign(count, false);
+        uint8_t mask = 0;
+        uint8_t value = 0;
+        for(size_t i = 0; i < count; i++) {
+            if(mask == 0) {
+                value = byte();
+                mask = 0x80;
+            }
+            out[i] = value & mask;
+            mask >>= 1;
+        }
+    }
+
+    // CRCs aren't checked, step over them
+    void digests(size_t count, std::vector<bool>& defined) {
+        if(byte())
+            defined.assign(count, true);
+        else
+            bits(count, defined);
+
+        for(bool d: defined)
+            if(d)
+                skip(4);
+    }
+};
+
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+bool SevenZipIStream::readStreamsInfo(SevenZipReader& reader, Streams& streams)
+{
+    uint64_t pack_position = 0;
+    std::vector<size_t> pack_sizes;
+    std::vector<size_t> pack_counts;    // pack streams used by each folder
+    std::vector<bool> folder_crc;
+    bool have_substreams = false;
+
+    uint8_t id = reader.byte();
+
+    if ( id == SEVENZIP_PACK_INFO )
+    {
+        pack_position = reader.number();
+        size_t count = reader.count();
+
+        while ( (id = reader.byte()) != SEVENZIP_END && !reader.error )
+        {
+            if ( id == SEVENZIP_SIZE )
+            {
+                for ( size_t i = 0; i < count; i++ )
+                    pack_sizes.push_back(reader.number());
+            }
+            else if ( id == SEVENZIP_CRC )
+            {
+                std::vector<bool> defined;
+                reader.digests(count, defined);
+            }
+            else
+                return false;
+        }
+
+        id = reader.byte();
+    }
+
+    if ( id == SEVENZIP_UNPACK_INFO )
+    {
+        if ( reader.byte() != SEVENZIP_FOLDER )
+            return false;
+
+        size_t count = reader.count();
+        if ( reader.byte() != 0 )
+        {
+            Debug_printv("external folders not supported");
+            return false;
+        }
+
+        std::vector<size_t> out_counts;
+        std::vector<size_t> main_out;
+
+        for ( size_t f = 0; f < count && !reader.error; f++ )
+        {
+            Folder folder = {};
+            folder.method = SEVENZIP_METHOD_UNSUPPORTED;
+
+            size_t coders = reader.count();
+            size_t total_in = 0;
+            size_t total_out = 0;
+
+            for ( size_t c = 0; c < coders && !reader.error; c++ )
+            {
+                uint8_t flags = reader.byte();
+                uint8_t id_size = flags & 0x0F;
+                uint32_t method = 0;
+                for ( uint8_t i = 0; i < id_size; i++ )
+                    method = (method << 8) | reader.byte();
+
+                if ( flags & 0x10 )
+                {
+                    total_in += reader.count();
+                    total_out += reader.count();
+                }
+                else
+                {
+                    total_in++;
+                    total_out++;
+                }
+
+                size_t props_size = 0;
+                size_t props_start = reader.tell();
+                if ( flags & 0x20 )
+                {
+                    props_size = reader.count();
+                    props_start = reader.tell();
+                    reader.skip(props_size);
+                }
+
+                if ( flags & 0x80 )
+                    return false;
+
+                if ( coders == 1 )
+                {
+                    if ( id_size == 1 && method == 0x00 )
+                        folder.method = SEVENZIP_METHOD_COPY;
+                    else if ( id_size == 3 && method == 0x030101 && props_size == 5 )
+                        folder.method = SEVENZIP_METHOD_LZMA;
+                    else if ( id_size == 1 && method == 0x21 && props_size == 1 )
+                        folder.method = SEVENZIP_METHOD_LZMA2;
+                    else
+                        Debug_printv("folder[%d] method[%06X] not supported", f, method);
+
+                    // Go back for the properties, they are small
+                    size_t end = reader.tell();
+                    reader.seek(props_start);
+                    folder.props_size = std::min(props_size, sizeof(folder.props));
+                    for ( uint8_t i = 0; i < folder.props_size; i++ )
+                        folder.props[i] = reader.byte();
+                    reader.seek(end);
+                }
+                else if ( c == 0 )
+                    Debug_printv("folder[%d] has [%d] coders, not supported", f, coders);
+            }
+
+            // Coder outputs feeding other coders, the one left is the result
+            std::vector<bool> bound(total_out, false);
+            size_t bind_pairs = total_out ? total_out - 1 : 0;
+            for ( size_t i = 0; i < bind_pairs; i++ )
+            {
+                reader.number();
+                uint64_t out = reader.number();
+                if ( out < total_out )
+                    bound[out] = true;
+            }
+
+            size_t packed = total_in - bind_pairs;
+            if ( packed > 1 )
+            {
+                for ( size_t i = 0; i < packed; i++ )
+                    reader.number();
+            }
+
+            size_t result = 0;
+            while ( result < total_out && bound[result] )
+                result++;
+
+            pack_counts.push_back(packed);
+            out_counts.push_back(total_out);
+            main_out.push_back(result);
+            streams.folders.push_back(folder);
+        }
+
+        if ( reader.byte() != SEVENZIP_UNPACK_SIZE )
+            return false;
+
+        for ( size_t f = 0; f < streams.folders.size(); f++ )
+        {
+            for ( size_t i = 0; i < out_counts[f]; i++ )
+            {
+                uint64_t size = reader.number();
+                if ( i == main_out[f] )
+                    streams.folders[f].unpack_size = size;
+            }
+        }
+
+        folder_crc.assign(streams.folders.size(), false);
+        while ( (id = reader.byte()) != SEVENZIP_END && !reader.error )
+        {
+            if ( id == SEVENZIP_CRC )
+                reader.digests(streams.folders.size(), folder_crc);
+            else
+                return false;
+        }
+
+        id = reader.byte();
+    }
+
+    // Where each folder's packed data starts
+    size_t pack_index = 0;
+    size_t offset = SEVENZIP_SIGNATURE_SIZE + pack_position;
+    for ( size_t f = 0; f < streams.folders.size(); f++ )
+    {
+        if ( pack_index >= pack_sizes.size() )
+            return false;
+
+        streams.folders[f].pack_offset = offset;
+        streams.folders[f].pack_size = pack_sizes[pack_index];
+        for ( size_t i = 0; i < pack_counts[f] && pack_index < pack_sizes.size(); i++ )
+            offset += pack_sizes[pack_index++];
+    }
+
+    streams.substreams.assign(streams.folders.size(), 1);
+
+    if ( id == SEVENZIP_SUBSTREAMS_INFO )
+    {
+        have_substreams = true;
+        id = reader.byte();
+
+        if ( id == SEVENZIP_UNPACK_STREAMS )
+        {
+            for ( auto& count: streams.substreams )
+                count = reader.count();
+            id = reader.byte();
+        }
+
+        // The last size in a folder is what's left of it
+        for ( size_t f = 0; f < streams.folders.size(); f++ )
+        {
+            if ( streams.substreams[f] == 0 )
+                continue;
+
+            size_t used = 0;
+            if ( id == SEVENZIP_SIZE )
+            {
+                for ( size_t i = 1; i < streams.substreams[f]; i++ )
+                {
+                    size_t size = reader.number();
+                    streams.sizes.push_back(size);
+                    used += size;
+                }
+            }
+            streams.sizes.push_back(streams.folders[f].unpack_size - used);
+        }
+        if ( id == SEVENZIP_SIZE )
+            id = reader.byte();
+
+        while ( id != SEVENZIP_END && !reader.error )
+        {
+            if ( id == SEVENZIP_CRC )
+            {
+                size_t count = 0;
+                for ( size_t f = 0; f < streams.folders.size(); f++ )
+                {
+                    if ( streams.substreams[f] != 1 || !folder_crc[f] )
+                        count += streams.substreams[f];
+                }
+                std::vector<bool> defined;
+                reader.digests(count, defined);
+            }
+            else
+                return false;
+
+            id = reader.byte();
+        }
+
+        id = reader.byte();
+    }
+
+    if ( !have_substreams )
+    {
+        for ( auto& folder: streams.folders )
+            streams.sizes.push_back(folder.unpack_size);
+    }
+
+    return id == SEVENZIP_END && !reader.error;
+}
+
+bool SevenZipIStream::readFilesInfo(SevenZipReader& reader, Streams& streams, Archive& archive)
+{
+    size_t count = reader.count();
+    std::vector<bool> empty_stream(count, false);
+    std::vector<bool> empty_file;
+    std::vector<std::string> names;
+
+    while ( !reader.error )
+    {
+        uint8_t type = reader.byte();
+        if ( type == SEVENZIP_END )
+            break;
+
+        size_t size = reader.count();
+        size_t end = reader.tell() + size;
+
+        if ( type == SEVENZIP_EMPTY_STREAM )
+        {
+            reader.bits(count, empty_stream);
+        }
+        else if ( type == SEVENZIP_EMPTY_FILE )
+        {
+            reader.bits(std::count(empty_stream.begin(), empty_stream.end(), true), empty_file);
+        }
+        else if ( type == SEVENZIP_NAME )
+        {
+            if ( reader.byte() != 0 )
+                return false;
+
+            // UTF-16LE, zero terminated
+            for ( size_t i = 0; i < count && reader.tell() < end; i++ )
+            {
+                std::string name;
+                while ( reader.tell() + 1 < end )
+                {
+                    uint32_t c = reader.byte();
+                    c |= reader.byte() << 8;
+                    if ( c == 0 )
+                        break;
+
+                    if ( c >= 0xD800 && c < 0xDC00 && reader.tell() + 1 < end )
+                    {
+                        uint32_t low = reader.byte();
+                        low |= reader.byte() << 8;
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    }
+
+                    if ( c == '\\' )
+                        c = '/';
+
+                    if ( c < 0x80 )
+                        name += (char)c;
+                    else if ( c < 0x800 )
+                    {
+                        name += (char)(0xC0 | (c >> 6));
+                        name += (char)(0x80 | (c & 0x3F));
+                    }
+                    else if ( c < 0x10000 )
+                    {
+                        name += (char)(0xE0 | (c >> 12));
+                        name += (char)(0x80 | ((c >> 6) & 0x3F));
+                        name += (char)(0x80 | (c & 0x3F));
+                    }
+                    else
+                    {
+                        name += (char)(0xF0 | (c >> 18));
+                        name += (char)(0x80 | ((c >> 12) & 0x3F));
+                        name += (char)(0x80 | ((c >> 6) & 0x3F));
+                        name += (char)(0x80 | (c & 0x3F));
+                    }
+                }
+                names.push_back(name);
+            }
+        }
+
+        reader.seek(end);
+    }
+
+    if ( reader.error )
+        return false;
+
+    // Files with data take the substreams in order, folder by folder
+    size_t empty_index = 0;
+    size_t stream_index = 0;
+    size_t folder = 0;
+    size_t in_folder = 0;
+    size_t offset = 0;
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        Entry e;
+        e.filename = ( i < names.size() ) ? names[i] : "";
+        e.size = 0;
+        e.folder = -1;
+        e.offset = 0;
+
+        if ( empty_stream[i] )
+        {
+            // Folders only exist as part of the file names
+            bool is_file = ( empty_index < empty_file.size() ) && empty_file[empty_index];
+            empty_index++;
+            if ( !is_file )
+                continue;
+        }
+        else
+        {
+            while ( folder < streams.folders.size() && streams.substreams[folder] == 0 )
+                folder++;
+            if ( folder >= streams.folders.size() || stream_index >= streams.sizes.size() )
+                return false;
+
+            e.folder = folder;
+            e.offset = offset;
+            e.size = streams.sizes[stream_index++];
+            offset += e.size;
+
+            if ( ++in_folder >= streams.substreams[folder] )
+            {
+                folder++;
+                in_folder = 0;
+                offset = 0;
+            }
+        }
+
+        if ( e.filename.empty() )
+            continue;
+
+        std::string key = e.filename;
+        mstr::toLower(key);
+        archive.names.insert(std::make_pair(key, archive.files.size()));
+        archive.files.push_back(e);
+    }
+
+    return true;
+}
+
+bool SevenZipIStream::decodeFolder(const Folder& folder, std::vector<uint8_t>& data)
+{
+    if ( folder.unpack_size > SEVENZIP_MAX_WINDOW )
+    {
+        Debug_printv("header size[%d] too large", folder.unpack_size);
+        return false;
+    }
+
+    data.resize(folder.unpack_size);
+
+    if ( folder.method == SEVENZIP_METHOD_COPY )
+        return containerStream->seek(folder.pack_offset) && containerStream->read(data.data(), data.size()) == data.size();
+
+    if ( folder.method != SEVENZIP_METHOD_LZMA && folder.method != SEVENZIP_METHOD_LZMA2 )
+        return false;
+
+    std::unique_ptr<LZMADecoder> decoder(new LZMADecoder(containerStream));
+    if ( !decoder->begin(folder.method == SEVENZIP_METHOD_LZMA2, folder.props, folder.props_size, folder.pack_offset, folder.pack_size, folder.unpack_size) )
+        return false;
+
+    return decoder->read(data.data(), data.size()) == data.size();
+}
+
+bool SevenZipIStream::readHeader(std::vector<uint8_t>& header)
+{
+    auto archive = std::make_shared<Archive>();
+
+    // Headers are usually compressed, maybe more than once
+    while ( true )
+    {
+        SevenZipReader reader(header);
+        uint8_t id = reader.byte();
+
+        if ( id == SEVENZIP_ENCODED_HEADER )
+        {
+            Streams streams;
+            std::vector<uint8_t> decoded;
+            if ( !readStreamsInfo(reader, streams) || streams.folders.empty() || !decodeFolder(streams.folders[0], decoded) )
+            {
+                Debug_printv("can't decode header");
+                return false;
+            }
+            header.swap(decoded);
+            continue;
+        }
+
+        if ( id != SEVENZIP_HEADER )
+            return false;
+
+        Streams streams;
+        id = reader.byte();
+
+        if ( id == SEVENZIP_ARCHIVE_PROPERTIES )
+        {
+            while ( reader.byte() != SEVENZIP_END && !reader.error )
+                reader.skip(reader.number());
+            id = reader.byte();
+        }
+
+        if ( id == SEVENZIP_ADDITIONAL_STREAMS )
+        {
+            Streams additional;
+            if ( !readStreamsInfo(reader, additional) )
+                return false;
+            id = reader.byte();
+        }
+
+        if ( id == SEVENZIP_MAIN_STREAMS )
+        {
+            if ( !readStreamsInfo(reader, streams) )
+                return false;
+            id = reader.byte();
+        }
+
+        if ( id == SEVENZIP_FILES_INFO )
+        {
+            if ( !readFilesInfo(reader, streams, *archive) )
+                return false;
+            id = reader.byte();
+        }
+
+        if ( id != SEVENZIP_END )
+            return false;
+
+        archive->folders.swap(streams.folders);
+        m_archive = archive;
+        return true;
+    }
+}
+
+bool SevenZipIStream::readDirectory()
+{
+    if ( m_directoryRead )
+        return m_archive != nullptr && m_archive->files.size() > 0;
+
+    m_directoryRead = true;
+
+    // Opened a moment ago by another stream
+    size_t size = containerStream->size();
+    if ( parked.archive != nullptr && parked.url == m_url && parked.size == size )
+    {
+        m_archive = parked.archive;
+        parked.used = millis();
+        return m_archive->files.size() > 0;
+    }
+
+    // Another archive, let go of its dictionary first. The stream
+    // ImageBroker keeps for listing it holds the index as well.
+    if ( parked.archive != nullptr && parked.url != m_url )
+        ImageBroker::dispose(parked.url);
+    parked.decoder.reset();
+    parked.archive.reset();
+    parked.url.clear();
+
+    uint8_t signature[SEVENZIP_SIGNATURE_SIZE];
+    if ( !containerStream->seek(0) || containerStream->read(signature, sizeof(signature)) != sizeof(signature) || memcmp(signature, "7z\xBC\xAF\x27\x1C", 6) != 0 )
+    {
+        Debug_printv("not a 7z archive");
+        return false;
+    }
+
+    uint64_t header_offset = le64(&signature[12]) + SEVENZIP_SIGNATURE_SIZE;
+    uint64_t header_size = le64(&signature[20]);
+    if ( header_size == 0 || header_offset + header_size > size || header_size > SEVENZIP_MAX_WINDOW )
+    {
+        Debug_printv("header_offset[%d] header_size[%d] size[%d] invalid", (size_t)header_offset, (size_t)header_size, size);
+        return false;
+    }
+
+    std::vector<uint8_t> header(header_size);
+    if ( !containerStream->seek(header_offset) || containerStream->read(header.data(), header.size()) != header.size() )
+        return false;
+
+    if ( !readHeader(header) )
+    {
+        Debug_printv("bad header");
+        m_archive.reset();
+        return false;
+    }
+
+    parked.url = m_url;
+    parked.size = size;
+    parked.archive = m_archive;
+    parked.folder = -1;
+    parked.used = millis();
+
+    Debug_printv("folders[%d] files[%d]", m_archive->folders.size(), m_archive->files.size());
+    return m_archive->files.size() > 0;
+}
+
+
+/********************************************************
+ * Solid block decoder
+ ********************************************************/
+
+bool SevenZipIStream::obtainDecoder(int32_t folder)
+{
+    if ( m_decoder != nullptr && m_decoderFolder == folder )
+        return true;
+
+    m_decoder.reset();
+    m_decoderFolder = -1;
+
+    // Pick up where the last stream on this folder left off
+    if ( parked.decoder != nullptr && parked.url == m_url && parked.folder == folder )
+    {
+        m_decoder = std::move(parked.decoder);
+        parked.folder = -1;
+        if ( m_decoder->setSource(containerStream) )
+        {
+            m_decoderFolder = folder;
+            return true;
+        }
+        m_decoder.reset();
+    }
+
+    // Only one dictionary at a time
+    parked.decoder.reset();
+    parked.folder = -1;
+
+    auto& f = m_archive->folders[folder];
+    m_decoder.reset(new LZMADecoder(containerStream));
+    if ( !m_decoder->begin(f.method == SEVENZIP_METHOD_LZMA2, f.props, f.props_size, f.pack_offset, f.pack_size, f.unpack_size) )
+    {
+        m_decoder.reset();
+        return false;
+    }
+
+    m_decoderFolder = folder;
+    return true;
+}
+
+void SevenZipIStream::parkDecoder()
+{
+    if ( m_decoder == nullptr || m_archive == nullptr || m_decoder->hasError() )
+        return;
+
+    // Don't keep the container open while nobody is reading
+    m_decoder->setSource(nullptr);
+
+    parked.url = m_url;
+    parked.size = containerStream->size();
+    parked.archive = m_archive;
+    parked.decoder = std::move(m_decoder);
+    parked.folder = m_decoderFolder;
+    parked.used = millis();
+    m_decoderFolder = -1;
+}
+
+void SevenZipIStream::idle()
+{
+    if ( parked.archive == nullptr || millis() - parked.used < SEVENZIP_PARK_TIMEOUT )
+        return;
+
+    // Streams still open on it keep their own references. So does the one
+    // ImageBroker lists the archive with, a listing may still be going on;
+    // it is dropped when another archive is opened.
+    Debug_printv("releasing [%s]", parked.url.c_str());
+    parked = Parked();
+}
+
+SevenZipIStream::~SevenZipIStream()
+{
+    parkDecoder();
+}
+
+size_t SevenZipIStream::memoryUsage()
+{
+    size_t usage = 0;
+
+    if ( m_archive != nullptr )
+    {
+        usage += sizeof(Archive) + m_archive->folders.size() * sizeof(Folder);
+        for ( auto& e: m_archive->files )
+            usage += sizeof(Entry) + e.filename.capacity() + sizeof(std::pair<std::string, size_t>) + e.filename.size();
+    }
+
+    if ( m_decoder != nullptr )
+        usage += m_decoder->memoryUsage();
+    if ( parked.decoder != nullptr )
+        usage += parked.decoder->memoryUsage();
+
+    return usage;
+}
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+bool SevenZipIStream::seekEntry( std::string filename )
+{
+    if ( filename.size() && readDirectory() )
+    {
+        if ( filename == "*" )
+            return seekEntry( (size_t)1 );
+
+        mstr::toLower(filename);
+        auto found = m_archive->names.find(filename);
+        if ( found != m_archive->names.end() )
+            return seekEntry( found->second + 1 );
+
+        for ( size_t index = 0; index < m_archive->files.size(); index++ )
+        {
+            if ( mstr::startsWith(m_archive->files[index].filename, filename.c_str(), false) )
+                return seekEntry( index + 1 );
+        }
+    }
+
+    entry.filename.clear();
+
+    return false;
+}
+
+bool SevenZipIStream::seekEntry( size_t index )
+{
+    if ( !readDirectory() || index < 1 || index > m_archive->files.size() )
+        return false;
+
+    entry = m_archive->files[index - 1];
+    entry_index = index;
+    return true;
+}
+
+size_t SevenZipIStream::readFile(uint8_t* buf, size_t size) {
+    size_t bytesRead = 0;
+
+    size = std::min(size, m_bytesAvailable);
+    if ( size == 0 || entry.folder < 0 )
+        return 0;
+
+    if ( m_archive->folders[entry.folder].method == SEVENZIP_METHOD_COPY )
+        bytesRead = containerStream->read(buf, size);
+    else if ( m_decoder != nullptr )
+        bytesRead = m_decoder->read(buf, size);
+
+    if ( bytesRead < size )
+        Debug_printv("filename[%s] short read at [%d]", entry.filename.c_str(), m_position + bytesRead);
+
+    m_bytesAvailable -= bytesRead;
+
+    return bytesRead;
+}
+
+bool SevenZipIStream::seek(size_t pos) {
+    // Not pointing at an entry, the archive itself is being read
+    if ( !seekCalled )
+        return containerStream->seek(pos);
+
+    if ( pos > m_length )
+        return false;
+
+    bool ok = true;
+    if ( entry.folder >= 0 )
+    {
+        if ( m_archive->folders[entry.folder].method == SEVENZIP_METHOD_COPY )
+            ok = containerStream->seek(m_archive->folders[entry.folder].pack_offset + entry.offset + pos);
+        else
+            ok = m_decoder != nullptr && m_decoder->seek(entry.offset + pos);
+    }
+
+    if ( !ok )
+        return false;
+
+    m_position = pos;
+    m_bytesAvailable = m_length - pos;
+    return true;
+}
+
+bool SevenZipIStream::seekPath(std::string path) {
+    // Implement this to skip a queue of file streams to start of file by name
+    // this will cause the next read to return bytes of 'path'
+    seekCalled = true;
+
+    entry_index = 0;
+
+    if ( !seekEntry(path) )
+    {
+        Debug_printv( "Not found! [%s]", path.c_str());
+        return false;
+    }
+
+    m_length = entry.size;
+    m_bytesAvailable = m_length;
+    m_position = 0;
+
+    if ( entry.folder < 0 )
+        return true;
+
+    auto& folder = m_archive->folders[entry.folder];
+    Debug_printv("filename[%s] size[%d] folder[%d] offset[%d] method[%d]", entry.filename.c_str(), entry.size, entry.folder, entry.offset, folder.method);
+
+    if ( folder.method == SEVENZIP_METHOD_COPY )
+        return containerStream->seek(folder.pack_offset + entry.offset);
+
+    if ( folder.method == SEVENZIP_METHOD_UNSUPPORTED )
+    {
+        Debug_printv("filename[%s] compression method not supported", entry.filename.c_str());
+        return false;
+    }
+
+    // Forward from wherever the solid block was left, back only if needed
+    return obtainDecoder(entry.folder) && m_decoder->seek(entry.offset);
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+MIStream* SevenZipFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new SevenZipIStream(containerIstream, streamFile->url);
+}
+
+
+bool SevenZipFile::isDirectory() {
+    //Debug_printv("pathInStream[%s]", pathInStream.c_str());
+    if ( pathInStream == "" )
+        return true;
+    else
+        return false;
+};
+
+bool SevenZipFile::rewindDirectory() {
+    dirIsOpen = true;
+    Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
+    auto image = ImageBroker::obtain<SevenZipIStream>(streamFile->url);
+    if ( image == nullptr )
+        Debug_printv("image pointer is null");
+
+    image->resetEntryCounter();
+
+    // Read Header
+    image->seekHeader();
+
+    // Set Media Info Fields
+    media_header = name;
+    mstr::toPETSCII(media_header);
+    media_id = " 7Z  ";
+    media_blocks_free = 0;
+    media_block_size = image->block_size;
+    media_image = name;
+
+    Debug_printv("media_header[%s] media_id[%s] media_blocks_free[%d] media_block_size[%d] media_image[%s]", media_header.c_str(), media_id.c_str(), media_blocks_free, media_block_size, media_image.c_str());
+
+    return true;
+}
+
+MFile* SevenZipFile::getNextFileInDir() {
+
+    if(!dirIsOpen)
+        rewindDirectory();
+
+    // Get entry pointed to by containerStream
+    auto image = ImageBroker::obtain<SevenZipIStream>(streamFile->url);
+
+    if ( image->seekNextImageEntry() )
+    {
+        return MFSOwner::File(streamFile->url + "/" + image->entry.filename);
+    }
+    else
+    {
+        dirIsOpen = false;
+        return nullptr;
+    }
+}
+
+
+size_t SevenZipFile::size() {
+    // use 7z to get size of the file in archive
+    auto& entry = ImageBroker::obtain<SevenZipIStream>(streamFile->url)->entry;
+
+    return entry.size;
+}
@@ -1,39 +1,139 @@
+// .7Z - 7-Zip archive
+// https://www.7-zip.org/sdk.html (DOC/7zFormat.txt)
+// https://py7zr.readthedocs.io/en/latest/archive_format.html
+//
+// The header (LZMA compressed itself in most archives) is read once into
+// an index of folders and files. A folder is one compressed stream, in a
+// solid archive it holds many files back to back, so a file is found by
+// its offset inside the decoded folder.
+//
+// Decoding a solid folder from the start for every file would make each
+// LOAD slower than the last. The decoder of the last folder used is kept
+// after its stream is closed, together with the index, and handed to the
+// next stream opened on the same archive. Opening the next file in the
+// folder then only decodes what lies in between. Only one decoder is
+// parked, and it is freed before another one is created, so memory stays
+// at one dictionary (see SEVENZIP_MAX_WINDOW). Opening another archive or
+// leaving it unused for SEVENZIP_PARK_TIMEOUT frees it too. The index
+// stays with the stream ImageBroker lists the archive through until
+// another archive is opened.
+//
+// Folders must have a single coder, LZMA, LZMA2 or Copy. Filters (BCJ),
+// PPMd, BZip2 and encrypted archives are listed but can't be read.
+// CRCs are not verified.
+//
+
 #ifndef MEATFILE_DEFINES_7ZIP_H
 #define MEATFILE_DEFINES_7ZIP_H
 
 #include "meat_io.h"
+#include "media/cbm_image.h"
+#include "lzma.h"
+
+#include <unordered_map>
+#include <vector>
+
+#define SEVENZIP_PARK_TIMEOUT 30000
 
 
+class SevenZipReader;
+
 /********************************************************
  * Streams implementations
  ********************************************************/
 
-class SevenZipIStream: MIStream {
+class SevenZipIStream : public CBMImageStream {
+
 public:
+    SevenZipIStream(std::shared_ptr<MIStream> is, std::string url) : CBMImageStream(is), m_url(url) {};
+    ~SevenZipIStream();
 
-    SevenZipIStream(MIStream* srcStream): srcStr(srcStream) {
-        // this stream must be able to return a stream of
-        // UNPACKED file contents
-        // additionaly it has to implement getNextEntry()
-        // which skips data in the stream to next file in zip
-    }
-    // MStream methods
-    size_t position() override;
-    void close() override;
-    bool open() override;
-    ~SevenZipIStream() {
-        close();
-    }
+    // The unpacked entry can be used as a container itself
+    bool seek(size_t pos) override;
+    bool seek(size_t pos, SeekMode mode) override {
+        return MIStream::seek(pos, mode);
+    };
+    bool isOpen() override { return containerStream->isOpen(); };
 
-    // MIStream methods
-    int available() override;
-    uint8_t read() override;
-    size_t read(uint8_t* buf, size_t size) override;
-    bool isOpen() override;
+    // Heap held by the index and the decoders, for the benchmarks
+    size_t memoryUsage();
+
+    // Free what is parked once nothing used it for SEVENZIP_PARK_TIMEOUT
+    static void idle();
 
 protected:
-    MStream* srcStr;
+    struct Folder {
+        uint8_t method;
+        uint8_t props[5];
+        uint8_t props_size;
+        size_t pack_offset;
+        size_t pack_size;
+        size_t unpack_size;
+    };
+
+    struct Entry {
+        std::string filename;
+        size_t size;
+        int32_t folder;         // -1 for empty files
+        size_t offset;          // inside the unpacked folder
+    };
+
+    struct Streams {
+        std::vector<Folder> folders;
+        std::vector<uint32_t> substreams;   // files in each folder
+        std::vector<size_t> sizes;          // every file with data, in folder order
+    };
+
+    struct Archive {
+        std::vector<Folder> folders;
+        std::vector<Entry> files;
+        std::unordered_map<std::string, size_t> names;  // lower case name -> index
+    };
+
+    void seekHeader() override {
+        readDirectory();
+    }
+
+    bool seekNextImageEntry() override {
+        return seekEntry(entry_index + 1);
+    }
 
+    bool seekEntry( std::string filename ) override;
+    bool seekEntry( size_t index ) override;
+
+    size_t readFile(uint8_t* buf, size_t size) override;
+    bool seekPath(std::string path) override;
+
+    Entry entry;
+
+    bool readDirectory();
+    bool readHeader(std::vector<uint8_t>& header);
+    bool readStreamsInfo(SevenZipReader& reader, Streams& streams);
+    bool readFilesInfo(SevenZipReader& reader, Streams& streams, Archive& archive);
+    bool decodeFolder(const Folder& folder, std::vector<uint8_t>& data);
+    bool obtainDecoder(int32_t folder);
+    void parkDecoder();
+
+    std::string m_url;
+    std::shared_ptr<Archive> m_archive;
+    bool m_directoryRead = false;
+
+    std::unique_ptr<LZMADecoder> m_decoder;
+    int32_t m_decoderFolder = -1;
+
+    // Index and decoder of the archive used last, see above
+    struct Parked {
+        std::string url;
+        size_t size = 0;
+        std::shared_ptr<Archive> archive;
+        std::unique_ptr<LZMADecoder> decoder;
+        int32_t folder = -1;
+        uint32_t used = 0;      // millis() it was last handed out or parked
+    };
+    static Parked parked;
+
+private:
+    friend class SevenZipFile;
 };
 
 
@@ -41,29 +141,33 @@ protected:
  * Files implementations
  ********************************************************/
 
-class SevenZipFile: public MFile
-{
+class SevenZipFile: public MFile {
 public:
-    SevenZipFile(std::string path) : MFile(path) {};
-    MIStream* createIStream(std::shared_ptr<MIStream> src) override;
 
-    bool isDirectory() override;
-    MIStream* inputStream() override ; // has to return OPENED stream
-    MOStream* outputStream() override ; // has to return OPENED stream
-    time_t getLastWrite() override ;
-    time_t getCreationTime() override ;
-    bool rewindDirectory() override ;
-    MFile* getNextFileInDir() override ;
-    bool mkDir() override ;
-    bool exists() override ;
-    size_t size() override ;
-    bool remove() override ;
-    bool rename(std::string dest);
-
-
-    bool isBrowsable() override {
-        return true;
+    SevenZipFile(std::string path, bool is_dir = true): MFile(path) {
+        isDir = is_dir;
+    };
+
+    ~SevenZipFile() {
+        // don't close the stream here! It will be used by shared ptr D64Util to keep reading image params
     }
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+    bool mkDir() override { return false; };
+
+    bool exists() override { return true; };
+    bool remove() override { return false; };
+    bool rename(std::string dest) { return false; };
+    time_t getLastWrite() override { return 0; };
+    time_t getCreationTime() override { return 0; };
+    size_t size() override;
+
+    bool isDir = true;
+    bool dirIsOpen = false;
 };
 
 
@@ -74,21 +178,21 @@ public:
 
 class SevenZipFileSystem: public MFileSystem
 {
-    MFile* getFile(std::string path) {
-        return new SevenZipFile(path);
-    };
-
-
 public:
-    SevenZipFileSystem(): MFileSystem("7z"){}
+    MFile* getFile(std::string path) override {
+        return new SevenZipFile(path);
+    }
 
     bool handles(std::string fileName) {
-        return fileName.rfind(".7z") == fileName.length()-4;
+        return byExtension(".7z", fileName);
     }
 
-private:
-};
+    void idle() override {
+        SevenZipIStream::idle();
+    }
 
+    SevenZipFileSystem(): MFileSystem("7z") {};
+};
 
 
-#endif
\ No newline at end of file
+#endif
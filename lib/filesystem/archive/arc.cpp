@@ -0,0 +1,350 @@
+#include "arc.h"
+
+#define ARC_HEADER_SIZE 11
+#define ARC_MAX_NAME 16
+#define ARC_MAX_FILES 1024
+
+#define ARC_MODE_STORED 0
+#define ARC_MODE_PACKED 1
+#define ARC_MODE_SQUEEZED 2
+#define ARC_MODE_CRUNCHED 3
+#define ARC_MODE_MAX 5
+
+#define ARC_HUFFMAN_EOF 256
+#define ARC_LZW_CLEAR 256
+#define ARC_LZW_FIRST 257
+#define ARC_LZW_MAX_BITS 12
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+bool ARCIStream::readHeader(size_t offset, Entry& e, size_t& next)
+{
+    uint8_t header[ARC_HEADER_SIZE + ARC_MAX_NAME];
+    if ( !containerStream->seek(offset) || containerStream->read(header, ARC_HEADER_SIZE) != ARC_HEADER_SIZE )
+        return false;
+
+    uint8_t version = header[0];
+    uint8_t mode = header[1];
+    size_t blocks = header[7] | (header[8] << 8);
+    char type = header[9];
+    uint8_t name_length = header[10];
+
+    if ( version < 1 || version > 2 || mode > ARC_MODE_MAX || blocks == 0 || !strchr("PSUR", type) || name_length == 0 || name_length > ARC_MAX_NAME )
+        return false;
+
+    if ( containerStream->read(&header[ARC_HEADER_SIZE], name_length) != name_length )
+        return false;
+
+    size_t header_size = ARC_HEADER_SIZE + name_length + ((version == 2) ? 3 : 0);
+    if ( header_size >= blocks * CBM_ARCHIVE_BLOCK_SIZE )
+        return false;
+
+    e.filename = std::string((char*)&header[ARC_HEADER_SIZE], name_length);
+    e.file_type = fileType(type);
+    e.size = header[4] | (header[5] << 8) | (header[6] << 16);
+    e.method = mode;
+    e.data_offset = offset + header_size;
+    e.data_size = blocks * CBM_ARCHIVE_BLOCK_SIZE - header_size;
+
+    next = offset + blocks * CBM_ARCHIVE_BLOCK_SIZE;
+    return true;
+}
+
+bool ARCIStream::readDirectory()
+{
+    size_t size = containerStream->size();
+    size_t offset = 0;
+    size_t next = 0;
+    Entry e;
+
+    // SEQ archives start with the first member, PRG ones after the load
+    // address and SDA ones after their loader
+    bool found = false;
+    for ( size_t block = 0; block < ARC_MAX_LOADER_BLOCKS && !found; block++ )
+    {
+        for ( size_t skip = 0; skip <= 2 && !found; skip += 2 )
+        {
+            offset = block * CBM_ARCHIVE_BLOCK_SIZE + skip;
+            found = ( offset < size ) && readHeader(offset, e, next);
+        }
+    }
+
+    if ( !found )
+    {
+        Debug_printv("no ARC member found");
+        return false;
+    }
+
+    Debug_printv("first member at [%d]", offset);
+
+    while ( found && m_files.size() < ARC_MAX_FILES )
+    {
+        if ( e.method > ARC_MODE_CRUNCHED )
+            Debug_printv("filename[%s] mode[%d] not supported", e.filename.c_str(), e.method);
+
+        addEntry(e);
+
+        offset = next;
+        found = ( offset < size ) && readHeader(offset, e, next);
+    }
+
+    return m_files.size() > 0;
+}
+
+
+/********************************************************
+ * Decoding
+ ********************************************************/
+
+int ARCIStream::nextByte()
+{
+    if ( m_inputPos >= m_inputLength )
+    {
+        if ( m_inputRemaining == 0 )
+            return -1;
+
+        m_inputLength = containerStream->read(m_input, std::min(sizeof(m_input), m_inputRemaining));
+        m_inputRemaining = ( m_inputLength ) ? m_inputRemaining - m_inputLength : 0;
+        m_inputPos = 0;
+        if ( m_inputLength == 0 )
+            return -1;
+    }
+
+    return m_input[m_inputPos++];
+}
+
+int ARCIStream::nextBits(uint8_t count)
+{
+    // Least significant bit first
+    while ( m_bitCount < count )
+    {
+        int value = nextByte();
+        if ( value < 0 )
+            return -1;
+        m_bitBuffer |= (uint32_t)value << m_bitCount;
+        m_bitCount += 8;
+    }
+
+    int value = m_bitBuffer & ((1 << count) - 1);
+    m_bitBuffer >>= count;
+    m_bitCount -= count;
+    return value;
+}
+
+int ARCIStream::nextHuffman()
+{
+    size_t node = 0;
+
+    while ( true )
+    {
+        int bit = nextBits(1);
+        if ( bit < 0 || node * 2 + 1 >= m_tree.size() )
+            return -1;
+
+        int16_t value = m_tree[node * 2 + bit];
+        if ( value < 0 )
+        {
+            value = -(value + 1);
+            return ( value == ARC_HUFFMAN_EOF ) ? -1 : value;
+        }
+        node = value;
+    }
+}
+
+int ARCIStream::nextLZW()
+{
+    if ( m_stackSize )
+        return m_stack[--m_stackSize];
+
+    int code = nextBits(m_codeBits);
+    if ( code == ARC_LZW_CLEAR )
+    {
+        m_nextCode = ARC_LZW_FIRST;
+        m_codeBits = 9;
+        m_previous = -1;
+        code = nextBits(m_codeBits);
+    }
+    if ( code < 0 )
+        return -1;
+
+    if ( m_previous < 0 )
+    {
+        if ( code > 0xFF )
+            return -1;
+        m_previous = code;
+        m_first = code;
+        return code;
+    }
+
+    int current = code;
+
+    // The code being defined right now, previous string plus its first byte
+    if ( code >= m_nextCode )
+    {
+        if ( code > m_nextCode )
+            return -1;
+        m_stack[m_stackSize++] = m_first;
+        code = m_previous;
+    }
+
+    while ( code > 0xFF )
+    {
+        if ( m_stackSize >= ARC_LZW_TABLE_SIZE - 1 )
+            return -1;
+        m_stack[m_stackSize++] = m_suffix[code];
+        code = m_prefix[code];
+    }
+    m_first = code;
+
+    if ( m_nextCode < ARC_LZW_TABLE_SIZE )
+    {
+        m_prefix[m_nextCode] = m_previous;
+        m_suffix[m_nextCode] = m_first;
+        m_nextCode++;
+        if ( m_nextCode >= (1 << m_codeBits) && m_codeBits < ARC_LZW_MAX_BITS )
+            m_codeBits++;
+    }
+
+    m_previous = current;
+    return m_first;
+}
+
+void ARCIStream::freeTables()
+{
+    delete[] m_prefix;
+    delete[] m_suffix;
+    delete[] m_stack;
+    m_prefix = nullptr;
+    m_suffix = nullptr;
+    m_stack = nullptr;
+}
+
+int ARCIStream::nextSymbol()
+{
+    switch ( entry.method )
+    {
+        case ARC_MODE_PACKED:
+            return nextByte();
+        case ARC_MODE_SQUEEZED:
+            return nextHuffman();
+        case ARC_MODE_CRUNCHED:
+            return nextLZW();
+        default:
+            return -1;
+    }
+}
+
+bool ARCIStream::openEntry()
+{
+    if ( !containerStream->seek(entry.data_offset) )
+        return false;
+
+    if ( entry.method == ARC_MODE_STORED )
+        return true;
+
+    if ( entry.method > ARC_MODE_CRUNCHED )
+    {
+        Debug_printv("filename[%s] mode[%d] not supported", entry.filename.c_str(), entry.method);
+        return false;
+    }
+
+    m_inputPos = 0;
+    m_inputLength = 0;
+    m_inputRemaining = entry.data_size;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    m_runCount = 0;
+
+    if ( entry.method == ARC_MODE_SQUEEZED )
+    {
+        int low = nextByte();
+        int high = nextByte();
+        if ( low < 0 || high < 0 )
+            return false;
+
+        size_t nodes = low | (high << 8);
+        if ( nodes > ARC_HUFFMAN_EOF + 1 )
+            return false;
+
+        m_tree.resize(nodes * 2);
+        for ( auto& value: m_tree )
+        {
+            low = nextByte();
+            high = nextByte();
+            if ( low < 0 || high < 0 )
+                return false;
+            value = (int16_t)(low | (high << 8));
+        }
+    }
+    else
+        m_tree.clear();
+
+    if ( entry.method == ARC_MODE_CRUNCHED )
+    {
+        if ( m_prefix == nullptr )
+        {
+            m_prefix = new (std::nothrow) uint16_t[ARC_LZW_TABLE_SIZE];
+            m_suffix = new (std::nothrow) uint8_t[ARC_LZW_TABLE_SIZE];
+            m_stack = new (std::nothrow) uint8_t[ARC_LZW_TABLE_SIZE];
+            if ( m_prefix == nullptr || m_suffix == nullptr || m_stack == nullptr )
+            {
+                Debug_printv("not enough memory for the LZW tables");
+                freeTables();
+                return false;
+            }
+        }
+        m_nextCode = ARC_LZW_FIRST;
+        m_codeBits = 9;
+        m_previous = -1;
+        m_stackSize = 0;
+    }
+    else
+        freeTables();
+
+    // Packed, squeezed and crunched data all ends up run length encoded.
+    // The marker is the last header byte, it is not squeezed or crunched.
+    int control = nextByte();
+    if ( control < 0 )
+        return false;
+    m_control = control;
+
+    return true;
+}
+
+size_t ARCIStream::readEntry(uint8_t* buf, size_t size)
+{
+    if ( entry.method == ARC_MODE_STORED )
+        return containerStream->read(buf, size);
+
+    size_t count = 0;
+    while ( count < size )
+    {
+        if ( m_runCount )
+        {
+            buf[count++] = m_runValue;
+            m_runCount--;
+            continue;
+        }
+
+        int c = nextSymbol();
+        if ( c < 0 )
+            break;
+
+        if ( c == m_control )
+        {
+            int length = nextSymbol();
+            int value = nextSymbol();
+            if ( length < 0 || value < 0 )
+                break;
+            m_runValue = value;
+            m_runCount = ( length ) ? length : 256;
+            continue;
+        }
+
+        buf[count++] = c;
+    }
+
+    return count;
+}
@@ -0,0 +1,129 @@
+// .ARC - C64 ARC by Chris Smeets (ARC230, ARC250)
+// https://ist.uwaterloo.ca/~schepers/formats.html
+//
+// Every member has its own header, followed by its packed data and
+// padded to whole 254 byte blocks:
+//
+//   $00      version (1 or 2)
+//   $01      mode, 0 stored, 1 packed (run length), 2 squeezed (Huffman
+//            and run length), 3 crunched (LZW and run length)
+//   $02-$03  checksum
+//   $04-$06  original size
+//   $07-$08  blocks taken by the member, header included
+//   $09      type, P S U or R
+//   $0A      name length, then the name
+//            version 2 adds the record length and a date (3 bytes)
+//            squeezed members have their Huffman tree next (node count,
+//            then 2 x 16 bit per node, negative values are leaves)
+//            packed members end the header with the run length marker
+//
+// Runs are marker, count, byte (count 0 means 256). Crunched data is LZW
+// with 9 to 12 bit codes (256 clears the table), best effort as the
+// variants differ. Members are unpacked while they are read, seeking back
+// starts the member over. Checksums are not verified.
+//
+
+#ifndef MEATFILE_DEFINES_ARC_H
+#define MEATFILE_DEFINES_ARC_H
+
+#include "cbm_archive.h"
+
+
+// The self extracting SDA loader is skipped by looking for a member header
+// at the start of each block
+#define ARC_MAX_LOADER_BLOCKS 32
+
+#define ARC_LZW_TABLE_SIZE 4096
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class ARCIStream : public CBMArchiveStream {
+
+public:
+    ARCIStream(std::shared_ptr<MIStream> is) : CBMArchiveStream(is) {};
+    ~ARCIStream() {
+        freeTables();
+    };
+
+protected:
+    bool readDirectory() override;
+    bool readHeader(size_t offset, Entry& e, size_t& next);
+
+    bool openEntry() override;
+    size_t readEntry(uint8_t* buf, size_t size) override;
+
+private:
+    // Packed input
+    uint8_t m_input[256];
+    size_t m_inputPos = 0;
+    size_t m_inputLength = 0;
+    size_t m_inputRemaining = 0;
+    uint32_t m_bitBuffer = 0;
+    uint8_t m_bitCount = 0;
+
+    int nextByte();
+    int nextBits(uint8_t count);
+
+    // One symbol before run length decoding, -1 at the end
+    int nextSymbol();
+
+    // Run length
+    uint8_t m_control = 0;
+    uint8_t m_runValue = 0;
+    size_t m_runCount = 0;
+
+    // Squeezed
+    std::vector<int16_t> m_tree;
+    int nextHuffman();
+
+    // Crunched, the tables only exist while a crunched member is open
+    uint16_t* m_prefix = nullptr;
+    uint8_t* m_suffix = nullptr;
+    uint8_t* m_stack = nullptr;
+    size_t m_stackSize = 0;
+    uint16_t m_nextCode = 0;
+    uint8_t m_codeBits = 0;
+    int m_previous = -1;
+    uint8_t m_first = 0;
+    int nextLZW();
+    void freeTables();
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class ARCFile: public CBMArchiveFile {
+public:
+    ARCFile(std::string path, const char* id = " ARC "): CBMArchiveFile(path, id) {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override {
+        return new ARCIStream(containerIstream);
+    };
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class ARCFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new ARCFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".arc", fileName);
+    }
+
+    ARCFileSystem(): MFileSystem("arc") {};
+};
+
+
+#endif
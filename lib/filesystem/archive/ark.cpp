@@ -0,0 +1,53 @@
+#include "ark.h"
+
+#define ARK_ENTRY_SIZE 29
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+bool ARKIStream::readDirectory()
+{
+    uint8_t count;
+    containerStream->seek(0);
+    if ( containerStream->read(&count, 1) != 1 || count == 0 )
+        return false;
+
+    size_t size = containerStream->size();
+    size_t directory_size = 1 + count * ARK_ENTRY_SIZE;
+    size_t offset = ((directory_size + CBM_ARCHIVE_BLOCK_SIZE - 1) / CBM_ARCHIVE_BLOCK_SIZE) * CBM_ARCHIVE_BLOCK_SIZE;
+    if ( offset > size )
+    {
+        Debug_printv("count[%d] size[%d] not an ARK archive", count, size);
+        return false;
+    }
+
+    // The entries are read in one sequential pass
+    uint8_t raw[ARK_ENTRY_SIZE];
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+        if ( containerStream->read(raw, sizeof(raw)) != sizeof(raw) )
+            break;
+
+        size_t blocks = raw[0x1B] | (raw[0x1C] << 8);
+
+        Entry e;
+        e.file_type = raw[0x00];
+        e.filename = std::string((char*)&raw[0x01], 16);
+        e.data_offset = offset;
+        e.data_size = blocks * CBM_ARCHIVE_BLOCK_SIZE;
+        e.size = blocksToBytes(blocks, raw[0x11]);
+        e.method = 0;
+
+        if ( e.data_offset + e.size > size )
+        {
+            Debug_printv("filename[%s] truncated", e.filename.c_str());
+            e.size = ( size > e.data_offset ) ? size - e.data_offset : 0;
+        }
+
+        addEntry(e);
+        offset += e.data_size;
+    }
+
+    return m_files.size() > 0;
+}
@@ -0,0 +1,64 @@
+// .ARK - Arkive
+// https://ist.uwaterloo.ca/~schepers/formats.html
+//
+// One byte with the number of files, then a 29 byte entry per file
+// (type, name, last block usage, size in blocks). The files are stored
+// after the directory, starting on the next 254 byte block boundary and
+// taking whole blocks each.
+//
+
+#ifndef MEATFILE_DEFINES_ARK_H
+#define MEATFILE_DEFINES_ARK_H
+
+#include "cbm_archive.h"
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class ARKIStream : public CBMArchiveStream {
+
+public:
+    ARKIStream(std::shared_ptr<MIStream> is) : CBMArchiveStream(is) {};
+
+protected:
+    bool readDirectory() override;
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class ARKFile: public CBMArchiveFile {
+public:
+    ARKFile(std::string path): CBMArchiveFile(path, " ARK ") {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override {
+        return new ARKIStream(containerIstream);
+    };
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class ARKFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new ARKFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".ark", fileName);
+    }
+
+    ARKFileSystem(): MFileSystem("ark") {};
+};
+
+
+#endif
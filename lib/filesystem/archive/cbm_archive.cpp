@@ -0,0 +1,265 @@
+#include "cbm_archive.h"
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+uint8_t CBMArchiveStream::fileType(char type)
+{
+    switch ( type )
+    {
+        case 'D':
+            return 0x80;
+        case 'S':
+            return 0x81;
+        case 'U':
+            return 0x83;
+        case 'R':
+            return 0x84;
+        default:
+            return 0x82;
+    }
+}
+
+void CBMArchiveStream::addEntry(Entry& e)
+{
+    mstr::rtrimA0(e.filename);
+    if ( e.filename.empty() )
+        return;
+
+    m_names.insert(std::make_pair(e.filename, m_files.size()));
+    m_files.push_back(e);
+}
+
+bool CBMArchiveStream::readIndex()
+{
+    if ( m_directoryRead )
+        return m_files.size() > 0;
+
+    m_directoryRead = true;
+    readDirectory();
+
+    Debug_printv("files[%d]", m_files.size());
+    return m_files.size() > 0;
+}
+
+void CBMArchiveStream::beginLines(size_t offset)
+{
+    m_lineOffset = offset;
+    m_linePos = 0;
+    m_lineLength = 0;
+    containerStream->seek(offset);
+}
+
+bool CBMArchiveStream::readLine(std::string& line)
+{
+    line.clear();
+
+    while ( true )
+    {
+        if ( m_linePos >= m_lineLength )
+        {
+            m_lineOffset += m_lineLength;
+            m_linePos = 0;
+            m_lineLength = containerStream->read(m_lines, sizeof(m_lines));
+            if ( m_lineLength == 0 )
+                return line.size() > 0;
+        }
+
+        uint8_t c = m_lines[m_linePos++];
+        if ( c == 0x0D )
+            return true;
+
+        // Nothing in these directories is longer, don't grow on garbage
+        if ( line.size() < 64 )
+            line += (char)c;
+    }
+}
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+bool CBMArchiveStream::seekEntry( std::string filename )
+{
+    mstr::rtrimA0(filename);
+    mstr::replaceAll(filename, "\\", "/");
+
+    CBMPattern pattern(filename);
+    if ( !pattern.empty() && readIndex() )
+    {
+        if ( !pattern.wildcard() )
+        {
+            auto found = m_names.find(filename);
+            if ( found != m_names.end() )
+                return seekEntry( found->second + 1 );
+        }
+
+        for ( size_t index = 0; index < m_files.size(); index++ )
+        {
+            if ( pattern.matches(m_files[index].filename, CBMPattern::fileType(m_files[index].file_type)) )
+                return seekEntry( index + 1 );
+        }
+    }
+
+    entry.filename.clear();
+
+    return false;
+}
+
+bool CBMArchiveStream::seekEntry( size_t index )
+{
+    if ( !readIndex() || index < 1 || index > m_files.size() )
+        return false;
+
+    entry = m_files[index - 1];
+    entry_index = index;
+    return true;
+}
+
+size_t CBMArchiveStream::readFile(uint8_t* buf, size_t size) {
+    size = std::min(size, m_bytesAvailable);
+    if ( size == 0 )
+        return 0;
+
+    size_t bytesRead = readEntry(buf, size);
+    if ( bytesRead < size )
+        Debug_printv("filename[%s] short read at [%d]", entry.filename.c_str(), m_position + bytesRead);
+
+    m_bytesAvailable -= bytesRead;
+
+    return bytesRead;
+}
+
+bool CBMArchiveStream::seek(size_t pos) {
+    // Not pointing at an entry, the archive itself is being read
+    if ( !seekCalled )
+        return containerStream->seek(pos);
+
+    if ( pos > m_length )
+        return false;
+
+    if ( entry.method == 0 )
+    {
+        if ( !containerStream->seek(entry.data_offset + pos) )
+            return false;
+    }
+    else
+    {
+        // Packed data can only be decoded forward
+        if ( pos < m_position )
+        {
+            if ( !openEntry() )
+                return false;
+            m_position = 0;
+        }
+
+        uint8_t scratch[256];
+        while ( m_position < pos )
+        {
+            size_t length = readEntry(scratch, std::min(sizeof(scratch), pos - m_position));
+            if ( length == 0 )
+                return false;
+            m_position += length;
+        }
+    }
+
+    m_position = pos;
+    m_bytesAvailable = m_length - pos;
+    return true;
+}
+
+bool CBMArchiveStream::seekPath(std::string path) {
+    // Implement this to skip a queue of file streams to start of file by name
+    // this will cause the next read to return bytes of 'path'
+    seekCalled = true;
+
+    entry_index = 0;
+
+    mstr::toPETSCII(path);
+    if ( !seekEntry(path) )
+    {
+        Debug_printv( "Not found! [%s]", path.c_str());
+        return false;
+    }
+
+    auto type = decodeType(entry.file_type);
+    Debug_printv("filename [%s] type[%s] size[%d] data_offset[%d] method[%d]", entry.filename.c_str(), type.c_str(), entry.size, entry.data_offset, entry.method);
+
+    m_length = entry.size;
+    m_bytesAvailable = m_length;
+    m_position = 0;
+
+    return openEntry();
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+bool CBMArchiveFile::isDirectory() {
+    //Debug_printv("pathInStream[%s]", pathInStream.c_str());
+    if ( pathInStream == "" )
+        return true;
+    else
+        return false;
+};
+
+bool CBMArchiveFile::rewindDirectory() {
+    dirIsOpen = true;
+    Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
+    auto image = ImageBroker::obtain<CBMArchiveStream>(streamFile->url);
+    if ( image == nullptr )
+        Debug_printv("image pointer is null");
+
+    image->resetEntryCounter();
+
+    // Read Header
+    image->seekHeader();
+
+    // Set Media Info Fields
+    media_header = name;
+    mstr::toPETSCII(media_header);
+    media_id = archive_id;
+    media_blocks_free = 0;
+    media_block_size = image->block_size;
+    media_image = name;
+
+    Debug_printv("media_header[%s] media_id[%s] media_blocks_free[%d] media_block_size[%d] media_image[%s]", media_header.c_str(), media_id.c_str(), media_blocks_free, media_block_size, media_image.c_str());
+
+    return true;
+}
+
+MFile* CBMArchiveFile::getNextFileInDir() {
+
+    if(!dirIsOpen)
+        rewindDirectory();
+
+    // Get entry pointed to by containerStream
+    auto image = ImageBroker::obtain<CBMArchiveStream>(streamFile->url);
+
+    if ( image->seekNextImageEntry() )
+    {
+        std::string fileName = image->entry.filename;
+        mstr::replaceAll(fileName, "/", "\\");
+        auto file = MFSOwner::File(streamFile->url + "/" + fileName);
+        file->extension = image->decodeType(image->entry.file_type);
+        return file;
+    }
+    else
+    {
+        //Debug_printv( "END OF DIRECTORY");
+        dirIsOpen = false;
+        return nullptr;
+    }
+}
+
+
+size_t CBMArchiveFile::size() {
+    // use the archive index to get size of the file
+    auto& entry = ImageBroker::obtain<CBMArchiveStream>(streamFile->url)->entry;
+
+    return entry.size;
+}
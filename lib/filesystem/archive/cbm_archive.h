@@ -0,0 +1,143 @@
+// C64 native archives - Lynx, ARK, LBR, ARC/SDA
+// https://ist.uwaterloo.ca/~schepers/formats.html
+//
+// Shared part of the archivers people used on the C64 itself. They all
+// hold a list of CBM files (PETSCII name, type, data with load address),
+// so the directory is read once into an index and a member is read
+// straight from its offset in the container. Formats that pack their
+// members (ARC) decode in openEntry/readEntry, everything else is stored.
+//
+
+#ifndef MEATFILE_DEFINES_CBM_ARCHIVE_H
+#define MEATFILE_DEFINES_CBM_ARCHIVE_H
+
+#include "meat_io.h"
+#include "media/cbm_image.h"
+
+#include <unordered_map>
+#include <vector>
+
+
+// Data bytes in a disk block, what these archivers count in
+#define CBM_ARCHIVE_BLOCK_SIZE 254
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class CBMArchiveStream : public CBMImageStream {
+
+public:
+    CBMArchiveStream(std::shared_ptr<MIStream> is) : CBMImageStream(is) {};
+
+    // Members can be containers themselves (a D64 in a Lynx)
+    bool seek(size_t pos) override;
+    bool seek(size_t pos, SeekMode mode) override {
+        return MIStream::seek(pos, mode);
+    };
+    bool isOpen() override { return containerStream->isOpen(); };
+
+protected:
+    struct Entry {
+        std::string filename;
+        uint8_t file_type;
+        size_t size;            // unpacked
+        size_t data_offset;
+        size_t data_size;       // in the container
+        uint8_t method;         // 0 = stored, the rest is up to the format
+    };
+
+    void seekHeader() override {
+        readIndex();
+    }
+
+    bool seekNextImageEntry() override {
+        return seekEntry(entry_index + 1);
+    }
+
+    bool seekEntry( std::string filename ) override;
+    bool seekEntry( size_t index ) override;
+
+    size_t readFile(uint8_t* buf, size_t size) override;
+    bool seekPath(std::string path) override;
+
+    // Fill m_files with addEntry, called once
+    virtual bool readDirectory() = 0;
+
+    // Position at the start of entry's data, packed formats reset their
+    // decoder here and unpack in readEntry
+    virtual bool openEntry() {
+        return containerStream->seek(entry.data_offset);
+    };
+    virtual size_t readEntry(uint8_t* buf, size_t size) {
+        return containerStream->read(buf, size);
+    };
+
+    bool readIndex();
+    void addEntry(Entry& e);
+
+    // 'P' -> PRG and so on
+    static uint8_t fileType(char type);
+
+    // Size of a file stored in whole blocks. lsu is the last block's link
+    // byte as the 1541 keeps it, the index of its last used byte.
+    static size_t blocksToBytes(size_t blocks, uint8_t lsu) {
+        if ( blocks == 0 )
+            return 0;
+        return (blocks - 1) * CBM_ARCHIVE_BLOCK_SIZE + ((lsu >= 2) ? lsu - 1 : CBM_ARCHIVE_BLOCK_SIZE);
+    };
+
+    // Lines of the text directories (Lynx, LBR), CR terminated
+    void beginLines(size_t offset);
+    bool readLine(std::string& line);
+    size_t linePosition() { return m_lineOffset + m_linePos; };
+
+    Entry entry;
+
+    std::vector<Entry> m_files;
+    std::unordered_map<std::string, size_t> m_names;
+    bool m_directoryRead = false;
+
+private:
+    uint8_t m_lines[256];
+    size_t m_lineOffset = 0;
+    size_t m_linePos = 0;
+    size_t m_lineLength = 0;
+
+    friend class CBMArchiveFile;
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class CBMArchiveFile: public MFile {
+public:
+
+    CBMArchiveFile(std::string path, const char* id): MFile(path), archive_id(id) {};
+
+    ~CBMArchiveFile() {
+        // don't close the stream here! It will be used by shared ptr D64Util to keep reading image params
+    }
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+    bool mkDir() override { return false; };
+
+    bool exists() override { return true; };
+    bool remove() override { return false; };
+    bool rename(std::string dest) { return false; };
+    time_t getLastWrite() override { return 0; };
+    time_t getCreationTime() override { return 0; };
+    size_t size() override;
+
+    bool dirIsOpen = false;
+
+protected:
+    const char* archive_id;
+};
+
+
+#endif
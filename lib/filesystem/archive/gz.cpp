@@ -0,0 +1,198 @@
+#include "gz.h"
+
+#define GZ_HEADER_SIZE 10
+#define GZ_TRAILER_SIZE 8
+#define GZ_METHOD_DEFLATE 8
+
+#define GZ_FLAG_HCRC 0x02
+#define GZ_FLAG_EXTRA 0x04
+#define GZ_FLAG_NAME 0x08
+#define GZ_FLAG_COMMENT 0x10
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+bool GZIStream::readHeader()
+{
+    if ( m_headerRead )
+        return m_dataOffset > 0;
+
+    m_headerRead = true;
+
+    uint8_t header[GZ_HEADER_SIZE];
+    containerStream->seek(0);
+    if ( containerStream->read(header, sizeof(header)) != sizeof(header) || header[0] != 0x1F || header[1] != 0x8B || header[2] != GZ_METHOD_DEFLATE )
+    {
+        Debug_printv("not a gzip file");
+        return false;
+    }
+
+    uint8_t flags = header[3];
+    size_t offset = GZ_HEADER_SIZE;
+
+    if ( flags & GZ_FLAG_EXTRA )
+    {
+        uint8_t length[2];
+        if ( containerStream->read(length, 2) != 2 )
+            return false;
+        offset += 2 + (length[0] | (length[1] << 8));
+        containerStream->seek(offset);
+    }
+
+    // Zero terminated name and comment
+    for ( uint8_t field = GZ_FLAG_NAME; field <= GZ_FLAG_COMMENT; field <<= 1 )
+    {
+        if ( !(flags & field) )
+            continue;
+
+        uint8_t c;
+        while ( containerStream->read(&c, 1) == 1 )
+        {
+            offset++;
+            if ( c == 0 )
+                break;
+            if ( field == GZ_FLAG_NAME )
+                filename += (char)c;
+        }
+    }
+
+    if ( flags & GZ_FLAG_HCRC )
+        offset += 2;
+
+    // ISIZE, the uncompressed size modulo 2^32, ends the file
+    size_t size = containerStream->size();
+    uint8_t trailer[GZ_TRAILER_SIZE];
+    if ( size < offset + GZ_TRAILER_SIZE || !containerStream->seek(size - GZ_TRAILER_SIZE) || containerStream->read(trailer, sizeof(trailer)) != sizeof(trailer) )
+    {
+        Debug_printv("can't read trailer, size[%d]", size);
+        return false;
+    }
+    m_size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+    m_dataOffset = offset;
+
+    Debug_printv("filename[%s] data_offset[%d] size[%d]", filename.c_str(), m_dataOffset, m_size);
+    return true;
+}
+
+bool GZIStream::seekEntry( size_t index )
+{
+    // Only one entry
+    if ( index != 1 || !readHeader() )
+        return false;
+
+    entry_index = index;
+    return true;
+}
+
+size_t GZIStream::readFile(uint8_t* buf, size_t size) {
+    size = std::min(size, m_bytesAvailable);
+    if ( size == 0 )
+        return 0;
+
+    size_t bytesRead = m_inflater.read(buf, size);
+    if ( bytesRead < size )
+        Debug_printv("short read at [%d]", m_position + bytesRead);
+
+    m_bytesAvailable -= bytesRead;
+
+    return bytesRead;
+}
+
+bool GZIStream::seek(size_t pos) {
+    // Not pointing at the entry, the compressed file itself is being read
+    if ( !seekCalled )
+        return containerStream->seek(pos);
+
+    if ( pos > m_length || !m_inflater.seek(pos) )
+        return false;
+
+    m_position = pos;
+    m_bytesAvailable = m_length - pos;
+    return true;
+}
+
+bool GZIStream::seekPath(std::string path) {
+    seekCalled = true;
+
+    // There is just the one file, whatever name it is asked for by
+    if ( !readHeader() )
+        return false;
+
+    m_length = m_size;
+    m_bytesAvailable = m_length;
+    m_position = 0;
+
+    return m_inflater.begin(m_dataOffset, SIZE_MAX);
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+MIStream* GZFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new GZIStream(containerIstream);
+}
+
+
+bool GZFile::isDirectory() {
+    //Debug_printv("pathInStream[%s]", pathInStream.c_str());
+    if ( pathInStream == "" )
+        return true;
+    else
+        return false;
+};
+
+bool GZFile::rewindDirectory() {
+    dirIsOpen = true;
+    Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
+    auto image = ImageBroker::obtain<GZIStream>(streamFile->url);
+    if ( image == nullptr )
+        Debug_printv("image pointer is null");
+
+    image->resetEntryCounter();
+
+    // Read Header
+    image->seekHeader();
+
+    // Set Media Info Fields
+    media_header = name;
+    mstr::toPETSCII(media_header);
+    media_id = " GZ  ";
+    media_blocks_free = 0;
+    media_block_size = image->block_size;
+    media_image = name;
+
+    return true;
+}
+
+MFile* GZFile::getNextFileInDir() {
+
+    if(!dirIsOpen)
+        rewindDirectory();
+
+    auto image = ImageBroker::obtain<GZIStream>(streamFile->url);
+
+    if ( image->seekNextImageEntry() )
+    {
+        // Name from the header, otherwise the file name without .gz
+        std::string fileName = image->filename;
+        if ( fileName.empty() )
+            fileName = mstr::dropLast(name, 3);
+
+        return MFSOwner::File(streamFile->url + "/" + fileName);
+    }
+    else
+    {
+        dirIsOpen = false;
+        return nullptr;
+    }
+}
+
+
+size_t GZFile::size() {
+    return ImageBroker::obtain<GZIStream>(streamFile->url)->m_size;
+}
@@ -0,0 +1,114 @@
+// .GZ - gzip compressed file
+// https://www.rfc-editor.org/rfc/rfc1952
+//
+// A gzip file holds exactly one deflate stream, it is presented as a
+// container with a single entry so game.d64.gz/game.d64/PROG works like
+// any other nested path. The uncompressed size comes from the trailer.
+//
+
+#ifndef MEATFILE_DEFINES_GZ_H
+#define MEATFILE_DEFINES_GZ_H
+
+#include "meat_io.h"
+#include "media/cbm_image.h"
+#include "inflate.h"
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class GZIStream : public CBMImageStream {
+
+public:
+    GZIStream(std::shared_ptr<MIStream> is) : CBMImageStream(is), m_inflater(is) {};
+
+    bool seek(size_t pos) override;
+    bool seek(size_t pos, SeekMode mode) override {
+        return MIStream::seek(pos, mode);
+    };
+    bool isOpen() override { return containerStream->isOpen(); };
+
+protected:
+    void seekHeader() override {
+        readHeader();
+    }
+
+    bool seekNextImageEntry() override {
+        return seekEntry(entry_index + 1);
+    }
+
+    bool seekEntry( size_t index ) override;
+
+    size_t readFile(uint8_t* buf, size_t size) override;
+    bool seekPath(std::string path) override;
+
+    bool readHeader();
+    bool m_headerRead = false;
+
+    std::string filename;       // original name, if the header has it
+    size_t m_dataOffset = 0;
+    size_t m_size = 0;
+
+    Inflater m_inflater;
+
+private:
+    friend class GZFile;
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class GZFile: public MFile {
+public:
+
+    GZFile(std::string path, bool is_dir = true): MFile(path) {
+        isDir = is_dir;
+    };
+
+    ~GZFile() {
+        // don't close the stream here! It will be used by shared ptr D64Util to keep reading image params
+    }
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+    bool mkDir() override { return false; };
+
+    bool exists() override { return true; };
+    bool remove() override { return false; };
+    bool rename(std::string dest) { return false; };
+    time_t getLastWrite() override { return 0; };
+    time_t getCreationTime() override { return 0; };
+    size_t size() override;
+
+    bool isDir = true;
+    bool dirIsOpen = false;
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class GZFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new GZFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".gz", fileName);
+    }
+
+    GZFileSystem(): MFileSystem("gz") {};
+};
+
+
+#endif
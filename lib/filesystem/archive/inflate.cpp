@@ -0,0 +1,470 @@
+#include "inflate.h"
+
+// Length and distance bases and extra bits, RFC 1951 3.2.5
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const uint8_t distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Order of the code length code lengths in a dynamic block header
+static const uint8_t code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+/********************************************************
+ * Setup
+ ********************************************************/
+
+bool Inflater::begin(size_t offset, size_t compressed_size)
+{
+    if ( m_window == nullptr )
+    {
+        m_window = new (std::nothrow) uint8_t[INFLATE_WINDOW_SIZE];
+        if ( m_window == nullptr )
+        {
+            Debug_printv("not enough memory for the window");
+            m_state = STATE_ERROR;
+            return false;
+        }
+    }
+
+    m_start = offset;
+    m_compressedSize = compressed_size;
+    return restart();
+}
+
+bool Inflater::restart()
+{
+    m_inputPos = 0;
+    m_inputLength = 0;
+    m_inputRemaining = m_compressedSize;
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+
+    m_total = 0;
+    m_readPos = 0;
+    m_state = STATE_HEADER;
+    m_final = false;
+    m_storedRemaining = 0;
+    m_copyLength = 0;
+
+    if ( !m_source->seek(m_start) )
+    {
+        m_state = STATE_ERROR;
+        return false;
+    }
+
+    return true;
+}
+
+
+/********************************************************
+ * Bit input
+ ********************************************************/
+
+bool Inflater::fill()
+{
+    if ( m_inputRemaining == 0 )
+        return false;
+
+    m_inputLength = m_source->read(m_input, std::min((size_t)INFLATE_INPUT_SIZE, m_inputRemaining));
+    m_inputPos = 0;
+    if ( m_inputRemaining != SIZE_MAX )
+        m_inputRemaining -= m_inputLength;
+
+    return m_inputLength > 0;
+}
+
+void Inflater::needBits(uint8_t count)
+{
+    // Past the end of the input zeros are shifted in, a valid stream never
+    // uses them but the fast table lookup may peek at them
+    while ( m_bitCount < count )
+    {
+        uint8_t value = 0;
+        if ( m_inputPos < m_inputLength || fill() )
+            value = m_input[m_inputPos++];
+
+        m_bitBuffer |= (uint32_t)value << m_bitCount;
+        m_bitCount += 8;
+    }
+}
+
+uint32_t Inflater::getBits(uint8_t count)
+{
+    if ( count == 0 )
+        return 0;
+
+    needBits(count);
+    uint32_t value = m_bitBuffer & ((1UL << count) - 1);
+    m_bitBuffer >>= count;
+    m_bitCount -= count;
+    return value;
+}
+
+
+/********************************************************
+ * Huffman codes
+ ********************************************************/
+
+bool Inflater::build(Huffman& h, const uint8_t* lengths, uint16_t count)
+{
+    memset(h.count, 0, sizeof(h.count));
+    memset(h.fast, 0, sizeof(h.fast));
+
+    for ( uint16_t symbol = 0; symbol < count; symbol++ )
+        h.count[lengths[symbol]]++;
+
+    if ( h.count[0] == count )
+        return true;
+
+    // Over-subscribed code sets can't be decoded, incomplete ones can
+    int left = 1;
+    for ( uint8_t len = 1; len < 16; len++ )
+    {
+        left <<= 1;
+        left -= h.count[len];
+        if ( left < 0 )
+            return false;
+    }
+
+    // Symbols sorted by code length for the canonical decode
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for ( uint8_t len = 1; len < 15; len++ )
+        offsets[len + 1] = offsets[len] + h.count[len];
+
+    for ( uint16_t symbol = 0; symbol < count; symbol++ )
+        if ( lengths[symbol] )
+            h.symbol[offsets[lengths[symbol]]++] = symbol;
+
+    // Short codes also go into a table indexed by the next input bits
+    uint16_t next[16];
+    uint16_t code = 0;
+    next[0] = 0;
+    for ( uint8_t len = 1; len < 16; len++ )
+    {
+        code = (code + (len > 1 ? h.count[len - 1] : 0)) << 1;
+        next[len] = code;
+    }
+
+    for ( uint16_t symbol = 0; symbol < count; symbol++ )
+    {
+        uint8_t len = lengths[symbol];
+        if ( len == 0 )
+            continue;
+
+        code = next[len]++;
+        if ( len > INFLATE_FAST_BITS )
+            continue;
+
+        // Codes are sent msb first, the bit buffer is lsb first
+        uint16_t reversed = 0;
+        for ( uint8_t i = 0; i < len; i++ )
+            reversed |= ((code >> i) & 1) << (len - 1 - i);
+
+        for ( uint16_t index = reversed; index < (1 << INFLATE_FAST_BITS); index += (1 << len) )
+            h.fast[index] = (len << 12) | symbol;
+    }
+
+    return true;
+}
+
+int Inflater::decode(const Huffman& h)
+{
+    needBits(INFLATE_FAST_BITS);
+
+    uint16_t entry = h.fast[m_bitBuffer & ((1 << INFLATE_FAST_BITS) - 1)];
+    if ( entry )
+    {
+        m_bitBuffer >>= (entry >> 12);
+        m_bitCount -= (entry >> 12);
+        return entry & 0x0FFF;
+    }
+
+    // Long code, walk the canonical code one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for ( uint8_t len = 1; len < 16; len++ )
+    {
+        code |= getBits(1);
+        int count = h.count[len];
+        if ( code - count < first )
+            return h.symbol[index + (code - first)];
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+bool Inflater::readDynamicTables()
+{
+    uint8_t lengths[288 + 32];
+
+    uint16_t nlen = getBits(5) + 257;
+    uint16_t ndist = getBits(5) + 1;
+    uint16_t ncode = getBits(4) + 4;
+    if ( nlen > 286 || ndist > 30 )
+        return false;
+
+    memset(lengths, 0, 19);
+    for ( uint8_t i = 0; i < ncode; i++ )
+        lengths[code_length_order[i]] = getBits(3);
+
+    // The code length code is only needed here, borrow the distance table
+    if ( !build(m_distcode, lengths, 19) )
+        return false;
+
+    uint16_t index = 0;
+    while ( index < nlen + ndist )
+    {
+        int symbol = decode(m_distcode);
+        if ( symbol < 0 )
+            return false;
+
+        if ( symbol < 16 )
+        {
+            lengths[index++] = symbol;
+            continue;
+        }
+
+        uint8_t value = 0;
+        uint8_t repeat;
+        if ( symbol == 16 )
+        {
+            if ( index == 0 )
+                return false;
+            value = lengths[index - 1];
+            repeat = 3 + getBits(2);
+        }
+        else if ( symbol == 17 )
+            repeat = 3 + getBits(3);
+        else
+            repeat = 11 + getBits(7);
+
+        if ( index + repeat > nlen + ndist )
+            return false;
+
+        while ( repeat-- )
+            lengths[index++] = value;
+    }
+
+    // A block without an end of block code can never finish
+    if ( lengths[256] == 0 )
+        return false;
+
+    return build(m_lencode, lengths, nlen) && build(m_distcode, lengths + nlen, ndist);
+}
+
+bool Inflater::readBlockHeader()
+{
+    m_final = getBits(1);
+
+    switch ( getBits(2) )
+    {
+        case 0:     // stored
+        {
+            // Skip to the byte boundary, LEN and NLEN follow
+            getBits(m_bitCount & 7);
+            uint16_t length = getBits(16);
+            uint16_t check = getBits(16);
+            if ( length != (uint16_t)~check )
+                return false;
+
+            m_storedRemaining = length;
+            m_state = STATE_STORED;
+            return true;
+        }
+
+        case 1:     // fixed codes
+        {
+            uint8_t lengths[288];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            build(m_lencode, lengths, 288);
+
+            memset(lengths, 5, 30);
+            build(m_distcode, lengths, 30);
+
+            m_state = STATE_HUFFMAN;
+            return true;
+        }
+
+        case 2:     // dynamic codes
+            if ( !readDynamicTables() )
+                return false;
+
+            m_state = STATE_HUFFMAN;
+            return true;
+    }
+
+    return false;
+}
+
+
+/********************************************************
+ * Output
+ ********************************************************/
+
+size_t Inflater::read(uint8_t* buf, size_t size)
+{
+    size_t count = 0;
+
+    if ( m_window == nullptr )
+        return 0;
+
+    // Bytes still in the window after a backward seek
+    while ( count < size && m_readPos < m_total )
+    {
+        size_t start = m_readPos & (INFLATE_WINDOW_SIZE - 1);
+        size_t length = std::min({ size - count, m_total - m_readPos, (size_t)INFLATE_WINDOW_SIZE - start });
+        memcpy(buf + count, &m_window[start], length);
+        count += length;
+        m_readPos += length;
+    }
+
+    while ( count < size )
+    {
+        // Pending back reference
+        if ( m_copyLength )
+        {
+            uint16_t length = std::min((size_t)m_copyLength, size - count);
+            m_copyLength -= length;
+            while ( length-- )
+            {
+                uint8_t value = m_window[(m_total - m_copyDistance) & (INFLATE_WINDOW_SIZE - 1)];
+                output(value);
+                buf[count++] = value;
+            }
+            continue;
+        }
+
+        switch ( m_state )
+        {
+            case STATE_HEADER:
+                if ( m_final )
+                {
+                    m_state = STATE_DONE;
+                    break;
+                }
+                if ( !readBlockHeader() )
+                {
+                    Debug_printv("bad block header at [%d]", m_total);
+                    m_state = STATE_ERROR;
+                }
+                break;
+
+            case STATE_STORED:
+                if ( m_storedRemaining == 0 )
+                {
+                    m_state = STATE_HEADER;
+                    break;
+                }
+                while ( m_storedRemaining && count < size )
+                {
+                    uint8_t value = getBits(8);
+                    output(value);
+                    buf[count++] = value;
+                    m_storedRemaining--;
+                }
+                break;
+
+            case STATE_HUFFMAN:
+            {
+                int symbol = decode(m_lencode);
+                if ( symbol < 256 )
+                {
+                    if ( symbol < 0 )
+                    {
+                        Debug_printv("bad literal/length code at [%d]", m_total);
+                        m_state = STATE_ERROR;
+                        break;
+                    }
+                    output(symbol);
+                    buf[count++] = symbol;
+                    break;
+                }
+
+                if ( symbol == 256 )
+                {
+                    m_state = STATE_HEADER;
+                    break;
+                }
+
+                symbol -= 257;
+                if ( symbol >= 29 )
+                {
+                    m_state = STATE_ERROR;
+                    break;
+                }
+                m_copyLength = length_base[symbol] + getBits(length_extra[symbol]);
+
+                symbol = decode(m_distcode);
+                if ( symbol < 0 || symbol >= 30 )
+                {
+                    m_state = STATE_ERROR;
+                    break;
+                }
+                m_copyDistance = distance_base[symbol] + getBits(distance_extra[symbol]);
+
+                if ( m_copyDistance > m_total )
+                {
+                    Debug_printv("distance[%d] too far back at [%d]", m_copyDistance, m_total);
+                    m_copyLength = 0;
+                    m_state = STATE_ERROR;
+                }
+                break;
+            }
+
+            case STATE_DONE:
+            case STATE_ERROR:
+                return count;
+        }
+    }
+
+    return count;
+}
+
+bool Inflater::seek(size_t pos)
+{
+    if ( m_window == nullptr )
+        return false;
+
+    // Still in the window
+    if ( pos <= m_total && m_total - pos <= INFLATE_WINDOW_SIZE )
+    {
+        m_readPos = pos;
+        return true;
+    }
+
+    if ( pos < m_total && !restart() )
+        return false;
+
+    // Decompress up to pos, the window keeps what is needed
+    m_readPos = m_total;
+    uint8_t scratch[256];
+    while ( m_total < pos )
+    {
+        size_t length = std::min(sizeof(scratch), pos - m_total);
+        if ( read(scratch, length) != length )
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,97 @@
+// Inflate - DEFLATE decompression (RFC 1951) for ZIP and GZ containers
+// https://www.rfc-editor.org/rfc/rfc1951
+// https://github.com/madler/zlib/blob/master/contrib/puff/puff.c
+//
+// Decompresses straight out of a container stream into the caller's
+// buffer. The only state that grows with the data is the 32K window that
+// DEFLATE back references need, so a multi megabyte entry can be read on
+// a device with a few dozen KB of free heap.
+//
+// The window doubles as a cache: seeking back less than 32K replays bytes
+// from it, seeking forward decompresses and drops, anything else starts
+// over from the beginning of the entry.
+//
+
+#ifndef MEATFILE_DEFINES_INFLATE_H
+#define MEATFILE_DEFINES_INFLATE_H
+
+#include "meat_io.h"
+
+
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE 512
+#define INFLATE_FAST_BITS 9
+
+
+class Inflater {
+public:
+    Inflater(std::shared_ptr<MIStream> source) : m_source(source) {};
+    ~Inflater() {
+        delete[] m_window;
+    };
+
+    // Start decompressing the deflate data at offset, compressed_size can
+    // be SIZE_MAX if it's only known where the data ends by decoding it
+    bool begin(size_t offset, size_t compressed_size);
+
+    size_t read(uint8_t* buf, size_t size);
+    bool seek(size_t pos);
+
+    // Uncompressed position of the next byte read returns
+    size_t position() { return m_readPos; };
+    bool isDone() { return m_state == STATE_DONE && m_readPos == m_total; };
+    bool hasError() { return m_state == STATE_ERROR; };
+
+private:
+    struct Huffman {
+        uint16_t count[16];
+        uint16_t symbol[288];
+        uint16_t fast[1 << INFLATE_FAST_BITS];  // length << 12 | symbol
+    };
+
+    enum State { STATE_HEADER, STATE_STORED, STATE_HUFFMAN, STATE_DONE, STATE_ERROR };
+
+    bool restart();
+
+    // Bit input, lsb first
+    bool fill();
+    void needBits(uint8_t count);
+    uint32_t getBits(uint8_t count);
+
+    bool build(Huffman& h, const uint8_t* lengths, uint16_t count);
+    int decode(const Huffman& h);
+    bool readBlockHeader();
+    bool readDynamicTables();
+
+    inline void output(uint8_t value) {
+        m_window[m_total & (INFLATE_WINDOW_SIZE - 1)] = value;
+        m_total++;
+        m_readPos++;
+    };
+
+    std::shared_ptr<MIStream> m_source;
+    size_t m_start = 0;
+    size_t m_compressedSize = 0;
+
+    uint8_t m_input[INFLATE_INPUT_SIZE];
+    size_t m_inputPos = 0;
+    size_t m_inputLength = 0;
+    size_t m_inputRemaining = 0;
+    uint32_t m_bitBuffer = 0;
+    uint8_t m_bitCount = 0;
+
+    uint8_t* m_window = nullptr;
+    size_t m_total = 0;         // bytes decompressed so far
+    size_t m_readPos = 0;       // bytes handed out, less than m_total after a replay seek
+
+    State m_state = STATE_HEADER;
+    bool m_final = false;
+    size_t m_storedRemaining = 0;
+    uint16_t m_copyLength = 0;
+    uint16_t m_copyDistance = 0;
+
+    Huffman m_lencode;
+    Huffman m_distcode;
+};
+
+#endif
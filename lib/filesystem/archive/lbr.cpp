@@ -0,0 +1,60 @@
+#include "lbr.h"
+
+#define LBR_MAX_FILES 1024
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+bool LBRIStream::readDirectory()
+{
+    std::string line;
+
+    // "DWB 3 "
+    beginLines(0);
+    if ( !readLine(line) || line.compare(0, 3, "DWB") != 0 )
+    {
+        Debug_printv("not an LBR archive");
+        return false;
+    }
+
+    size_t count = atoi(line.c_str() + 3);
+    if ( count == 0 && readLine(line) )
+        count = atoi(line.c_str());
+    if ( count == 0 || count > LBR_MAX_FILES )
+        return false;
+
+    std::vector<Entry> entries;
+    for ( size_t i = 0; i < count; i++ )
+    {
+        Entry e;
+        std::string type, size;
+        if ( !readLine(e.filename) || !readLine(type) || !readLine(size) )
+            break;
+
+        e.file_type = fileType(type.size() ? type[0] : 'P');
+        e.size = atoi(size.c_str());
+        e.data_size = e.size;
+        e.method = 0;
+        entries.push_back(e);
+    }
+
+    // Data starts right after the last directory line
+    size_t offset = linePosition();
+    size_t size = containerStream->size();
+    for ( auto& e: entries )
+    {
+        e.data_offset = offset;
+        offset += e.data_size;
+
+        if ( e.data_offset + e.size > size )
+        {
+            Debug_printv("filename[%s] truncated", e.filename.c_str());
+            e.size = ( size > e.data_offset ) ? size - e.data_offset : 0;
+        }
+
+        addEntry(e);
+    }
+
+    return m_files.size() > 0;
+}
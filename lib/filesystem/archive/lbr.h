@@ -0,0 +1,63 @@
+// .LBR - C64 library
+// https://ist.uwaterloo.ca/~schepers/formats/LBR.TXT
+//
+// "DWB", the number of files and per file its name, type and size in
+// bytes, all as CR terminated text. The files follow the directory back
+// to back, not aligned to blocks.
+//
+
+#ifndef MEATFILE_DEFINES_LBR_H
+#define MEATFILE_DEFINES_LBR_H
+
+#include "cbm_archive.h"
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class LBRIStream : public CBMArchiveStream {
+
+public:
+    LBRIStream(std::shared_ptr<MIStream> is) : CBMArchiveStream(is) {};
+
+protected:
+    bool readDirectory() override;
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class LBRFile: public CBMArchiveFile {
+public:
+    LBRFile(std::string path): CBMArchiveFile(path, " LBR ") {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override {
+        return new LBRIStream(containerIstream);
+    };
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class LBRFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new LBRFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".lbr", fileName);
+    }
+
+    LBRFileSystem(): MFileSystem("lbr") {};
+};
+
+
+#endif
@@ -0,0 +1,109 @@
+#include "lnx.h"
+
+#define LNX_LOAD_ADDRESS 0x0801
+#define LNX_MAX_FILES 1024
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+size_t LNXIStream::findDirectory()
+{
+    uint8_t block[CBM_ARCHIVE_BLOCK_SIZE];
+    containerStream->seek(0);
+    size_t length = containerStream->read(block, sizeof(block));
+
+    // Follow the BASIC line links, the directory starts after the
+    // program's end marker
+    if ( length > 4 && block[0] == (LNX_LOAD_ADDRESS & 0xFF) && block[1] == (LNX_LOAD_ADDRESS >> 8) )
+    {
+        size_t pos = 2;
+        while ( pos + 1 < length )
+        {
+            uint16_t link = block[pos] | (block[pos + 1] << 8);
+            if ( link == 0 )
+            {
+                pos += 2;
+                if ( pos < length && block[pos] == 0x0D )
+                    pos++;
+                return pos;
+            }
+
+            size_t next = link - LNX_LOAD_ADDRESS + 2;
+            if ( link < LNX_LOAD_ADDRESS || next <= pos )
+                break;
+            pos = next;
+        }
+    }
+
+    // No usable stub, look for the signature and start at its line
+    for ( size_t i = 0; i + 4 <= length; i++ )
+    {
+        if ( memcmp(&block[i], "LYNX", 4) == 0 )
+        {
+            while ( i > 0 && block[i - 1] != 0x0D )
+                i--;
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+bool LNXIStream::readDirectory()
+{
+    std::string line;
+
+    beginLines(findDirectory());
+
+    // " 1  *LYNX XV  BY WILL CORLEY"
+    if ( !readLine(line) )
+        return false;
+    size_t directory_blocks = atoi(line.c_str());
+
+    if ( !readLine(line) )
+        return false;
+    size_t count = atoi(line.c_str());
+
+    if ( directory_blocks == 0 || count == 0 || count > LNX_MAX_FILES )
+    {
+        Debug_printv("directory_blocks[%d] count[%d] not a Lynx archive", directory_blocks, count);
+        return false;
+    }
+
+    size_t size = containerStream->size();
+    size_t offset = directory_blocks * CBM_ARCHIVE_BLOCK_SIZE;
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        Entry e;
+        std::string blocks, type, lsu;
+
+        if ( !readLine(e.filename) || !readLine(blocks) || !readLine(type) )
+            break;
+
+        if ( type.size() && type[0] == 'R' )
+            readLine(lsu);      // record length
+        if ( !readLine(lsu) )
+            break;
+
+        size_t block_count = atoi(blocks.c_str());
+        e.file_type = fileType(type.size() ? type[0] : 'P');
+        e.data_offset = offset;
+        e.data_size = block_count * CBM_ARCHIVE_BLOCK_SIZE;
+        e.size = blocksToBytes(block_count, atoi(lsu.c_str()));
+        e.method = 0;
+
+        // The last file isn't padded to a whole block
+        if ( e.data_offset + e.size > size )
+        {
+            Debug_printv("filename[%s] truncated", e.filename.c_str());
+            e.size = ( size > e.data_offset ) ? size - e.data_offset : 0;
+        }
+
+        addEntry(e);
+        offset += e.data_size;
+    }
+
+    return m_files.size() > 0;
+}
@@ -0,0 +1,68 @@
+// .LNX - Lynx archive
+// https://ist.uwaterloo.ca/~schepers/formats/LNX.TXT
+//
+// A BASIC stub, then a text directory (CR terminated lines): the number
+// of directory blocks with the signature, the number of files and for
+// every file its name, size in blocks, type and last block usage. Files
+// follow the directory, each one starts on a 254 byte block boundary.
+//
+// REL files carry their record length as an extra line, their side
+// sectors are part of the stored blocks and are not stripped.
+//
+
+#ifndef MEATFILE_DEFINES_LNX_H
+#define MEATFILE_DEFINES_LNX_H
+
+#include "cbm_archive.h"
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class LNXIStream : public CBMArchiveStream {
+
+public:
+    LNXIStream(std::shared_ptr<MIStream> is) : CBMArchiveStream(is) {};
+
+protected:
+    bool readDirectory() override;
+    size_t findDirectory();
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class LNXFile: public CBMArchiveFile {
+public:
+    LNXFile(std::string path): CBMArchiveFile(path, " LNX ") {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override {
+        return new LNXIStream(containerIstream);
+    };
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class LNXFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new LNXFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".lnx", fileName);
+    }
+
+    LNXFileSystem(): MFileSystem("lnx") {};
+};
+
+
+#endif
@@ -0,0 +1,594 @@
+#include "lzma.h"
+
+#define LZMA_STATES 12
+#define LZMA_POS_STATES_MAX 16
+#define LZMA_MATCH_MIN 2
+#define LZMA_END_POS_MODEL 14
+#define LZMA_FULL_DISTANCES 128
+#define LZMA_PROB_INIT 1024
+
+// All probabilities live in one array, these are the offsets
+#define LZMA_IS_MATCH 0
+#define LZMA_IS_REP (LZMA_IS_MATCH + LZMA_STATES * LZMA_POS_STATES_MAX)
+#define LZMA_IS_REP_G0 (LZMA_IS_REP + LZMA_STATES)
+#define LZMA_IS_REP_G1 (LZMA_IS_REP_G0 + LZMA_STATES)
+#define LZMA_IS_REP_G2 (LZMA_IS_REP_G1 + LZMA_STATES)
+#define LZMA_IS_REP0_LONG (LZMA_IS_REP_G2 + LZMA_STATES)
+#define LZMA_POS_SLOT (LZMA_IS_REP0_LONG + LZMA_STATES * LZMA_POS_STATES_MAX)
+#define LZMA_SPEC_POS (LZMA_POS_SLOT + 4 * 64)
+#define LZMA_ALIGN (LZMA_SPEC_POS + 1 + LZMA_FULL_DISTANCES - LZMA_END_POS_MODEL)
+#define LZMA_LEN (LZMA_ALIGN + 16)
+#define LZMA_LEN_SIZE (2 + 2 * LZMA_POS_STATES_MAX * 8 + 256)
+#define LZMA_REP_LEN (LZMA_LEN + LZMA_LEN_SIZE)
+#define LZMA_LITERAL (LZMA_REP_LEN + LZMA_LEN_SIZE)
+
+
+/********************************************************
+ * Setup
+ ********************************************************/
+
+bool LZMADecoder::begin(bool lzma2, const uint8_t* props, size_t props_size, size_t offset, size_t packed_size, size_t unpacked_size)
+{
+    m_lzma2 = lzma2;
+    m_start = offset;
+    m_packedSize = packed_size;
+    m_unpackedSize = unpacked_size;
+
+    // Dictionary size from the coder properties
+    uint32_t dictionary;
+    if ( lzma2 )
+    {
+        if ( props_size < 1 || props[0] > 40 )
+            return false;
+        dictionary = ( props[0] == 40 ) ? 0xFFFFFFFF : (2 | (props[0] & 1)) << (props[0] / 2 + 11);
+    }
+    else
+    {
+        if ( props_size < 5 )
+            return false;
+        memcpy(m_props, props, 5);
+        dictionary = props[1] | (props[2] << 8) | (props[3] << 16) | ((uint32_t)props[4] << 24);
+    }
+
+    // No point in a dictionary larger than what is decoded
+    size_t window = std::max((size_t)4096, std::min((size_t)dictionary, unpacked_size));
+    if ( window > SEVENZIP_MAX_WINDOW )
+    {
+        Debug_printv("dictionary[%u] unpacked_size[%d] needs more than [%d] bytes", dictionary, unpacked_size, SEVENZIP_MAX_WINDOW);
+        return false;
+    }
+
+    if ( m_window == nullptr || m_windowSize != window )
+    {
+        delete[] m_window;
+        m_windowSize = window;
+        m_window = new (std::nothrow) uint8_t[m_windowSize];
+        if ( m_window == nullptr )
+        {
+            Debug_printv("not enough memory for a [%d] byte dictionary", m_windowSize);
+            m_windowSize = 0;
+            return false;
+        }
+    }
+
+    return restart();
+}
+
+bool LZMADecoder::setProperties(uint8_t props)
+{
+    if ( props >= 9 * 5 * 5 )
+        return false;
+
+    m_lc = props % 9;
+    props /= 9;
+    m_lp = props % 5;
+    m_pb = props / 5;
+
+    if ( m_lc + m_lp > LZMA_MAX_LCLP )
+    {
+        Debug_printv("lc[%d] lp[%d] not supported", m_lc, m_lp);
+        return false;
+    }
+
+    size_t count = LZMA_LITERAL + (0x300 << (m_lc + m_lp));
+    if ( m_probs == nullptr || m_probsCount < count )
+    {
+        delete[] m_probs;
+        m_probs = new (std::nothrow) uint16_t[count];
+        if ( m_probs == nullptr )
+        {
+            m_probsCount = 0;
+            return false;
+        }
+        m_probsCount = count;
+    }
+
+    return true;
+}
+
+void LZMADecoder::resetState()
+{
+    for ( size_t i = 0; i < m_probsCount; i++ )
+        m_probs[i] = LZMA_PROB_INIT;
+
+    m_state = 0;
+    m_rep[0] = m_rep[1] = m_rep[2] = m_rep[3] = 0;
+    m_remainLen = 0;
+}
+
+bool LZMADecoder::restart()
+{
+    m_inputPos = 0;
+    m_inputLength = 0;
+    m_inputRemaining = m_packedSize;
+    m_consumed = 0;
+
+    m_windowPos = 0;
+    m_total = 0;
+    m_readPos = 0;
+    m_dictStart = 0;
+
+    m_chunkRemaining = 0;
+    m_chunkInputEnd = 0;
+    m_chunkUncompressed = false;
+    m_needProps = true;
+    m_remainLen = 0;
+    m_done = false;
+    m_error = false;
+
+    if ( m_source == nullptr || !m_source->seek(m_start) )
+    {
+        m_error = true;
+        return false;
+    }
+
+    // LZMA2 gets its properties and range coder setup with every chunk
+    if ( !m_lzma2 )
+    {
+        if ( !setProperties(m_props[0]) )
+        {
+            m_error = true;
+            return false;
+        }
+        resetState();
+        return initRange();
+    }
+
+    return true;
+}
+
+bool LZMADecoder::setSource(std::shared_ptr<MIStream> source)
+{
+    m_source = source;
+    if ( m_source == nullptr )
+        return true;
+
+    // Everything up to the buffered input has been read already
+    return m_source->seek(m_start + m_packedSize - m_inputRemaining);
+}
+
+
+/********************************************************
+ * Range decoder
+ ********************************************************/
+
+uint8_t LZMADecoder::nextByte()
+{
+    if ( m_inputPos >= m_inputLength )
+    {
+        if ( m_inputRemaining == 0 || m_source == nullptr )
+        {
+            m_error = true;
+            return 0;
+        }
+
+        m_inputLength = m_source->read(m_input, std::min((size_t)LZMA_INPUT_SIZE, m_inputRemaining));
+        m_inputRemaining -= m_inputLength;
+        m_inputPos = 0;
+        if ( m_inputLength == 0 )
+        {
+            m_inputRemaining = 0;
+            m_error = true;
+            return 0;
+        }
+    }
+
+    m_consumed++;
+    return m_input[m_inputPos++];
+}
+
+bool LZMADecoder::initRange()
+{
+    // The first byte is always zero
+    if ( nextByte() != 0 )
+    {
+        m_error = true;
+        return false;
+    }
+
+    m_range = 0xFFFFFFFF;
+    m_code = 0;
+    for ( uint8_t i = 0; i < 4; i++ )
+        m_code = (m_code << 8) | nextByte();
+
+    if ( m_code == m_range )
+        m_error = true;
+
+    return !m_error;
+}
+
+inline void LZMADecoder::normalize()
+{
+    if ( m_range < (1UL << 24) )
+    {
+        m_range <<= 8;
+        m_code = (m_code << 8) | nextByte();
+    }
+}
+
+uint32_t LZMADecoder::decodeBit(uint16_t& prob)
+{
+    uint32_t bound = (m_range >> 11) * prob;
+    uint32_t bit;
+
+    if ( m_code < bound )
+    {
+        prob += ((1 << 11) - prob) >> 5;
+        m_range = bound;
+        bit = 0;
+    }
+    else
+    {
+        prob -= prob >> 5;
+        m_code -= bound;
+        m_range -= bound;
+        bit = 1;
+    }
+
+    normalize();
+    return bit;
+}
+
+uint32_t LZMADecoder::decodeDirect(uint8_t count)
+{
+    uint32_t result = 0;
+
+    while ( count-- )
+    {
+        m_range >>= 1;
+        m_code -= m_range;
+        uint32_t t = 0 - (m_code >> 31);
+        m_code += m_range & t;
+        normalize();
+        result = (result << 1) + (t + 1);
+    }
+
+    return result;
+}
+
+uint32_t LZMADecoder::decodeTree(uint16_t* probs, uint8_t bits)
+{
+    uint32_t m = 1;
+    for ( uint8_t i = 0; i < bits; i++ )
+        m = (m << 1) + decodeBit(probs[m]);
+    return m - (1 << bits);
+}
+
+uint32_t LZMADecoder::decodeReverse(uint16_t* probs, uint8_t bits)
+{
+    uint32_t m = 1;
+    uint32_t symbol = 0;
+    for ( uint8_t i = 0; i < bits; i++ )
+    {
+        uint32_t bit = decodeBit(probs[m]);
+        m = (m << 1) + bit;
+        symbol |= bit << i;
+    }
+    return symbol;
+}
+
+uint32_t LZMADecoder::decodeLength(uint16_t* probs, uint32_t pos_state)
+{
+    if ( !decodeBit(probs[0]) )
+        return decodeTree(&probs[2 + pos_state * 8], 3);
+    if ( !decodeBit(probs[1]) )
+        return 8 + decodeTree(&probs[2 + LZMA_POS_STATES_MAX * 8 + pos_state * 8], 3);
+    return 16 + decodeTree(&probs[2 + 2 * LZMA_POS_STATES_MAX * 8], 8);
+}
+
+
+/********************************************************
+ * Decoding
+ ********************************************************/
+
+bool LZMADecoder::decodeSymbol()
+{
+    uint32_t pos_state = m_total & ((1 << m_pb) - 1);
+    uint32_t state = m_state;
+
+    if ( !decodeBit(m_probs[LZMA_IS_MATCH + (state << 4) + pos_state]) )
+    {
+        // Literal, matched against the byte at rep0 after a match
+        uint8_t previous = ( m_total > m_dictStart ) ? dictByte(1) : 0;
+        uint32_t lit_state = ((m_total & ((1 << m_lp) - 1)) << m_lc) + (previous >> (8 - m_lc));
+        uint16_t* probs = &m_probs[LZMA_LITERAL + 0x300 * lit_state];
+        uint32_t symbol = 1;
+
+        if ( state >= 7 )
+        {
+            uint32_t match = dictByte(m_rep[0] + 1);
+            do
+            {
+                uint32_t match_bit = (match >> 7) & 1;
+                match <<= 1;
+                uint32_t bit = decodeBit(probs[((1 + match_bit) << 8) + symbol]);
+                symbol = (symbol << 1) | bit;
+                if ( match_bit != bit )
+                    break;
+            } while ( symbol < 0x100 );
+        }
+
+        while ( symbol < 0x100 )
+            symbol = (symbol << 1) | decodeBit(probs[symbol]);
+
+        output(symbol - 0x100);
+        m_state = ( state < 4 ) ? 0 : ( state < 10 ) ? state - 3 : state - 6;
+        return !m_error;
+    }
+
+    uint32_t len;
+
+    if ( decodeBit(m_probs[LZMA_IS_REP + state]) )
+    {
+        if ( m_total == m_dictStart )
+        {
+            m_error = true;
+            return false;
+        }
+
+        if ( !decodeBit(m_probs[LZMA_IS_REP_G0 + state]) )
+        {
+            // Short rep, a single byte from rep0
+            if ( !decodeBit(m_probs[LZMA_IS_REP0_LONG + (state << 4) + pos_state]) )
+            {
+                m_state = ( state < 7 ) ? 9 : 11;
+                output(dictByte(m_rep[0] + 1));
+                return !m_error;
+            }
+        }
+        else
+        {
+            uint32_t distance;
+            if ( !decodeBit(m_probs[LZMA_IS_REP_G1 + state]) )
+                distance = m_rep[1];
+            else
+            {
+                if ( !decodeBit(m_probs[LZMA_IS_REP_G2 + state]) )
+                    distance = m_rep[2];
+                else
+                {
+                    distance = m_rep[3];
+                    m_rep[3] = m_rep[2];
+                }
+                m_rep[2] = m_rep[1];
+            }
+            m_rep[1] = m_rep[0];
+            m_rep[0] = distance;
+        }
+
+        len = decodeLength(&m_probs[LZMA_REP_LEN], pos_state);
+        m_state = ( state < 7 ) ? 8 : 11;
+    }
+    else
+    {
+        m_rep[3] = m_rep[2];
+        m_rep[2] = m_rep[1];
+        m_rep[1] = m_rep[0];
+        len = decodeLength(&m_probs[LZMA_LEN], pos_state);
+        m_state = ( state < 7 ) ? 7 : 10;
+
+        // Distance
+        uint32_t len_state = std::min(len, (uint32_t)3);
+        uint32_t slot = decodeTree(&m_probs[LZMA_POS_SLOT + (len_state << 6)], 6);
+        uint32_t distance = slot;
+        if ( slot >= 4 )
+        {
+            uint8_t direct = (slot >> 1) - 1;
+            distance = (2 | (slot & 1)) << direct;
+            if ( slot < LZMA_END_POS_MODEL )
+                distance += decodeReverse(&m_probs[LZMA_SPEC_POS + distance - slot], direct);
+            else
+            {
+                distance += decodeDirect(direct - 4) << 4;
+                distance += decodeReverse(&m_probs[LZMA_ALIGN], 4);
+            }
+        }
+        m_rep[0] = distance;
+
+        // End marker
+        if ( distance == 0xFFFFFFFF )
+        {
+            m_done = true;
+            return false;
+        }
+    }
+
+    if ( m_rep[0] >= m_windowSize || m_rep[0] >= m_total - m_dictStart )
+    {
+        Debug_printv("distance[%u] out of range at [%d]", m_rep[0], m_total);
+        m_error = true;
+        return false;
+    }
+
+    m_remainLen = len + LZMA_MATCH_MIN;
+    return !m_error;
+}
+
+bool LZMADecoder::nextChunk()
+{
+    // The range coder must have used up exactly the previous chunk
+    if ( m_consumed > m_chunkInputEnd )
+    {
+        m_error = true;
+        return false;
+    }
+    while ( m_consumed < m_chunkInputEnd && !m_error )
+        nextByte();
+
+    uint8_t control = nextByte();
+    if ( m_error )
+        return false;
+
+    if ( control == 0x00 )
+    {
+        m_done = true;
+        return false;
+    }
+
+    if ( control == 0x01 || control == 0x02 )
+    {
+        // Uncompressed chunk, 0x01 resets the dictionary
+        if ( control == 0x01 )
+            m_dictStart = m_total;
+
+        m_chunkRemaining = ((nextByte() << 8) | nextByte()) + 1;
+        m_chunkUncompressed = true;
+        m_chunkInputEnd = m_consumed + m_chunkRemaining;
+        return !m_error;
+    }
+
+    if ( control < 0x80 )
+    {
+        m_error = true;
+        return false;
+    }
+
+    m_chunkRemaining = (((control & 0x1F) << 16) | (nextByte() << 8) | nextByte()) + 1;
+    size_t packed = ((nextByte() << 8) | nextByte()) + 1;
+    uint8_t reset = (control >> 5) & 0x03;
+
+    if ( reset == 3 )
+        m_dictStart = m_total;
+
+    if ( reset >= 2 )
+    {
+        if ( !setProperties(nextByte()) )
+        {
+            m_error = true;
+            return false;
+        }
+        m_needProps = false;
+    }
+    else if ( m_needProps )
+    {
+        m_error = true;
+        return false;
+    }
+
+    if ( reset >= 1 )
+        resetState();
+
+    m_chunkUncompressed = false;
+    m_chunkInputEnd = m_consumed + packed;
+    return initRange();
+}
+
+size_t LZMADecoder::read(uint8_t* buf, size_t size)
+{
+    size_t count = 0;
+
+    if ( m_window == nullptr )
+        return 0;
+
+    // Bytes still in the dictionary after a backward seek
+    while ( count < size && m_readPos < m_total )
+    {
+        size_t back = m_total - m_readPos;
+        size_t start = ( m_windowPos >= back ) ? m_windowPos - back : m_windowSize - back + m_windowPos;
+        size_t length = std::min({ size - count, back, m_windowSize - start });
+        memcpy(buf + count, &m_window[start], length);
+        count += length;
+        m_readPos += length;
+    }
+
+    while ( count < size && !m_error )
+    {
+        if ( m_total >= m_unpackedSize )
+            break;
+
+        // Pending match
+        if ( m_remainLen )
+        {
+            size_t length = std::min({ (size_t)m_remainLen, size - count, m_unpackedSize - m_total });
+            uint32_t distance = m_rep[0] + 1;
+            m_remainLen -= length;
+            while ( length-- )
+            {
+                uint8_t value = dictByte(distance);
+                output(value);
+                buf[count++] = value;
+            }
+            continue;
+        }
+
+        if ( m_done )
+            break;
+
+        if ( m_lzma2 )
+        {
+            if ( m_chunkRemaining == 0 && !nextChunk() )
+                break;
+
+            if ( m_chunkUncompressed )
+            {
+                while ( m_chunkRemaining && count < size && !m_error )
+                {
+                    uint8_t value = nextByte();
+                    output(value);
+                    buf[count++] = value;
+                }
+                continue;
+            }
+        }
+
+        size_t before = m_total;
+        if ( !decodeSymbol() )
+            break;
+
+        if ( m_total != before )
+            buf[count++] = m_window[(m_windowPos ? m_windowPos : m_windowSize) - 1];
+    }
+
+    if ( m_error )
+        Debug_printv("data error at [%d]", m_total);
+
+    return count;
+}
+
+bool LZMADecoder::seek(size_t pos)
+{
+    if ( m_window == nullptr || pos > m_unpackedSize )
+        return false;
+
+    // Still in the dictionary
+    if ( pos <= m_total && m_total - pos <= m_windowSize )
+    {
+        m_readPos = pos;
+        return true;
+    }
+
+    if ( pos < m_total && !restart() )
+        return false;
+
+    // Decode up to pos, the dictionary keeps what is needed
+    m_readPos = m_total;
+    uint8_t scratch[256];
+    while ( m_total < pos )
+    {
+        size_t length = std::min(sizeof(scratch), pos - m_total);
+        if ( read(scratch, length) != length )
+            return false;
+    }
+
+    return true;
+}
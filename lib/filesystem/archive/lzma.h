@@ -0,0 +1,137 @@
+// LZMA / LZMA2 decompression for 7z containers
+// https://www.7-zip.org/sdk.html (DOC/lzma-specification.txt, LzmaSpec.cpp)
+// https://github.com/tukaani-project/xz/blob/master/doc/xz-file-format.txt
+//
+// Works like Inflater: the compressed data is pulled from the container
+// stream and decoded straight into the caller's buffer. The dictionary is
+// the only thing that grows with the data. It is never larger than the
+// folder being decoded, and never larger than SEVENZIP_MAX_WINDOW. If an
+// archive needs more than that it is refused instead of running out of
+// heap halfway.
+//
+// Seeking back inside the dictionary replays bytes from it, seeking
+// forward decodes and drops, anything else starts over.
+//
+
+#ifndef MEATFILE_DEFINES_LZMA_H
+#define MEATFILE_DEFINES_LZMA_H
+
+#include "meat_io.h"
+
+
+#if defined(BOARD_HAS_PSRAM)
+#define SEVENZIP_MAX_WINDOW (2 * 1024 * 1024)
+#elif defined(ESP32)
+#define SEVENZIP_MAX_WINDOW (96 * 1024)
+#else
+#define SEVENZIP_MAX_WINDOW (16 * 1024)
+#endif
+
+#define LZMA_INPUT_SIZE 512
+
+// lc + lp above this would need more than 48K of probabilities, 7-Zip
+// never writes that and LZMA2 doesn't allow it
+#define LZMA_MAX_LCLP 4
+
+
+class LZMADecoder {
+public:
+    LZMADecoder(std::shared_ptr<MIStream> source) : m_source(source) {};
+    ~LZMADecoder() {
+        delete[] m_window;
+        delete[] m_probs;
+    };
+
+    // Decode packed_size bytes at offset into unpacked_size bytes
+    bool begin(bool lzma2, const uint8_t* props, size_t props_size, size_t offset, size_t packed_size, size_t unpacked_size);
+
+    size_t read(uint8_t* buf, size_t size);
+    bool seek(size_t pos);
+
+    // Continue on another stream over the same data, nullptr lets go of
+    // the current one while the decoder is parked
+    bool setSource(std::shared_ptr<MIStream> source);
+
+    size_t position() { return m_readPos; };
+    bool hasError() { return m_error; };
+
+    // Heap held by this decoder, for the benchmarks
+    size_t memoryUsage() { return sizeof(*this) + m_windowSize + m_probsCount * sizeof(uint16_t); };
+
+private:
+    bool restart();
+    bool setProperties(uint8_t props);
+    void resetState();
+
+    // Range decoder
+    uint8_t nextByte();
+    bool initRange();
+    inline void normalize();
+    uint32_t decodeBit(uint16_t& prob);
+    uint32_t decodeDirect(uint8_t count);
+    uint32_t decodeTree(uint16_t* probs, uint8_t bits);
+    uint32_t decodeReverse(uint16_t* probs, uint8_t bits);
+    uint32_t decodeLength(uint16_t* probs, uint32_t pos_state);
+
+    // One literal or match, false at the end marker or on an error
+    bool decodeSymbol();
+    bool nextChunk();
+
+    inline uint8_t dictByte(uint32_t distance) {
+        return m_window[(m_windowPos >= distance) ? m_windowPos - distance : m_windowSize - distance + m_windowPos];
+    };
+
+    inline void output(uint8_t value) {
+        m_window[m_windowPos++] = value;
+        if ( m_windowPos == m_windowSize )
+            m_windowPos = 0;
+        m_total++;
+        m_readPos++;
+        if ( m_chunkRemaining )
+            m_chunkRemaining--;
+    };
+
+    std::shared_ptr<MIStream> m_source;
+    bool m_lzma2 = false;
+    uint8_t m_props[5];
+    size_t m_start = 0;
+    size_t m_packedSize = 0;
+    size_t m_unpackedSize = 0;
+
+    uint8_t m_input[LZMA_INPUT_SIZE];
+    size_t m_inputPos = 0;
+    size_t m_inputLength = 0;
+    size_t m_inputRemaining = 0;
+    size_t m_consumed = 0;
+
+    uint32_t m_range = 0;
+    uint32_t m_code = 0;
+
+    uint8_t* m_window = nullptr;
+    size_t m_windowSize = 0;
+    size_t m_windowPos = 0;
+    size_t m_total = 0;         // bytes decoded so far
+    size_t m_readPos = 0;       // bytes handed out, less than m_total after a replay seek
+    size_t m_dictStart = 0;     // matches can't reach back past a dictionary reset
+
+    uint16_t* m_probs = nullptr;
+    size_t m_probsCount = 0;
+    uint8_t m_lc = 0;
+    uint8_t m_lp = 0;
+    uint8_t m_pb = 0;
+
+    uint32_t m_state = 0;
+    uint32_t m_rep[4];
+    uint32_t m_remainLen = 0;
+
+    // LZMA2 chunks
+    size_t m_chunkRemaining = 0;
+    size_t m_chunkInputEnd = 0;
+    bool m_chunkUncompressed = false;
+    bool m_needProps = true;
+
+    bool m_done = false;
+    bool m_error = false;
+};
+
+#endif
@@ -0,0 +1,34 @@
+// .SDA - Self dissolving ARC
+// https://ist.uwaterloo.ca/~schepers/formats.html
+//
+// A C64 ARC archive behind a loader that unpacks it when RUN. ARCIStream
+// looks past the loader for the first member, so this is ARC with its own
+// extension.
+//
+
+#ifndef MEATFILE_DEFINES_SDA_H
+#define MEATFILE_DEFINES_SDA_H
+
+#include "arc.h"
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class SDAFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new ARCFile(path, " SDA ");
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".sda", fileName);
+    }
+
+    SDAFileSystem(): MFileSystem("sda") {};
+};
+
+
+#endif
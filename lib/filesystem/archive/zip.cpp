@@ -0,0 +1,382 @@
+#include "zip.h"
+
+#define ZIP_LOCAL_HEADER 0x04034b50
+#define ZIP_CENTRAL_HEADER 0x02014b50
+#define ZIP_END_OF_CENTRAL 0x06054b50
+
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_OF_CENTRAL_SIZE 22
+#define ZIP_MAX_COMMENT 0xFFFF
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATE 8
+#define ZIP_FLAG_ENCRYPTED 0x0001
+#define ZIP_FLAG_DATA_DESCRIPTOR 0x0008
+
+static inline uint16_t le16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+void ZIPIStream::addEntry(Entry& e)
+{
+    // Folders only exist as part of the file names
+    if ( e.filename.empty() || mstr::endsWith(e.filename, "/") )
+        return;
+
+    if ( e.flags & ZIP_FLAG_ENCRYPTED )
+    {
+        Debug_printv("filename[%s] encrypted, skipped", e.filename.c_str());
+        return;
+    }
+
+    std::string key = e.filename;
+    mstr::toLower(key);
+    m_names.insert(std::make_pair(key, m_files.size()));
+    m_files.push_back(e);
+}
+
+bool ZIPIStream::readCentralDirectory()
+{
+    size_t size = containerStream->size();
+    if ( size < ZIP_END_OF_CENTRAL_SIZE )
+        return false;
+
+    // The end record is at the very end unless there is an archive comment,
+    // search backwards in chunks that overlap by a record
+    uint8_t buffer[512 + ZIP_END_OF_CENTRAL_SIZE];
+    size_t lowest = ( size > ZIP_END_OF_CENTRAL_SIZE + ZIP_MAX_COMMENT ) ? size - ZIP_END_OF_CENTRAL_SIZE - ZIP_MAX_COMMENT : 0;
+    size_t chunk_end = size;
+    uint8_t* eocd = nullptr;
+
+    while ( eocd == nullptr && chunk_end > lowest )
+    {
+        size_t chunk_start = ( chunk_end - lowest > 512 ) ? chunk_end - 512 : lowest;
+        size_t length = std::min(sizeof(buffer), size - chunk_start);
+
+        if ( !containerStream->seek(chunk_start) || containerStream->read(buffer, length) != length )
+            return false;
+
+        for ( int i = (int)length - ZIP_END_OF_CENTRAL_SIZE; i >= 0; i-- )
+        {
+            if ( le32(&buffer[i]) == ZIP_END_OF_CENTRAL )
+            {
+                eocd = &buffer[i];
+                break;
+            }
+        }
+
+        chunk_end = chunk_start;
+    }
+
+    if ( eocd == nullptr )
+        return false;
+
+    uint16_t count = le16(&eocd[10]);
+    uint32_t offset = le32(&eocd[16]);
+    if ( offset == 0xFFFFFFFF || count == 0xFFFF )
+    {
+        Debug_printv("ZIP64 archives are not supported");
+        return false;
+    }
+
+    // Read the entries in one sequential pass, no seeks in between
+    if ( !containerStream->seek(offset) )
+        return false;
+
+    uint8_t header[ZIP_CENTRAL_HEADER_SIZE];
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        if ( containerStream->read(header, sizeof(header)) != sizeof(header) || le32(header) != ZIP_CENTRAL_HEADER )
+        {
+            Debug_printv("bad central directory entry[%d]", i);
+            break;
+        }
+
+        Entry e;
+        e.flags = le16(&header[8]);
+        e.method = le16(&header[10]);
+        e.compressed_size = le32(&header[20]);
+        e.size = le32(&header[24]);
+        e.local_offset = le32(&header[42]);
+
+        uint16_t name_length = le16(&header[28]);
+        size_t skip = le16(&header[30]) + le16(&header[32]);
+
+        e.filename.resize(name_length);
+        if ( containerStream->read((uint8_t*)&e.filename[0], name_length) != name_length )
+            break;
+
+        while ( skip )
+        {
+            size_t bytes = containerStream->read(buffer, std::min(skip, sizeof(buffer)));
+            if ( bytes == 0 )
+                break;
+            skip -= bytes;
+        }
+
+        addEntry(e);
+    }
+
+    return true;
+}
+
+bool ZIPIStream::readLocalHeaders()
+{
+    // No central directory in reach (truncated archive or a stream that
+    // can't seek to its end), walk the local headers from the start
+    uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+    size_t offset = 0;
+
+    while ( containerStream->seek(offset) && containerStream->read(header, sizeof(header)) == sizeof(header) )
+    {
+        if ( le32(header) != ZIP_LOCAL_HEADER )
+            break;
+
+        Entry e;
+        e.flags = le16(&header[6]);
+        e.method = le16(&header[8]);
+        e.compressed_size = le32(&header[18]);
+        e.size = le32(&header[22]);
+        e.local_offset = offset;
+
+        // Sizes are only known after the data, can't skip over it
+        if ( e.flags & ZIP_FLAG_DATA_DESCRIPTOR )
+        {
+            Debug_printv("data descriptor at [%d], stopping", offset);
+            break;
+        }
+
+        uint16_t name_length = le16(&header[26]);
+        e.filename.resize(name_length);
+        if ( containerStream->read((uint8_t*)&e.filename[0], name_length) != name_length )
+            break;
+
+        addEntry(e);
+
+        offset += ZIP_LOCAL_HEADER_SIZE + name_length + le16(&header[28]) + e.compressed_size;
+    }
+
+    return m_files.size() > 0;
+}
+
+bool ZIPIStream::readDirectory()
+{
+    if ( m_directoryRead )
+        return m_files.size() > 0;
+
+    m_directoryRead = true;
+
+    if ( !readCentralDirectory() )
+        readLocalHeaders();
+
+    Debug_printv("files[%d]", m_files.size());
+    return m_files.size() > 0;
+}
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+bool ZIPIStream::seekEntry( std::string filename )
+{
+    if ( filename.size() && readDirectory() )
+    {
+        if ( filename == "*" )
+            return seekEntry( (size_t)1 );
+
+        mstr::toLower(filename);
+        auto found = m_names.find(filename);
+        if ( found != m_names.end() )
+            return seekEntry( found->second + 1 );
+
+        for ( size_t index = 0; index < m_files.size(); index++ )
+        {
+            if ( mstr::startsWith(m_files[index].filename, filename.c_str(), false) )
+                return seekEntry( index + 1 );
+        }
+    }
+
+    entry.filename.clear();
+
+    return false;
+}
+
+bool ZIPIStream::seekEntry( size_t index )
+{
+    if ( !readDirectory() || index < 1 || index > m_files.size() )
+        return false;
+
+    entry = m_files[index - 1];
+    entry_index = index;
+    return true;
+}
+
+size_t ZIPIStream::readFile(uint8_t* buf, size_t size) {
+    size_t bytesRead = 0;
+
+    size = std::min(size, m_bytesAvailable);
+    if ( size == 0 )
+        return 0;
+
+    if ( entry.method == ZIP_METHOD_STORED )
+        bytesRead = containerStream->read(buf, size);
+    else
+        bytesRead = m_inflater.read(buf, size);
+
+    if ( bytesRead < size )
+        Debug_printv("filename[%s] short read at [%d]", entry.filename.c_str(), m_position + bytesRead);
+
+    m_bytesAvailable -= bytesRead;
+
+    return bytesRead;
+}
+
+bool ZIPIStream::seek(size_t pos) {
+    // Not pointing at an entry, the archive itself is being read
+    if ( !seekCalled )
+        return containerStream->seek(pos);
+
+    if ( pos > m_length )
+        return false;
+
+    bool ok;
+    if ( entry.method == ZIP_METHOD_STORED )
+        ok = containerStream->seek(m_dataOffset + pos);
+    else
+        ok = m_inflater.seek(pos);
+
+    if ( !ok )
+        return false;
+
+    m_position = pos;
+    m_bytesAvailable = m_length - pos;
+    return true;
+}
+
+bool ZIPIStream::seekPath(std::string path) {
+    // Implement this to skip a queue of file streams to start of file by name
+    // this will cause the next read to return bytes of 'path'
+    seekCalled = true;
+
+    entry_index = 0;
+
+    if ( !seekEntry(path) )
+    {
+        Debug_printv( "Not found! [%s]", path.c_str());
+        return false;
+    }
+
+    if ( entry.method != ZIP_METHOD_STORED && entry.method != ZIP_METHOD_DEFLATE )
+    {
+        Debug_printv("filename[%s] method[%d] not supported", entry.filename.c_str(), entry.method);
+        return false;
+    }
+
+    // The local header can have a different extra field than the central one
+    uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+    if ( !containerStream->seek(entry.local_offset) || containerStream->read(header, sizeof(header)) != sizeof(header) || le32(header) != ZIP_LOCAL_HEADER )
+    {
+        Debug_printv("filename[%s] bad local header", entry.filename.c_str());
+        return false;
+    }
+    m_dataOffset = entry.local_offset + ZIP_LOCAL_HEADER_SIZE + le16(&header[26]) + le16(&header[28]);
+
+    m_length = entry.size;
+    m_bytesAvailable = m_length;
+    m_position = 0;
+
+    bool ok;
+    if ( entry.method == ZIP_METHOD_STORED )
+        ok = containerStream->seek(m_dataOffset);
+    else
+        ok = m_inflater.begin(m_dataOffset, entry.compressed_size);
+
+    Debug_printv("filename[%s] method[%d] size[%d] compressed_size[%d] data_offset[%d]", entry.filename.c_str(), entry.method, entry.size, entry.compressed_size, m_dataOffset);
+
+    return ok;
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+MIStream* ZIPFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new ZIPIStream(containerIstream);
+}
+
+
+bool ZIPFile::isDirectory() {
+    //Debug_printv("pathInStream[%s]", pathInStream.c_str());
+    if ( pathInStream == "" )
+        return true;
+    else
+        return false;
+};
+
+bool ZIPFile::rewindDirectory() {
+    dirIsOpen = true;
+    Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
+    auto image = ImageBroker::obtain<ZIPIStream>(streamFile->url);
+    if ( image == nullptr )
+        Debug_printv("image pointer is null");
+
+    image->resetEntryCounter();
+
+    // Read Header
+    image->seekHeader();
+
+    // Set Media Info Fields
+    media_header = name;
+    mstr::toPETSCII(media_header);
+    media_id = " ZIP ";
+    media_blocks_free = 0;
+    media_block_size = image->block_size;
+    media_image = name;
+
+    Debug_printv("media_header[%s] media_id[%s] media_blocks_free[%d] media_block_size[%d] media_image[%s]", media_header.c_str(), media_id.c_str(), media_blocks_free, media_block_size, media_image.c_str());
+
+    return true;
+}
+
+MFile* ZIPFile::getNextFileInDir() {
+
+    if(!dirIsOpen)
+        rewindDirectory();
+
+    // Get entry pointed to by containerStream
+    auto image = ImageBroker::obtain<ZIPIStream>(streamFile->url);
+
+    if ( image->seekNextImageEntry() )
+    {
+        //Debug_printv( "entry[%s]", (streamFile->url + "/" + image->entry.filename).c_str() );
+        return MFSOwner::File(streamFile->url + "/" + image->entry.filename);
+    }
+    else
+    {
+        //Debug_printv( "END OF DIRECTORY");
+        dirIsOpen = false;
+        return nullptr;
+    }
+}
+
+
+size_t ZIPFile::size() {
+    // Debug_printv("[%s]", streamFile->url.c_str());
+    // use ZIP to get size of the file in image
+    auto& entry = ImageBroker::obtain<ZIPIStream>(streamFile->url)->entry;
+
+    return entry.size;
+}
@@ -0,0 +1,139 @@
+// .ZIP - PKWARE ZIP archive
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+// https://en.wikipedia.org/wiki/ZIP_(file_format)
+//
+// The central directory at the end of the archive is read once and kept
+// as an index. Entries are served straight from the container, stored
+// ones as they are and deflated ones through Inflater, so nothing is
+// staged on flash and nested paths like game.zip/disk1.d64/PROG work.
+//
+// ZIP64, encryption and methods other than stored (0) and deflate (8)
+// are not supported.
+//
+
+#ifndef MEATFILE_DEFINES_ZIP_H
+#define MEATFILE_DEFINES_ZIP_H
+
+#include "meat_io.h"
+#include "media/cbm_image.h"
+#include "inflate.h"
+
+#include <unordered_map>
+#include <vector>
+
+
+/********************************************************
+ * Streams implementations
+ ********************************************************/
+
+class ZIPIStream : public CBMImageStream {
+
+public:
+    ZIPIStream(std::shared_ptr<MIStream> is) : CBMImageStream(is), m_inflater(is) {};
+
+    // Unlike disk images the unpacked entry can be used as a container
+    // itself (a D64 in a ZIP), so it has to be seekable
+    bool seek(size_t pos) override;
+    bool seek(size_t pos, SeekMode mode) override {
+        return MIStream::seek(pos, mode);
+    };
+    bool isOpen() override { return containerStream->isOpen(); };
+
+protected:
+    struct Entry {
+        std::string filename;
+        uint16_t flags;
+        uint16_t method;
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t local_offset;
+    };
+
+    void seekHeader() override {
+        readDirectory();
+    }
+
+    bool seekNextImageEntry() override {
+        return seekEntry(entry_index + 1);
+    }
+
+    bool seekEntry( std::string filename ) override;
+    bool seekEntry( size_t index ) override;
+
+    size_t readFile(uint8_t* buf, size_t size) override;
+    bool seekPath(std::string path) override;
+
+    Entry entry;
+
+    bool readDirectory();
+    bool readCentralDirectory();
+    bool readLocalHeaders();
+    void addEntry(Entry& e);
+
+    std::vector<Entry> m_files;
+    std::unordered_map<std::string, size_t> m_names;    // lower case name -> index
+    bool m_directoryRead = false;
+
+    Inflater m_inflater;
+    size_t m_dataOffset = 0;
+
+private:
+    friend class ZIPFile;
+};
+
+
+/********************************************************
+ * Files implementations
+ ********************************************************/
+
+class ZIPFile: public MFile {
+public:
+
+    ZIPFile(std::string path, bool is_dir = true): MFile(path) {
+        isDir = is_dir;
+    };
+
+    ~ZIPFile() {
+        // don't close the stream here! It will be used by shared ptr D64Util to keep reading image params
+    }
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+    bool mkDir() override { return false; };
+
+    bool exists() override { return true; };
+    bool remove() override { return false; };
+    bool rename(std::string dest) { return false; };
+    time_t getLastWrite() override { return 0; };
+    time_t getCreationTime() override { return 0; };
+    size_t size() override;
+
+    bool isDir = true;
+    bool dirIsOpen = false;
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class ZIPFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new ZIPFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".zip", fileName);
+    }
+
+    ZIPFileSystem(): MFileSystem("zip") {};
+};
+
+
+#endif
@@ -18,10 +18,29 @@
 #include "media/d82.h"
 #include "media/d8b.h"
 #include "media/dnp.h"
+#include "media/d2m.h"
+#include "media/d4m.h"
+#include "media/dhd.h"
+#include "media/dfi.h"
+#include "media/g64.h"
+#include "media/nib.h"
+#include "media/scp.h"
 
 // Tape
 #include "media/t64.h"
+#include "media/tap.h"
 #include "media/tcrt.h"
+#include "media/crt.h"
+#include "media/p00.h"
+#include "media/x64.h"
+#include "archive/zip.h"
+#include "archive/gz.h"
+#include "archive/7z.h"
+#include "archive/lnx.h"
+#include "archive/ark.h"
+#include "archive/lbr.h"
+#include "archive/arc.h"
+#include "archive/sda.h"
 
 #include <vector>
 #include <sstream>
@@ -51,10 +70,29 @@ D81FileSystem d81FS;
 D82FileSystem d82FS;
 D8BFileSystem d8bFS;
 DNPFileSystem dnpFS;
+D2MFileSystem d2mFS;
+D4MFileSystem d4mFS;
+DHDFileSystem dhdFS;
+DFIFileSystem dfiFS;
+G64FileSystem g64FS;
+NIBFileSystem nibFS;
+SCPFileSystem scpFS;
 
 // Tape
 T64FileSystem t64FS;
+TAPFileSystem tapFS;
 TCRTFileSystem tcrtFS;
+CRTFileSystem crtFS;
+P00FileSystem p00FS;
+X64FileSystem x64FS;
+ZIPFileSystem zipFS;
+GZFileSystem gzFS;
+SevenZipFileSystem sevenZipFS;
+LNXFileSystem lnxFS;
+ARKFileSystem arkFS;
+LBRFileSystem lbrFS;
+ARCFileSystem arcFS;
+SDAFileSystem sdaFS;
 
 // Cartridge
 
@@ -62,7 +100,7 @@ TCRTFileSystem tcrtFS;
 
 // put all available filesystems in this array - first matching system gets the file!
 // fist in list is default
-std::vector<MFileSystem*> MFSOwner::availableFS{ &defaultFS, &d64FS, &d71FS, &d80FS, &d81FS, &d82FS, &d8bFS, &dnpFS, &t64FS, &tcrtFS, &mlFS, &httpFS, &wsFS };
+std::vector<MFileSystem*> MFSOwner::availableFS{ &defaultFS, &d64FS, &d71FS, &d80FS, &d81FS, &d82FS, &d8bFS, &dnpFS, &d2mFS, &d4mFS, &dhdFS, &dfiFS, &x64FS, &g64FS, &nibFS, &scpFS, &t64FS, &tapFS, &tcrtFS, &crtFS, &p00FS, &zipFS, &gzFS, &sevenZipFS, &lnxFS, &arkFS, &lbrFS, &arcFS, &sdaFS, &mlFS, &httpFS, &wsFS };
 
 bool MFSOwner::mount(std::string name) {
     Serial.print("MFSOwner::mount fs:");
@@ -100,6 +138,12 @@ bool MFSOwner::umount(std::string name) {
     return true;
 }
 
+void MFSOwner::idle() {
+    for(auto fs : availableFS) {
+        fs->idle();
+    }
+}
+
 MFile* MFSOwner::File(MFile* file) {
     return File(file->url);
 }
@@ -226,6 +270,13 @@ MIStream* MFile::inputStream() {
     //std::shared_ptr<MFile> containerFile(MFSOwner::File(streamPath)); // get the base file that knows how to handle this kind of container, i.e 7z
 
     std::shared_ptr<MIStream> containerStream(streamFile->inputStream()); // get its base stream, i.e. zip raw file contents
+    return inputStream(containerStream);
+}
+
+MIStream* MFile::inputStream(std::shared_ptr<MIStream> containerStream) {
+    if(containerStream == nullptr)
+        return nullptr;
+
     Debug_printv("containerStream isRandomAccess[%d] isBrowsable[%d]", containerStream->isRandomAccess(), containerStream->isBrowsable());
 
     MIStream* decodedStream(createIStream(containerStream)); // wrap this stream into decodec stream, i.e. unpacked zip files
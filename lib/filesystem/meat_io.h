@@ -61,6 +61,8 @@ public:
 
     // has to return OPENED stream
     virtual MIStream* inputStream();
+    // The same over a container stream already open
+    virtual MIStream* inputStream(std::shared_ptr<MIStream> containerStream);
     virtual MOStream* outputStream() { return nullptr; };
 
     virtual MFile* cd(std::string newDir);
@@ -76,6 +78,17 @@ public:
     virtual time_t getCreationTime() = 0 ;
     virtual size_t size() = 0;
 
+    // Sector access for the DOS block commands (U1/U2, B-A/B-F), only disk
+    // images have it. allocateBlock fails on a block in use with track and
+    // sector moved to the next free one, 0/0 when the disk is full.
+    virtual bool isBlock( uint8_t track, uint8_t sector ) { return false; };
+    virtual bool readBlock( uint8_t track, uint8_t sector, uint8_t* data ) { return false; };
+    virtual bool writeBlock( uint8_t track, uint8_t sector, uint8_t* data ) { return false; };
+    virtual bool allocateBlock( uint8_t &track, uint8_t &sector ) { return false; };
+    virtual bool freeBlock( uint8_t track, uint8_t sector ) { return false; };
+    // Blocks written and allocated are kept until this writes them out
+    virtual bool flush() { return true; };
+
     MFile* streamFile = nullptr;
     std::string pathInStream;
 
@@ -99,6 +112,8 @@ public:
     virtual bool umount() { return true; };
     virtual bool handles(std::string path) = 0;
     virtual MFile* getFile(std::string path) = 0;
+    // Called while the bus is idle, to let go of what is kept between files
+    virtual void idle() {};
     bool isMounted() {
         return m_isMounted;
     }
@@ -134,6 +149,7 @@ public:
 
     static bool mount(std::string name);
     static bool umount(std::string name);
+    static void idle();
 };
 
 /********************************************************
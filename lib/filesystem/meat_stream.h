@@ -27,6 +27,12 @@ public:
 class MOStream: public MStream {
 public:
     virtual size_t write(const uint8_t *buf, size_t size) = 0;
+
+    // For streams that can be written in place, disk images are updated
+    // sector by sector
+    virtual bool seek(size_t pos) {
+        return false;
+    };
 };
 
 
@@ -63,6 +69,9 @@ public:
 
     virtual bool isBrowsable() { return false; };
     virtual bool isRandomAccess() { return false; };
+
+    // For files made of fixed size records (REL), 0 for anything else
+    virtual uint8_t recordLength() { return 0; };
 };
 
 
@@ -96,4 +96,4 @@ bool CBMImageStream::isOpen() {
 };
 
 
-std::unordered_map<std::string, CBMImageStream*> ImageBroker::repo;
\ No newline at end of file
+std::unordered_map<std::string, std::shared_ptr<CBMImageStream>> ImageBroker::repo;
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <bitset>
 
 #include "string_utils.h"
+#include "cbm_pattern.h"
 
 
 /********************************************************
@@ -101,12 +102,22 @@ private:
     friend class D82File;
     friend class D8BFile;
     friend class DNPFile;
+    friend class D2MFile;
+    friend class DFIFile;
 
     // Tape
     friend class T64File;
+    friend class TAPFile;
     friend class TCRTFile;
 
     // Cartridge
+    friend class CRTFile;
+
+    // Archive
+    friend class ZIPFile;
+    friend class GZFile;
+    friend class SevenZipFile;
+    friend class CBMArchiveFile;
 
 };
 
@@ -116,12 +127,12 @@ private:
  * Utility implementations
  ********************************************************/
 class ImageBroker {
-    static std::unordered_map<std::string, CBMImageStream*> repo;
+    static std::unordered_map<std::string, std::shared_ptr<CBMImageStream>> repo;
 public:
     template<class T> static T* obtain(std::string url) {
         // obviously you have to supply STREAMFILE.url to this function!
         if(repo.find(url)!=repo.end()) {
-            return (T*)repo.at(url);
+            return (T*)repo.at(url).get();
         }
 
         // create and add stream to broker if not found
@@ -138,21 +149,27 @@ public:
             Debug_printv("SINGLE FILE [%s]", url.c_str());
         }
 
-        repo.insert(std::make_pair(url, newStream));
+        repo.insert(std::make_pair(url, std::shared_ptr<CBMImageStream>((CBMImageStream*)newStream)));
         delete newFile;
         return newStream;
     }
 
+    // Same as obtain, for streams that have to outlive a dispose (an image
+    // being written stays alive until its last writer is done with it)
+    template<class T> static std::shared_ptr<T> share(std::string url) {
+        T* stream = obtain<T>(url);
+        if ( stream == nullptr )
+            return nullptr;
+
+        return std::shared_ptr<T>(repo.at(url), stream);
+    }
+
     static CBMImageStream* obtain(std::string url) {
         return obtain<CBMImageStream>(url);
     }
 
     static void dispose(std::string url) {
-        if(repo.find(url)!=repo.end()) {
-            auto toDelete = repo.at(url);
-            repo.erase(url);
-            delete toDelete;
-        }
+        repo.erase(url);
     }
 };
 
@@ -0,0 +1,297 @@
+#include "crt.h"
+
+#define CRT_CHIP_HEADER_SIZE 0x10
+#define CRT_HARDWARE_EASYFLASH 32
+
+/********************************************************
+ * Cartridge index
+ ********************************************************/
+
+bool CRTIStream::readIndex()
+{
+    if ( m_indexRead )
+        return m_banks.size() > 0;
+
+    m_indexRead = true;
+
+    uint8_t raw[0x40];
+    containerStream->seek(0);
+    if ( containerStream->read(raw, sizeof(raw)) != sizeof(raw) || memcmp(raw, "C64 CARTRIDGE", 13) != 0 )
+    {
+        Debug_printv("not a CRT image");
+        return false;
+    }
+
+    uint32_t offset = (raw[0x10] << 24) | (raw[0x11] << 16) | (raw[0x12] << 8) | raw[0x13];
+    hardware_type = (raw[0x16] << 8) | raw[0x17];
+    memcpy(header.cart_name, &raw[0x20], sizeof(header.cart_name));
+
+    // Some images have a wrong header length, the packets start at $40 anyway
+    if ( offset < sizeof(raw) )
+        offset = sizeof(raw);
+
+    // Only remember where each ROM is, the data stays in the container
+    uint8_t chip[CRT_CHIP_HEADER_SIZE];
+    while ( containerStream->seek(offset) && containerStream->read(chip, sizeof(chip)) == sizeof(chip) )
+    {
+        if ( memcmp(chip, "CHIP", 4) != 0 )
+            break;
+
+        uint32_t length = (chip[4] << 24) | (chip[5] << 16) | (chip[6] << 8) | chip[7];
+        uint16_t bank = (chip[0x0A] << 8) | chip[0x0B];
+        uint16_t load_address = (chip[0x0C] << 8) | chip[0x0D];
+        uint16_t size = (chip[0x0E] << 8) | chip[0x0F];
+
+        if ( length < CRT_CHIP_HEADER_SIZE )
+            break;
+
+        // Ultimax ROMH at $E000 shows up at $A000 of the bank
+        if ( load_address == 0xE000 )
+            load_address = 0xA000;
+
+        if ( bank >= m_banks.size() )
+            m_banks.resize(bank + 1);
+        m_banks[bank].push_back({ load_address, size, offset + CRT_CHIP_HEADER_SIZE });
+
+        offset += length;
+    }
+
+    Debug_printv("hardware_type[%d] banks[%d]", hardware_type, m_banks.size());
+
+    if ( hardware_type == CRT_HARDWARE_EASYFLASH )
+        readEasyFS();
+
+    return m_banks.size() > 0;
+}
+
+const CRTIStream::Chip* CRTIStream::findChip(uint16_t bank, uint16_t address)
+{
+    if ( bank >= m_banks.size() )
+        return nullptr;
+
+    for ( auto& chip: m_banks[bank] )
+    {
+        if ( address >= chip.load_address && address < chip.load_address + chip.size )
+            return &chip;
+    }
+
+    return nullptr;
+}
+
+size_t CRTIStream::readLinear(uint32_t address, uint8_t* buf, size_t size)
+{
+    size_t count = 0;
+
+    while ( count < size )
+    {
+        uint16_t bank = address / EASYFS_BANK_SIZE;
+        uint16_t cart_address = 0x8000 + (address % EASYFS_BANK_SIZE);
+
+        auto chip = findChip(bank, cart_address);
+        if ( chip == nullptr )
+        {
+            Debug_printv("bank[%d] address[%04X] not in image", bank, cart_address);
+            break;
+        }
+
+        size_t offset = cart_address - chip->load_address;
+        size_t length = std::min(size - count, (size_t)chip->size - offset);
+
+        containerStream->seek(chip->data_offset + offset);
+        size_t bytes = containerStream->read(buf + count, length);
+
+        count += bytes;
+        address += bytes;
+        if ( bytes < length )
+            break;
+    }
+
+    return count;
+}
+
+bool CRTIStream::readEasyFS()
+{
+    uint8_t table[EASYFS_ENTRY_SIZE * 16];
+    size_t index = 0;
+
+    while ( index < EASYFS_MAX_ENTRIES )
+    {
+        size_t count = std::min((size_t)EASYFS_MAX_ENTRIES - index, sizeof(table) / EASYFS_ENTRY_SIZE);
+        count = readLinear(EASYFS_DIRECTORY_ADDRESS + index * EASYFS_ENTRY_SIZE, table, count * EASYFS_ENTRY_SIZE) / EASYFS_ENTRY_SIZE;
+        if ( count == 0 )
+            break;
+
+        for ( size_t i = 0; i < count; i++ )
+        {
+            uint8_t* raw = &table[i * EASYFS_ENTRY_SIZE];
+            uint8_t type = raw[0x10] & EASYFS_TYPE_MASK;
+
+            if ( type == EASYFS_TYPE_END )
+                return true;
+
+            if ( type == EASYFS_TYPE_NONE || (raw[0x10] & EASYFS_FLAG_HIDDEN && !show_hidden) )
+                continue;
+
+            Entry e;
+            e.filename = std::string((char*)raw, strnlen((char*)raw, 16));
+            e.file_type = ( type == EASYFS_TYPE_PRG ) ? 0x82 : 0x83;
+            e.address = raw[0x11] * EASYFS_BANK_SIZE + (raw[0x13] | (raw[0x14] << 8));
+            e.file_size = raw[0x15] | (raw[0x16] << 8) | ((uint32_t)raw[0x17] << 16);
+            m_files.push_back(e);
+        }
+
+        index += count;
+    }
+
+    Debug_printv("files[%d]", m_files.size());
+    return m_files.size() > 0;
+}
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool CRTIStream::seekEntry( std::string filename )
+{
+    mstr::rtrimA0(filename);
+    mstr::replaceAll(filename, "\\", "/");
+
+    CBMPattern pattern(filename);
+    if ( !pattern.empty() && readIndex() )
+    {
+        for ( size_t index = 0; index < m_files.size(); index++ )
+        {
+            if ( pattern.matches(m_files[index].filename, CBMPattern::fileType(m_files[index].file_type)) )
+                return seekEntry( index + 1 );
+        }
+    }
+
+    entry.filename.clear();
+
+    return false;
+}
+
+bool CRTIStream::seekEntry( size_t index )
+{
+    if ( !readIndex() || index < 1 || index > m_files.size() )
+        return false;
+
+    entry = m_files[index - 1];
+    entry_index = index;
+    return true;
+}
+
+size_t CRTIStream::readFile(uint8_t* buf, size_t size) {
+    size_t bytesRead = readLinear(m_address, buf, std::min(size, m_bytesAvailable));
+
+    m_address += bytesRead;
+    m_bytesAvailable -= bytesRead;
+
+    return bytesRead;
+}
+
+bool CRTIStream::seekPath(std::string path) {
+    // Implement this to skip a queue of file streams to start of file by name
+    // this will cause the next read to return bytes of 'path'
+    seekCalled = true;
+
+    entry_index = 0;
+
+    // call image method to obtain file bytes here, return true on success:
+    mstr::toPETSCII(path);
+    if ( seekEntry(path) )
+    {
+        Debug_printv("filename [%s] address[%06X] size[%d]", entry.filename.c_str(), entry.address, entry.file_size);
+
+        m_length = entry.file_size;
+        m_bytesAvailable = m_length;
+        m_position = 0;
+        m_address = entry.address;
+
+        return true;
+    }
+    else
+    {
+        Debug_printv( "Not found! [%s]", path.c_str());
+    }
+
+    return false;
+};
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+MIStream* CRTFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new CRTIStream(containerIstream);
+}
+
+
+bool CRTFile::isDirectory() {
+    //Debug_printv("pathInStream[%s]", pathInStream.c_str());
+    if ( pathInStream == "" )
+        return true;
+    else
+        return false;
+};
+
+bool CRTFile::rewindDirectory() {
+    dirIsOpen = true;
+    Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
+    auto image = ImageBroker::obtain<CRTIStream>(streamFile->url);
+    if ( image == nullptr )
+        Debug_printv("image pointer is null");
+
+    image->resetEntryCounter();
+
+    // Read Header
+    image->seekHeader();
+
+    // Set Media Info Fields
+    media_header = mstr::format("%.16s", image->header.cart_name);
+    media_id = ( image->hardware_type == CRT_HARDWARE_EASYFLASH ) ? " EFS " : " CRT ";
+    media_blocks_free = 0;
+    media_block_size = image->block_size;
+    media_image = name;
+
+    Debug_printv("media_header[%s] media_id[%s] media_blocks_free[%d] media_block_size[%d] media_image[%s]", media_header.c_str(), media_id.c_str(), media_blocks_free, media_block_size, media_image.c_str());
+
+    return true;
+}
+
+MFile* CRTFile::getNextFileInDir() {
+
+    if(!dirIsOpen)
+        rewindDirectory();
+
+    // Get entry pointed to by containerStream
+    auto image = ImageBroker::obtain<CRTIStream>(streamFile->url);
+
+    if ( image->seekNextImageEntry() )
+    {
+        std::string fileName = image->entry.filename;
+        mstr::replaceAll(fileName, "/", "\\");
+        //Debug_printv( "entry[%s]", (streamFile->url + "/" + fileName).c_str() );
+        auto file = MFSOwner::File(streamFile->url + "/" + fileName);
+        file->extension = image->decodeType(image->entry.file_type);
+        return file;
+    }
+    else
+    {
+        //Debug_printv( "END OF DIRECTORY");
+        dirIsOpen = false;
+        return nullptr;
+    }
+}
+
+
+size_t CRTFile::size() {
+    // Debug_printv("[%s]", streamFile->url.c_str());
+    // use CRT to get size of the file in image
+    auto& entry = ImageBroker::obtain<CRTIStream>(streamFile->url)->entry;
+
+    return entry.file_size;
+}
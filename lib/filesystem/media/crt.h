@@ -2,3 +2,159 @@
 // https://vice-emu.sourceforge.io/vice_17.html#SEC369
 // https://ist.uwaterloo.ca/~schepers/formats/CRT.TXT
 //
+// EasyFlash 3 Cart File System
+// https://skoe.de/easyflash/develdocs/
+// https://bitbucket.org/skoe/easyflash/src/master/
+//
+// $00 - $0F : signature "C64 CARTRIDGE   "
+// $10 - $13 : header length (big endian, like every CRT field)
+// $16 - $17 : hardware type, 32 = EasyFlash
+// $20 - $3F : cartridge name
+//
+// CHIP packets follow the header:
+// $00 - $03 : "CHIP"
+// $04 - $07 : packet length including this header
+// $0A - $0B : bank
+// $0C - $0D : load address
+// $0E - $0F : ROM size
+// $10       : ROM data
+//
+
+
+#ifndef MEATFILESYSTEM_MEDIA_CRT
+#define MEATFILESYSTEM_MEDIA_CRT
+
+#include "meat_io.h"
+#include "cbm_image.h"
+#include "crt/easyfs.h"
+
+#include <vector>
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class CRTIStream : public CBMImageStream {
+    // override everything that requires overriding here
+
+public:
+    CRTIStream(std::shared_ptr<MIStream> is) : CBMImageStream(is) {};
+
+    // Read from the linear cartridge address space, bank * $4000 + offset.
+    // The bytes come straight from the CHIP packets in the container.
+    size_t readLinear(uint32_t address, uint8_t* buf, size_t size);
+
+protected:
+    struct Header {
+        char cart_name[32];
+    };
+
+    struct Chip {
+        uint16_t load_address;
+        uint16_t size;
+        uint32_t data_offset;
+    };
+
+    struct Entry {
+        std::string filename;
+        uint8_t file_type;
+        uint32_t address;       // linear cartridge address
+        uint32_t file_size;
+    };
+
+    void seekHeader() override {
+        readIndex();
+    }
+
+    bool seekNextImageEntry() override {
+        return seekEntry(entry_index + 1);
+    }
+
+    bool seekEntry( std::string filename ) override;
+    bool seekEntry( size_t index ) override;
+
+    size_t readFile(uint8_t* buf, size_t size) override;
+    bool seekPath(std::string path) override;
+
+    Header header;
+    Entry entry;
+    uint16_t hardware_type = 0;
+
+    // One pass over the CHIP packets, then the EasyFS directory if any
+    bool readIndex();
+    bool readEasyFS();
+    const Chip* findChip(uint16_t bank, uint16_t address);
+
+    std::vector<std::vector<Chip>> m_banks;
+    std::vector<Entry> m_files;
+    bool m_indexRead = false;
+
+    uint32_t m_address = 0;
+
+private:
+    friend class CRTFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class CRTFile: public MFile {
+public:
+
+    CRTFile(std::string path, bool is_dir = true): MFile(path) {
+        isDir = is_dir;
+    };
+    
+    ~CRTFile() {
+        // don't close the stream here! It will be used by shared ptr D64Util to keep reading image params
+    }
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+
+    std::string petsciiName() override {
+        // It's already in PETSCII
+        mstr::replaceAll(name, "\\", "/");
+        return name;
+    }
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+    bool mkDir() override { return false; };
+
+    bool exists() override { return true; };
+    bool remove() override { return false; };
+    bool rename(std::string dest) { return false; };
+    time_t getLastWrite() override { return 0; };
+    time_t getCreationTime() override { return 0; };
+    size_t size() override;
+
+    bool isDir = true;
+    bool dirIsOpen = false;
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class CRTFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new CRTFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".crt", fileName);
+    }
+
+    CRTFileSystem(): MFileSystem("crt") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_CRT */
@@ -1,4 +1,37 @@
-// EasyFlash 3 Cart File System
+// EasyFS - EasyFlash Cart File System
 // https://skoe.de/easyflash/develdocs/
 // https://bitbucket.org/skoe/easyflash/src/master/
 //
+// The directory lives in bank 0, ROMH ($A000), right after the 8K of
+// startup code in ROML. Every entry is 24 bytes:
+//
+// $00 - $0F : file name, padded with $00
+// $10       : flags, bits 0-4 type, bit 7 hidden
+// $11       : bank
+// $12       : bank high byte (reserved, always 0)
+// $13 - $14 : offset in the bank, $0000 - $3FFF spans ROML and ROMH
+// $15 - $17 : file size
+//
+// A type of $1F ends the directory. Files are stored like on disk, PRGs
+// include their load address. A file that doesn't fit into a bank
+// continues in ROML of the next one, so bank * $4000 + offset is a
+// linear address into the cartridge.
+//
+
+
+#ifndef MEATFILESYSTEM_MEDIA_CRT_EASYFS
+#define MEATFILESYSTEM_MEDIA_CRT_EASYFS
+
+#define EASYFS_DIRECTORY_ADDRESS 0x2000
+#define EASYFS_ENTRY_SIZE 24
+#define EASYFS_MAX_ENTRIES 255
+
+#define EASYFS_TYPE_MASK 0x1F
+#define EASYFS_TYPE_NONE 0x00
+#define EASYFS_TYPE_PRG 0x01
+#define EASYFS_TYPE_END 0x1F
+#define EASYFS_FLAG_HIDDEN 0x80
+
+#define EASYFS_BANK_SIZE 0x4000
+
+#endif /* MEATFILESYSTEM_MEDIA_CRT_EASYFS */
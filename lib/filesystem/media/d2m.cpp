@@ -0,0 +1,279 @@
+#include "d2m.h"
+
+#include "d71.h"
+#include "d81.h"
+#include "wrappers/offset_stream.h"
+
+// System partition tracks of the FD formats: D1M 81 tracks, D2M and D4M
+// the same with more sectors each
+#define CMD_FD_TRACKS 81
+
+std::unordered_map<std::string, D2MFile::PartitionTable> D2MFile::tables;
+
+
+/********************************************************
+ * Partition table
+ ********************************************************/
+
+bool D2MFile::scanPartitionTable( std::shared_ptr<MIStream> image, size_t from, size_t to, size_t &offset )
+{
+    // The table starts with the system partition's own entry
+    uint8_t buffer[4096];
+    from &= ~(size_t)0xFF;
+    for ( size_t chunk = from; chunk < to; chunk += sizeof(buffer) )
+    {
+        if ( !image->seek(chunk) )
+            return false;
+
+        size_t length = image->read(buffer, std::min(sizeof(buffer), to - chunk));
+        for ( size_t i = 0; i + 0x0B <= length; i += 0x100 )
+        {
+            if ( buffer[i + 2] == 0xFF && memcmp(&buffer[i + 5], "SYSTEM", 6) == 0 )
+            {
+                offset = chunk + i;
+                return true;
+            }
+        }
+
+        if ( length < sizeof(buffer) )
+            break;
+    }
+
+    return false;
+}
+
+bool D2MFile::findPartitionTable( std::shared_ptr<MIStream> image, size_t &offset )
+{
+    // FD disks keep the system partition on an extra last track
+    size_t size = image->size();
+    return scanPartitionTable(image, size - (size / CMD_FD_TRACKS), size, offset);
+}
+
+D2MFile::PartitionTable* D2MFile::partitionTable( std::shared_ptr<MIStream> image )
+{
+    auto found = tables.find(streamFile->url);
+    if ( found != tables.end() && (image == nullptr || image->size() == found->second.image_size) )
+        return &found->second;
+
+    if ( image == nullptr )
+        image.reset(streamFile->inputStream());
+    if ( image == nullptr )
+        return nullptr;
+
+    PartitionTable table;
+    table.image_size = image->size();
+
+    size_t offset;
+    if ( findPartitionTable(image, offset) )
+    {
+        // 8 entries per sector, linked like a directory. The entry number
+        // is the partition number.
+        uint8_t data[256];
+        for ( uint8_t sector = 0; sector < 32; sector++ )
+        {
+            if ( !image->seek(offset + (sector * sizeof(data))) || image->read(data, sizeof(data)) != sizeof(data) )
+                break;
+
+            for ( uint8_t slot = 0; slot < 8; slot++ )
+            {
+                uint8_t *e = &data[slot * 32];
+                if ( e[2] < PART_NATIVE || e[2] > PART_1581 )
+                    continue;
+
+                Partition part;
+                part.number = (sector * 8) + slot;
+                part.type = e[2];
+                part.name = std::string((char *)&e[5], 16);
+                mstr::rtrimA0(part.name);
+                part.offset = (size_t)((e[0x15] << 16) | (e[0x16] << 8) | e[0x17]) * CMD_PARTITION_BLOCK_SIZE;
+                part.size = (size_t)((e[0x1D] << 16) | (e[0x1E] << 8) | e[0x1F]) * CMD_PARTITION_BLOCK_SIZE;
+
+                if ( part.size == 0 || part.offset + part.size > table.image_size )
+                {
+                    Debug_printv("partition[%d] outside the image", part.number);
+                    continue;
+                }
+
+                Debug_printv("partition[%d] type[%d] name[%s] offset[%d] size[%d]", part.number, part.type, part.name.c_str(), part.offset, part.size);
+                table.partitions.push_back(part);
+            }
+
+            if ( data[0] == 0 )
+                break;
+        }
+    }
+
+    if ( table.partitions.empty() )
+    {
+        // No system partition, the whole image is a native one
+        Debug_printv("no partition table [%s]", streamFile->url.c_str());
+        table.partitions.push_back({ 1, PART_NATIVE, "", 0, 0 });
+    }
+
+    tables[streamFile->url] = table;
+    return &tables[streamFile->url];
+}
+
+D2MFile::Partition* D2MFile::partition( std::string &path )
+{
+    auto table = partitionTable();
+    if ( table == nullptr )
+        return nullptr;
+
+    size_t slash = path.find('/');
+    std::string name = path.substr(0, slash);
+    std::string petscii = name;
+    mstr::toPETSCII(petscii);
+
+    for ( auto &part : table->partitions )
+    {
+        if ( name == std::to_string(part.number) || (part.name.size() && (name == part.name || petscii == part.name)) )
+        {
+            path = (slash == std::string::npos) ? "" : path.substr(slash + 1);
+            return &part;
+        }
+    }
+
+    return &table->partitions[0];
+}
+
+MIStream* D2MFile::partitionStream( std::shared_ptr<MIStream> image, Partition* part )
+{
+    if ( part == nullptr )
+        return nullptr;
+
+    auto view = std::make_shared<OffsetIStream>(image, part->offset, part->size);
+    switch ( part->type )
+    {
+        case PART_NATIVE:
+            return new DNPIStream(view, streamFile->url + "/" + std::to_string(part->number));
+        case PART_1541:
+            return new D64IStream(view);
+        case PART_1571:
+            return new D71IStream(view);
+        case PART_1581:
+            return new D81IStream(view);
+    }
+
+    return nullptr;
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+MIStream* D2MFile::inputStream(std::shared_ptr<MIStream> containerStream) {
+    // has to return OPENED stream
+    Debug_printv("pathInStream[%s] streamFile[%s]", pathInStream.c_str(), streamFile->url.c_str());
+
+    if ( containerStream == nullptr || partitionTable(containerStream) == nullptr )
+        return nullptr;
+
+    std::string path = pathInStream;
+    MIStream* decodedStream = partitionStream(containerStream, partition(path));
+    if ( decodedStream != nullptr && path != "" && !decodedStream->seekPath(path) )
+    {
+        Debug_printv("path in stream not found");
+        delete decodedStream;
+        return nullptr;
+    }
+
+    return decodedStream;
+}
+
+MIStream* D2MFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    std::string path;
+    partitionTable(containerIstream);
+    return partitionStream(containerIstream, partition(path));
+}
+
+MOStream* D2MFile::outputStream() {
+    std::string path = pathInStream;
+    auto part = partition(path);
+    if ( part == nullptr || part->type == PART_NATIVE )
+        return nullptr;
+
+    return D64File::outputStream();
+}
+
+std::shared_ptr<MOStream> D2MFile::imageOStream() {
+    std::string path = pathInStream;
+    auto part = partition(path);
+    auto ostream = D64File::imageOStream();
+    if ( part == nullptr || ostream == nullptr )
+        return nullptr;
+
+    return std::make_shared<OffsetOStream>(ostream, part->offset);
+}
+
+bool D2MFile::remove() {
+    std::string path = pathInStream;
+    auto part = partition(path);
+    if ( part == nullptr || part->type == PART_NATIVE || path == "" )
+        return false;
+
+    return D64File::remove();
+}
+
+bool D2MFile::isDirectory() {
+    if ( pathInStream == "" )
+        return true;
+
+    // A partition
+    std::string path = pathInStream;
+    if ( partition(path) != nullptr && path == "" )
+        return true;
+
+    return DNPFile::isDirectory();
+}
+
+bool D2MFile::rewindDirectory() {
+    if ( pathInStream != "" )
+        return D64File::rewindDirectory();
+
+    // The image root lists the partitions
+    dirIsOpen = true;
+    m_partitionIndex = 0;
+
+    media_header = name;
+    mstr::toPETSCII(media_header);
+    media_id = image_id;
+    media_blocks_free = 0;
+    media_block_size = 256;
+    media_image = name;
+
+    return partitionTable() != nullptr;
+}
+
+MFile* D2MFile::getNextFileInDir() {
+    if ( pathInStream != "" )
+        return D64File::getNextFileInDir();
+
+    if ( !dirIsOpen )
+        rewindDirectory();
+
+    auto table = partitionTable();
+    if ( table == nullptr || m_partitionIndex >= table->partitions.size() )
+    {
+        dirIsOpen = false;
+        return nullptr;
+    }
+
+    auto &part = table->partitions[m_partitionIndex++];
+    std::string partName = part.name.size() ? part.name : std::to_string(part.number);
+    mstr::replaceAll(partName, "/", "\\");
+
+    return MFSOwner::File(streamFile->url + "/" + partName);
+}
+
+size_t D2MFile::size() {
+    std::string path = pathInStream;
+    auto part = partition(path);
+    if ( part != nullptr && pathInStream != "" && path == "" )
+        return part->size ? part->size : partitionTable()->image_size;
+
+    return D64File::size();
+}
@@ -1,2 +1,107 @@
+// .D1M/.D2M - CMD FD-2000 disk images (DD/HD)
+// https://ist.uwaterloo.ca/~schepers/formats/D2M-DNP.TXT
+// https://cbm8bit.com/8bit/commodore/server/Unrenamed%20Achives/browse/c64/d2m
+//
+// A raw dump of a partitioned CMD disk. The system partition holds the
+// partition table, 32 byte entries laid out like directory entries: type
+// at $02, name at $05, start at $15 and size at $1D, both big endian in
+// 512 byte blocks. On FD disks it is on the extra track at the end of the
+// image (D4M adds the FD-4000 ED disks, DHD the CMD HD, see there).
+//
+// Partitions are the directories of the image. "IMAGE/2/FILE" or
+// "IMAGE/GAMES/FILE" is a file in partition 2 named GAMES, a path that
+// doesn't start with a partition is in the first one. Each partition is
+// handed to the stream of its kind (DNP, D64, D71, D81) through an
+// OffsetIStream. The table is read once per image and kept, so changing
+// partitions (CP) is a lookup.
+//
 
-// https://cbm8bit.com/8bit/commodore/server/Unrenamed%20Achives/browse/c64/d2m
\ No newline at end of file
+#ifndef MEATFILESYSTEM_MEDIA_D2M
+#define MEATFILESYSTEM_MEDIA_D2M
+
+#include "meat_io.h"
+#include "dnp.h"
+
+#include <unordered_map>
+
+
+#define CMD_PARTITION_BLOCK_SIZE 512
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class D2MFile: public DNPFile {
+public:
+    D2MFile(std::string path, const char* id = "fd", bool is_dir = true) : DNPFile(path, is_dir), image_id(id) {};
+
+    using DNPFile::inputStream;
+    MIStream* inputStream(std::shared_ptr<MIStream> containerStream) override;
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+    MOStream* outputStream() override;
+    std::shared_ptr<MOStream> imageOStream() override;
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+
+    bool remove() override;
+    size_t size() override;
+
+protected:
+    enum partition_types { PART_NONE, PART_NATIVE, PART_1541, PART_1571, PART_1581 };
+
+    struct Partition {
+        uint8_t number;
+        uint8_t type;
+        std::string name;   // PETSCII
+        size_t offset;
+        size_t size;
+    };
+
+    struct PartitionTable {
+        size_t image_size;
+        std::vector<Partition> partitions;  // the ones we can read, in order
+    };
+
+    // Image url -> partition table
+    static std::unordered_map<std::string, PartitionTable> tables;
+
+    // Where the partition table is in the image
+    virtual bool findPartitionTable( std::shared_ptr<MIStream> image, size_t &offset );
+    static bool scanPartitionTable( std::shared_ptr<MIStream> image, size_t from, size_t to, size_t &offset );
+
+    // Read on first use, an image without a table is one native partition
+    PartitionTable* partitionTable( std::shared_ptr<MIStream> image = nullptr );
+
+    // The partition path starts with. It is taken off path, anything else
+    // is in the first partition and path stays as it is.
+    Partition* partition( std::string &path );
+    MIStream* partitionStream( std::shared_ptr<MIStream> image, Partition* part );
+
+    const char* image_id;
+    size_t m_partitionIndex = 0;
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class D2MFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new D2MFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".d1m", fileName) || byExtension(".d2m", fileName);
+    }
+
+    D2MFileSystem(): MFileSystem("d2m") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_D2M */
@@ -0,0 +1,33 @@
+// .D4M - CMD FD-4000 disk image (ED)
+// https://ist.uwaterloo.ca/~schepers/formats/D2M-DNP.TXT
+//
+// Same layout as D2M with twice the sectors per track, see d2m.h.
+//
+
+#ifndef MEATFILESYSTEM_MEDIA_D4M
+#define MEATFILESYSTEM_MEDIA_D4M
+
+#include "meat_io.h"
+#include "d2m.h"
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class D4MFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new D2MFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".d4m", fileName);
+    }
+
+    D4MFileSystem(): MFileSystem("d4m") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_D4M */
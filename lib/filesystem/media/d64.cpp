@@ -1,14 +1,16 @@
 
 #include "d64.h"
 
+#include <algorithm>
+
+D64IStream::RecordIndex D64IStream::vlir_index;
+
 
 // D64 Utility Functions
 
-bool D64IStream::seekSector( uint8_t track, uint8_t sector, size_t offset )
+uint32_t D64IStream::blockIndex( uint8_t track, uint8_t sector )
 {
-	uint16_t sectorOffset = 0;
-
-    //Debug_printv("track[%d] sector[%d] offset[%d]", track, sector, offset);
+	uint32_t sectorOffset = 0;
 
     track--;
 	for (uint8_t index = 0; index < track; ++index)
@@ -16,12 +18,18 @@ bool D64IStream::seekSector( uint8_t track, uint8_t sector, size_t offset )
 		sectorOffset += sectorsPerTrack[speedZone(index)];
         //Debug_printv("track[%d] speedZone[%d] secotorsPerTrack[%d] sectorOffset[%d]", (index + 1), speedZone(index), sectorsPerTrack[speedZone(index)], sectorOffset);
 	}
-	sectorOffset += sector;
 
-    this->track = track + 1;
+	return sectorOffset + sector;
+}
+
+bool D64IStream::seekSector( uint8_t track, uint8_t sector, size_t offset )
+{
+    //Debug_printv("track[%d] sector[%d] offset[%d]", track, sector, offset);
+
+    this->track = track;
     this->sector = sector;
 
-    return containerStream->seek( (sectorOffset * block_size) + offset );
+    return containerStream->seek( (blockIndex(track, sector) * block_size) + offset );
 }
 
 bool D64IStream::seekSector( std::vector<uint8_t> trackSectorOffset )
@@ -32,268 +40,1489 @@ bool D64IStream::seekSector( std::vector<uint8_t> trackSectorOffset )
 
 std::string D64IStream::readBlock(uint8_t track, uint8_t sector)
 {
-    return "";
+    auto dirty = m_dirty.find(blockIndex(track, sector));
+    if ( dirty != m_dirty.end() )
+        return dirty->second;
+
+    std::string data(block_size, '\0');
+    if ( !seekSector(track, sector) )
+        return "";
+
+    size_t length = containerStream->read((uint8_t *)&data[0], block_size);
+    if ( length != block_size )
+    {
+        Debug_printv("track[%d] sector[%d] short read[%d]", track, sector, length);
+        return "";
+    }
+
+    return data;
 }
 
 bool D64IStream::writeBlock(uint8_t track, uint8_t sector, std::string data)
 {
+    if ( !loadBAM() || track == 0 || track >= m_bam.size() || sector >= sectorsInTrack(track) )
+        return false;
+
+    data.resize(block_size, '\0');
+    m_dirty[blockIndex(track, sector)] = data;
     return true;
 }
 
 bool D64IStream::allocateBlock( uint8_t track, uint8_t sector)
 {
+    if ( !isFree(track, sector) )
+        return false;
+
+    m_bam[track][sector / 8] &= ~(1 << (sector % 8));
+    m_bamDirty = true;
+    return true;
+}
+
+bool D64IStream::deallocateBlock( uint8_t track, uint8_t sector)
+{
+    if ( !loadBAM() || track == 0 || track >= m_bam.size() || sector >= sectorsInTrack(track) )
+        return false;
+
+    m_bam[track][sector / 8] |= (1 << (sector % 8));
+    m_bamDirty = true;
+    return true;
+}
+
+bool D64IStream::isBlock( uint8_t track, uint8_t sector )
+{
+    if ( track == 0 || sector >= sectorsInTrack(track) )
+        return false;
+
+    return (blockIndex(track, sector) + 1) * block_size <= containerStream->size();
+}
+
+
+bool D64IStream::loadBAM()
+{
+    if ( m_bam.size() )
+        return true;
+
+    uint8_t tracks = 0;
+    for ( auto &map : block_allocation_map )
+        tracks = std::max(tracks, map.end_track);
+
+    m_bam.resize(tracks + 1);
+    for ( auto &map : block_allocation_map )
+    {
+        std::string data = readBlock(map.track, map.sector);
+        if ( data.empty() )
+        {
+            m_bam.clear();
+            return false;
+        }
+
+        for ( uint8_t i = map.start_track; i <= map.end_track; i++ )
+        {
+            // The free count comes first if there is room for it
+            uint8_t bytes = (sectorsInTrack(i) + 7) / 8;
+            size_t offset = map.offset + ((i - map.start_track) * map.byte_count) + (map.byte_count > bytes);
+            if ( offset + bytes > block_size )
+                break;
+
+            m_bam[i].assign(data.begin() + offset, data.begin() + offset + bytes);
+        }
+    }
+
+    return true;
+}
+
+bool D64IStream::writeBAM()
+{
+    for ( auto &map : block_allocation_map )
+    {
+        std::string data = readBlock(map.track, map.sector);
+        if ( data.empty() )
+            return false;
+
+        for ( uint8_t i = map.start_track; i <= map.end_track; i++ )
+        {
+            uint8_t bytes = m_bam[i].size();
+            size_t offset = map.offset + ((i - map.start_track) * map.byte_count);
+            if ( bytes == 0 || offset + map.byte_count > block_size )
+                continue;
+
+            if ( map.byte_count > bytes )
+            {
+                uint8_t free_count = 0;
+                for ( auto bits : m_bam[i] )
+                    free_count += std::bitset<8>(bits).count();
+                data[offset++] = free_count;
+            }
+            std::copy(m_bam[i].begin(), m_bam[i].end(), data.begin() + offset);
+        }
+
+        writeBlock(map.track, map.sector, data);
+    }
+
+    return true;
+}
+
+bool D64IStream::isFree( uint8_t track, uint8_t sector )
+{
+    if ( !loadBAM() || track == 0 || track >= m_bam.size() || sector >= sectorsInTrack(track) )
+        return false;
+
+    if ( m_bam[track].size() <= sector / 8 )
+        return false;
+
+    return m_bam[track][sector / 8] & (1 << (sector % 8));
+}
+
+bool D64IStream::nextFreeSector( uint8_t track, uint8_t &sector, uint8_t interleave )
+{
+    uint8_t sectors = sectorsInTrack(track);
+
+    // Step over the sectors passing the head while the last one is
+    // processed, wrapping like the 1541 does
+    uint16_t next = sector + interleave;
+    if ( next >= sectors )
+    {
+        next -= sectors;
+        if ( next > 0 )
+            next--;
+    }
+
+    for ( uint8_t i = 0; i < sectors; i++ )
+    {
+        uint8_t s = (next + i) % sectors;
+        if ( isFree(track, s) )
+        {
+            sector = s;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool D64IStream::nextFreeBlock( uint8_t &track, uint8_t &sector )
+{
+    if ( !loadBAM() )
+        return false;
+
+    int16_t directory_track = directory_list_offset[0];
+    int16_t last_track = m_bam.size() - 1;
+    uint8_t s = 0;
+
+    if ( track == 0 )
+    {
+        // New file, nearest track to the directory, below it first
+        for ( int16_t distance = 1; distance < last_track; distance++ )
+        {
+            for ( int16_t t : { directory_track - distance, directory_track + distance } )
+            {
+                if ( t > 0 && t <= last_track && nextFreeSector(t, s, 0) )
+                {
+                    track = t;
+                    sector = s;
+                    return true;
+                }
+            }
+        }
+    }
+    else
+    {
+        // Keep going on this track
+        if ( nextFreeSector(track, sector, file_interleave) )
+            return true;
+
+        // Then further away from the directory, then the other side
+        int16_t direction = (track > directory_track) ? 1 : -1;
+        int16_t t = track;
+        for ( uint8_t pass = 0; pass < 2; pass++ )
+        {
+            for ( t += direction; t > 0 && t <= last_track; t += direction )
+            {
+                if ( t != directory_track && nextFreeSector(t, s, 0) )
+                {
+                    track = t;
+                    sector = s;
+                    return true;
+                }
+            }
+
+            direction = -direction;
+            t = directory_track;
+        }
+    }
+
+    Debug_printv("disk full");
+    return false;
+}
+
+bool D64IStream::findSlot( std::string filename, Entry &slot, uint8_t &track, uint8_t &sector, uint8_t &offset )
+{
+    uint8_t t = directory_list_offset[0];
+    uint8_t s = directory_list_offset[1];
+
+    for ( uint16_t count = 0; t && count < 256; count++ )
+    {
+        std::string data = readBlock(t, s);
+        if ( data.empty() )
+            return false;
+
+        for ( uint16_t o = 0; o < block_size; o += sizeof(Entry) )
+        {
+            memcpy(&slot, &data[o], sizeof(Entry));
+
+            bool found = false;
+            if ( filename.empty() )
+            {
+                found = (slot.file_type == 0x00);
+            }
+            else if ( slot.file_type != 0x00 )
+            {
+                std::string entryFilename(slot.filename, sizeof(slot.filename));
+                mstr::rtrimA0(entryFilename);
+                found = (entryFilename == filename);
+            }
+
+            if ( found )
+            {
+                track = t;
+                sector = s;
+                offset = o;
+                return true;
+            }
+        }
+
+        if ( (uint8_t)data[0] == 0 )
+            break;
+
+        t = data[0];
+        s = data[1];
+    }
+
+    if ( !filename.empty() || t == 0 )
+        return false;
+
+    // Directory is full, link a new sector on the directory track
+    uint8_t next = s;
+    if ( !nextFreeSector(t, next, directory_interleave) || !allocateBlock(t, next) )
+    {
+        Debug_printv("directory full");
+        return false;
+    }
+
+    std::string data = readBlock(t, s);
+    data[0] = t;
+    data[1] = next;
+    writeBlock(t, s, data);
+
+    data.assign(block_size, '\0');
+    data[1] = 0xFF;
+    writeBlock(t, next, data);
+
+    memset(&slot, 0, sizeof(Entry));
+    track = t;
+    sector = next;
+    offset = 0;
+    return true;
+}
+
+bool D64IStream::writeEntry( Entry &slot, uint8_t track, uint8_t sector, uint8_t offset )
+{
+    std::string data = readBlock(track, sector);
+    if ( data.empty() )
+        return false;
+
+    // The first two bytes of a slot are the sector link in the first one,
+    // leave them alone
+    memcpy(&data[offset + 2], (uint8_t *)&slot + 2, sizeof(Entry) - 2);
+    return writeBlock(track, sector, data);
+}
+
+bool D64IStream::scratchEntry( std::string filename )
+{
+    Entry slot;
+    uint8_t t, s, o;
+
+    if ( !loadBAM() || !findSlot(filename, slot, t, s, o) )
+        return false;
+
+    // Give back the blocks of the file, the chain ends on track 0. REL
+    // files also have their side sectors, GEOS files their info block and
+    // VLIR files a chain per record.
+    if ( readSideSectors(slot) )
+    {
+        for ( auto &side : m_sideSectors )
+            deallocateBlock(side.first, side.second);
+
+        // 1581 super side sector in front of them
+        if ( m_sideSectors.empty() || m_sideSectors[0].first != slot.rel_start_track || m_sideSectors[0].second != slot.rel_start_sector )
+            deallocateBlock(slot.rel_start_track, slot.rel_start_sector);
+    }
+    else if ( slot.geos_type )
+    {
+        if ( readRecordIndex(slot) )
+        {
+            for ( auto &record : vlir_index.records )
+                freeChain(record.first, record.second);
+            vlir_index = RecordIndex();
+        }
+
+        freeChain(slot.rel_start_track, slot.rel_start_sector);
+    }
+
+    freeChain(slot.start_track, slot.start_sector);
+
+    slot.file_type = 0x00;
+    return writeEntry(slot, t, s, o);
+}
+
+bool D64IStream::renameEntry( std::string filename, std::string newname )
+{
+    Entry slot;
+    uint8_t t, s, o;
+
+    if ( newname.empty() || newname.size() > sizeof(slot.filename) || findSlot(newname, slot, t, s, o) )
+        return false;
+
+    if ( !findSlot(filename, slot, t, s, o) )
+        return false;
+
+    memset(slot.filename, 0xA0, sizeof(slot.filename));
+    memcpy(slot.filename, newname.data(), newname.size());
+    return writeEntry(slot, t, s, o);
+}
+
+bool D64IStream::readSideSectors( Entry &rel )
+{
+    m_dataBlocks.clear();
+    m_sideSectors.clear();
+    m_recordLength = 0;
+
+    if ( (rel.file_type & 0b00000111) != 0x04 )
+        return false;
+
+    uint8_t t = rel.rel_start_track;
+    uint8_t s = rel.rel_start_sector;
+    for ( uint16_t count = 0; t && count < 256; count++ )
+    {
+        std::string data = readBlock(t, s);
+        if ( data.empty() )
+            return false;
+
+        // 1581 super side sector, the side sectors are linked behind it
+        if ( (uint8_t)data[2] == 0xFE )
+        {
+            t = data[0];
+            s = data[1];
+            continue;
+        }
+
+        m_sideSectors.push_back(std::make_pair(t, s));
+
+        // 120 data blocks per side sector, the last one ends at its link byte
+        size_t end = data[0] ? block_size : (uint8_t)data[1] + 1;
+        for ( size_t offset = 16; offset + 1 < end && data[offset]; offset += 2 )
+            m_dataBlocks.push_back(std::make_pair((uint8_t)data[offset], (uint8_t)data[offset + 1]));
+
+        t = data[0];
+        s = data[1];
+    }
+
+    m_recordLength = rel.rel_record_length;
+    return m_recordLength > 0;
+}
+
+bool D64IStream::addRelativeBlock( Entry &rel )
+{
+    uint8_t t = 0;
+    uint8_t s = 0;
+    if ( m_dataBlocks.size() )
+    {
+        t = m_dataBlocks.back().first;
+        s = m_dataBlocks.back().second;
+    }
+
+    uint8_t last_track = t;
+    uint8_t last_sector = s;
+    if ( !nextFreeBlock(t, s) || !allocateBlock(t, s) )
+        return false;
+
+    size_t index = m_dataBlocks.size();
+    size_t side = index / 120;
+    if ( side >= m_sideSectors.size() )
+    {
+        // Six side sectors is all a side sector can list
+        uint8_t st = t;
+        uint8_t ss = s;
+        if ( side >= 6 || !nextFreeBlock(st, ss) || !allocateBlock(st, ss) )
+        {
+            Debug_printv("REL file full");
+            deallocateBlock(t, s);
+            return false;
+        }
+
+        std::string data(block_size, '\0');
+        data[2] = side;
+        data[3] = m_recordLength;
+        writeBlock(st, ss, data);
+        rel.blocks++;
+
+        if ( side )
+        {
+            data = readBlock(m_sideSectors.back().first, m_sideSectors.back().second);
+            data[0] = st;
+            data[1] = ss;
+            writeBlock(m_sideSectors.back().first, m_sideSectors.back().second, data);
+        }
+        else if ( super_side_sector )
+        {
+            uint8_t xt = st;
+            uint8_t xs = ss;
+            if ( !nextFreeBlock(xt, xs) || !allocateBlock(xt, xs) )
+                return false;
+
+            data.assign(block_size, '\0');
+            data[0] = st;
+            data[1] = ss;
+            data[2] = 0xFE;
+            data[3] = st;
+            data[4] = ss;
+            writeBlock(xt, xs, data);
+            rel.blocks++;
+
+            rel.rel_start_track = xt;
+            rel.rel_start_sector = xs;
+        }
+        else
+        {
+            rel.rel_start_track = st;
+            rel.rel_start_sector = ss;
+        }
+        m_sideSectors.push_back(std::make_pair(st, ss));
+
+        // Every side sector lists all of them
+        for ( auto &side_sector : m_sideSectors )
+        {
+            data = readBlock(side_sector.first, side_sector.second);
+            for ( size_t i = 0; i < m_sideSectors.size(); i++ )
+            {
+                data[4 + (i * 2)] = m_sideSectors[i].first;
+                data[5 + (i * 2)] = m_sideSectors[i].second;
+            }
+            writeBlock(side_sector.first, side_sector.second, data);
+        }
+    }
+
+    // Point the side sector at the block, its link byte at the pointer
+    auto &side_sector = m_sideSectors[side];
+    std::string data = readBlock(side_sector.first, side_sector.second);
+    size_t offset = 16 + ((index % 120) * 2);
+    data[1] = offset + 1;
+    data[offset] = t;
+    data[offset + 1] = s;
+    writeBlock(side_sector.first, side_sector.second, data);
+
+    if ( index )
+    {
+        data = readBlock(last_track, last_sector);
+        data[0] = t;
+        data[1] = s;
+        writeBlock(last_track, last_sector, data);
+    }
+
+    data.assign(block_size, '\0');
+    data[1] = 1;
+    writeBlock(t, s, data);
+
+    m_dataBlocks.push_back(std::make_pair(t, s));
+    rel.blocks++;
     return true;
 }
 
-bool D64IStream::deallocateBlock( uint8_t track, uint8_t sector)
-{
+size_t D64IStream::relativeLength()
+{
+    if ( m_dataBlocks.empty() )
+        return 0;
+
+    std::string data = readBlock(m_dataBlocks.back().first, m_dataBlocks.back().second);
+    if ( data.empty() )
+        return 0;
+
+    // Link byte of the last block is the index of its last used byte
+    uint8_t lsu = data[1];
+    return ((m_dataBlocks.size() - 1) * (block_size - 2)) + ((lsu >= 2) ? lsu - 1 : 0);
+}
+
+bool D64IStream::flush( MOStream* out )
+{
+    // An OffsetOStream over a stream that can't seek isn't open, the
+    // changes stay here rather than go out as a truncated image
+    if ( out == nullptr || !out->isOpen() )
+    {
+        Debug_printv("image can't be written");
+        return false;
+    }
+
+    if ( m_bamDirty && !writeBAM() )
+        return false;
+
+    // Sectors to write instead of what's in m_dirty
+    std::map<uint32_t, std::string> held;
+    holdWriters(held);
+
+    bool success = true;
+    if ( out->seek(0) )
+    {
+        // In place, one write per changed sector
+        for ( auto &dirty : m_dirty )
+        {
+            auto sector = held.find(dirty.first);
+            const std::string &data = (sector != held.end()) ? sector->second : dirty.second;
+            if ( !out->seek(dirty.first * block_size) || out->write((uint8_t *)data.data(), block_size) != block_size )
+            {
+                Debug_printv("write failed at block[%d]", dirty.first);
+                success = false;
+                break;
+            }
+        }
+    }
+    else
+    {
+        // Stream can't seek, send the whole image in one pass
+        std::string data(block_size, '\0');
+        size_t size = containerStream->size();
+        containerStream->seek(0);
+        for ( size_t pos = 0; pos < size; pos += block_size )
+        {
+            size_t length = std::min(block_size, size - pos);
+            auto dirty = m_dirty.find(pos / block_size);
+            if ( dirty != m_dirty.end() && length == block_size )
+            {
+                auto sector = held.find(dirty->first);
+                data = (sector != held.end()) ? sector->second : dirty->second;
+                containerStream->seek(pos + block_size);
+            }
+            else if ( containerStream->read((uint8_t *)&data[0], length) != length )
+            {
+                success = false;
+                break;
+            }
+
+            if ( out->write((uint8_t *)data.data(), length) != length )
+            {
+                success = false;
+                break;
+            }
+        }
+    }
+
+    Debug_printv("blocks[%d] bam[%d] writers[%d] success[%d]", m_dirty.size(), m_bamDirty, m_writers.size(), success);
+
+    // Files still being written need their sectors until they are closed
+    if ( m_writers.empty() )
+        m_dirty.clear();
+    m_bamDirty = false;
+    return success;
+}
+
+void D64IStream::holdWriters( std::map<uint32_t, std::string> &held )
+{
+    // REL files are written in place, their entries are complete
+    std::vector<D64OStream*> open;
+    for ( auto writer : m_writers )
+    {
+        if ( writer->m_isOpen && !writer->m_recordLength )
+            open.push_back(writer);
+    }
+
+    if ( open.empty() )
+        return;
+
+    // Their directory slots are left empty
+    for ( auto writer : open )
+    {
+        uint32_t index = blockIndex(writer->m_entryTrack, writer->m_entrySector);
+        if ( held.find(index) == held.end() )
+            held[index] = readBlock(writer->m_entryTrack, writer->m_entrySector);
+
+        std::string &data = held[index];
+        if ( data.size() == block_size )
+            memset(&data[writer->m_entryOffset + 2], 0, sizeof(Entry) - 2);
+    }
+
+    // and their blocks free in the BAM
+    for ( auto writer : open )
+    {
+        for ( auto &block : writer->m_chain )
+            deallocateBlock(block.first, block.second);
+    }
+    writeBAM();
+    for ( auto &map : block_allocation_map )
+        held[blockIndex(map.track, map.sector)] = readBlock(map.track, map.sector);
+
+    for ( auto writer : open )
+    {
+        for ( auto &block : writer->m_chain )
+            allocateBlock(block.first, block.second);
+    }
+    writeBAM();
+}
+
+bool D64IStream::seekEntry( std::string filename )
+{
+    mstr::rtrimA0(filename);
+    mstr::replaceAll(filename, "\\", "/");
+
+    return seekEntry( CBMPattern(filename) );
+}
+
+bool D64IStream::seekEntry( const CBMPattern &pattern )
+{
+    size_t index = 1;
+
+    // Read Directory Entries
+    if ( !pattern.empty() )
+    {
+        while ( seekEntry( index ) || entry_index == index )
+        {
+            if ( entry.file_type == 0x00 )
+            {
+                // Scratched
+                index++;
+                continue;
+            }
+
+            if ( pattern.matches(entry.filename, sizeof(entry.filename), CBMPattern::fileType(entry.file_type)) )
+            {
+                // Move stream pointer to start track/sector
+                return true;
+            }
+            index++;
+        }
+    }
+
+    entry.next_track = 0;
+    entry.next_sector = 0;
+    entry.blocks = 0;
+    entry.filename[0] = '\0';
+
+    return false;
+}
+
+bool D64IStream::seekEntry( size_t index )
+{
+    bool r = false;
+
+    // Calculate Sector offset & Entry offset
+    // 8 Entries Per Sector, 32 bytes Per Entry
+    index--;
+    uint8_t sectorOffset = index / 8;
+    uint8_t entryOffset = (index % 8) * 32;
+
+    //Debug_printv("----------");
+    //Debug_printv("index[%d] sectorOffset[%d] entryOffset[%d] entry_index[%d]", index, sectorOffset, entryOffset, entry_index);
+
+
+    if (index == 0 || index != entry_index)
+    {
+        // Start at first sector of directory
+        next_track = 0;
+        r = seekSector( directory_list_offset );
+
+        // Find sector with requested entry
+        do
+        {
+            if ( next_track )
+            {
+                //Debug_printv("next_track[%d] next_sector[%d]", entry.next_track, entry.next_sector);
+                r = seekSector( entry.next_track, entry.next_sector, 0x00 );
+            }
+
+            containerStream->read((uint8_t *)&entry, sizeof(entry));
+            next_track = entry.next_track;
+            next_sector = entry.next_sector;
+
+            //Debug_printv("sectorOffset[%d] -> track[%d] sector[%d]", sectorOffset, track, sector);
+        } while ( sectorOffset-- > 0 );
+        r = seekSector( track, sector, entryOffset );
+    }
+    else
+    {
+        if ( entryOffset == 0 )
+        {
+            if ( next_track == 0 )
+                return false;
+
+            //Debug_printv("Follow link track[%d] sector[%d] entryOffset[%d]", next_track, next_sector, entryOffset);
+            r = seekSector( next_track, next_sector, entryOffset );
+        }
+    }
+
+    containerStream->read((uint8_t *)&entry, sizeof(entry));
+
+    // If we are at the first entry in the sector then get next_track/next_sector
+    if ( entryOffset == 0 )
+    {
+        next_track = entry.next_track;
+        next_sector = entry.next_sector;
+    }
+
+    //Debug_printv("r[%d] file_type[%02X] file_name[%.16s]", r, entry.file_type, entry.filename);
+
+    //if ( next_track == 0 && next_sector == 0xFF )
+    entry_index = index + 1;
+    if ( entry.file_type == 0x00 )
+        return false;
+    else
+        return true;
+}
+
+
+uint16_t D64IStream::blocksFree()
+{
+    uint16_t free_count = 0;
+
+    for(uint8_t x = 0; x < block_allocation_map.size(); x++)
+    {
+        uint8_t bam[block_allocation_map[x].byte_count] = { 0 };
+        Debug_printv("start_track[%d] end_track[%d]", block_allocation_map[x].start_track, block_allocation_map[x].end_track);
+
+        seekSector(block_allocation_map[x].track, block_allocation_map[x].sector, block_allocation_map[x].offset);
+        for(uint8_t i = block_allocation_map[x].start_track; i <= block_allocation_map[x].end_track; i++)
+        {
+            containerStream->read((uint8_t *)&bam, sizeof(bam));
+            if ( sizeof(bam) > 3 )
+            {
+                if ( i != directory_list_offset[0] )
+                {
+                    Debug_printv("x[%d] track[%d] count[%d] size[%d]", x, i, bam[0], sizeof(bam));
+                    free_count += bam[0];
+                }
+            }
+            else
+            {
+                // D71 tracks 36 - 70 you have to count the 1 bits (0 is allocated)
+                uint8_t bit_count = 0;
+                bit_count += std::bitset<8>(bam[0]).count();
+                bit_count += std::bitset<8>(bam[1]).count();
+                bit_count += std::bitset<8>(bam[2]).count();
+
+                //Debug_printv("x[%d] track[%d] count[%d] size[%d] bam0[%d] bam1[%d] bam2[%d] (counting 1 bits)", x, i, bit_count, sizeof(bam), bam[0], bam[1], bam[2]);
+                free_count += bit_count;
+            }
+        }
+    }
+
+    return free_count;
+}
+
+size_t D64IStream::readFile(uint8_t* buf, size_t size) {
+    size_t bytesRead = 0;
+
+    if ( m_bytesAvailable == 0 )
+        return 0;
+
+    // Another file of the image may have moved the container
+    size_t offset = sector_offset % block_size;
+    if ( containerStream->position() != (blockIndex(track, sector) * block_size) + offset )
+        seekSector( track, sector, offset );
+
+    if ( sector_offset % block_size == 0 )
+    {
+        // We are at the beginning of the block
+        // Read track/sector link
+        containerStream->read((uint8_t *)&next_track, 1);
+        containerStream->read((uint8_t *)&next_sector, 1);
+        sector_offset += 2;
+        //Debug_printv("next_track[%d] next_sector[%d] sector_offset[%d]", next_track, next_sector, sector_offset);
+    }
+
+    // Stay inside this block, the link says where the file goes on
+    size = std::min(size, block_size - sector_offset);
+    size = std::min(size, m_bytesAvailable);
+
+    bytesRead += containerStream->read(buf, size);
+    sector_offset += bytesRead;
+    m_bytesAvailable -= bytesRead;
+
+    if ( sector_offset % block_size == 0 )
+    {
+        // We are at the end of the block
+        // Follow track/sector link to move to next block
+        seekSector( next_track, next_sector );
+        //Debug_printv("track[%d] sector[%d] sector_offset[%d]", track, sector, sector_offset);
+    }
+
+    // if ( !bytesRead )
+    // {
+    //     sector_offset = 0;
+    // }
+
+    return bytesRead;
+}
+
+
+bool D64IStream::seek(size_t pos) {
+    // Not pointing at a file, the image itself is being read
+    if ( !seekCalled )
+        return containerStream->seek(pos);
+
+    if ( pos > m_length )
+        return false;
+
+    m_position = pos;
+    m_bytesAvailable = m_length - pos;
+    if ( pos == m_length )
+        return true;
+
+    size_t data_size = block_size - 2;
+    size_t block = pos / data_size;
+    uint8_t t = m_startTrack;
+    uint8_t s = m_startSector;
+
+    if ( m_dataBlocks.size() )
+    {
+        if ( block >= m_dataBlocks.size() )
+            return false;
+
+        t = m_dataBlocks[block].first;
+        s = m_dataBlocks[block].second;
+    }
+    else
+    {
+        for ( size_t i = 0; i < block && t; i++ )
+        {
+            seekSector( t, s );
+            containerStream->read(&t, 1);
+            containerStream->read(&s, 1);
+        }
+    }
+
+    if ( t == 0 || !seekSector( t, s ) )
+        return false;
+
+    containerStream->read(&next_track, 1);
+    containerStream->read(&next_sector, 1);
+    sector_offset = 2 + (pos % data_size);
+
+    return seekSector( t, s, sector_offset );
+}
+
+bool D64IStream::seekPath(std::string path) {
+    // Implement this to skip a queue of file streams to start of file by name
+    // this will cause the next read to return bytes of 'path'
+    seekCalled = true;
+
+    next_track = 0;
+    next_sector = 0;
+    sector_offset = 0;
+
+    entry_index = 0;
+
+    // call image method to obtain file bytes here, return true on success:
+    // return D64Image.seekFile(containerIStream, path);
+    mstr::toPETSCII(path);
+
+    // "NAME/3" is record 3 of a GEOS VLIR file, "NAME/INFO" the info block
+    // of any GEOS file. Only a suffix like that is tried as one, before
+    // the whole name, so a record costs one directory scan.
+    size_t slash = path.rfind('/');
+    if ( slash != std::string::npos && slash + 1 < path.size() )
+    {
+        std::string part = path.substr(slash + 1);
+        char *end = nullptr;
+        size_t record = strtoul(part.c_str(), &end, 10);
+        bool info = mstr::equals(part, (char *)"info", false);
+        if ( (info || (isdigit(part[0]) && *end == '\0')) && seekEntry(path.substr(0, slash)) && entry.geos_type )
+        {
+            m_dataBlocks.clear();
+            m_recordLength = 0;
+
+            if ( info )
+                return seekInfo(entry);
+
+            if ( seekRecord(entry, record) )
+                return true;
+        }
+    }
+
+    if ( seekEntry(path) )
+    {
+        //auto entry = containerImage->entry;
+        auto type = decodeType(entry.file_type).c_str();
+        //auto blocks = (entry.blocks[0] << 8 | entry.blocks[1] >> 8);
+        //auto blocks = (entry.blocks[0] * 256) + entry.blocks[1];
+        Debug_printv("filename [%.16s] type[%s] start_track[%d] start_sector[%d]", entry.filename, type, entry.start_track, entry.start_sector);
+
+        m_startTrack = entry.start_track;
+        m_startSector = entry.start_sector;
+
+        // REL files know their blocks from the side sectors
+        if ( readSideSectors(entry) )
+        {
+            m_length = relativeLength();
+            m_bytesAvailable = m_length;
+            m_position = 0;
+
+            Debug_printv("REL record_length[%d] blocks[%d] size[%d]", m_recordLength, m_dataBlocks.size(), m_length);
+            return seek(0);
+        }
+
+        // Calculate file size
+        m_length = chainLength(m_startTrack, m_startSector);
+        m_bytesAvailable = m_length;
+        m_position = 0;
+
+        Debug_printv("File Size: size[%d] available[%d]", m_length, m_bytesAvailable);
+
+        // Set position to beginning of file
+        return seekSector( m_startTrack, m_startSector );
+    }
+
+    Debug_printv( "Not found! [%s]", path.c_str());
+    return false;
+};
+
+bool D64IStream::isDirectoryEntry( std::string filename )
+{
+    std::string current(entry.filename, sizeof(entry.filename));
+    mstr::rtrimA0(current);
+    mstr::replaceAll(filename, "\\", "/");
+    if ( entry_index && current == filename )
+        return (entry.file_type & 0b00000111) == 0x06;
+
+    // Names from a listing are PETSCII already, typed ones aren't
+    size_t index = entry_index;
+    bool found = seekEntry(filename);
+    if ( !found )
+    {
+        mstr::toPETSCII(filename);
+        found = seekEntry(filename);
+    }
+    found = found && (entry.file_type & 0b00000111) == 0x06;
+
+    if ( index )
+        seekEntry(index);
+    else
+        resetEntryCounter();
+
+    return found;
+}
+
+bool D64IStream::readRecordIndex( Entry &vlir )
+{
+    if ( !isVLIR(vlir) )
+        return false;
+
+    // Same file of the same image as last time
+    if ( vlir_index.records.size() && vlir_index.container.lock() == containerStream &&
+         vlir.start_track == vlir_index.track && vlir.start_sector == vlir_index.sector )
+        return true;
+
+    vlir_index = RecordIndex();
+
+    std::string data = readBlock(vlir.start_track, vlir.start_sector);
+    if ( data.empty() )
+        return false;
+
+    // 0/0 ends the index, 0/FF is a record that is there but empty
+    for ( size_t offset = 2; offset + 1 < block_size; offset += 2 )
+    {
+        if ( data[offset] == 0 && data[offset + 1] == 0 )
+            break;
+
+        vlir_index.records.push_back(std::make_pair((uint8_t)data[offset], (uint8_t)data[offset + 1]));
+    }
+
+    vlir_index.container = containerStream;
+    vlir_index.track = vlir.start_track;
+    vlir_index.sector = vlir.start_sector;
+
+    Debug_printv("index track[%d] sector[%d] records[%d]", vlir_index.track, vlir_index.sector, vlir_index.records.size());
+    return true;
+}
+
+bool D64IStream::seekRecord( Entry &vlir, size_t record )
+{
+    if ( !readRecordIndex(vlir) || record >= vlir_index.records.size() )
+        return false;
+
+    // An empty record has track 0 and reads as nothing
+    m_startTrack = vlir_index.records[record].first;
+    m_startSector = vlir_index.records[record].second;
+    m_length = chainLength(m_startTrack, m_startSector);
+    m_bytesAvailable = m_length;
+    m_position = 0;
+
+    Debug_printv("record[%d] track[%d] sector[%d] size[%d]", record, m_startTrack, m_startSector, m_length);
+    return seek(0);
+}
+
+bool D64IStream::seekInfo( Entry &geos )
+{
+    if ( !geos.geos_type || geos.rel_start_track == 0 )
+        return false;
+
+    // A single block, its link is 0/FF
+    m_startTrack = geos.rel_start_track;
+    m_startSector = geos.rel_start_sector;
+    m_length = chainLength(m_startTrack, m_startSector);
+    m_bytesAvailable = m_length;
+    m_position = 0;
+
+    return seek(0);
+}
+
+std::string D64IStream::decodeGEOSType( Entry &geos )
+{
+    // Keep the locked and splat marks of the CBM type
+    std::string type = decodeType(geos.file_type);
+    if ( geos.geos_type == 0 )
+        return type;
+
+    return geos_type_label[ std::min(geos.geos_type, (uint8_t)15) ] + type.substr(3);
+}
+
+size_t D64IStream::chainLength( uint8_t track, uint8_t sector )
+{
+    size_t length = 0;
+
+    for ( uint16_t count = 0; track && count < 65535; count++ )
+    {
+        std::string data = readBlock(track, sector);
+        if ( data.empty() )
+            break;
+
+        track = data[0];
+        sector = data[1];
+
+        // The last block links to the index of its last used byte
+        if ( track )
+            length += block_size - 2;
+        else if ( sector > 1 )
+            length += sector - 1;
+    }
+
+    return length;
+}
+
+void D64IStream::freeChain( uint8_t track, uint8_t sector )
+{
+    for ( uint16_t count = 0; track && count < 65535; count++ )
+    {
+        std::string data = readBlock(track, sector);
+        if ( data.empty() || !deallocateBlock(track, sector) )
+            break;
+
+        track = data[0];
+        sector = data[1];
+    }
+}
+
+
+/********************************************************
+ * Ostream impls
+ ********************************************************/
+
+bool D64OStream::open() {
+    if ( m_isOpen )
+        return true;
+
+    if ( m_image == nullptr || containerStream == nullptr || !containerStream->isOpen() )
+    {
+        Debug_printv("image not writable [%s]", m_url.c_str());
+        return false;
+    }
+
+    // "name,s" picks the file type like OPEN does on the drive
+    uint8_t file_type = 0x02;
+    auto parts = mstr::split(m_filename, ',', 3);
+    std::string filename = parts[0];
+    if ( parts.size() > 1 && parts[1].size() )
+    {
+        switch ( tolower(parts[1][0]) )
+        {
+            case 's': file_type = 0x01; break;
+            case 'u': file_type = 0x03; break;
+            case 'l': file_type = 0x04; break;
+        }
+    }
+
+    mstr::replaceAll(filename, "\\", "/");
+    mstr::toPETSCII(filename);
+    if ( filename.empty() || filename.size() > sizeof(m_entry.filename) )
+        return false;
+
+    if ( !m_image->loadBAM() )
+        return false;
+
+    // Until close, so a flush for another file leaves this one out
+    m_image->m_writers.push_back(this);
+
+    if ( m_image->findSlot(filename, m_entry, m_entryTrack, m_entrySector, m_entryOffset) )
+    {
+        // REL files are written in place
+        if ( m_image->readSideSectors(m_entry) )
+        {
+            m_recordLength = m_image->m_recordLength;
+            m_length = m_image->relativeLength();
+            m_blocks = m_entry.blocks;
+            m_position = 0;
+            m_isOpen = true;
+
+            Debug_printv("filename[%s] record_length[%d] size[%d]", filename.c_str(), m_recordLength, m_length);
+            return true;
+        }
+
+        Debug_printv("file exists [%s]", filename.c_str());
+        return false;
+    }
+
+    if ( !m_image->findSlot("", m_entry, m_entryTrack, m_entrySector, m_entryOffset) )
+        return false;
+
+    memset((uint8_t *)&m_entry + 2, 0, sizeof(m_entry) - 2);
+    memset(m_entry.filename, 0xA0, sizeof(m_entry.filename));
+    memcpy(m_entry.filename, filename.data(), filename.size());
+
+    if ( file_type == 0x04 )
+    {
+        // New REL file, one block of empty records to start with
+        m_recordLength = (parts.size() > 2) ? atoi(parts[2].c_str()) : 0;
+        if ( m_recordLength == 0 || m_recordLength > m_image->block_size - 2 )
+        {
+            Debug_printv("bad record length [%d]", m_recordLength);
+            return false;
+        }
+
+        m_entry.file_type = 0x80 | file_type;
+        m_entry.rel_record_length = m_recordLength;
+        m_image->readSideSectors(m_entry);
+
+        size_t records = (m_image->block_size - 2) / m_recordLength;
+        if ( !growRelative(records * m_recordLength) )
+            return false;
+
+        m_entry.start_track = m_image->m_dataBlocks[0].first;
+        m_entry.start_sector = m_image->m_dataBlocks[0].second;
+        m_image->writeEntry(m_entry, m_entryTrack, m_entrySector, m_entryOffset);
+
+        m_position = 0;
+        m_isOpen = true;
+
+        Debug_printv("filename[%s] record_length[%d] created", filename.c_str(), m_recordLength);
+        return true;
+    }
+
+    // First block of the file, the directory entry stays open (no bit 7)
+    // until close
+    m_track = 0;
+    if ( !m_image->nextFreeBlock(m_track, m_sector) )
+        return false;
+    m_image->allocateBlock(m_track, m_sector);
+    m_chain.push_back(std::make_pair(m_track, m_sector));
+
+    m_entry.file_type = file_type;
+    m_entry.start_track = m_track;
+    m_entry.start_sector = m_sector;
+    m_image->writeEntry(m_entry, m_entryTrack, m_entrySector, m_entryOffset);
+
+    m_block.assign(m_image->block_size, '\0');
+    m_used = 0;
+    m_blocks = 1;
+    m_position = 0;
+    m_isOpen = true;
+
+    Debug_printv("filename[%s] track[%d] sector[%d]", filename.c_str(), m_track, m_sector);
+    return true;
+}
+
+bool D64OStream::growRelative(size_t length) {
+    // Whole records only
+    length = ((length + m_recordLength - 1) / m_recordLength) * m_recordLength;
+    if ( length <= m_length )
+        return true;
+
+    size_t data_size = m_image->block_size - 2;
+    size_t blocks = (length + data_size - 1) / data_size;
+    while ( m_image->m_dataBlocks.size() < blocks )
+    {
+        if ( !m_image->addRelativeBlock(m_entry) )
+            return false;
+    }
+
+    fillRelative(m_length, length);
+    m_length = length;
+
+    // Last block ends with the last record
+    auto &last = m_image->m_dataBlocks.back();
+    std::string data = m_image->readBlock(last.first, last.second);
+    data[0] = 0;
+    data[1] = (length - ((blocks - 1) * data_size)) + 1;
+    return m_image->writeBlock(last.first, last.second, data);
+}
+
+void D64OStream::fillRelative(size_t from, size_t to) {
+    // Empty records are $FF followed by zeros
+    size_t data_size = m_image->block_size - 2;
+    while ( from < to )
+    {
+        auto &block = m_image->m_dataBlocks[from / data_size];
+        std::string data = m_image->readBlock(block.first, block.second);
+        do
+        {
+            data[2 + (from % data_size)] = (from % m_recordLength) ? 0x00 : 0xFF;
+            from++;
+        } while ( from < to && (from % data_size) );
+        m_image->writeBlock(block.first, block.second, data);
+    }
+}
+
+bool D64OStream::seek(size_t pos) {
+    // Records past the end are added when they are written
+    if ( !m_isOpen || !m_recordLength )
+        return false;
+
+    m_position = pos;
+    return true;
+}
+
+bool D64OStream::nextBlock() {
+    uint8_t t = m_track;
+    uint8_t s = m_sector;
+    if ( !m_image->nextFreeBlock(t, s) || !m_image->allocateBlock(t, s) )
+        return false;
+    m_chain.push_back(std::make_pair(t, s));
+
+    m_block[0] = t;
+    m_block[1] = s;
+    m_image->writeBlock(m_track, m_sector, m_block);
+
+    m_block.assign(m_image->block_size, '\0');
+    m_used = 0;
+    m_track = t;
+    m_sector = s;
+    m_blocks++;
     return true;
 }
 
-bool D64IStream::seekEntry( std::string filename )
-{
-    uint8_t index = 1;
-    mstr::rtrimA0(filename);
-    mstr::replaceAll(filename, "\\", "/");
+size_t D64OStream::write(const uint8_t *buf, size_t size) {
+    if ( !m_isOpen || !buf )
+        return 0;
 
-    // Read Directory Entries
-    if ( filename.size() )
+    size_t data_size = m_image->block_size - 2;
+    size_t written = 0;
+
+    if ( m_recordLength )
     {
-        while ( seekEntry( index ) )
+        if ( !growRelative(m_position + size) )
+            return 0;
+
+        while ( written < size )
         {
-            std::string entryFilename = entry.filename;
-            mstr::rtrimA0(entryFilename);
-            //Debug_printv("track[%d] sector[%d] filename[%s] entry.filename[%.16s]", track, sector, filename.c_str(), entryFilename.c_str());
+            auto &block = m_image->m_dataBlocks[m_position / data_size];
+            size_t offset = m_position % data_size;
+            size_t length = std::min(size - written, data_size - offset);
 
-            // Read Entry From Stream
-            if (entry.file_type & 0b00000111 && filename == "*")
-            {
-                filename == entryFilename;
-            }
+            std::string data = m_image->readBlock(block.first, block.second);
+            memcpy(&data[2 + offset], buf + written, length);
+            m_image->writeBlock(block.first, block.second, data);
 
-            if ( mstr::startsWith(entryFilename, filename.c_str()) )
-            {
-                // Move stream pointer to start track/sector
-                return true;
-            }
-            index++;
+            m_position += length;
+            written += length;
         }
-    }
 
-    entry.next_track = 0;
-    entry.next_sector = 0;
-    entry.blocks = 0;
-    entry.filename[0] = '\0';
+        return written;
+    }
 
-    return false;
-}
+    while ( written < size )
+    {
+        if ( m_used == data_size && !nextBlock() )
+            break;
 
-bool D64IStream::seekEntry( size_t index )
-{
-    bool r = false;
+        size_t length = std::min(size - written, data_size - m_used);
+        memcpy(&m_block[2 + m_used], buf + written, length);
+        m_used += length;
+        written += length;
+    }
 
-    // Calculate Sector offset & Entry offset
-    // 8 Entries Per Sector, 32 bytes Per Entry
-    index--;
-    uint8_t sectorOffset = index / 8;
-    uint8_t entryOffset = (index % 8) * 32;
+    m_position += written;
+    return written;
+}
 
-    //Debug_printv("----------");
-    //Debug_printv("index[%d] sectorOffset[%d] entryOffset[%d] entry_index[%d]", index, sectorOffset, entryOffset, entry_index);
+void D64OStream::close() {
+    if ( m_image == nullptr )
+        return;
 
+    auto &writers = m_image->m_writers;
+    writers.erase(std::remove(writers.begin(), writers.end(), this), writers.end());
 
-    if (index == 0 || index != entry_index)
+    if ( !m_isOpen )
     {
-        // Start at first sector of directory
-        next_track = 0;
-        r = seekSector( directory_list_offset );
-
-        // Find sector with requested entry
-        do
-        {
-            if ( next_track )
-            {
-                //Debug_printv("next_track[%d] next_sector[%d]", entry.next_track, entry.next_sector);
-                r = seekSector( entry.next_track, entry.next_sector, 0x00 );
-            }
+        m_image = nullptr;
+        return;
+    }
 
-            containerStream->read((uint8_t *)&entry, sizeof(entry));
-            next_track = entry.next_track;
-            next_sector = entry.next_sector;
+    m_isOpen = false;
 
-            //Debug_printv("sectorOffset[%d] -> track[%d] sector[%d]", sectorOffset, track, sector);
-        } while ( sectorOffset-- > 0 );
-        r = seekSector( track, sector, entryOffset );
-    }
-    else
+    if ( !m_recordLength )
     {
-        if ( entryOffset == 0 )
-        {
-            if ( next_track == 0 )
-                return false;
+        // Last block, link byte is the index of its last used byte
+        m_block[0] = 0;
+        m_block[1] = m_used + 1;
+        m_image->writeBlock(m_track, m_sector, m_block);
 
-            //Debug_printv("Follow link track[%d] sector[%d] entryOffset[%d]", next_track, next_sector, entryOffset);
-            r = seekSector( next_track, next_sector, entryOffset );
-        }
+        m_entry.file_type |= 0x80;
+        m_entry.blocks = m_blocks;
     }
 
-    containerStream->read((uint8_t *)&entry, sizeof(entry));
-
-    // If we are at the first entry in the sector then get next_track/next_sector
-    if ( entryOffset == 0 )
-    {
-        next_track = entry.next_track;
-        next_sector = entry.next_sector;
-    }
+    // Records written in place leave the directory alone
+    if ( m_entry.blocks != m_blocks || !m_recordLength )
+        m_image->writeEntry(m_entry, m_entryTrack, m_entrySector, m_entryOffset);
 
-    //Debug_printv("r[%d] file_type[%02X] file_name[%.16s]", r, entry.file_type, entry.filename);
+    // Files still being written into the image aren't part of this
+    m_image->flush(containerStream.get());
+    containerStream->close();
+    D64File::containers.erase(m_container);
 
-    //if ( next_track == 0 && next_sector == 0xFF )
-    entry_index = index + 1;
-    if ( entry.file_type == 0x00 )
-        return false;
-    else
-        return true;
+    // Everything cached from the image is stale now, unless another file
+    // is still being written through it
+    if ( writers.empty() )
+        ImageBroker::dispose(m_url);
+    m_image = nullptr;
 }
 
 
-uint16_t D64IStream::blocksFree()
-{
-    uint16_t free_count = 0;
+/********************************************************
+ * File implementations
+ ********************************************************/
 
-    for(uint8_t x = 0; x < block_allocation_map.size(); x++)
-    {
-        uint8_t bam[block_allocation_map[x].byte_count] = { 0 };
-        Debug_printv("start_track[%d] end_track[%d]", block_allocation_map[x].start_track, block_allocation_map[x].end_track);
+std::unordered_map<std::string, std::weak_ptr<MIStream>> D64File::containers;
+std::unordered_map<std::string, uint32_t> D64File::pending;
 
-        seekSector(block_allocation_map[x].track, block_allocation_map[x].sector, block_allocation_map[x].offset);
-        for(uint8_t i = block_allocation_map[x].start_track; i <= block_allocation_map[x].end_track; i++)
+MIStream* D64File::inputStream() {
+    // D64IStream puts the container back where it left it before reading,
+    // so files open side by side can share it
+    std::shared_ptr<MIStream> containerStream = containers[streamFile->url].lock();
+    if ( containerStream == nullptr )
+    {
+        // Images nothing reads any more are forgotten
+        for ( auto it = containers.begin(); it != containers.end(); )
         {
-            containerStream->read((uint8_t *)&bam, sizeof(bam));
-            if ( sizeof(bam) > 3 )
-            {
-                if ( i != directory_list_offset[0] )
-                {
-                    Debug_printv("x[%d] track[%d] count[%d] size[%d]", x, i, bam[0], sizeof(bam));
-                    free_count += bam[0];
-                }
-            }
+            if ( it->second.expired() )
+                it = containers.erase(it);
             else
-            {
-                // D71 tracks 36 - 70 you have to count the 1 bits (0 is allocated)
-                uint8_t bit_count = 0;
-                bit_count += std::bitset<8>(bam[0]).count();
-                bit_count += std::bitset<8>(bam[1]).count();
-                bit_count += std::bitset<8>(bam[2]).count();
-
-                //Debug_printv("x[%d] track[%d] count[%d] size[%d] bam0[%d] bam1[%d] bam2[%d] (counting 1 bits)", x, i, bit_count, sizeof(bam), bam[0], bam[1], bam[2]);
-                free_count += bit_count;
-            }
+                ++it;
         }
+
+        containerStream.reset(streamFile->inputStream());
+        containers[streamFile->url] = containerStream;
     }
 
-    return free_count;
+    return inputStream(containerStream);
 }
 
-size_t D64IStream::readFile(uint8_t* buf, size_t size) {
-    size_t bytesRead = 0;
+MIStream* D64File::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
 
-    if ( sector_offset % block_size == 0 )
-    {
-        // We are at the beginning of the block
-        // Read track/sector link
-        containerStream->read((uint8_t *)&next_track, 1);
-        containerStream->read((uint8_t *)&next_sector, 1);
-        sector_offset += 2;
-        //Debug_printv("next_track[%d] next_sector[%d] sector_offset[%d]", next_track, next_sector, sector_offset);
-    }
+    return new D64IStream(containerIstream);
+}
 
-    bytesRead += containerStream->read(buf, size);
-    sector_offset += bytesRead;
-    m_bytesAvailable -= bytesRead;
+MOStream* D64File::outputStream() {
+    // has to return OPENED stream
+    Debug_printv("[%s]", url.c_str());
 
-    if ( sector_offset % block_size == 0 )
+    auto image = ImageBroker::share<D64IStream>(directoryUrl());
+    MOStream* ostream = new D64OStream(image, imageOStream(), directoryUrl(), entryName(), streamFile->url);
+    ostream->open();
+    return ostream;
+}
+
+bool D64File::remove() {
+    if ( pathInStream == "" )
+        return false;
+
+    auto image = ImageBroker::obtain<D64IStream>(directoryUrl());
+    if ( image == nullptr )
+        return false;
+
+    std::string filename = entryName();
+    mstr::replaceAll(filename, "\\", "/");
+    mstr::toPETSCII(filename);
+
+    if ( !image->scratchEntry(filename) )
     {
-        // We are at the end of the block
-        // Follow track/sector link to move to next block
-        seekSector( next_track, next_sector );
-        //Debug_printv("track[%d] sector[%d] sector_offset[%d]", track, sector, sector_offset);
+        if ( image->m_writers.empty() )
+            ImageBroker::dispose(directoryUrl());
+        return false;
     }
 
-    // if ( !bytesRead )
-    // {
-    //     sector_offset = 0;
-    // }
-
-    return bytesRead;
+    return flushImage(directoryUrl());
 }
 
+bool D64File::rename(std::string dest) {
+    if ( pathInStream == "" )
+        return false;
 
+    auto image = ImageBroker::obtain<D64IStream>(directoryUrl());
+    if ( image == nullptr )
+        return false;
 
-bool D64IStream::seekPath(std::string path) {
-    // Implement this to skip a queue of file streams to start of file by name
-    // this will cause the next read to return bytes of 'path'
-    seekCalled = true;
-
-    next_track = 0;
-    next_sector = 0;
-    sector_offset = 0;
+    std::string filename = entryName();
+    mstr::replaceAll(filename, "\\", "/");
+    mstr::toPETSCII(filename);
 
-    entry_index = 0;
+    // Only the name changes, the file stays in its directory
+    std::string newname = dest.substr(dest.rfind('/') + 1);
+    mstr::replaceAll(newname, "\\", "/");
+    mstr::toPETSCII(newname);
 
-    // call image method to obtain file bytes here, return true on success:
-    // return D64Image.seekFile(containerIStream, path);
-    mstr::toPETSCII(path);
-    if ( seekEntry(path) )
+    if ( !image->renameEntry(filename, newname) )
     {
-        //auto entry = containerImage->entry;
-        auto type = decodeType(entry.file_type).c_str();
-        //auto blocks = (entry.blocks[0] << 8 | entry.blocks[1] >> 8);
-        //auto blocks = (entry.blocks[0] * 256) + entry.blocks[1];
-        Debug_printv("filename [%.16s] type[%s] start_track[%d] start_sector[%d]", entry.filename, type, entry.start_track, entry.start_sector);
-        seekSector(entry.start_track, entry.start_sector);
+        if ( image->m_writers.empty() )
+            ImageBroker::dispose(directoryUrl());
+        return false;
+    }
 
-        // Calculate file size
-        uint8_t t = 0;
-        uint8_t s = 0;
-        size_t blocks = 0; 
-        do
-        {
-            //Debug_printv("t[%d] s[%d]", t, s);
+    return flushImage(directoryUrl());
+}
 
-            containerStream->read(&t, 1);
-            containerStream->read(&s, 1);
-            blocks++;
-            seekSector( t, s );
-        } while ( t > 0 );
-        blocks--;
-        m_length = (blocks * 254) + s;
-        m_bytesAvailable = m_length;
-        
-        // Set position to beginning of file
-        seekSector( entry.start_track, entry.start_sector );
+bool D64File::flushImage( std::string url ) {
+    auto image = ImageBroker::obtain<D64IStream>(url);
+    auto ostream = imageOStream();
+    bool success = image->flush(ostream.get());
+    if ( ostream != nullptr )
+        ostream->close();
+
+    // Files opened from now on read what was written. Files still being
+    // written into the image keep it, they drop it when they are closed.
+    if ( image->m_writers.empty() )
+        ImageBroker::dispose(url);
+    containers.erase(streamFile->url);
+    pending.erase(url);
+    return success;
+}
 
-        Debug_printv("File Size: blocks[%d] size[%d] available[%d]", (blocks + 1), m_length, m_bytesAvailable);
-        
-        return true;
-    }
-    else
-    {
-        Debug_printv( "Not found! [%s]", path.c_str());
-    }
+std::string D64File::listUrl() {
+    if ( pathInStream == "" )
+        return streamFile->url;
 
-    return false;
-};
+    return streamFile->url + "/" + pathInStream;
+}
 
+std::string D64File::directoryUrl() {
+    size_t slash = pathInStream.rfind('/');
+    if ( slash == std::string::npos )
+        return streamFile->url;
 
-/********************************************************
- * File implementations
- ********************************************************/
+    return streamFile->url + "/" + pathInStream.substr(0, slash);
+}
 
-MIStream* D64File::createIStream(std::shared_ptr<MIStream> containerIstream) {
-    Debug_printv("[%s]", url.c_str());
+std::string D64File::entryName() {
+    size_t slash = pathInStream.rfind('/');
+    if ( slash == std::string::npos )
+        return pathInStream;
 
-    return new D64IStream(containerIstream);
+    return pathInStream.substr(slash + 1);
 }
 
 bool D64File::isDirectory() {
@@ -307,7 +1536,7 @@ bool D64File::isDirectory() {
 bool D64File::rewindDirectory() {
     dirIsOpen = true;
     Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
-    auto image = ImageBroker::obtain<D64IStream>(streamFile->url);
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
     if ( image == nullptr )
         Debug_printv("image pointer is null");
 
@@ -334,16 +1563,16 @@ MFile* D64File::getNextFileInDir() {
         rewindDirectory();
 
     // Get entry pointed to by containerStream
-    auto image = ImageBroker::obtain<D64IStream>(streamFile->url);
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
 
     if ( image->seekNextImageEntry() )
     {
-        std::string fileName = image->entry.filename;
+        std::string fileName(image->entry.filename, sizeof(image->entry.filename));
         mstr::rtrimA0(fileName);
         mstr::replaceAll(fileName, "/", "\\");
-        //Debug_printv( "entry[%s]", (streamFile->url + "/" + fileName).c_str() );
-        auto file = MFSOwner::File(streamFile->url + "/" + fileName);
-        file->extension = image->decodeType(image->entry.file_type);
+        //Debug_printv( "entry[%s]", (listUrl() + "/" + fileName).c_str() );
+        auto file = MFSOwner::File(listUrl() + "/" + fileName);
+        file->extension = image->decodeGEOSType(image->entry);
         return file;
     }
     else
@@ -360,7 +1589,7 @@ time_t D64File::getLastWrite() {
 
 time_t D64File::getCreationTime() {
     tm *entry_time = 0;
-    auto entry = ImageBroker::obtain<D64IStream>(streamFile->url)->entry;
+    auto entry = ImageBroker::obtain<D64IStream>(directoryUrl())->entry;
     entry_time->tm_year = entry.year + 1900;
     entry_time->tm_mon = entry.month;
     entry_time->tm_mday = entry.day;
@@ -379,8 +1608,102 @@ bool D64File::exists() {
 size_t D64File::size() {
     // Debug_printv("[%s]", streamFile->url.c_str());
     // use D64 to get size of the file in image
-    auto entry = ImageBroker::obtain<D64IStream>(streamFile->url)->entry;
+    auto entry = ImageBroker::obtain<D64IStream>(directoryUrl())->entry;
     size_t bytes = UINT16_FROM_LE_UINT16(entry.blocks);
     
     return bytes;
 }
+
+
+bool D64File::isBlock( uint8_t track, uint8_t sector ) {
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
+    return image != nullptr && image->isBlock(track, sector);
+}
+
+bool D64File::readBlock( uint8_t track, uint8_t sector, uint8_t* data ) {
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
+    if ( image == nullptr || !image->isBlock(track, sector) )
+        return false;
+
+    std::string block = image->readBlock(track, sector);
+    if ( block.size() != image->block_size )
+        return false;
+
+    memcpy(data, block.data(), block.size());
+    return true;
+}
+
+bool D64File::writeBlock( uint8_t track, uint8_t sector, uint8_t* data ) {
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
+    if ( image == nullptr || !image->isBlock(track, sector) )
+        return false;
+
+    if ( !image->writeBlock(track, sector, std::string((char *)data, image->block_size)) )
+        return false;
+
+    pending[listUrl()] = millis();
+    return true;
+}
+
+bool D64File::allocateBlock( uint8_t &track, uint8_t &sector ) {
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
+    if ( image == nullptr || image->block_allocation_map.empty() || !image->isBlock(track, sector) )
+        return false;
+
+    if ( image->allocateBlock(track, sector) )
+    {
+        pending[listUrl()] = millis();
+        return true;
+    }
+
+    // In use, tell where the next free one is
+    if ( !image->nextFreeBlock(track, sector) )
+    {
+        track = 0;
+        sector = 0;
+    }
+
+    return false;
+}
+
+bool D64File::freeBlock( uint8_t track, uint8_t sector ) {
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
+    if ( image == nullptr || image->block_allocation_map.empty() || !image->isBlock(track, sector) || !image->deallocateBlock(track, sector) )
+        return false;
+
+    pending[listUrl()] = millis();
+    return true;
+}
+
+bool D64File::flush() {
+    auto changed = pending.find(listUrl());
+    if ( changed == pending.end() )
+        return true;
+    pending.erase(changed);
+
+    // A file saved into the image since wrote them along
+    auto image = ImageBroker::obtain<D64IStream>(listUrl());
+    if ( image == nullptr )
+        return false;
+    if ( image->m_dirty.empty() && !image->m_bamDirty )
+        return true;
+
+    return flushImage(listUrl());
+}
+
+void D64File::idle() {
+    std::vector<std::string> urls;
+    for ( auto &changed : pending )
+    {
+        if ( millis() - changed.second >= D64_FLUSH_TIMEOUT )
+            urls.push_back(changed.first);
+    }
+
+    for ( auto &url : urls )
+    {
+        std::unique_ptr<MFile> image(MFSOwner::File(url));
+        if ( image == nullptr || !image->flush() )
+            Debug_printv("can't write [%s]", url.c_str());
+        pending.erase(url);
+    }
+}
@@ -2,6 +2,7 @@
 // https://vice-emu.sourceforge.io/vice_17.html#SEC345
 // https://ist.uwaterloo.ca/~schepers/formats/D64.TXT
 // https://ist.uwaterloo.ca/~schepers/formats/GEOS.TXT
+// https://ist.uwaterloo.ca/~schepers/formats/REL.TXT
 // https://www.lemon64.com/forum/viewtopic.php?t=70024&start=0 (File formats = Why is D64 not called D40/D41)
 //  - disucssion of disk id in sector missing from d64 file format is interesting
 // https://www.c64-wiki.com/wiki/Disk_Image
@@ -15,6 +16,10 @@
 
 #include <map>
 #include <bitset>
+#include <unordered_map>
+
+// Block commands changing an image this long ago get it written
+#define D64_FLUSH_TIMEOUT 2000
 
 #include "string_utils.h"
 #include "cbm_image.h"
@@ -24,11 +29,40 @@
  * Streams
  ********************************************************/
 
+class D64OStream;
+
 class D64IStream : public CBMImageStream {
 
 public:
     D64IStream(std::shared_ptr<MIStream> is) : CBMImageStream(is) {};
 
+    // Sector access for the write path. Written sectors are kept in RAM
+    // until flush() and reads see them, so a SAVE can allocate, link and
+    // update the directory before anything touches the image.
+    std::string readBlock( uint8_t track, uint8_t sector );
+    bool writeBlock( uint8_t track, uint8_t sector, std::string data );
+    bool allocateBlock( uint8_t track, uint8_t sector );
+    bool deallocateBlock( uint8_t track, uint8_t sector );
+
+    // A block this disk has
+    virtual bool isBlock( uint8_t track, uint8_t sector );
+
+    // Free block for the next sector of a file, interleaved after
+    // track/sector like the drive does. Track 0 starts a new file next to
+    // the directory track.
+    bool nextFreeBlock( uint8_t &track, uint8_t &sector );
+
+    // Write the BAM and the changed sectors to the image, in sector order
+    bool flush( MOStream* out );
+
+    // Position inside the file seekPath found. REL files go straight to
+    // the block through their side sectors, anything else follows links.
+    bool seek(size_t pos) override;
+    bool seek(size_t pos, SeekMode mode) override {
+        return MIStream::seek(pos, mode);
+    };
+    uint8_t recordLength() override { return m_recordLength; };
+
 protected:
 
     struct Header {
@@ -73,6 +107,15 @@ protected:
     std::vector<uint8_t> sectorsPerTrack = { 17, 18, 19, 21 };
     //uint8_t sector_buffer[256] = { 0 };
 
+    // 1541 interleave for files and the directory
+    uint8_t file_interleave = 10;
+    uint8_t directory_interleave = 3;
+
+    virtual uint32_t blockIndex( uint8_t track, uint8_t sector );
+    uint8_t sectorsInTrack( uint8_t track ) {
+        return sectorsPerTrack[speedZone(track - 1)];
+    };
+
     bool seekSector( uint8_t track, uint8_t sector, size_t offset = 0 );
     bool seekSector( std::vector<uint8_t> trackSectorOffset = { 0 } );
 
@@ -82,11 +125,56 @@ protected:
     }
 
     bool seekNextImageEntry() override {
-        return seekEntry(entry_index + 1);
+        // Step over scratched entries, seekEntry only reads nothing at the
+        // end of the directory
+        size_t index = entry_index + 1;
+        while ( !seekEntry(index) )
+        {
+            if ( entry_index != index )
+                return false;
+            index++;
+        }
+        return true;
     }
 
     virtual uint16_t blocksFree();
 
+    // BAM in RAM, one bitmap per track (bit set = free), written back once
+    // on flush
+    bool loadBAM();
+    virtual bool writeBAM();
+    bool isFree( uint8_t track, uint8_t sector );
+    bool nextFreeSector( uint8_t track, uint8_t &sector, uint8_t interleave );
+
+    // Directory slots, looked up through readBlock so entries created
+    // before a flush are seen. An empty filename finds a free slot, adding
+    // a directory sector when all are used.
+    bool findSlot( std::string filename, Entry &slot, uint8_t &track, uint8_t &sector, uint8_t &offset );
+    bool writeEntry( Entry &slot, uint8_t track, uint8_t sector, uint8_t offset );
+    bool scratchEntry( std::string filename );
+    bool renameEntry( std::string filename, std::string newname );
+
+    // REL files. The side sectors are read into a list of the data blocks,
+    // so any record is one lookup away. addRelativeBlock appends a data
+    // block to rel, with a new side sector when the last one is full.
+    bool readSideSectors( Entry &rel );
+    bool addRelativeBlock( Entry &rel );
+    size_t relativeLength();
+
+    // GEOS VLIR files. The entry's start block is the record index, 127
+    // track/sector pairs each starting the chain of one record. The index
+    // of the file used last is kept for the image, so loading a program
+    // record by record ("NAME/0", "NAME/1"...) reads it once.
+    bool isVLIR( Entry &file ) {
+        return file.geos_type && file.rel_record_length == 0x01;
+    };
+    bool readRecordIndex( Entry &vlir );
+    bool seekRecord( Entry &vlir, size_t record );
+    bool seekInfo( Entry &geos );
+    std::string decodeGEOSType( Entry &geos );
+    size_t chainLength( uint8_t track, uint8_t sector );
+    void freeChain( uint8_t track, uint8_t sector );
+
 	virtual uint8_t speedZone( uint8_t track)
 	{
 		return (track < 17) + (track < 24) + (track < 30);
@@ -109,17 +197,46 @@ protected:
     uint8_t next_sector = 0;
     uint8_t sector_offset = 0;
 
-private:
-    void sendListing();
+    std::vector<std::pair<uint8_t, uint8_t>> m_dataBlocks;     // REL data blocks, in order
+    std::vector<std::pair<uint8_t, uint8_t>> m_sideSectors;
+    uint8_t m_recordLength = 0;
+    bool super_side_sector = false;     // 1581 style REL files
+
+    // First block of what seekPath opened, a record of a VLIR file starts
+    // somewhere else than its entry
+    uint8_t m_startTrack = 0;
+    uint8_t m_startSector = 0;
+
+    // Record index of the VLIR file read last. It stays valid while the
+    // container it was read from does, writing the image replaces that.
+    struct RecordIndex {
+        std::weak_ptr<MIStream> container;
+        uint8_t track = 0;              // index block the records came from
+        uint8_t sector = 0;
+        std::vector<std::pair<uint8_t, uint8_t>> records;   // record -> first block
+    };
+    static RecordIndex vlir_index;
+    std::string geos_type_label[16] = { "", "bas", "asm", "dat", "sys", "acc", "app", "doc", "fnt", "prt", "inp", "drv", "boo", "tmp", "aut", "???" };
+
+    std::vector<std::vector<uint8_t>> m_bam;
+    bool m_bamDirty = false;
+    std::map<uint32_t, std::string> m_dirty;    // block index -> sector
+
+    // Files being written into the image. Until they are closed a flush
+    // leaves their entries and blocks out, as if they weren't there yet.
+    std::vector<D64OStream*> m_writers;
+    void holdWriters( std::map<uint32_t, std::string> &held );
 
     bool seekEntry( std::string filename );
+    bool seekEntry( const CBMPattern &pattern );
     bool seekEntry( size_t index = 0 );
 
+    // Sub-directories (CMD native partitions). The entry a listing is at
+    // is checked first, any other lookup puts the listing back where it was.
+    bool isDirectoryEntry( std::string filename );
 
-    std::string readBlock( uint8_t track, uint8_t sector );
-    bool writeBlock( uint8_t track, uint8_t sector, std::string data );    
-    bool allocateBlock( uint8_t track, uint8_t sector );
-    bool deallocateBlock( uint8_t track, uint8_t sector );
+private:
+    void sendListing();
 
 
     // uint8_t d64_get_type(uint16_t imgsize)
@@ -156,7 +273,72 @@ private:
     friend class D81File;
     friend class D82File;
     friend class D8BFile;
-    friend class DNPFile;    
+    friend class DNPFile;
+    friend class D2MFile;
+    friend class DFIFile;
+
+    friend class D64OStream;
+};
+
+
+// Writes one file into the image. Blocks are allocated and linked as the
+// data comes in, the directory entry is made on open and closed (with its
+// block count) on close, which is also when the image is written. Files
+// written side by side share the image, the last one closed releases it.
+//
+// "name,l,<record length>" creates a REL file. An existing REL file is
+// opened for writing in place: seek to the record, write it, close, and
+// only the blocks it touched are written. Writing past the end adds empty
+// records up to it like DOS does.
+class D64OStream : public MOStream {
+
+public:
+    D64OStream(std::shared_ptr<D64IStream> image, std::shared_ptr<MOStream> os, std::string url, std::string filename, std::string container = "") :
+        m_image(image), containerStream(os), m_url(url), m_filename(filename), m_container(container) {};
+    ~D64OStream() {
+        close();
+    };
+
+    // MStream methods
+    size_t position() override { return m_position; };
+    void close() override;
+    bool open() override;
+    bool isOpen() override { return m_isOpen; };
+
+    // MOStream methods
+    size_t write(const uint8_t *buf, size_t size) override;
+    bool seek(size_t pos) override;
+
+protected:
+    bool nextBlock();
+    bool growRelative(size_t length);
+    void fillRelative(size_t from, size_t to);
+
+    std::shared_ptr<D64IStream> m_image;     // shared with the other files written into it
+    std::shared_ptr<MOStream> containerStream;
+    std::string m_url;
+    std::string m_filename;
+    std::string m_container;    // Url of the image in D64File::containers
+
+    bool m_isOpen = false;
+    size_t m_position = 0;
+
+    D64IStream::Entry m_entry;
+    uint8_t m_entryTrack = 0;
+    uint8_t m_entrySector = 0;
+    uint8_t m_entryOffset = 0;
+
+    std::string m_block;
+    size_t m_used = 0;
+    uint8_t m_track = 0;
+    uint8_t m_sector = 0;
+    uint16_t m_blocks = 0;
+    std::vector<std::pair<uint8_t, uint8_t>> m_chain;  // blocks allocated so far
+
+    uint8_t m_recordLength = 0;
+    size_t m_length = 0;
+
+    friend class D64IStream;
 };
 
 
@@ -175,7 +357,17 @@ public:
         // don't close the stream here! It will be used by shared ptr D64Util to keep reading image params
     }
 
+    // Files of one image open at the same time (one per channel) read
+    // through one container stream
+    using MFile::inputStream;
+    MIStream* inputStream() override;
     MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+    MOStream* outputStream() override;
+
+    // Writable stream over the whole image, see X64File
+    virtual std::shared_ptr<MOStream> imageOStream() {
+        return std::shared_ptr<MOStream>(streamFile->outputStream());
+    };
 
     std::string petsciiName() override {
         // It's already in PETSCII
@@ -189,14 +381,46 @@ public:
     bool mkDir() override { return false; };
 
     bool exists() override;
-    bool remove() override { return false; };
-    bool rename(std::string dest) { return false; };
+    bool remove() override;
+    bool rename(std::string dest) override;
     time_t getLastWrite() override;
     time_t getCreationTime() override;
     size_t size() override;     
 
+    bool isBlock( uint8_t track, uint8_t sector ) override;
+    bool readBlock( uint8_t track, uint8_t sector, uint8_t* data ) override;
+    bool writeBlock( uint8_t track, uint8_t sector, uint8_t* data ) override;
+    bool allocateBlock( uint8_t &track, uint8_t &sector ) override;
+    bool freeBlock( uint8_t track, uint8_t sector ) override;
+    bool flush() override;
+
+    // Write the images the block commands left alone for D64_FLUSH_TIMEOUT
+    static void idle();
+
     bool isDir = true;
     bool dirIsOpen = false;
+
+protected:
+    // ImageBroker keeps one image stream per directory, under the url of
+    // the image followed by the path inside it. listUrl() is the one for
+    // this file as a directory, directoryUrl() the one it is listed in.
+    std::string listUrl();
+    std::string directoryUrl();
+    std::string entryName();
+
+    // Write what the stream ImageBroker keeps under url changed to the
+    // image, then drop it unless files are still being written into it
+    bool flushImage( std::string url );
+
+    // Image url -> container stream of the files open in it. Entries go
+    // when the image is written, expired ones when another is added.
+    static std::unordered_map<std::string, std::weak_ptr<MIStream>> containers;
+
+    // Image url (listUrl) -> millis() of the last block command changing
+    // it. The sectors stay with the stream ImageBroker keeps until flush().
+    static std::unordered_map<std::string, uint32_t> pending;
+
+    friend class D64OStream;
 };
 
 
@@ -217,6 +441,11 @@ public:
         return byExtension(".d64", fileName);
     }
 
+    // Every image D64File handles, D71, D81...
+    void idle() override {
+        D64File::idle();
+    }
+
     D64FileSystem(): MFileSystem("d64") {};
 };
 
@@ -1,5 +1,31 @@
 #include "d71.h"
 
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool D71IStream::writeBAM()
+{
+    if ( !D64IStream::writeBAM() )
+        return false;
+
+    // Free counts of the second side are kept in the first BAM sector
+    std::string data = readBlock(18, 0);
+    if ( data.empty() )
+        return false;
+
+    for ( uint8_t i = 36; i <= 70 && i < m_bam.size(); i++ )
+    {
+        uint8_t free_count = 0;
+        for ( auto bits : m_bam[i] )
+            free_count += std::bitset<8>(bits).count();
+        data[0xDD + (i - 36)] = free_count;
+    }
+
+    return writeBlock(18, 0, data);
+}
+
+
 /********************************************************
  * File implementations
  ********************************************************/
@@ -26,9 +26,11 @@ public:
         //directory_list_offset = {18, 1, 0x00};
         block_allocation_map = { {18, 0, 0x04, 1, 35, 4}, {53, 0, 0x00, 36, 70, 3} };
         //sectorsPerTrack = { 17, 18, 19, 21 };
+        file_interleave = 6;
     };
 
     //virtual uint16_t blocksFree() override;
+    bool writeBAM() override;
 	virtual uint8_t speedZone( uint8_t track) override
 	{
         if ( track < 35 )
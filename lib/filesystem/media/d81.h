@@ -26,6 +26,9 @@ public:
         directory_list_offset = {40, 3, 0x00};
         block_allocation_map = { {40, 1, 0x10, 1, 40, 6}, {40, 2, 0x10, 41, 80, 6} };
         sectorsPerTrack = { 40 };
+        file_interleave = 1;
+        directory_interleave = 1;
+        super_side_sector = true;
     };
 
     //virtual uint16_t blocksFree() override;
@@ -0,0 +1,60 @@
+#include "dfi.h"
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool DFIIStream::readHeader()
+{
+    std::string data = readBlock(1, 0);
+    if ( data.empty() || data.compare(1, 22, "DREAMLOAD FILE ARCHIVE") != 0 )
+    {
+        Debug_printv("bad DFI signature");
+        return false;
+    }
+
+    m_tracks = (uint8_t)data[0x1C] | ((uint8_t)data[0x1D] << 8) | ((uint8_t)data[0x1E] << 16) | ((uint8_t)data[0x1F] << 24);
+    bam_track = data[0x22];
+    bam_sector = data[0x23];
+
+    Debug_printv("tracks[%d] root track[%d] sector[%d] bam track[%d] sector[%d]", m_tracks, (uint8_t)data[0x20], (uint8_t)data[0x21], bam_track, bam_sector);
+    return enterDirectory(data[0x20], data[0x21]);
+}
+
+uint16_t DFIIStream::blocksFree()
+{
+    if ( m_blocksFree >= 0 )
+        return m_blocksFree;
+
+    if ( m_dfiBam.empty() )
+    {
+        // One run of sectors without links
+        m_dfiBam.resize(DFI_BAM_SIZE);
+        if ( bam_track == 0 || !seekSector(bam_track, bam_sector) || containerStream->read(m_dfiBam.data(), DFI_BAM_SIZE) != DFI_BAM_SIZE )
+        {
+            m_dfiBam.clear();
+            return 0;
+        }
+    }
+
+    // A bit per sector from track 1 sector 0 up, only the tracks in the
+    // image count
+    uint32_t free_count = 0;
+    size_t bytes = std::min((size_t)m_tracks * 32, m_dfiBam.size());
+    for ( size_t i = 0; i < bytes; i++ )
+        free_count += std::bitset<8>(m_dfiBam[i]).count();
+
+    m_blocksFree = std::min(free_count, (uint32_t)UINT16_MAX);
+    return m_blocksFree;
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+MIStream* DFIFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new DFIIStream(containerIstream, streamFile->url);
+}
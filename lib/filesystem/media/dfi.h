@@ -1,5 +1,6 @@
 // .DFI - DreamLoad File Archive
 // https://www.lemon64.com/forum/viewtopic.php?t=37415#458552
+// https://cbm8bit.com/8bit/commodore/server/Unrenamed%20Achives/browse/c64/dfi
 //
 
 //
@@ -87,5 +88,79 @@
 // sources "cbmconvert-2.1.2_dfi.tar.gz" from the retrohackers forum:
 // http://retrohackers.org/forum/viewtopic.php?p=434#434
 //
+//
+// Same geometry as a CMD native partition, so DFIIStream is a DNPIStream
+// with the root directory and BAM taken from the header. The BAM is read
+// into RAM once, it is only 8 KB.
+//
+
+#ifndef MEATFILESYSTEM_MEDIA_DFI
+#define MEATFILESYSTEM_MEDIA_DFI
+
+#include "meat_io.h"
+#include "dnp.h"
+
+
+#define DFI_BAM_SIZE 8192
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class DFIIStream : public DNPIStream {
+
+public:
+    DFIIStream(std::shared_ptr<MIStream> is, std::string url = "") : DNPIStream(is, url)
+    {
+        header_name_offset = 0x90;
+        readHeader();
+    };
+
+    uint16_t blocksFree() override;
+
+protected:
+    bool readHeader();
+
+    uint32_t m_tracks = 0;
+    uint8_t bam_track = 0;
+    uint8_t bam_sector = 0;
+    std::vector<uint8_t> m_dfiBam;
+
+private:
+    friend class DFIFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class DFIFile: public DNPFile {
+public:
+    DFIFile(std::string path, bool is_dir = true) : DNPFile(path, is_dir) {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class DFIFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new DFIFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".dfi", fileName);
+    }
+
+    DFIFileSystem(): MFileSystem("dfi") {};
+};
+
 
-// https://cbm8bit.com/8bit/commodore/server/Unrenamed%20Achives/browse/c64/dfi
\ No newline at end of file
+#endif /* MEATFILESYSTEM_MEDIA_DFI */
@@ -0,0 +1,56 @@
+// .DHD - CMD HD hard disk image
+// https://ist.uwaterloo.ca/~schepers/formats/D2M-DNP.TXT
+// https://vice-emu.sourceforge.io/vice_17.html
+//
+// A dump of a CMD HD, partitioned like the FD disks (see d2m.h) with the
+// system partition near the start instead of at the end. Images made by
+// VICE are a single native partition without a table, those are read as
+// one.
+//
+
+#ifndef MEATFILESYSTEM_MEDIA_DHD
+#define MEATFILESYSTEM_MEDIA_DHD
+
+#include "meat_io.h"
+#include "d2m.h"
+
+
+// How far into the image the partition table is looked for
+#define DHD_SYSTEM_SEARCH_SIZE (512 * 1024)
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class DHDFile: public D2MFile {
+public:
+    DHDFile(std::string path, bool is_dir = true) : D2MFile(path, "hd", is_dir) {};
+
+protected:
+    bool findPartitionTable( std::shared_ptr<MIStream> image, size_t &offset ) override {
+        return scanPartitionTable(image, 0, std::min(image->size(), (size_t)DHD_SYSTEM_SEARCH_SIZE), offset);
+    };
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class DHDFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new DHDFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".dhd", fileName);
+    }
+
+    DHDFileSystem(): MFileSystem("dhd") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_DHD */
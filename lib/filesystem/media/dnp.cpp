@@ -1,6 +1,101 @@
-
 #include "dnp.h"
 
+/********************************************************
+ * Streams
+ ********************************************************/
+
+std::unordered_map<std::string, DNPIStream::Directory> DNPIStream::directories;
+
+uint16_t DNPIStream::blocksFree()
+{
+    if ( m_blocksFree >= 0 )
+        return m_blocksFree;
+
+    // The last track is in the BAM header, the tracks follow it
+    uint8_t last_track = 0;
+    if ( !seekSector(1, 2, 0x08) || containerStream->read(&last_track, 1) != 1 )
+        return 0;
+
+    uint32_t free_count = 0;
+    uint8_t bam[32];
+    seekSector(1, 2, sizeof(bam));
+    for ( uint16_t i = 1; i <= last_track; i++ )
+    {
+        if ( containerStream->read(bam, sizeof(bam)) != sizeof(bam) )
+            break;
+
+        for ( auto bits : bam )
+            free_count += std::bitset<8>(bits).count();
+    }
+
+    m_blocksFree = std::min(free_count, (uint32_t)UINT16_MAX);
+    Debug_printv("last_track[%d] blocks_free[%d]", last_track, m_blocksFree);
+    return m_blocksFree;
+}
+
+bool DNPIStream::enterDirectory( uint8_t track, uint8_t sector )
+{
+    std::string data = readBlock(track, sector);
+    if ( data.empty() || data[0] == 0 )
+        return false;
+
+    directory_header_offset = { track, sector, header_name_offset };
+    directory_list_offset = { (uint8_t)data[0], (uint8_t)data[1], 0x00 };
+    resetEntryCounter();
+
+    return true;
+}
+
+bool DNPIStream::seekPath(std::string path) {
+    // Walk down the directories in front of the file. A path that ends on
+    // a directory leaves the stream in it, for listing.
+    std::string dir;
+    size_t start = 0;
+    while ( start < path.size() )
+    {
+        size_t slash = path.find('/', start);
+        std::string name = path.substr(start, (slash == std::string::npos) ? slash : slash - start);
+        std::string dirPath = dir.empty() ? name : dir + "/" + name;
+
+        uint8_t t, s;
+        auto cached = directories.find(m_url + "/" + dirPath);
+        if ( m_url.size() && cached != directories.end() && cached->second.image_size == containerStream->size() )
+        {
+            t = cached->second.track;
+            s = cached->second.sector;
+        }
+        else
+        {
+            mstr::toPETSCII(name);
+            if ( !seekEntry(name) || (entry.file_type & 0b00000111) != 0x06 )
+                break;
+
+            t = entry.start_track;
+            s = entry.start_sector;
+            if ( m_url.size() )
+                directories[m_url + "/" + dirPath] = { containerStream->size(), t, s };
+        }
+
+        if ( !enterDirectory(t, s) )
+            return false;
+
+        Debug_printv("directory[%s] header track[%d] sector[%d]", dirPath.c_str(), t, s);
+        dir = dirPath;
+        start = (slash == std::string::npos) ? path.size() : slash + 1;
+    }
+
+    if ( start < path.size() )
+        return D64IStream::seekPath(path.substr(start));
+
+    // A directory, nothing to read
+    seekCalled = true;
+    m_length = 0;
+    m_bytesAvailable = 0;
+    m_position = 0;
+    return true;
+}
+
+
 /********************************************************
  * File implementations
  ********************************************************/
@@ -8,5 +103,16 @@
 MIStream* DNPFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
     Debug_printv("[%s]", url.c_str());
 
-    return new DNPIStream(containerIstream);
+    return new DNPIStream(containerIstream, streamFile->url);
+}
+
+bool DNPFile::isDirectory() {
+    if ( pathInStream == "" )
+        return true;
+
+    auto image = ImageBroker::obtain<D64IStream>(directoryUrl());
+    if ( image == nullptr )
+        return false;
+
+    return image->isDirectoryEntry(entryName());
 }
@@ -1,6 +1,18 @@
 // .DNP - CMD hard Disk Native Partition
 // https://ist.uwaterloo.ca/~schepers/formats/D2M-DNP.TXT
 //
+// Tracks of 256 sectors, up to 255 of them. The header of the root
+// directory is at 1/1, the BAM follows it from 1/2 as one run of 32 bytes
+// per track (the first 32 are the BAM header), and the first directory
+// sector is wherever the header links to, 1/34 on a fresh disk.
+//
+// Entries of type DIR point to the header of a sub-directory, which looks
+// like the root one. Directories are entered by path ("GAMES/ACTION/FILE")
+// and where each one's header lives is remembered per image, so going
+// back into a directory doesn't search its parents again.
+//
+// Native partitions are read only.
+//
 
 #ifndef MEATFILESYSTEM_MEDIA_DNP
 #define MEATFILESYSTEM_MEDIA_DNP
@@ -8,6 +20,8 @@
 #include "meat_io.h"
 #include "d64.h"
 
+#include <unordered_map>
+
 
 /********************************************************
  * Streams
@@ -17,19 +31,47 @@ class DNPIStream : public D64IStream {
     // override everything that requires overriding here
 
 public:
-    DNPIStream(std::shared_ptr<MIStream> is) : D64IStream(is) 
+    DNPIStream(std::shared_ptr<MIStream> is, std::string url = "") : D64IStream(is), m_url(url)
     {
         // DNP Offsets
-        directory_header_offset = {1, 0, 0x04};
-        directory_list_offset = {1, 0, 0x20}; // Read this offset to get t/s link to start of directory
-        block_allocation_map = { {1, 2, 0x10, 1, 255, 8} };
-        sectorsPerTrack = { 255 };
+        directory_header_offset = {1, 1, 0x04};
+        directory_list_offset = {1, 34, 0x00};
+        block_allocation_map = {};      // not writable
+        sectorsPerTrack = { 255 };      // 256 really, see blockIndex
     };
 
-    //virtual uint16_t blocksFree() override;
+    bool isBlock( uint8_t track, uint8_t sector ) override {
+        return track && ((blockIndex(track, sector) + 1) * block_size <= containerStream->size());
+    };
+
+    uint16_t blocksFree() override;
 	virtual uint8_t speedZone( uint8_t track) override { return 0; };
 
 protected:
+    uint32_t blockIndex( uint8_t track, uint8_t sector ) override {
+        return ((track - 1) * 256) + sector;
+    };
+
+    bool seekPath(std::string path) override;
+
+    // Make the directory with its header at track/sector the current one
+    virtual bool enterDirectory( uint8_t track, uint8_t sector );
+
+    // Where the name is in a directory header
+    uint8_t header_name_offset = 0x04;
+
+    // Free blocks, counted once
+    int32_t m_blocksFree = -1;
+
+    // Image url + directory path -> header track/sector
+    struct Directory {
+        size_t image_size;
+        uint8_t track;
+        uint8_t sector;
+    };
+    static std::unordered_map<std::string, Directory> directories;
+
+    std::string m_url;
 
 private:
     friend class DNPFile;
@@ -45,6 +87,10 @@ public:
     DNPFile(std::string path, bool is_dir = true) : D64File(path, is_dir) {};
 
     MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+    MOStream* outputStream() override { return nullptr; };
+
+    bool isDirectory() override;
+    bool remove() override { return false; };
 };
 
 
@@ -1,5 +1,70 @@
 #include "g64.h"
 
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool G64GCRStream::readTrackTable() {
+    if(table_read)
+        return track_offsets.size() > 0;
+
+    table_read = true;
+
+    uint8_t header[12];
+    containerStream->seek(0);
+    if(containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "GCR-1541", 8) != 0) {
+        Debug_printv("not a G64 image");
+        return false;
+    }
+
+    uint8_t half_tracks = header[9];
+    max_track_size = header[10] | (header[11] << 8);
+
+    std::vector<uint8_t> table(half_tracks * 4);
+    if(containerStream->read(table.data(), table.size()) != table.size())
+        return false;
+
+    track_offsets.resize(half_tracks);
+    for(size_t i = 0; i < half_tracks; i++) {
+        track_offsets[i] = table[i * 4] | (table[i * 4 + 1] << 8) | (table[i * 4 + 2] << 16) | ((uint32_t)table[i * 4 + 3] << 24);
+    }
+
+    Debug_printv("half_tracks[%d] max_track_size[%d]", half_tracks, max_track_size);
+    return true;
+}
+
+uint8_t G64GCRStream::trackCount() {
+    if(!readTrackTable())
+        return 0;
+
+    return std::min((size_t)42, (track_offsets.size() + 1) / 2);
+}
+
+bool G64GCRStream::readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) {
+    if(!readTrackTable())
+        return false;
+
+    // Only full tracks carry regular sectors
+    size_t index = (track - 1) * 2;
+    if(index >= track_offsets.size() || track_offsets[index] == 0)
+        return false;
+
+    uint8_t length[2];
+    containerStream->seek(track_offsets[index]);
+    if(containerStream->read(length, 2) != 2)
+        return false;
+
+    size_t track_size = length[0] | (length[1] << 8);
+    if(max_track_size && track_size > max_track_size)
+        track_size = max_track_size;
+
+    bits.resize(track_size);
+    bit_count = containerStream->read(bits.data(), track_size) * 8;
+
+    return bit_count > 0;
+}
+
+
 /********************************************************
  * File implementations
  ********************************************************/
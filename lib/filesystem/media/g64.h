@@ -9,34 +9,49 @@
 
 #include "meat_io.h"
 #include "d64.h"
+#include "gcr.h"
 
 
 /********************************************************
  * Streams
  ********************************************************/
 
+// Raw G64 tracks, decoded to sectors by GCRDiskStream
+class G64GCRStream : public GCRDiskStream {
+
+public:
+    G64GCRStream(std::shared_ptr<MIStream> is) : GCRDiskStream(is) {};
+
+protected:
+    bool readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) override;
+    uint8_t trackCount() override;
+
+private:
+    bool readTrackTable();
+
+    // $00 - $07 : signature "GCR-1541"
+    // $08       : version ($00)
+    // $09       : number of half tracks
+    // $0A - $0B : maximum track size
+    // $0C       : half track offset table, 4 bytes each, 0 = not present
+    std::vector<uint32_t> track_offsets;
+    uint16_t max_track_size = 0;
+    bool table_read = false;
+};
+
 class G64IStream : public D64IStream {
     // override everything that requires overriding here
 
 public:
-    G64IStream(std::shared_ptr<MIStream> is) : D64IStream(is) 
+    G64IStream(std::shared_ptr<MIStream> is) : D64IStream(std::make_shared<G64GCRStream>(is)) 
     {
         // G64 Offsets
         //directory_header_offset = {18, 0, 0x90};
         //directory_list_offset = {18, 1, 0x00};
-        block_allocation_map = { {18, 0, 0x04, 1, 35, 4}, {53, 0, 0x00, 36, 70, 3} };
+        //block_allocation_map = { {18, 0, 0x04, 1, 35, 4} };
         //sectorsPerTrack = { 17, 18, 19, 21 };
     };
 
-    //virtual uint16_t blocksFree() override;
-	virtual uint8_t speedZone( uint8_t track) override
-	{
-        if ( track < 35 )
-		    return (track < 17) + (track < 24) + (track < 30);
-        else
-            return (track < 52) + (track < 59) + (track < 65);
-	};
-
 protected:
 
 private:
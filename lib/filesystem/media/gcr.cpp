@@ -0,0 +1,269 @@
+#include "gcr.h"
+
+// 5 bit GCR code -> 4 bit nibble, 0xFF for codes that never appear
+static const uint8_t gcr_decode_table[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x08, 0x00, 0x01, 0xFF, 0x0C, 0x04, 0x05,
+    0xFF, 0xFF, 0x02, 0x03, 0xFF, 0x0F, 0x06, 0x07,
+    0xFF, 0x09, 0x0A, 0x0B, 0xFF, 0x0D, 0x0E, 0xFF
+};
+
+#define GCR_SYNC_BITS 10
+#define GCR_HEADER_ID 0x08
+#define GCR_DATA_ID 0x07
+#define GCR_HEADER_BITS (10 * 8)
+#define GCR_DATA_BITS (325 * 8)
+// Maximum distance between the end of a header and its data block sync
+#define GCR_GAP_BITS (64 * 8)
+
+/********************************************************
+ * Bitstream helpers
+ ********************************************************/
+
+class GCRBitReader {
+    const std::vector<uint8_t>& bits;
+    size_t count;
+
+public:
+    GCRBitReader(const std::vector<uint8_t>& b, size_t c) : bits(b), count(c) {};
+
+    inline uint8_t bit(size_t pos) {
+        pos %= count;
+        return (bits[pos >> 3] >> (7 - (pos & 7))) & 1;
+    }
+
+    // 8 bits starting at any bit position, wrapping around the track end
+    inline uint8_t byte(size_t pos) {
+        pos %= count;
+        if(pos + 16 <= count) {
+            size_t index = pos >> 3;
+            uint8_t shift = pos & 7;
+            return ((bits[index] << 8 | bits[index + 1]) >> (8 - shift)) & 0xFF;
+        }
+
+        uint8_t value = 0;
+        for(uint8_t i = 0; i < 8; i++)
+            value = (value << 1) | bit(pos + i);
+        return value;
+    }
+
+    // Decode len bytes (multiple of 4) from 40 bit GCR groups at pos
+    bool decode(size_t pos, uint8_t* out, size_t len) {
+        bool valid = true;
+
+        for(size_t group = 0; group < len / 4; group++) {
+            uint64_t value = 0;
+            for(uint8_t i = 0; i < 5; i++)
+                value = (value << 8) | byte(pos + i * 8);
+            pos += 40;
+
+            for(uint8_t i = 0; i < 4; i++) {
+                uint8_t hi = gcr_decode_table[(value >> (35 - i * 10)) & 0x1F];
+                uint8_t lo = gcr_decode_table[(value >> (30 - i * 10)) & 0x1F];
+                if(hi == 0xFF || lo == 0xFF)
+                    valid = false;
+                *out++ = (hi << 4) | (lo & 0x0F);
+            }
+        }
+
+        return valid;
+    }
+
+    // Position of the first bit after the next sync mark, or limit if none
+    size_t findSync(size_t pos, size_t limit) {
+        uint8_t ones = 0;
+
+        for(; pos < limit; pos++) {
+            if(bit(pos)) {
+                if(ones < 0xFF)
+                    ones++;
+            }
+            else {
+                if(ones >= GCR_SYNC_BITS)
+                    return pos;
+                ones = 0;
+            }
+        }
+
+        return limit;
+    }
+};
+
+
+/********************************************************
+ * Decoding
+ ********************************************************/
+
+bool GCRDiskStream::decodeTrack(uint8_t track, std::vector<uint8_t>& sectors) {
+    std::vector<uint8_t> bits;
+    size_t bit_count = 0;
+
+    uint8_t count = sectorsPerTrack(track);
+    sectors.assign(count * 256, 0x00);
+
+    if(!readTrackBits(track, bits, bit_count) || bit_count < GCR_HEADER_BITS + GCR_DATA_BITS) {
+        Debug_printv("track[%d] has no data", track);
+        return false;
+    }
+
+    GCRBitReader reader(bits, bit_count);
+    std::vector<bool> found(count, false);
+    uint8_t found_count = 0;
+    bool decoded = false;
+
+    // Go around twice, so blocks crossing the end of the track are found too
+    size_t limit = bit_count * 2;
+    size_t pos = reader.findSync(0, limit);
+    while(pos < limit && found_count < count) {
+        uint8_t header[8];
+        if(!reader.decode(pos, header, 8) || header[0] != GCR_HEADER_ID) {
+            pos = reader.findSync(pos + 1, limit);
+            continue;
+        }
+
+        uint8_t sector = header[2];
+        if(header[1] != (header[2] ^ header[3] ^ header[4] ^ header[5]) || header[3] != track || sector >= count || found[sector]) {
+            pos = reader.findSync(pos + GCR_HEADER_BITS, limit);
+            continue;
+        }
+
+        size_t data = reader.findSync(pos + GCR_HEADER_BITS, pos + GCR_HEADER_BITS + GCR_GAP_BITS);
+        if(data >= pos + GCR_HEADER_BITS + GCR_GAP_BITS) {
+            pos = reader.findSync(pos + GCR_HEADER_BITS, limit);
+            continue;
+        }
+
+        uint8_t block[260];
+        if(reader.decode(data, block, 260) && block[0] == GCR_DATA_ID) {
+            uint8_t checksum = 0;
+            for(size_t i = 1; i < 257; i++)
+                checksum ^= block[i];
+
+            // A bad copy is better than nothing, but keep looking for a good
+            // one. Nibbled tracks often hold more than one revolution.
+            memcpy(&sectors[sector * 256], &block[1], 256);
+            decoded = true;
+            if(checksum == block[257]) {
+                found[sector] = true;
+                found_count++;
+            }
+            else
+                Debug_printv("track[%d] sector[%d] checksum error", track, sector);
+
+            pos = data + GCR_DATA_BITS;
+        }
+        else {
+            Debug_printv("track[%d] sector[%d] bad data block", track, sector);
+            pos = data;
+        }
+
+        pos = reader.findSync(pos, limit);
+    }
+
+    if(found_count < count)
+        Debug_printv("track[%d] found[%d] of [%d] sectors", track, found_count, count);
+
+    return decoded;
+}
+
+GCRDiskStream::FluxBits::FluxBits(uint16_t cell_time, std::vector<uint8_t>& bits, size_t& bit_count)
+    : m_cellTime(cell_time), m_bits(bits), m_bitCount(bit_count) {
+    m_bits.clear();
+    m_bitCount = 0;
+}
+
+void GCRDiskStream::FluxBits::push(uint8_t bit) {
+    m_current = (m_current << 1) | bit;
+    if((++m_bitCount & 7) == 0) {
+        m_bits.push_back(m_current);
+        m_current = 0;
+    }
+}
+
+void GCRDiskStream::FluxBits::add(uint32_t interval) {
+    // Every transition is a 1, the time in between holds that many 0 cells
+    uint32_t cells = (interval + m_cellTime / 2) / m_cellTime;
+    if(cells == 0)
+        cells = 1;
+    for(uint32_t i = 1; i < cells; i++)
+        push(0);
+    push(1);
+}
+
+void GCRDiskStream::FluxBits::finish() {
+    if(m_bitCount & 7)
+        m_bits.push_back(m_current << (8 - (m_bitCount & 7)));
+    m_current = 0;
+}
+
+
+/********************************************************
+ * Sector image view
+ ********************************************************/
+
+GCRDiskStream::Track* GCRDiskStream::obtainTrack(uint8_t track) {
+    for(auto it = m_tracks.begin(); it != m_tracks.end(); ++it) {
+        if(it->number == track) {
+            // most recently used goes to the front
+            if(it != m_tracks.begin()) {
+                Track t = std::move(*it);
+                m_tracks.erase(it);
+                m_tracks.push_front(std::move(t));
+            }
+            return &m_tracks.front();
+        }
+    }
+
+    if(m_tracks.size() >= GCR_TRACK_CACHE)
+        m_tracks.pop_back();
+
+    m_tracks.push_front({ track, {} });
+    decodeTrack(track, m_tracks.front().sectors);
+    return &m_tracks.front();
+}
+
+size_t GCRDiskStream::trackOffset(uint8_t track) {
+    size_t offset = 0;
+    for(uint8_t t = 1; t < track; t++)
+        offset += sectorsPerTrack(t) * 256;
+    return offset;
+}
+
+size_t GCRDiskStream::size() {
+    return trackOffset(trackCount() + 1);
+}
+
+bool GCRDiskStream::seek(size_t pos) {
+    if(pos > size())
+        return false;
+
+    m_position = pos;
+    return true;
+}
+
+size_t GCRDiskStream::read(uint8_t* buf, size_t size) {
+    size_t count = 0;
+    uint8_t tracks = trackCount();
+
+    while(count < size) {
+        // find the track holding the current position
+        uint8_t track = 1;
+        size_t start = 0;
+        while(track <= tracks && m_position >= start + sectorsPerTrack(track) * 256) {
+            start += sectorsPerTrack(track) * 256;
+            track++;
+        }
+        if(track > tracks)
+            break;
+
+        auto decoded = obtainTrack(track);
+        size_t offset = m_position - start;
+        size_t len = std::min(size - count, decoded->sectors.size() - offset);
+        memcpy(buf + count, &decoded->sectors[offset], len);
+
+        count += len;
+        m_position += len;
+    }
+
+    return count;
+}
@@ -0,0 +1,105 @@
+// GCR - Commodore Group Code Recording
+// https://ist.uwaterloo.ca/~schepers/formats/G64.TXT
+// http://www.baltissen.org/newhtm/1541c.htm
+// https://www.c64-wiki.com/wiki/GCR
+//
+// Shared decoding pipeline for images that don't store sectors directly
+//
+//   flux transitions -> bit cells -> GCR bitstream -> sectors
+//
+// Every image format only has to deliver a track as a GCR bitstream (or as
+// flux timings, see FluxBits). Finding sync marks, decoding the 5-to-4 GCR
+// groups and verifying header/data blocks is done here once for all of them.
+// The result is presented as a plain D64 sector image, so D64IStream can
+// browse it without knowing anything about GCR.
+//
+
+
+#ifndef MEATFILESYSTEM_MEDIA_GCR
+#define MEATFILESYSTEM_MEDIA_GCR
+
+#include "meat_io.h"
+
+#include <deque>
+#include <vector>
+
+
+// Decoded tracks kept in RAM, directory track 18 is usually one of them
+#define GCR_TRACK_CACHE 4
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class GCRDiskStream : public MIStream {
+
+public:
+    GCRDiskStream(std::shared_ptr<MIStream> is) : containerStream(is) {};
+
+    // MStream methods
+    size_t position() override { return m_position; };
+    void close() override { m_tracks.clear(); };
+    bool open() override { return isOpen(); };
+    bool isOpen() override { return containerStream->isOpen(); };
+
+    // MIStream methods
+    bool seek(size_t pos) override;
+    size_t available() override { return size() - m_position; };
+    size_t size() override;
+    size_t read(uint8_t* buf, size_t size) override;
+    bool isRandomAccess() override { return true; };
+
+    // Decode a track into its sectors, 256 bytes each in sector order
+    bool decodeTrack(uint8_t track, std::vector<uint8_t>& sectors);
+
+    static uint8_t sectorsPerTrack(uint8_t track) {
+        return (track < 18) ? 21 : (track < 25) ? 19 : (track < 31) ? 18 : 17;
+    };
+
+    // Bit cell length in nanoseconds for each speed zone (zone 3 is fastest)
+    static uint16_t bitCellTime(uint8_t track) {
+        return (track < 18) ? 3250 : (track < 25) ? 3500 : (track < 31) ? 3750 : 4000;
+    };
+
+protected:
+    std::shared_ptr<MIStream> containerStream;
+
+    // Deliver the raw GCR bitstream of a full track, msb first. The bitstream
+    // is treated as circular, just like the track on a spinning disk.
+    virtual bool readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) = 0;
+
+    // Number of full tracks in the image
+    virtual uint8_t trackCount() = 0;
+
+    // Turns flux transition intervals (nanoseconds) into bit cells, one at
+    // a time as they are read, so no revolution of flux is ever held
+    class FluxBits {
+    public:
+        FluxBits(uint16_t cell_time, std::vector<uint8_t>& bits, size_t& bit_count);
+        void add(uint32_t interval);
+        void finish();
+
+    private:
+        void push(uint8_t bit);
+
+        uint16_t m_cellTime;
+        std::vector<uint8_t>& m_bits;
+        size_t& m_bitCount;
+        uint8_t m_current = 0;
+    };
+
+private:
+    struct Track {
+        uint8_t number;
+        std::vector<uint8_t> sectors;
+    };
+    std::deque<Track> m_tracks;
+
+    size_t m_position = 0;
+
+    Track* obtainTrack(uint8_t track);
+    size_t trackOffset(uint8_t track);
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_GCR */
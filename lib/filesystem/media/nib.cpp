@@ -0,0 +1,65 @@
+#include "nib.h"
+
+#define NIB_HEADER_SIZE 0x100
+#define NIB_TRACK_SIZE 0x2000
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool NIBGCRStream::readTrackTable() {
+    if(table_read)
+        return track_index.size() > 0;
+
+    table_read = true;
+
+    uint8_t header[NIB_HEADER_SIZE];
+    containerStream->seek(0);
+    if(containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "MNIB-1541-RAW", 13) != 0) {
+        Debug_printv("not a NIB image");
+        return false;
+    }
+
+    for(uint8_t i = 0; 0x10 + i * 2 < NIB_HEADER_SIZE; i++) {
+        uint8_t half_track = header[0x10 + i * 2];
+        if(half_track == 0)
+            break;
+        track_index[half_track] = i;
+    }
+
+    Debug_printv("version[%d] tracks[%d]", header[0x0D], track_index.size());
+    return track_index.size() > 0;
+}
+
+uint8_t NIBGCRStream::trackCount() {
+    if(!readTrackTable())
+        return 0;
+
+    return std::min(42, track_index.rbegin()->first / 2);
+}
+
+bool NIBGCRStream::readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) {
+    if(!readTrackTable())
+        return false;
+
+    auto found = track_index.find(track * 2);
+    if(found == track_index.end())
+        return false;
+
+    bits.resize(NIB_TRACK_SIZE);
+    containerStream->seek(NIB_HEADER_SIZE + found->second * NIB_TRACK_SIZE);
+    bit_count = containerStream->read(bits.data(), NIB_TRACK_SIZE) * 8;
+
+    return bit_count > 0;
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+MIStream* NIBFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new NIBIStream(containerIstream);
+}
@@ -1,3 +1,85 @@
 // .NIB - Commodore 1541/1571 nibbler disk image
 // https://github.com/markusC64/nibtools
 // 
+// $00 - $0C : signature "MNIB-1541-RAW"
+// $0D       : version
+// $10 - $FF : track entries, 2 bytes each: half track number, density
+// $100      : track data, $2000 bytes of raw GCR per entry, in entry order
+//
+// The raw data is byte aligned and usually holds a bit more than one
+// revolution of the track.
+//
+
+
+#ifndef MEATFILESYSTEM_MEDIA_NIB
+#define MEATFILESYSTEM_MEDIA_NIB
+
+#include "meat_io.h"
+#include "d64.h"
+#include "gcr.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class NIBGCRStream : public GCRDiskStream {
+
+public:
+    NIBGCRStream(std::shared_ptr<MIStream> is) : GCRDiskStream(is) {};
+
+protected:
+    bool readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) override;
+    uint8_t trackCount() override;
+
+private:
+    bool readTrackTable();
+
+    // half track number -> index of its data block
+    std::map<uint8_t, uint8_t> track_index;
+    bool table_read = false;
+};
+
+class NIBIStream : public D64IStream {
+
+public:
+    NIBIStream(std::shared_ptr<MIStream> is) : D64IStream(std::make_shared<NIBGCRStream>(is)) {};
+
+private:
+    friend class NIBFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class NIBFile: public D64File {
+public:
+    NIBFile(std::string path, bool is_dir = true) : D64File(path, is_dir) {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class NIBFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new NIBFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".nib", fileName);
+    }
+
+    NIBFileSystem(): MFileSystem("nib") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_NIB */
@@ -0,0 +1,71 @@
+#include "p00.h"
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+P00File::P00File(std::string path) : MFile(path)
+{
+    // P00 -> prg and so on, listings show the type instead of "p00"
+    switch ( tolower(extension.size() ? extension[0] : 'p') )
+    {
+        case 's':
+            extension = "seq";
+            break;
+        case 'u':
+            extension = "usr";
+            break;
+        case 'r':
+            extension = "rel";
+            break;
+        default:
+            extension = "prg";
+    }
+}
+
+bool P00File::readHeader(MIStream* stream)
+{
+    m_headerRead = true;
+
+    uint8_t header[P00_HEADER_SIZE];
+    if ( stream == nullptr || !stream->seek(0) || stream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "C64File", 8) != 0 )
+    {
+        Debug_printv("[%s] has no PC64 header", url.c_str());
+        return false;
+    }
+
+    m_cbmName = std::string((char*)&header[8], strnlen((char*)&header[8], 16));
+    m_headerValid = true;
+    return true;
+}
+
+MIStream* P00File::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    if ( !m_headerRead )
+        readHeader(containerIstream.get());
+
+    // Without a header it's taken as the plain file
+    return new OffsetIStream(containerIstream, ( m_headerValid ) ? P00_HEADER_SIZE : 0);
+}
+
+std::string P00File::petsciiName() {
+    if ( !m_headerRead && streamFile != nullptr )
+    {
+        std::unique_ptr<MIStream> stream(streamFile->inputStream());
+        readHeader(stream.get());
+    }
+
+    if ( m_headerValid && m_cbmName.size() )
+        return m_cbmName;
+
+    return MFile::petsciiName();
+}
+
+size_t P00File::size() {
+    if ( streamFile == nullptr )
+        return 0;
+
+    size_t size = streamFile->size();
+    return ( size > P00_HEADER_SIZE ) ? size - P00_HEADER_SIZE : 0;
+}
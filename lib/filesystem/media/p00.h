@@ -1,3 +1,90 @@
 // .P00/P** - P00/S00/U00/R00 (Container files for the PC64 emulator)
 // https://ist.uwaterloo.ca/~schepers/formats/PC64.TXT
-//
\ No newline at end of file
+//
+// A 26 byte header in front of the unchanged CBM file:
+//
+//   $00-$07  "C64File" and a zero
+//   $08-$17  original CBM name, PETSCII, padded with zeros
+//   $18      REL record size
+//   $19      unused
+//
+// The type is the first letter of the extension. The file is served
+// through OffsetIStream, so it LOADs as fast as a plain PRG. Listings use
+// the CBM name from the header instead of the 8.3 host name.
+//
+
+#ifndef MEATFILESYSTEM_MEDIA_P00
+#define MEATFILESYSTEM_MEDIA_P00
+
+#include "meat_io.h"
+#include "wrappers/offset_stream.h"
+
+
+#define P00_HEADER_SIZE 26
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class P00File: public MFile {
+public:
+    P00File(std::string path);
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+
+    // Original CBM name, read from the header on first use
+    std::string petsciiName() override;
+
+    bool isDirectory() override { return false; };
+    bool rewindDirectory() override { return false; };
+    MFile* getNextFileInDir() override { return nullptr; };
+    bool mkDir() override { return false; };
+
+    bool exists() override { return streamFile != nullptr && streamFile->exists(); };
+    bool remove() override { return false; };
+    bool rename(std::string dest) override { return false; };
+    time_t getLastWrite() override { return ( streamFile ) ? streamFile->getLastWrite() : 0; };
+    time_t getCreationTime() override { return ( streamFile ) ? streamFile->getCreationTime() : 0; };
+    size_t size() override;
+
+private:
+    bool readHeader(MIStream* stream);
+
+    std::string m_cbmName;
+    bool m_headerRead = false;
+    bool m_headerValid = false;
+};
+
+
+
+/********************************************************
+ * FS implementations
+ ********************************************************/
+
+class P00FileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new P00File(path);
+    }
+
+    // .P00 to .P99, same for S, U and R
+    static bool isPC64Name(std::string fileName) {
+        size_t length = fileName.length();
+        if ( length < 5 || fileName[length - 4] != '.' )
+            return false;
+
+        char type = tolower(fileName[length - 3]);
+        return strchr("psur", type) && isdigit(fileName[length - 2]) && isdigit(fileName[length - 1]);
+    }
+
+    bool handles(std::string fileName) {
+        return isPC64Name(fileName);
+    }
+
+    P00FileSystem(): MFileSystem("p00") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_P00 */
@@ -0,0 +1,18 @@
+// .P64 - Pulse-based 1541 disk image (NUFLI / VICE)
+// https://github.com/OpenEmulationProject/p64
+// https://vice-emu.sourceforge.io/vice_17.html#SEC339
+//
+// $00 - $07 : signature "P64-1541"
+// $08 - $0B : version
+// $0C - $0F : flags
+// $10 - $13 : size of the chunk data
+// $14 - $17 : CRC32 of the chunk data
+// $18       : chunks, each: 4 byte id, 4 byte size, 4 byte CRC32, data
+//
+// "HTP" + half track number chunks hold the flux pulses of one revolution,
+// as positions in 16MHz ticks (3200000 per rotation). They are stored with
+// an adaptive range coder. "DONE" ends the chunk list.
+//
+// Once the pulses are decoded, a track is flux intervals like SCP and can go
+// through GCRDiskStream the same way.
+//
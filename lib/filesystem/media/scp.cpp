@@ -0,0 +1,112 @@
+#include "scp.h"
+
+#define SCP_TRACK_TABLE 0x10
+#define SCP_TRACK_ENTRIES 168
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool SCPGCRStream::readHeader() {
+    if(header_read)
+        return revolutions > 0;
+
+    header_read = true;
+
+    uint8_t header[SCP_TRACK_TABLE];
+    containerStream->seek(0);
+    if(containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "SCP", 3) != 0) {
+        Debug_printv("not a SCP image");
+        return false;
+    }
+
+    revolutions = header[0x05];
+    end_track = header[0x07];
+    flags = header[0x08];
+    heads = header[0x0A];
+    resolution = 25 * (header[0x0B] + 1);
+
+    Debug_printv("revolutions[%d] tracks[%d-%d] flags[%02X] heads[%d]", revolutions, header[0x06], end_track, flags, heads);
+    return revolutions > 0;
+}
+
+// A 1541 track sits on every second cylinder of a 96tpi drive, and images
+// holding both sides interleave the heads
+uint8_t SCPGCRStream::trackEntry(uint8_t track) {
+    uint8_t cylinder = (track - 1) * ((flags & 0x02) ? 2 : 1);
+    return (heads == 0) ? cylinder * 2 : cylinder;
+}
+
+uint8_t SCPGCRStream::trackCount() {
+    if(!readHeader())
+        return 0;
+
+    uint8_t tracks = 0;
+    while(tracks < 42 && trackEntry(tracks + 1) <= end_track)
+        tracks++;
+
+    return tracks;
+}
+
+bool SCPGCRStream::readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) {
+    if(!readHeader())
+        return false;
+
+    uint8_t entry = trackEntry(track);
+    if(entry >= SCP_TRACK_ENTRIES)
+        return false;
+
+    uint8_t raw[4];
+    containerStream->seek(SCP_TRACK_TABLE + entry * 4);
+    containerStream->read(raw, 4);
+    uint32_t track_offset = raw[0] | (raw[1] << 8) | (raw[2] << 16) | ((uint32_t)raw[3] << 24);
+    if(track_offset == 0)
+        return false;
+
+    // Use the first revolution, GCRDiskStream treats it as circular
+    uint8_t header[16];
+    containerStream->seek(track_offset);
+    if(containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "TRK", 3) != 0)
+        return false;
+
+    uint32_t flux_count = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+    uint32_t data_offset = header[12] | (header[13] << 8) | (header[14] << 16) | ((uint32_t)header[15] << 24);
+
+    // flux -> nanoseconds -> bit cells, as it comes off the image
+    FluxBits cells(bitCellTime(track), bits, bit_count);
+    containerStream->seek(track_offset + data_offset);
+
+    uint8_t buffer[256];
+    uint32_t carry = 0;
+    uint32_t remaining = flux_count;
+    while(remaining) {
+        size_t chunk = std::min((uint32_t)sizeof(buffer) / 2, remaining);
+        if(containerStream->read(buffer, chunk * 2) != chunk * 2)
+            break;
+
+        for(size_t i = 0; i < chunk; i++) {
+            uint32_t value = (buffer[i * 2] << 8) | buffer[i * 2 + 1];
+            if(value == 0) {
+                carry += 65536;
+                continue;
+            }
+            cells.add((carry + value) * resolution);
+            carry = 0;
+        }
+        remaining -= chunk;
+    }
+
+    cells.finish();
+    return bit_count > 0;
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+MIStream* SCPFile::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    return new SCPIStream(containerIstream);
+}
@@ -2,3 +2,93 @@
 // https://www.cbmstuff.com/forum/showthread.php?tid=16
 // https://www.cbmstuff.com/downloads/scp/scp_image_specs.txt
 // 
+// $00 - $02 : signature "SCP"
+// $05       : number of revolutions
+// $06 / $07 : start / end track
+// $08       : flags, bit 1 set = captured with a 96tpi drive
+// $0A       : heads, 0 = both, 1 = side 0, 2 = side 1
+// $0B       : resolution, flux times are in units of 25ns * (resolution + 1)
+// $10       : track header offsets, 4 bytes each
+//
+// Track header: "TRK", track number, then 12 bytes per revolution:
+// index time, flux count, flux data offset (from the track header).
+// Flux data are 16 bit big endian intervals, 0 adds 65536 to the next one.
+//
+
+
+#ifndef MEATFILESYSTEM_MEDIA_SCP
+#define MEATFILESYSTEM_MEDIA_SCP
+
+#include "meat_io.h"
+#include "d64.h"
+#include "gcr.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class SCPGCRStream : public GCRDiskStream {
+
+public:
+    SCPGCRStream(std::shared_ptr<MIStream> is) : GCRDiskStream(is) {};
+
+protected:
+    bool readTrackBits(uint8_t track, std::vector<uint8_t>& bits, size_t& bit_count) override;
+    uint8_t trackCount() override;
+
+private:
+    bool readHeader();
+    uint8_t trackEntry(uint8_t track);
+
+    uint8_t revolutions = 0;
+    uint8_t end_track = 0;
+    uint8_t flags = 0;
+    uint8_t heads = 0;
+    uint16_t resolution = 25;
+    bool header_read = false;
+};
+
+class SCPIStream : public D64IStream {
+
+public:
+    SCPIStream(std::shared_ptr<MIStream> is) : D64IStream(std::make_shared<SCPGCRStream>(is)) {};
+
+private:
+    friend class SCPFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class SCPFile: public D64File {
+public:
+    SCPFile(std::string path, bool is_dir = true) : D64File(path, is_dir) {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class SCPFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new SCPFile(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".scp", fileName);
+    }
+
+    SCPFileSystem(): MFileSystem("scp") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_SCP */
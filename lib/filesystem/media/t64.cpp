@@ -1,82 +1,157 @@
 #include "t64.h"
 
+#include <algorithm>
+
+#define T64_DIRECTORY_OFFSET 0x40
+#define T64_ENTRY_SIZE 32
+
 /********************************************************
  * Streams
  ********************************************************/
 
-bool T64IStream::seekEntry( std::string filename )
+bool T64IStream::readDirectory()
 {
-    uint8_t index = 1;
-    mstr::rtrimA0(filename);
-    mstr::replaceAll(filename, "\\", "/");
+    if ( m_directoryRead )
+        return m_files.size() > 0;
+
+    m_directoryRead = true;
 
-    // Read Directory Entries
-    if ( filename.size() )
+    uint8_t info[4];
+    containerStream->seek(0x22);
+    if ( containerStream->read(info, sizeof(info)) != sizeof(info) )
+        return false;
+
+    // Some converters leave the maximum entry count at zero
+    size_t max_entries = info[0] | (info[1] << 8);
+    size_t used_entries = info[2] | (info[3] << 8);
+    if ( max_entries == 0 )
+        max_entries = std::max(used_entries, (size_t)1);
+
+    size_t image_size = containerStream->size();
+
+    // Read the table in chunks instead of one seek and read per entry
+    uint8_t table[T64_ENTRY_SIZE * 32];
+    size_t index = 0;
+    containerStream->seek(T64_DIRECTORY_OFFSET);
+    while ( index < max_entries )
     {
-        while ( seekEntry( index ) )
-        {
-            std::string entryFilename = entry.filename;
-            mstr::rtrimA0(entryFilename);
-            Debug_printv("filename[%s] entry.filename[%.16s]", filename.c_str(), entryFilename.c_str());
+        size_t count = std::min(max_entries - index, sizeof(table) / T64_ENTRY_SIZE);
+        size_t bytes = containerStream->read(table, count * T64_ENTRY_SIZE);
+        count = bytes / T64_ENTRY_SIZE;
+        if ( count == 0 )
+            break;
 
-            // Read Entry From Stream
-            if (filename == "*")
+        for ( size_t i = 0; i < count; i++ )
+        {
+            uint8_t* raw = &table[i * T64_ENTRY_SIZE];
+
+            // Entry type 0 is a free slot
+            if ( raw[0] == 0x00 )
+                continue;
+
+            Entry e;
+            e.file_type = raw[1] ? raw[1] : 0x82;
+            e.start_address = raw[2] | (raw[3] << 8);
+            e.end_address = raw[4] | (raw[5] << 8);
+            e.data_offset = raw[8] | (raw[9] << 8) | (raw[10] << 16) | ((uint32_t)raw[11] << 24);
+            e.filename = std::string((char*)&raw[16], 16);
+            mstr::rtrimA0(e.filename);
+            mstr::rtrim(e.filename);
+
+            if ( image_size && e.data_offset >= image_size )
             {
-                filename == entryFilename;
+                Debug_printv("entry[%d] data_offset[%d] beyond image", index + i, e.data_offset);
+                continue;
             }
 
-            if ( mstr::startsWith(entryFilename, filename.c_str()) )
-            {
-                // Move stream pointer to start track/sector
-                return true;
-            }
-            index++;
+            m_files.push_back(e);
         }
+
+        index += count;
     }
 
-    entry.filename[0] = '\0';
+    // Many images carry a bogus end address (often $C3C6). The data really
+    // ends where the next file starts or at the end of the image.
+    std::vector<uint32_t> offsets;
+    for ( auto& e: m_files )
+        offsets.push_back(e.data_offset);
+    std::sort(offsets.begin(), offsets.end());
 
-    return false;
+    for ( size_t i = 0; i < m_files.size(); i++ )
+    {
+        auto& e = m_files[i];
+
+        // first one wins, like a scan from the top would
+        m_names.insert(std::make_pair(e.filename, i));
+
+        auto next = std::upper_bound(offsets.begin(), offsets.end(), e.data_offset);
+        size_t limit = ( next != offsets.end() ) ? *next : image_size;
+        if ( limit <= e.data_offset )
+            continue;
+
+        size_t available = limit - e.data_offset;
+        if ( e.end_address <= e.start_address || (size_t)(e.end_address - e.start_address) > available )
+        {
+            e.end_address = std::min(e.start_address + available, (size_t)0xFFFF);
+            Debug_printv("filename[%s] end_address fixed to [%04X]", e.filename.c_str(), e.end_address);
+        }
+    }
+
+    Debug_printv("max_entries[%d] used_entries[%d] files[%d]", max_entries, used_entries, m_files.size());
+    return m_files.size() > 0;
 }
 
-bool T64IStream::seekEntry( size_t index )
+bool T64IStream::seekEntry( std::string filename )
 {
-    // Calculate Sector offset & Entry offset
-    index--;
-    uint8_t entryOffset = 0x40 + (index * sizeof(entry));
+    mstr::rtrimA0(filename);
+    mstr::replaceAll(filename, "\\", "/");
+
+    CBMPattern pattern(filename);
+    if ( !pattern.empty() && readDirectory() )
+    {
+        if ( !pattern.wildcard() )
+        {
+            auto found = m_names.find(filename);
+            if ( found != m_names.end() )
+                return seekEntry( found->second + 1 );
+        }
 
-    //Debug_printv("----------");
-    //Debug_printv("index[%d] sectorOffset[%d] entryOffset[%d] entry_index[%d]", index, sectorOffset, entryOffset, entry_index);
+        for ( size_t index = 0; index < m_files.size(); index++ )
+        {
+            if ( pattern.matches(m_files[index].filename, CBMPattern::fileType(m_files[index].file_type)) )
+                return seekEntry( index + 1 );
+        }
+    }
 
-    containerStream->seek(entryOffset);
-    containerStream->read((uint8_t *)&entry, sizeof(entry));
+    entry.filename.clear();
 
-    //Debug_printv("r[%d] file_type[%02X] file_name[%.16s]", r, entry.file_type, entry.filename);
+    return false;
+}
 
-    //if ( next_track == 0 && next_sector == 0xFF )
-    entry_index = index + 1;    
-    if ( entry.file_type == 0x00 )
+bool T64IStream::seekEntry( size_t index )
+{
+    if ( !readDirectory() || index < 1 || index > m_files.size() )
         return false;
-    else
-        return true;
+
+    entry = m_files[index - 1];
+    entry_index = index;
+    return true;
 }
 
 
 size_t T64IStream::readFile(uint8_t* buf, size_t size) {
     size_t bytesRead = 0;
 
-    if (m_position < 2)
+    // Send Starting Address
+    while ( m_position + bytesRead < 2 && bytesRead < size )
     {
-        //Debug_printv("position[%d]", m_position);
-
-        // Send Starting Address
-        buf[0] = entry.start_address[m_position];
+        buf[bytesRead] = (m_position + bytesRead) ? (entry.start_address >> 8) : (entry.start_address & 0xFF);
         bytesRead++;
     }
-    else
-    {
-        bytesRead += containerStream->read(buf, size);
-    }
+
+    size_t remaining = std::min(size - bytesRead, m_bytesAvailable - bytesRead);
+    if ( remaining )
+        bytesRead += containerStream->read(buf + bytesRead, remaining);
 
     m_bytesAvailable -= bytesRead;
 
@@ -94,15 +169,11 @@ bool T64IStream::seekPath(std::string path) {
     mstr::toPETSCII(path);
     if ( seekEntry(path) )
     {
-        //auto entry = containerImage->entry;
-        auto type = decodeType(entry.file_type).c_str();
-        size_t start_address = UINT16_FROM_HILOBYTES(entry.start_address[1], entry.start_address[0]);
-        size_t end_address = UINT16_FROM_HILOBYTES(entry.end_address[1], entry.end_address[0]);
-        size_t data_offset = UINT32_FROM_LE_UINT32(entry.data_offset);
-        Debug_printv("filename [%.16s] type[%s] start_address[%d] end_address[%d] data_offset[%d]", entry.filename, type, start_address, end_address, data_offset);
+        auto type = decodeType(entry.file_type);
+        Debug_printv("filename [%s] type[%s] start_address[%d] end_address[%d] data_offset[%d]", entry.filename.c_str(), type.c_str(), entry.start_address, entry.end_address, entry.data_offset);
 
         // Calculate file size
-        m_length = ( end_address - start_address ) + 2;
+        m_length = ( entry.end_address - entry.start_address ) + 2;
         m_bytesAvailable = m_length;
         m_position = 0;
 
@@ -174,9 +245,8 @@ MFile* T64File::getNextFileInDir() {
 
     if ( image->seekNextImageEntry() )
     {
-        std::string fileName = mstr::format("%.16s", image->entry.filename);
+        std::string fileName = image->entry.filename;
         mstr::replaceAll(fileName, "/", "\\");
-        mstr::rtrimA0(fileName);
         //Debug_printv( "entry[%s]", (streamFile->url + "/" + fileName).c_str() );
         auto file = MFSOwner::File(streamFile->url + "/" + fileName);
         file->extension = image->decodeType(image->entry.file_type);
@@ -194,14 +264,10 @@ MFile* T64File::getNextFileInDir() {
 size_t T64File::size() {
     // Debug_printv("[%s]", streamFile->url.c_str());
     // use T64 to get size of the file in image
-    auto entry = ImageBroker::obtain<T64IStream>(streamFile->url)->entry;
-
-    //Debug_printv("end0[%d] end1[%d] start0[%d] start1[%d]", entry.end_address[0], entry.end_address[1], entry.start_address[0], entry.start_address[1]);
-    size_t end_address = UINT16_FROM_HILOBYTES(entry.end_address[1], entry.end_address[0]);
-    size_t start_address = UINT16_FROM_HILOBYTES(entry.start_address[1], entry.start_address[0]);
+    auto& entry = ImageBroker::obtain<T64IStream>(streamFile->url)->entry;
 
-    size_t bytes = ( end_address - start_address );
-    //Debug_printv("start_address[%d] end_address[%d] bytes[%d]", start_address, end_address, bytes);
+    size_t bytes = ( entry.end_address - entry.start_address );
+    //Debug_printv("start_address[%d] end_address[%d] bytes[%d]", entry.start_address, entry.end_address, bytes);
 
     return bytes;
 }
@@ -10,6 +10,9 @@
 #include "meat_io.h"
 #include "cbm_image.h"
 
+#include <unordered_map>
+#include <vector>
+
 
 /********************************************************
  * Streams
@@ -27,19 +30,17 @@ protected:
     };
 
     struct Entry {
-        uint8_t entry_type;
         uint8_t file_type;
-        uint8_t start_address[2];
-        uint8_t end_address[2];
-        uint16_t free_1;
+        uint16_t start_address;
+        uint16_t end_address;
         uint32_t data_offset;
-        uint32_t free_2;
-        char filename[16];
+        std::string filename;
     };
 
     void seekHeader() override {
         containerStream->seek(0x28);
         containerStream->read((uint8_t*)&header, 24);
+        readDirectory();
     }
 
     bool seekNextImageEntry() override {
@@ -55,6 +56,12 @@ protected:
     Header header;
     Entry entry;
 
+    // The whole directory is read once, lookups are served from memory
+    bool readDirectory();
+    std::vector<Entry> m_files;
+    std::unordered_map<std::string, size_t> m_names;
+    bool m_directoryRead = false;
+
 private:
     friend class T64File;
 };
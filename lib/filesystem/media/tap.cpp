@@ -1,33 +1,401 @@
 #include "tap.h"
 
+#define TAP_HEADER_SIZE 0x14
+
+// Pulse lengths in TAP units, placed between the nominal kernal short (0x30),
+// medium (0x42) and long (0x56) pulses to allow for tape speed variation
+#define TAP_PULSE_MIN 0x20
+#define TAP_PULSE_SHORT_MAX 0x3A
+#define TAP_PULSE_MEDIUM_MAX 0x4D
+#define TAP_PULSE_LONG_MAX 0x70
+
+// Short pulses needed before a block marker counts as the start of a block
+#define TAP_PILOT_MIN 16
+
+#define TAP_HEADER_BLOCK 192
+#define TAP_SEQ_BLOCK_DATA 191
+
+/********************************************************
+ * Pulse reader
+ ********************************************************/
+
+bool TAPPulseReader::begin() {
+    uint8_t header[TAP_HEADER_SIZE];
+
+    containerStream->seek(0);
+    if ( containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "C64-TAPE-RAW", 12) != 0 )
+        return false;
+
+    version = header[0x0C];
+    m_end = TAP_HEADER_SIZE + (header[0x10] | (header[0x11] << 8) | (header[0x12] << 16) | ((uint32_t)header[0x13] << 24));
+
+    size_t size = containerStream->size();
+    if ( size && m_end > size )
+        m_end = size;
+
+    Debug_printv("version[%d] end[%d]", version, m_end);
+
+    m_bufferLength = 0;
+    return seek(TAP_HEADER_SIZE);
+}
+
+bool TAPPulseReader::seek(size_t offset) {
+    // Still in the buffer, common when going back to a block just indexed
+    if ( offset >= m_bufferStart && offset <= m_bufferStart + m_bufferLength )
+    {
+        m_bufferPos = offset - m_bufferStart;
+        return true;
+    }
+
+    m_bufferStart = offset;
+    m_bufferPos = 0;
+    m_bufferLength = 0;
+    return containerStream->seek(offset);
+}
+
+bool TAPPulseReader::nextByte(uint8_t& value) {
+    if ( m_bufferPos >= m_bufferLength )
+    {
+        size_t next = m_bufferStart + m_bufferLength;
+        if ( next >= m_end )
+            return false;
+
+        if ( m_bufferLength == 0 || containerStream->position() != next )
+            containerStream->seek(next);
+
+        m_bufferStart = next;
+        m_bufferPos = 0;
+        m_bufferLength = containerStream->read(m_buffer, std::min(sizeof(m_buffer), m_end - next));
+        if ( m_bufferLength == 0 )
+            return false;
+    }
+
+    value = m_buffer[m_bufferPos++];
+    return true;
+}
+
+bool TAPPulseReader::nextValue(uint32_t& value) {
+    uint8_t b;
+    if ( !nextByte(b) )
+        return false;
+
+    if ( b )
+    {
+        value = b;
+        return true;
+    }
+
+    // Version 0 only says "longer than 255", newer ones give the cycle count
+    if ( version == 0 )
+    {
+        value = 0x100;
+        return true;
+    }
+
+    uint8_t cycles[3];
+    for ( auto& c: cycles )
+        if ( !nextByte(c) )
+            return false;
+
+    value = (cycles[0] | (cycles[1] << 8) | ((uint32_t)cycles[2] << 16)) / 8;
+    return true;
+}
+
+bool TAPPulseReader::next(uint32_t& pulse) {
+    if ( !nextValue(pulse) )
+        return false;
+
+    // Version 2 stores every half wave on its own
+    if ( version == 2 )
+    {
+        uint32_t half;
+        if ( !nextValue(half) )
+            return false;
+        pulse += half;
+    }
+
+    return true;
+}
+
+
+/********************************************************
+ * Kernal tape decoding
+ ********************************************************/
+
+TAPIStream::Pulse TAPIStream::readPulse() {
+    uint32_t pulse;
+
+    if ( !reader.next(pulse) )
+        return PULSE_END;
+
+    if ( pulse < TAP_PULSE_MIN || pulse > TAP_PULSE_LONG_MAX )
+        return PULSE_INVALID;
+    if ( pulse <= TAP_PULSE_SHORT_MAX )
+        return PULSE_SHORT;
+    if ( pulse <= TAP_PULSE_MEDIUM_MAX )
+        return PULSE_MEDIUM;
+    return PULSE_LONG;
+}
+
+TAPIStream::ByteResult TAPIStream::readByte(uint8_t& value, bool marker_read) {
+    if ( !marker_read )
+    {
+        // Long/medium starts a byte, long/short ends the block
+        if ( readPulse() != PULSE_LONG )
+            return BYTE_ERROR;
+
+        auto pulse = readPulse();
+        if ( pulse == PULSE_SHORT )
+            return BYTE_END;
+        if ( pulse != PULSE_MEDIUM )
+            return BYTE_ERROR;
+    }
+
+    uint8_t parity = 1;
+    value = 0;
+
+    for ( uint8_t i = 0; i < 9; i++ )
+    {
+        auto first = readPulse();
+        auto second = readPulse();
+
+        uint8_t bit;
+        if ( first == PULSE_SHORT && second == PULSE_MEDIUM )
+            bit = 0;
+        else if ( first == PULSE_MEDIUM && second == PULSE_SHORT )
+            bit = 1;
+        else
+            return BYTE_ERROR;
+
+        if ( i < 8 )
+        {
+            value |= bit << i;
+            parity ^= bit;
+        }
+        else if ( bit != parity )
+            return BYTE_ERROR;
+    }
+
+    return BYTE_OK;
+}
+
+bool TAPIStream::findBlock() {
+    size_t shorts = 0;
+
+    // Pilot tone of short pulses followed by the first byte marker
+    while ( true )
+    {
+        auto pulse = readPulse();
+        switch ( pulse )
+        {
+            case PULSE_END:
+                return false;
+
+            case PULSE_SHORT:
+                shorts++;
+                break;
+
+            case PULSE_LONG:
+                if ( shorts >= TAP_PILOT_MIN && readPulse() == PULSE_MEDIUM )
+                    return true;
+                shorts = 0;
+                break;
+
+            default:
+                shorts = 0;
+        }
+    }
+}
+
+bool TAPIStream::readBlock(Block& block) {
+    while ( findBlock() )
+    {
+        uint8_t value;
+        if ( readByte(value, true) != BYTE_OK )
+            continue;
+
+        // Countdown $89..$81 or $09..$01, a damaged first count is tolerated
+        uint8_t count = value & 0x7F;
+        if ( count < 1 || count > 9 )
+            continue;
+
+        block.repeat = !(value & 0x80);
+        while ( count > 1 )
+        {
+            if ( readByte(value) != BYTE_OK )
+                break;
+
+            count = value & 0x7F;
+            if ( count < 1 || count > 9 )
+                break;
+        }
+        if ( count != 1 )
+            continue;
+
+        block.offset = reader.tell();
+        block.length = 0;
+
+        uint8_t checksum = 0;
+        while ( readByte(value) == BYTE_OK )
+        {
+            if ( block.length < sizeof(block.data) )
+                block.data[block.length] = value;
+            block.length++;
+            checksum ^= value;
+        }
+
+        if ( block.length == 0 )
+            continue;
+
+        // The last byte is the checksum, so everything xors to zero
+        block.length--;
+        block.valid = (checksum == 0);
+        return true;
+    }
+
+    return false;
+}
+
+bool TAPIStream::buildIndex() {
+    if ( m_indexed )
+        return m_files.size() > 0;
+
+    m_indexed = true;
+
+    if ( !reader.begin() )
+    {
+        Debug_printv("not a TAP image");
+        return false;
+    }
+
+    auto parseHeader = [](Entry& file, Block& block) {
+        file.start_address = block.data[1] | (block.data[2] << 8);
+        file.end_address = block.data[3] | (block.data[4] << 8);
+        memcpy(file.filename, &block.data[5], sizeof(file.filename));
+    };
+
+    Block block;
+    std::vector<uint16_t> errors;
+    int prg = -1;           // PRG header still waiting for its data block
+    int seq = -1;           // SEQ file collecting its data blocks
+    int last_file = -1;     // file the previous first copy belonged to
+    bool last_header = false;
+    bool last_valid = true;
+    bool last_first = false;
+
+    while ( readBlock(block) )
+    {
+        // The repeated copy only matters when the first one was damaged
+        if ( block.repeat && last_first )
+        {
+            last_first = false;
+            if ( last_valid || !block.valid || last_file < 0 )
+                continue;
+
+            auto& file = m_files[last_file];
+            if ( last_header )
+                parseHeader(file, block);
+            else
+                file.segments.back().offset = block.offset;
+            errors[last_file]--;
+            continue;
+        }
+
+        bool header = (block.length == TAP_HEADER_BLOCK && block.data[0] >= 1 && block.data[0] <= 5);
+        last_file = -1;
+
+        if ( prg >= 0 && !(header && (m_files[prg].end_address - m_files[prg].start_address) != TAP_HEADER_BLOCK) )
+        {
+            auto& file = m_files[prg];
+            uint16_t length = file.end_address - file.start_address;
+            file.segments.push_back({ block.offset, 0, (uint16_t)std::min((size_t)length, block.length) });
+            last_file = prg;
+            last_header = false;
+            prg = -1;
+        }
+        else if ( header )
+        {
+            prg = -1;
+            switch ( block.data[0] )
+            {
+                case 1:     // relocatable program
+                case 3:     // non-relocatable program
+                case 4:     // SEQ file header
+                {
+                    Entry file;
+                    file.file_type = (block.data[0] == 4) ? 0x81 : 0x82;
+                    parseHeader(file, block);
+                    m_files.push_back(file);
+                    errors.push_back(0);
+
+                    last_file = m_files.size() - 1;
+                    last_header = true;
+                    if ( block.data[0] == 4 )
+                        seq = last_file;
+                    else
+                    {
+                        prg = last_file;
+                        seq = -1;
+                    }
+                    break;
+                }
+
+                case 2:     // SEQ data block
+                    if ( seq >= 0 )
+                    {
+                        m_files[seq].segments.push_back({ block.offset, 1, TAP_SEQ_BLOCK_DATA });
+                        last_file = seq;
+                        last_header = false;
+                    }
+                    break;
+
+                case 5:     // end of tape marker
+                    seq = -1;
+                    break;
+            }
+        }
+        else
+        {
+            Debug_printv("offset[%d] length[%d] unexpected block", block.offset, block.length);
+        }
+
+        last_first = true;
+        last_valid = block.valid;
+        if ( !block.valid && last_file >= 0 )
+            errors[last_file]++;
+    }
+
+    // Files with damaged blocks are listed as not closed (splat files)
+    for ( size_t i = 0; i < m_files.size(); i++ )
+    {
+        if ( errors[i] || (m_files[i].file_type == 0x82 && m_files[i].segments.empty()) )
+            m_files[i].file_type &= 0x7F;
+    }
+
+    Debug_printv("files[%d]", m_files.size());
+    return m_files.size() > 0;
+}
+
+
 /********************************************************
  * Streams
  ********************************************************/
 
 bool TAPIStream::seekEntry( std::string filename )
 {
-    uint8_t index = 1;
+    size_t index = 1;
     mstr::rtrimA0(filename);
     mstr::replaceAll(filename, "\\", "/");
 
     // Read Directory Entries
-    if ( filename.size() )
+    CBMPattern pattern(filename);
+    if ( !pattern.empty() )
     {
         while ( seekEntry( index ) )
         {
-            std::string entryFilename = entry.filename;
-            mstr::rtrimA0(entryFilename);
-            Debug_printv("filename[%s] entry.filename[%.16s]", filename.c_str(), entryFilename.c_str());
-
             // Read Entry From Stream
-            if (filename == "*")
-            {
-                filename == entryFilename;
-            }
-            
-            if ( mstr::startsWith(entryFilename, filename.c_str()) )
+            if ( pattern.matches(entry.filename, sizeof(entry.filename), CBMPattern::fileType(entry.file_type)) )
             {
-                // Move stream pointer to start track/sector
                 return true;
             }
             index++;
@@ -41,32 +409,60 @@ bool TAPIStream::seekEntry( std::string filename )
 
 bool TAPIStream::seekEntry( size_t index )
 {
-    // Calculate Sector offset & Entry offset
-    index--;
-    uint8_t entryOffset = 0x40 + (index * sizeof(entry));
+    if ( !buildIndex() || index < 1 || index > m_files.size() )
+        return false;
 
-    //Debug_printv("----------");
-    //Debug_printv("index[%d] sectorOffset[%d] entryOffset[%d] entry_index[%d]", index, sectorOffset, entryOffset, entry_index);
+    entry = m_files[index - 1];
+    entry_index = index;
+    return true;
+}
 
-    containerStream->seek(entryOffset);
-    containerStream->read((uint8_t *)&entry, sizeof(entry));
+bool TAPIStream::nextSegment() {
+    if ( m_segment >= entry.segments.size() )
+        return false;
 
-    //Debug_printv("r[%d] file_type[%02X] file_name[%.16s]", r, entry.file_type, entry.filename);
+    auto& segment = entry.segments[m_segment++];
+    reader.seek(segment.offset);
 
-    //if ( next_track == 0 && next_sector == 0xFF )
-    entry_index = index + 1;    
-    if ( entry.file_type == 0x00 )
-        return false;
-    else
-        return true;
-}
+    uint8_t value;
+    for ( uint16_t i = 0; i < segment.skip; i++ )
+        if ( readByte(value) != BYTE_OK )
+            return false;
 
+    m_segmentRemaining = segment.length;
+    return true;
+}
 
 size_t TAPIStream::readFile(uint8_t* buf, size_t size) {
     size_t bytesRead = 0;
+    bool load_address = ( (entry.file_type & 0x07) == 2 );
+
+    while ( bytesRead < size && m_bytesAvailable )
+    {
+        size_t position = m_position + bytesRead;
+
+        if ( load_address && position < 2 )
+        {
+            // Send Starting Address
+            buf[bytesRead] = position ? (entry.start_address >> 8) : (entry.start_address & 0xFF);
+        }
+        else
+        {
+            uint8_t value;
+            if ( (!m_segmentRemaining && !nextSegment()) || readByte(value) != BYTE_OK )
+            {
+                Debug_printv("read error at offset[%d]", reader.tell());
+                m_bytesAvailable = 0;
+                break;
+            }
 
-    bytesRead += containerStream->read(buf, size);
-    m_bytesAvailable -= bytesRead;
+            buf[bytesRead] = value;
+            m_segmentRemaining--;
+        }
+
+        bytesRead++;
+        m_bytesAvailable--;
+    }
 
     return bytesRead;
 }
@@ -82,22 +478,18 @@ bool TAPIStream::seekPath(std::string path) {
     mstr::toPETSCII(path);
     if ( seekEntry(path) )
     {
-        //auto entry = containerImage->entry;
-        auto type = decodeType(entry.file_type).c_str();
-        size_t start_address = UINT16_FROM_LE_UINT16(entry.start_address);
-        size_t end_address = UINT16_FROM_LE_UINT16(entry.end_address);
-        size_t data_offset = UINT32_FROM_LE_UINT32(entry.data_offset);
-        Debug_printv("filename [%.16s] type[%s] start_address[%d] end_address[%d] data_offset[%d]", entry.filename, type, start_address, end_address, data_offset);
+        m_length = ( (entry.file_type & 0x07) == 2 ) ? 2 : 0;
+        for ( auto& segment: entry.segments )
+            m_length += segment.length;
 
-        // Calculate file size
-        m_length = ( end_address - start_address );
         m_bytesAvailable = m_length;
+        m_position = 0;
+        m_segment = 0;
+        m_segmentRemaining = 0;
 
-        // Set position to beginning of file
-        containerStream->seek(entry.data_offset);
+        Debug_printv("filename [%.16s] start_address[%d] end_address[%d] segments[%d]", entry.filename, entry.start_address, entry.end_address, entry.segments.size());
+        Debug_printv("File Size: size[%d] available[%d] position[%d]", m_length, m_bytesAvailable, m_position);
 
-        Debug_printv("File Size: size[%d] available[%d]", m_length, m_bytesAvailable);
-        
         return true;
     }
     else
@@ -140,8 +532,9 @@ bool TAPFile::rewindDirectory() {
     image->seekHeader();
 
     // Set Media Info Fields
-    media_header = mstr::format("%.24", image->header.disk_name);
-    media_id = "TAP";
+    media_header = name;
+    mstr::toPETSCII(media_header);
+    media_id = " TAP ";
     media_blocks_free = 0;
     media_block_size = image->block_size;
     media_image = name;
@@ -163,6 +556,8 @@ MFile* TAPFile::getNextFileInDir() {
     {
         std::string fileName = mstr::format("%.16s", image->entry.filename);
         mstr::replaceAll(fileName, "/", "\\");
+        mstr::rtrimA0(fileName);
+        mstr::rtrim(fileName);
         //Debug_printv( "entry[%s]", (streamFile->url + "/" + fileName).c_str() );
         auto file = MFSOwner::File(streamFile->url + "/" + fileName);
         file->extension = image->decodeType(image->entry.file_type);
@@ -180,9 +575,11 @@ MFile* TAPFile::getNextFileInDir() {
 size_t TAPFile::size() {
     // Debug_printv("[%s]", streamFile->url.c_str());
     // use TAP to get size of the file in image
-    auto image = ImageBroker::obtain<TAPIStream>(streamFile->url);
+    auto entry = ImageBroker::obtain<TAPIStream>(streamFile->url)->entry;
 
-    size_t blocks = (UINT16_FROM_LE_UINT16(image->entry.end_address) - UINT16_FROM_LE_UINT16(image->entry.start_address)) / image->block_size;
+    size_t bytes = 0;
+    for ( auto& segment: entry.segments )
+        bytes += segment.length;
 
-    return blocks;
+    return bytes;
 }
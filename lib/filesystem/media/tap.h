@@ -6,6 +6,16 @@
 // https://web.archive.org/web/20170117094643/http://tapes.c64.no/
 // https://web.archive.org/web/20191021114418/http://www.subchristsoftware.com:80/finaltap.htm
 //
+// $00 - $0B : signature "C64-TAPE-RAW"
+// $0C       : version, 0 = overflow byte, 1 = 24 bit overflow, 2 = half waves
+// $10 - $13 : size of the pulse data
+// $14       : pulse data, one byte per pulse in units of 8 cycles
+//
+// Only the standard kernal encoding is decoded. Every byte is a long/medium
+// marker, 8 bits lsb first (short/medium = 0, medium/short = 1) and an odd
+// parity bit. Blocks start with a countdown $89..$81 ($09..$01 for the
+// repeated copy) and end with their xor checksum.
+//
 
 
 #ifndef MEATFILESYSTEM_MEDIA_TAP
@@ -14,37 +24,68 @@
 #include "meat_io.h"
 #include "cbm_image.h"
 
+#include <vector>
+
+
+#define TAP_BUFFER_SIZE 512
 
 /********************************************************
  * Streams
  ********************************************************/
 
+class TAPPulseReader {
+
+public:
+    TAPPulseReader(std::shared_ptr<MIStream> is) : containerStream(is) {};
+
+    // Check the signature and move to the first pulse
+    bool begin();
+
+    // Next full pulse in TAP units (8 cycles)
+    bool next(uint32_t& pulse);
+
+    // File offset of the next pulse, can be handed back to seek
+    size_t tell() { return m_bufferStart + m_bufferPos; };
+    bool seek(size_t offset);
+
+    uint8_t version = 0;
+
+private:
+    bool nextValue(uint32_t& value);
+    bool nextByte(uint8_t& value);
+
+    std::shared_ptr<MIStream> containerStream;
+
+    uint8_t m_buffer[TAP_BUFFER_SIZE];
+    size_t m_bufferStart = 0;
+    size_t m_bufferPos = 0;
+    size_t m_bufferLength = 0;
+    size_t m_end = 0;
+};
+
 class TAPIStream : public CBMImageStream {
     // override everything that requires overriding here
 
 public:
-    TAPIStream(std::shared_ptr<MIStream> is) : CBMImageStream(is) { };
+    TAPIStream(std::shared_ptr<MIStream> is) : CBMImageStream(is), reader(is) { };
 
 protected:
-    struct Header {
-        char disk_name[24];
+    struct Segment {
+        size_t offset;      // pulse offset of the first payload byte
+        uint16_t skip;      // payload bytes that are not file data
+        uint16_t length;    // file data bytes
     };
 
     struct Entry {
-        uint8_t entry_type;
         uint8_t file_type;
         uint16_t start_address;
         uint16_t end_address;
-        uint16_t free_1;
-        uint32_t data_offset;
-        uint32_t free_2;
         char filename[16];
+        std::vector<Segment> segments;
     };
 
     void seekHeader() override {
-        Debug_printv("here");
-        containerStream->seek(0x28);
-        containerStream->read((uint8_t*)&header, sizeof(header));
+        buildIndex();
     }
 
     bool seekNextImageEntry() override {
@@ -57,10 +98,35 @@ protected:
     size_t readFile(uint8_t* buf, size_t size) override;
     bool seekPath(std::string path) override;
 
-    Header header;
     Entry entry;
 
 private:
+    enum Pulse { PULSE_SHORT, PULSE_MEDIUM, PULSE_LONG, PULSE_INVALID, PULSE_END };
+    enum ByteResult { BYTE_OK, BYTE_END, BYTE_ERROR };
+
+    struct Block {
+        bool repeat;        // second copy, countdown $09..$01
+        bool valid;         // checksum matched
+        size_t offset;      // pulse offset of the first payload byte
+        size_t length;      // payload bytes without the checksum
+        uint8_t data[192];  // start of the payload, a full header block
+    };
+
+    Pulse readPulse();
+    ByteResult readByte(uint8_t& value, bool marker_read = false);
+    bool findBlock();
+    bool readBlock(Block& block);
+    bool nextSegment();
+
+    // Scan the whole tape once, the result is kept for every later access
+    bool buildIndex();
+    std::vector<Entry> m_files;
+    bool m_indexed = false;
+
+    TAPPulseReader reader;
+    size_t m_segment = 0;
+    size_t m_segmentRemaining = 0;
+
     friend class TAPFile;
 };
 
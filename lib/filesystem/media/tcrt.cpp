@@ -1,69 +1,140 @@
 #include "tcrt.h"
 
+// Flash contents start after the header and loader, file offsets in the
+// directory count 256 byte pages from there
+#define TCRT_FLASH_OFFSET 0xD8
+#define TCRT_PAGE_SIZE 0x100
+#define TCRT_DIRECTORY_OFFSET 0xE7
+#define TCRT_ENTRY_SIZE 32
+#define TCRT_MAX_ENTRIES 128
+
 /********************************************************
  * Streams
  ********************************************************/
 
-bool TCRTIStream::seekEntry( std::string filename )
+bool TCRTIStream::readDirectory()
 {
-    size_t index = 1;
-    mstr::rtrimA0(filename);
-    mstr::replaceAll(filename, "\\", "/");
+    if ( m_directoryRead )
+        return m_files.size() > 0;
 
-    // Read Directory Entries
-    if ( filename.size() )
+    m_directoryRead = true;
+
+    size_t image_size = containerStream->size();
+
+    // Read the table in chunks instead of one seek and read per entry
+    uint8_t table[TCRT_ENTRY_SIZE * 16];
+    size_t index = 0;
+    bool done = false;
+    containerStream->seek(TCRT_DIRECTORY_OFFSET);
+    while ( !done && index < TCRT_MAX_ENTRIES )
     {
-        while ( seekEntry( index ) )
+        size_t count = std::min((size_t)TCRT_MAX_ENTRIES - index, sizeof(table) / TCRT_ENTRY_SIZE);
+        count = containerStream->read(table, count * TCRT_ENTRY_SIZE) / TCRT_ENTRY_SIZE;
+        if ( count == 0 )
+            break;
+
+        for ( size_t i = 0; i < count; i++ )
         {
-            std::string entryFilename = entry.filename;
-            mstr::rtrimA0(entryFilename);
-            Debug_printv("filename[%s] entry.filename[%.16s]", filename.c_str(), entryFilename.c_str());
+            uint8_t* raw = &table[i * TCRT_ENTRY_SIZE];
 
-            // Read Entry From Stream
-            if (filename == "*")
+            // End of directory
+            if ( raw[16] == 0xFF )
             {
-                filename == entryFilename;
+                done = true;
+                break;
             }
-            
-            if ( mstr::startsWith(entryFilename, filename.c_str()) )
+
+            Entry e;
+            e.filename = std::string((char*)raw, 16);
+            mstr::rtrimA0(e.filename);
+            mstr::rtrim(e.filename);
+            e.file_type = raw[16];
+            e.data_offset = TCRT_FLASH_OFFSET + ((raw[17] | (raw[18] << 8)) * TCRT_PAGE_SIZE);
+            e.file_size = raw[19] | (raw[20] << 8) | ((uint32_t)raw[21] << 16);
+            e.load_address = raw[22] | (raw[23] << 8);
+            e.bundle.compatibility = raw[24] | (raw[25] << 8);
+            e.bundle.main_start = raw[26] | (raw[27] << 8);
+            e.bundle.main_length = raw[28] | (raw[29] << 8);
+            e.bundle.main_call_address = raw[30] | (raw[31] << 8);
+
+            if ( image_size && e.data_offset + e.file_size > image_size )
             {
-                // Move stream pointer to start track/sector
-                return true;
+                Debug_printv("filename[%s] data_offset[%d] file_size[%d] beyond image", e.filename.c_str(), e.data_offset, e.file_size);
+                continue;
             }
-            index++;
+
+            // first one wins, like a scan from the top would
+            m_names.insert(std::make_pair(e.filename, m_files.size()));
+            m_files.push_back(e);
+        }
+
+        index += count;
+    }
+
+    Debug_printv("files[%d]", m_files.size());
+    return m_files.size() > 0;
+}
+
+bool TCRTIStream::seekEntry( std::string filename )
+{
+    mstr::rtrimA0(filename);
+    mstr::replaceAll(filename, "\\", "/");
+
+    CBMPattern pattern(filename);
+    if ( !pattern.empty() && readDirectory() )
+    {
+        if ( !pattern.wildcard() )
+        {
+            auto found = m_names.find(filename);
+            if ( found != m_names.end() )
+                return seekEntry( found->second + 1 );
+        }
+
+        for ( size_t index = 0; index < m_files.size(); index++ )
+        {
+            if ( pattern.matches(m_files[index].filename, CBMPattern::fileType(m_files[index].file_type)) )
+                return seekEntry( index + 1 );
         }
     }
 
-    entry.filename[0] = '\0';
+    entry.filename.clear();
 
     return false;
 }
 
 bool TCRTIStream::seekEntry( size_t index )
 {
-    // Calculate Sector offset & Entry offset
-    index--;
-    size_t entryOffset = 0xE7 + (index * 32);
-
-    Debug_printv("----------");
-    Debug_printv("index[%d] entryOffset[%d] entry_index[%d]", (index + 1), entryOffset, entry_index);
-
-    containerStream->seek(entryOffset);
-    containerStream->read((uint8_t *)&entry, sizeof(entry));
+    if ( !readDirectory() || index < 1 || index > m_files.size() )
+        return false;
 
-    Debug_printv("file_type[%02X] file_name[%.16s]", entry.file_type, entry.filename);
+    entry = m_files[index - 1];
+    entry_index = index;
+    return true;
+}
 
-    entry_index = index + 1;    
-    if ( entry.file_type == 0xFF )
+bool TCRTIStream::bundle(Bundle& info)
+{
+    if ( entry.filename.empty() || entry.bundle.main_length == 0 )
         return false;
-    else
-        return true;
+
+    info = entry.bundle;
+    return true;
 }
 
 size_t TCRTIStream::readFile(uint8_t* buf, size_t size) {
     size_t bytesRead = 0;
 
-    bytesRead += containerStream->read(buf, size);
+    // Send Starting Address
+    while ( m_position + bytesRead < 2 && bytesRead < size )
+    {
+        buf[bytesRead] = (m_position + bytesRead) ? (m_loadAddress >> 8) : (m_loadAddress & 0xFF);
+        bytesRead++;
+    }
+
+    size_t remaining = std::min(size - bytesRead, m_bytesAvailable - bytesRead);
+    if ( remaining )
+        bytesRead += containerStream->read(buf + bytesRead, remaining);
+
     m_bytesAvailable -= bytesRead;
 
     return bytesRead;
@@ -76,17 +147,25 @@ bool TCRTIStream::seekPath(std::string path) {
 
     entry_index = 0;
 
+    // "NAME/MAIN" is the main program of a bundle, LOAD"NAME/MAIN" starts
+    // it without loading the rest of the file
+    size_t slash = path.rfind('/');
+    std::string part = (slash != std::string::npos) ? path.substr(slash + 1) : "";
+    if ( mstr::equals(part, (char *)"main", false) && seekBundleMain(path.substr(0, slash)) )
+        return true;
+
     // call image method to obtain file bytes here, return true on success:
     mstr::toPETSCII(path);
     if ( seekEntry(path) )
     {
-        //auto entry = containerImage->entry;
-        auto type = decodeType(entry.file_type).c_str();
-        Debug_printv("filename [%.16s] type[%s]", entry.filename, type);
+        auto type = decodeType(entry.file_type);
+        Debug_printv("filename [%s] type[%s] load_address[%04X] data_offset[%d]", entry.filename.c_str(), type.c_str(), entry.load_address, entry.data_offset);
 
         // Calculate file size
-        m_length = entry.file_size[0] + entry.file_size[0] + entry.file_size[0];
+        m_length = entry.file_size + 2;
         m_bytesAvailable = m_length;
+        m_position = 0;
+        m_loadAddress = entry.load_address;
 
         // Set position to beginning of file
         containerStream->seek(entry.data_offset);
@@ -103,6 +182,29 @@ bool TCRTIStream::seekPath(std::string path) {
     return false;
 };
 
+bool TCRTIStream::seekBundleMain(std::string path) {
+    Bundle info;
+
+    if ( !seekPath(path) || !bundle(info) )
+        return false;
+
+    if ( (uint32_t)info.main_start + info.main_length > entry.file_size )
+    {
+        Debug_printv("filename [%s] bundle main outside of file", entry.filename.c_str());
+        return false;
+    }
+
+    m_length = info.main_length + 2;
+    m_bytesAvailable = m_length;
+    m_loadAddress = entry.load_address + info.main_start;
+
+    containerStream->seek(entry.data_offset + info.main_start);
+
+    Debug_printv("filename [%s] main_start[%d] main_length[%d] call_address[%04X]", entry.filename.c_str(), info.main_start, info.main_length, info.main_call_address);
+
+    return true;
+}
+
 /********************************************************
  * File implementations
  ********************************************************/
@@ -135,7 +237,7 @@ bool TCRTFile::rewindDirectory() {
     image->seekHeader();
 
     // Set Media Info Fields
-    media_header = mstr::format("%.24", image->header.disk_name);
+    media_header = mstr::format("%.16s", image->header.disk_name);
     media_id = "tcrt";
     media_blocks_free = 0;
     media_block_size = image->block_size;
@@ -156,7 +258,7 @@ MFile* TCRTFile::getNextFileInDir() {
 
     if ( image->seekNextImageEntry() )
     {
-        std::string fileName = mstr::format("%.16s", image->entry.filename);
+        std::string fileName = image->entry.filename;
         mstr::replaceAll(fileName, "/", "\\");
         //Debug_printv( "entry[%s]", (streamFile->url + "/" + fileName).c_str() );
         auto file = MFSOwner::File(streamFile->url + "/" + fileName);
@@ -175,10 +277,7 @@ MFile* TCRTFile::getNextFileInDir() {
 size_t TCRTFile::size() {
     // Debug_printv("[%s]", streamFile->url.c_str());
     // use TCRT to get size of the file in image
-    auto image = ImageBroker::obtain<TCRTIStream>(streamFile->url);
-
-    //size_t blocks = (UINT16_FROM_LE_UINT16(image->entry.start_address) + image->entry.file_size)) / image->block_size;
-    size_t blocks = 1;
+    auto& entry = ImageBroker::obtain<TCRTIStream>(streamFile->url)->entry;
 
-    return blocks;
+    return entry.file_size;
 }
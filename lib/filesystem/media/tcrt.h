@@ -8,7 +8,10 @@
 #define MEATFILESYSTEM_MEDIA_TCRT
 
 #include "meat_io.h"
-#include "d64.h"
+#include "cbm_image.h"
+
+#include <unordered_map>
+#include <vector>
 
 
 /********************************************************
@@ -21,27 +24,40 @@ class TCRTIStream : public CBMImageStream {
 public:
     TCRTIStream(std::shared_ptr<MIStream> is) : CBMImageStream(is) {};
 
+    // Bundles carry a main program inside the file that can be started
+    // without loading the rest, it is opened as "NAME/MAIN"
+    struct Bundle {
+        uint16_t compatibility;
+        uint16_t main_start;
+        uint16_t main_length;
+        uint16_t main_call_address;
+    };
+
+    bool bundle(Bundle& info);
+
+    // Like seekPath, but only serves the bundle main program (with its own
+    // load address) so it can be sent to the computer first
+    bool seekBundleMain(std::string path);
+
 protected:
     struct Header {
         char disk_name[16];
     };
 
     struct Entry {
-        char filename[16];
+        std::string filename;
         uint8_t file_type;
-        uint16_t data_offset;
-        uint8_t file_size[3];
+        uint32_t data_offset;       // absolute offset in the image
+        uint32_t file_size;
         uint16_t load_address;
-        uint16_t bundle_compatibility;
-        uint16_t bundle_main_start;
-        uint16_t bundle_main_length;
-        uint16_t bundle_main_call_address;
+        Bundle bundle;
     };
 
     void seekHeader() override {
         Debug_printv("here");
         containerStream->seek(0x18);
         containerStream->read((uint8_t*)&header, sizeof(header));
+        readDirectory();
     }
 
     bool seekNextImageEntry() override {
@@ -57,6 +73,15 @@ protected:
     Header header;
     Entry entry;
 
+    // The whole directory is read once, lookups are served from memory
+    bool readDirectory();
+    std::vector<Entry> m_files;
+    std::unordered_map<std::string, size_t> m_names;
+    bool m_directoryRead = false;
+
+    // Load address sent in front of the data
+    uint16_t m_loadAddress = 0;
+
 private:
     friend class TCRTFile;
 };
@@ -0,0 +1,30 @@
+#include "x64.h"
+
+// 40 track single sided image with error info, anything larger is a D71
+#define X64_D64_MAX_SIZE 197376
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+MIStream* X64File::createIStream(std::shared_ptr<MIStream> containerIstream) {
+    Debug_printv("[%s]", url.c_str());
+
+    uint8_t header[4];
+    if ( !containerIstream->seek(0) || containerIstream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "C\x15\x41\x64", 4) != 0 )
+        Debug_printv("[%s] bad X64 signature", url.c_str());
+
+    auto image = std::make_shared<OffsetIStream>(containerIstream, X64_HEADER_SIZE);
+    if ( image->size() > X64_D64_MAX_SIZE )
+        return new D71IStream(image);
+
+    return new D64IStream(image);
+}
+
+std::shared_ptr<MOStream> X64File::imageOStream() {
+    auto ostream = D64File::imageOStream();
+    if ( ostream == nullptr )
+        return nullptr;
+
+    return std::make_shared<OffsetOStream>(ostream, X64_HEADER_SIZE);
+}
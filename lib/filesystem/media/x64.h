@@ -1,3 +1,55 @@
 // .X64 - Disk Image Format
 // https://vice-emu.sourceforge.io/vice_17.html#SEC350
 //
+// A 64 byte header (signature, version, drive type, track count) in front
+// of a plain sector image. The image behind it is handed to D64IStream (or
+// D71IStream for double sided ones) through OffsetIStream, so every
+// sector access goes straight to the container. Writes go through
+// OffsetOStream the same way.
+//
+
+#ifndef MEATFILESYSTEM_MEDIA_X64
+#define MEATFILESYSTEM_MEDIA_X64
+
+#include "meat_io.h"
+#include "d64.h"
+#include "d71.h"
+#include "wrappers/offset_stream.h"
+
+
+#define X64_HEADER_SIZE 64
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class X64File: public D64File {
+public:
+    X64File(std::string path, bool is_dir = true) : D64File(path, is_dir) {};
+
+    MIStream* createIStream(std::shared_ptr<MIStream> containerIstream) override;
+    std::shared_ptr<MOStream> imageOStream() override;
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class X64FileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new X64File(path);
+    }
+
+    bool handles(std::string fileName) {
+        return byExtension(".x64", fileName);
+    }
+
+    X64FileSystem(): MFileSystem("x64") {};
+};
+
+
+#endif /* MEATFILESYSTEM_MEDIA_X64 */
@@ -12,7 +12,11 @@ CServerSessionMgr CServerFileSystem::session;
 
 bool CServerSessionMgr::establishSession() {
     if(!buf.is_open()) {
+        // a fresh connection always starts in the root, whatever we thought before
         currentDir = "cs:/";
+        m_currentParts.clear();
+        m_pathKnown = true;
+        m_reconnects++;
         buf.open();
     }
     
@@ -20,23 +24,46 @@ bool CServerSessionMgr::establishSession() {
 }
 
 std::string CServerSessionMgr::readLn() {
-    char buffer[80];
+    char buffer[80] = { 0 };
     // telnet line ends with 10;
     getline(buffer, 80, 10);
+
+    // a timeout or an overlong line sets failbit, don't let it poison later reads
+    if(fail())
+        clear();
+
     //Debug_printv("Inside readLn: %s", buffer);
     return std::string((char *)buffer);
 }
 
 bool CServerSessionMgr::sendCommand(std::string command) {
+    return sendCommands({ command });
+}
+
+bool CServerSessionMgr::sendCommands(const std::vector<std::string>& commands) {
     // 13 (CR) sends the command
-    if(establishSession()) {
-        Serial.printf("CServer: send command: %s\n", command.c_str());
-        (*this) << (command+'\r');
+    // Several commands are written in one go, the server executes them in
+    // order and we collect the replies afterwards
+    for(int attempt = 0; attempt < 2; attempt++) {
+        if(!establishSession())
+            return false;
+
+        for(auto& command: commands) {
+            Serial.printf("CServer: send command: %s\n", command.c_str());
+            (*this) << (command+'\r');
+        }
         (*this).flush();
-        return true;
+
+        if(good())
+            return true;
+
+        // connection dropped under us, reconnect and try once more
+        Debug_printv("send failed, reconnecting");
+        clear();
+        buf.close();
     }
-    else
-        return false;
+
+    return false;
 }
 
 bool CServerSessionMgr::isOK() {
@@ -49,74 +76,114 @@ bool CServerSessionMgr::isOK() {
 }
 
 bool CServerSessionMgr::traversePath(MFile* path) {
-    // tricky. First we have to
-    // CF / - to go back to root
-
     //Debug_printv("Traversing path: [%s]", path->path.c_str());
 
-    if(buf.is_open()) {
-        // if we are still connected we can smart change dir by just going up or down
-        // but for time being, we stick to traversing from root
-        if(!sendCommand("cf /"))
-            return false;
+    // Make sure we are connected. If the connection was lost, establishSession
+    // resets our idea of the current dir and we transparently walk it again
+    if(!establishSession())
+        return false;
+
+    if(currentDir == path->url)
+        return true;
+
+    auto reconnects = m_reconnects;
+    if(walkPath(path))
+        return true;
+
+    // the connection dropped while we were walking, the server is back in
+    // root now, so walk the whole path once more
+    if(reconnects != m_reconnects)
+        return walkPath(path);
+
+    return false;
+}
+
+bool CServerSessionMgr::walkPath(MFile* path) {
+    std::vector<std::string> chopped = mstr::split(path->path, '/');
+    std::vector<std::string> target;
+
+    for(size_t i = 1; i < chopped.size(); i++) {
+        target.push_back(chopped[i]);
+        // disk image is the end
+        if(mstr::endsWith(chopped[i], ".d64", false))
+            break;
     }
-    else {
-        // if we aren't, change dir to root (alos connects the session);
-        if(!sendCommand("cf /"))
-            return false;
+
+    // If the server already points somewhere on our way (and no image is
+    // mounted there) we only need to walk down the remaining parts
+    size_t common = 0;
+    bool imageMounted = m_currentParts.size() && mstr::endsWith(m_currentParts.back(), ".d64", false);
+    if(!imageMounted) {
+        while(common < m_currentParts.size() && common < target.size() && m_currentParts[common] == target[common])
+            common++;
     }
 
-    if(isOK()) {
-        if(path->path.compare("/") == 0) {
-            currentDir = path->url;
-            return true;
-        }
+    std::vector<std::string> commands;
+    if(!m_pathKnown || common < m_currentParts.size() || imageMounted) {
+        // CF / - to go back to root
+        commands.push_back("cf /");
+        common = 0;
+    }
 
-        std::vector<std::string> chopped = mstr::split(path->path, '/');
-
-        //MFile::parsePath(&chopped, path->path); - nope this doessn't work and crases in the loop!
-
-        Debug_printv("Before loop");
-        //Debug_printv("Chopped size:%d\n", chopped.size());
-        delay(500);
-
-        for(size_t i = 1; i < chopped.size(); i++) {
-            //Debug_printv("Before chopped deref");
-
-            auto part = chopped[i];
-            
-            //Debug_printv("traverse path part: [%s]\n", part.c_str());
-            if(mstr::endsWith(part, ".d64", false)) 
-            {
-                // THEN we have to mount the image INSERT image_name
-                sendCommand("insert "+part);
-
-                // disk image is the end, so return
-                if(isOK()) {
-                    currentDir = path->url;
-                    return true;
-                }
-                else {
-                    // or: ?500 - DISK NOT FOUND.
-                    return false;
-                }
-            }
-            else 
-            {
-                // CF xxx - to browse into subsequent dirs
-                sendCommand("cf "+part);
-                if(!isOK()) {
-                    // or: ?500 - CANNOT CHANGE TO dupa
-                    return false;
-                }
-            }
+    for(size_t i = common; i < target.size(); i++) {
+        if(mstr::endsWith(target[i], ".d64", false))
+            // THEN we have to mount the image INSERT image_name
+            commands.push_back("insert "+target[i]);
+        else
+            // CF xxx - to browse into subsequent dirs
+            commands.push_back("cf "+target[i]);
+    }
+
+    // Send the whole walk at once, then collect one reply per command
+    if(commands.size() && !sendCommands(commands))
+        return false;
+
+    bool ok = true;
+    for(size_t i = 0; i < commands.size(); i++) {
+        // or: ?500 - CANNOT CHANGE TO dupa
+        // or: ?500 - DISK NOT FOUND.
+        // keep reading so the replies don't spill into the next command
+        if(!isOK())
+            ok = false;
+    }
+
+    if(!ok) {
+        // we don't know where the server ended up, start from root next time
+        currentDir = "";
+        m_pathKnown = false;
+        return false;
+    }
+
+    m_currentParts = target;
+    m_pathKnown = true;
+    currentDir = path->url;
+    return true;
+}
+
+CServerDirCache* CServerSessionMgr::cachedDir(std::string url) {
+    auto found = m_dirCache.find(url);
+    if(found == m_dirCache.end())
+        return nullptr;
+
+    return &found->second;
+}
+
+CServerDirCache* CServerSessionMgr::cacheDir(std::string url, CServerDirCache& dir) {
+    if(m_dirCache.find(url) == m_dirCache.end()) {
+        if(m_dirCacheOrder.size() >= CS_DIR_CACHE_MAX) {
+            m_dirCache.erase(m_dirCacheOrder.front());
+            m_dirCacheOrder.erase(m_dirCacheOrder.begin());
         }
-        
-        currentDir = path->url;
-        return true;
+        m_dirCacheOrder.push_back(url);
     }
-    else
-        return false; // shouldn't really happen, right?
+
+    m_dirCache[url] = std::move(dir);
+    return &m_dirCache[url];
+}
+
+void CServerSessionMgr::invalidateDir(std::string url) {
+    m_dirCache.erase(url);
+    m_dirCacheOrder.erase(std::remove(m_dirCacheOrder.begin(), m_dirCacheOrder.end(), url), m_dirCacheOrder.end());
 }
 
 /********************************************************
@@ -128,12 +195,32 @@ size_t CServerIStream::position() {
 };
 
 void CServerIStream::close() {
+    // The rest of an aborted LOAD is still coming, it must not be read as
+    // the reply to the next command. A short tail is likely buffered
+    // already, anything longer is cheaper to drop with the connection.
+    if(m_isOpen && m_bytesAvailable) {
+        uint8_t buffer[64];
+        while(m_bytesAvailable && m_bytesAvailable <= CS_BUFFER_SIZE) {
+            if(read(buffer, std::min(sizeof(buffer), m_bytesAvailable)) == 0)
+                break;
+        }
+
+        if(m_bytesAvailable) {
+            Debug_printv("dropping the connection, [%d] bytes left", m_bytesAvailable);
+            CServerFileSystem::session.buf.close();
+        }
+    }
+
     m_isOpen = false;
+    m_bytesAvailable = 0;
 };
 
 bool CServerIStream::open() {
     auto file = std::make_unique<CServerFile>(url);
     m_isOpen = false;
+    m_position = 0;
+    m_length = 0;
+    m_bytesAvailable = 0;
 
     if(file->isDirectory())
         return false; // or do we want to stream whole d64 image? :D
@@ -148,17 +235,22 @@ bool CServerIStream::open() {
         CServerFileSystem::session.sendCommand("load "+file->name);
         // read first 2 bytes with size, low first, but may also reply with: ?500 - ERROR
         uint8_t buffer[2] = { 0, 0 };
-        read(buffer, 2);
-        // hmmm... should we check if they're "?5" for error?!
+        if(CServerFileSystem::session.receive(buffer, 2) != 2) {
+            Serial.println("CServer: no reply to load");
+            return false;
+        }
+
         if(buffer[0]=='?' && buffer[1]=='5') {
             Serial.println("CServer: open file failed");
             CServerFileSystem::session.readLn();
             m_isOpen = false;
         }
         else {
-            m_bytesAvailable = buffer[0] + buffer[1]*256; // put len here
-            // if everything was ok
-            Serial.printf("CServer: file open, size: %d\n", m_bytesAvailable);
+            // the server announces the length up front, from now on exactly
+            // that many bytes of the file follow on the connection
+            m_length = buffer[0] + buffer[1]*256;
+            m_bytesAvailable = m_length;
+            Serial.printf("CServer: file open, size: %d\n", m_length);
             m_isOpen = true;
         }
     }
@@ -172,11 +264,20 @@ size_t CServerIStream::available() {
 };
 
 size_t CServerIStream::size() {
-    return m_bytesAvailable;
+    return m_length;
 };
 
 size_t CServerIStream::read(uint8_t* buf, size_t size)  {
     //Serial.println("CServerIStream::read");
+
+    // never read past the announced length, whatever comes after it
+    // belongs to the next reply
+    if(size > m_bytesAvailable)
+        size = m_bytesAvailable;
+
+    if(size == 0)
+        return 0;
+
     auto bytesRead = CServerFileSystem::session.receive(buf, size);
     m_bytesAvailable-=bytesRead;
     m_position+=bytesRead;
@@ -193,33 +294,100 @@ bool CServerIStream::isOpen() {
  ********************************************************/
 
 size_t CServerOStream::position() {
-    return 0;
+    return m_buffer.size();
 };
 
 void CServerOStream::close() {
+    if(m_isOpen)
+        upload();
+
     m_isOpen = false;
 };
 
 bool CServerOStream::open() {
     auto file = std::make_unique<CServerFile>(url);
 
-    if(CServerFileSystem::session.traversePath(file.get())) {
-        m_isOpen = true;
-    }
-    else
-        m_isOpen = false;
+    m_buffer.clear();
+    m_isOpen = !file->isDirectory();
 
     return m_isOpen;
 };
 
 // MOStream methods
 size_t CServerOStream::write(const uint8_t *buf, size_t size) {
-    // we have to write all at once... sorry...
+    // C=Server wants to know the size before the first byte is sent, so we
+    // collect everything and upload it in one go when the stream gets closed
+    if(!m_isOpen)
+        return 0;
+
+    // Too big to hold, fail now rather than upload part of it on close
+    if(m_buffer.size() + size > CS_SAVE_MAX) {
+        Serial.printf("CServer: save larger than %u bytes\n", (unsigned)CS_SAVE_MAX);
+        m_buffer.clear();
+        m_buffer.shrink_to_fit();
+        m_isOpen = false;
+        return 0;
+    }
+
+    m_buffer.insert(m_buffer.end(), buf, buf + size);
+    return size;
+};
+
+bool CServerOStream::upload() {
     auto file = std::make_unique<CServerFile>(url);
+    auto& session = CServerFileSystem::session;
+
+    if(!session.traversePath(file.get()))
+        return false;
+
+    mstr::rtrimA0(file->name);
+    mstr::toPETSCII(file->name);
+
+    std::string type = "PRG";
+    if(mstr::endsWith(file->name, ".seq", false))
+        type = "SEQ";
+
+    // save fileName,size[,type=PRG,SEQ]
+    session.sendCommand(mstr::format("save %s,%u,%s", file->name.c_str(), (unsigned)m_buffer.size(), type.c_str()));
+
+    // Stream the data in blocks, only sending the next one once the
+    // previous block has been accepted by the TCP stack. A server that
+    // stops taking data for CS_TIMEOUT fails the save.
+    size_t sent = 0;
+    uint32_t start = millis();
+    while(sent < m_buffer.size()) {
+        size_t block = std::min((size_t)CS_BUFFER_SIZE, m_buffer.size() - sent);
+        size_t written = session.send(m_buffer.data() + sent, block);
+        if(written == 0) {
+            if(!session.is_open()) {
+                Serial.println("CServer: connection lost during save");
+                return false;
+            }
+            if(millis() - start > CS_TIMEOUT) {
+                // The server still waits for the rest, start over
+                Serial.println("CServer: save timed out");
+                session.buf.close();
+                return false;
+            }
+            yield();
+            continue;
+        }
+        sent += written;
+        start = millis();
+    }
+
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
 
-    CServerFileSystem::session.sendCommand("save fileName,size[,type=PRG,SEQ]");
-    m_isOpen = false; // c64 server supports only writing all at once, so this channel has to be marked closed
-    return CServerFileSystem::session.send(buf, size);
+    // listing of this directory has changed
+    auto dirUrl = url.substr(0, url.find_last_of('/'));
+    session.invalidateDir(dirUrl == "cs:" ? "cs:/" : dirUrl);
+
+    bool ok = session.isOK();
+    if(!ok)
+        Serial.println("CServer: save failed");
+
+    return ok;
 };
 
 
@@ -373,118 +541,124 @@ MOStream* CServerFile::outputStream() {
 
 bool CServerFile::rewindDirectory() {    
     dirIsOpen = false;
+    m_dirIndex = 0;
 
     if(!isDirectory())
         return false;
 
-    if(!CServerFileSystem::session.traversePath(this)) return false;
+    auto& session = CServerFileSystem::session;
+
+    m_dir = session.cachedDir(url);
+    if(m_dir == nullptr) {
+        CServerDirCache dir;
+        if(!readDirectory(dir))
+            return false;
+
+        // A listing a timeout cut short is shown this once and read again
+        // next time
+        if(dir.complete) {
+            m_dir = session.cacheDir(url, dir);
+        }
+        else {
+            m_listing = std::move(dir);
+            m_dir = &m_listing;
+        }
+    }
+
+    dirIsImage = m_dir->isImage;
+    media_header = m_dir->media_header;
+    media_id = m_dir->media_id;
+    media_image = m_dir->media_image;
+    media_blocks_free = m_dir->media_blocks_free;
+    dirIsOpen = true;
+
+    return true;
+};
+
+// Fetch the complete listing in one go, so it can be cached and the
+// connection is free for the next command right away
+bool CServerFile::readDirectory(CServerDirCache& dir) {
+    auto& session = CServerFileSystem::session;
+
+    if(!session.traversePath(this)) return false;
+
+    std::string new_url = url;
+    if(url.size()>4) // If we are not at root then add additional "/"
+        new_url += "/";
 
     if(mstr::endsWith(path, ".d64", false))
     {
-        dirIsImage = true;
+        dir.isImage = true;
         // to list image contents we have to run
         //Serial.println("cserver: this is a d64 img!");
-        CServerFileSystem::session.sendCommand("$");
-        auto line = CServerFileSystem::session.readLn(); // mounted image name
-        if(CServerFileSystem::session.is_open()) {
-            dirIsOpen = true;
-            media_image = line.substr(5);
-            line = CServerFileSystem::session.readLn(); // dir header
-            media_header = line.substr(2, line.find_last_of("\""));
-            media_id = line.substr(line.find_last_of("\"")+2);
-            return true;
-        }
-        else
+        session.sendCommand("$");
+        auto line = session.readLn(); // mounted image name
+        if(!session.is_open())
             return false;
+
+        dir.media_image = line.substr(5);
+        line = session.readLn(); // dir header
+        dir.media_header = line.substr(2, line.find_last_of("\""));
+        dir.media_id = line.substr(line.find_last_of("\"")+2);
+
+        while(session.is_open()) {
+            line = session.readLn();
+            Debug_printv("next file in dir got %s", line.c_str());
+            // 'ot line:'0 "CIE�������������" 00�2A�
+            // 'ot line:'2   "CIE+SERIAL      " PRG   2049
+            // 'ot line:'1   "CIE-SYS31801    " PRG   2049
+            // 'ot line:'1   "CIE-SYS31801S   " PRG   2049
+            // 'ot line:'1   "CIE-SYS52281    " PRG   2049
+            // 'ot line:'1   "CIE-SYS52281S   " PRG   2049
+            // 'ot line:'658 BLOCKS FREE.
+
+            // A timeout drops the connection, the listing isn't complete
+            if(line.empty() || line.find('\x04')!=std::string::npos) {
+                dir.complete = session.is_open();
+                break;
+            }
+            if(line.find("BLOCKS FREE.")!=std::string::npos) {
+                dir.media_blocks_free = atoi(line.substr(0, line.find_first_of(" ")).c_str());
+                dir.complete = true;
+                break;
+            }
+
+            auto name = line.substr(5,15);
+            size_t size = atoi(line.substr(0, line.find_first_of(" ")).c_str());
+            mstr::rtrim(name);
+            dir.entries.push_back({ new_url + name, size });
+        }
     }
     else 
     {
-        dirIsImage = false;
+        dir.isImage = false;
         // to list directory contents we use
         //Serial.println("cserver: this is a directory!");
-        CServerFileSystem::session.sendCommand("disks");
-        auto line = CServerFileSystem::session.readLn(); // dir header
-        if(CServerFileSystem::session.is_open()) {
-            media_header = line.substr(2, line.find_last_of("]")-1);
-            media_id = "C=SVR";
-            dirIsOpen = true;
-
-            return true;
-        }
-        else 
+        session.sendCommand("disks");
+        auto line = session.readLn(); // dir header
+        if(!session.is_open())
             return false;
-    }
-};
 
-MFile* CServerFile::getNextFileInDir() {
-    if(!dirIsOpen)
-        rewindDirectory();
+        dir.media_header = line.substr(2, line.find_last_of("]")-1);
+        dir.media_id = "C=SVR";
 
-    if(!dirIsOpen)
-        return nullptr;
+        while(session.is_open()) {
+            line = session.readLn();
+            // 'ot line:'FAST-TESTER DELUXE EXCESS.D64
+            // 'ot line:'EMPTY.D64
+            // 'ot line:'CMD UTILITIES D1.D64
+            // 'ot line:'GEOS DISK EDITOR (1990)(GREG BADROS).D64
+            // 'ot line:'1541 DEMO DISK (19XX)(-).D64
 
-    std::string name;
-    size_t size;
-    std::string new_url = url;
+            // 32 62 91 68 73 83 75 32 84 79 79 76 83 93 13 No more! = > [DISK TOOLS]
 
-    if(url.size()>4) // If we are not at root then add additional "/"
-        new_url += "/";
-
-    if(dirIsImage) {
-        auto line = CServerFileSystem::session.readLn();
-        Debug_printv("next file in dir got %s", line);
-        // 'ot line:'0 ␒"CIE�������������" 00�2A�
-        // 'ot line:'2   "CIE+SERIAL      " PRG   2049
-        // 'ot line:'1   "CIE-SYS31801    " PRG   2049
-        // 'ot line:'1   "CIE-SYS31801S   " PRG   2049
-        // 'ot line:'1   "CIE-SYS52281    " PRG   2049
-        // 'ot line:'1   "CIE-SYS52281S   " PRG   2049
-        // 'ot line:'658 BLOCKS FREE.
-
-        if(line.find('\x04')!=std::string::npos) {
-            Serial.println("No more!");
-            dirIsOpen = false;
-            return nullptr;
-        }
-        if(line.find("BLOCKS FREE.")!=std::string::npos) {
-            media_blocks_free = atoi(line.substr(0, line.find_first_of(" ")).c_str());
-            dirIsOpen = false;
-            return nullptr;
-        }
-        else {
-            name = line.substr(5,15);
-            size = atoi(line.substr(0, line.find_first_of(" ")).c_str());
-            mstr::rtrim(name);
-            Debug_printv("xx: %s -- %s %d", line.c_str(), name.c_str(), size);
-            //return new CServerFile(path() +"/"+ name);
-            new_url += name;
-            return new CServerFile(new_url, size);
-        }
-    } else {
-        auto line = CServerFileSystem::session.readLn();
-        // Got line:''
-        // Got line:''
-        // 'ot line:'FAST-TESTER DELUXE EXCESS.D64
-        // 'ot line:'EMPTY.D64
-        // 'ot line:'CMD UTILITIES D1.D64
-        // 'ot line:'CBMCMD22.D64
-        // 'ot line:'NAV96.D64
-        // 'ot line:'NAV92.D64
-        // 'ot line:'SINGLE DISKCOPY 64 (1983)(KEVIN PICKELL).D64
-        // 'ot line:'LYNX (19XX)(-).D64
-        // 'ot line:'GEOS DISK EDITOR (1990)(GREG BADROS).D64
-        // 'ot line:'FLOPPY REPAIR KIT (1984)(ORCHID SOFTWARE LABORATOR
-        // 'ot line:'1541 DEMO DISK (19XX)(-).D64
-
-        // 32 62 91 68 73 83 75 32 84 79 79 76 83 93 13 No more! = > [DISK TOOLS]
-
-        if(line.find('\x04')!=std::string::npos) {
-            Serial.println("No more!");
-            dirIsOpen = false;
-            return nullptr;
-        }
-        else {
+            if(line.empty() || line.find('\x04')!=std::string::npos) {
+                dir.complete = session.is_open();
+                break;
+            }
 
+            std::string name;
+            size_t size;
             if((*line.begin())=='[') {
                 name = line.substr(1,line.length()-3);
                 size = 0;
@@ -496,14 +670,31 @@ MFile* CServerFile::getNextFileInDir() {
 
             // Debug_printv("\nurl[%s] name[%s] size[%d]\n", url.c_str(), name.c_str(), size);
             if(name.size() > 0)
-            {
-                new_url += name;
-                return new CServerFile(new_url, size);                
-            }
-            else
-                return nullptr;
+                dir.entries.push_back({ new_url + name, size });
         }
     }
+
+    return true;
+}
+
+MFile* CServerFile::getNextFileInDir() {
+    if(!dirIsOpen)
+        rewindDirectory();
+
+    if(!dirIsOpen)
+        return nullptr;
+
+    // the cache entry may have been evicted by another listing meanwhile
+    if(m_dir != &m_listing)
+        m_dir = CServerFileSystem::session.cachedDir(url);
+    if(m_dir == nullptr || m_dirIndex >= m_dir->entries.size()) {
+        Serial.println("No more!");
+        dirIsOpen = false;
+        return nullptr;
+    }
+
+    auto& entry = m_dir->entries[m_dirIndex++];
+    return new CServerFile(entry.name, entry.size);
 };
 
 bool CServerFile::exists() {
@@ -12,16 +12,35 @@
 #include "utils.h"
 #include "string_utils.h"
 
+#include <algorithm>
 #include <streambuf>
 #include <istream>
+#include <unordered_map>
+#include <vector>
 
 /********************************************************
  * Telnet buffer
  ********************************************************/
 
+// A reply that doesn't come within CS_TIMEOUT drops the connection, what is
+// still in flight would otherwise be taken for the reply to the next
+// command. Reconnecting backs off from CS_RETRY_MIN to CS_RETRY_MAX on every
+// failure in a row, until then cs: fails right away instead of holding up
+// loop() for another timeout.
+#define CS_TIMEOUT 1000
+#define CS_RETRY_MIN 1000
+#define CS_RETRY_MAX 30000
+#define CS_BUFFER_SIZE 512
+
+// A SAVE is held in RAM until the size is known, no more than fits in a C64
+#define CS_SAVE_MAX 65536
+
 class csstreambuf : public std::streambuf {
-    char* gbuf;
-    char* pbuf;
+    char* gbuf = nullptr;
+    char* pbuf = nullptr;
+
+    uint32_t m_retryAt = 0;
+    uint32_t m_retryWait = 0;   // 0 when the last attempt worked
 
 protected:
     WiFiClient m_wifi;
@@ -41,21 +60,35 @@ public:
         if(m_wifi.connected())
             return true;
 
+        if(m_retryWait && (int32_t)(millis() - m_retryAt) < 0)
+            return false;
+
         int rc = m_wifi.connect("commodoreserver.com", 1541);
         Serial.printf("csstreambuf: connect to cserver returned: %d\n", rc);
 
         if(rc == 1) {
+            m_wifi.setNoDelay(true);
             if(gbuf == nullptr)
-                gbuf = new char[512];
+                gbuf = new char[CS_BUFFER_SIZE];
             if(pbuf == nullptr)
-                pbuf = new char[512];
-        }
+                pbuf = new char[CS_BUFFER_SIZE];
 
-        setp(pbuf, pbuf+512);
+            setp(pbuf, pbuf+CS_BUFFER_SIZE);
+            setg(gbuf, gbuf, gbuf);
+        }
+        else {
+            backOff();
+        }
 
         return rc == 1;
     }
 
+    void backOff() {
+        m_retryWait = m_retryWait ? std::min(m_retryWait * 2, (uint32_t)CS_RETRY_MAX) : CS_RETRY_MIN;
+        m_retryAt = millis() + m_retryWait;
+        Debug_printv("next connect in [%d]ms", m_retryWait);
+    }
+
     void close() {
         Serial.printf("csstreambuf: closing\n");
         if(m_wifi.connected()) {
@@ -65,27 +98,50 @@ public:
             delete[] gbuf;
         if(pbuf != nullptr)
             delete[] pbuf;
+        gbuf = nullptr;
+        pbuf = nullptr;
+        setg(nullptr, nullptr, nullptr);
+        setp(nullptr, nullptr);
+    }
+
+    // Wait for the server, at most CS_TIMEOUT. We yield instead of delay()
+    // so WiFi and the watchdog keep running
+    bool waitForData() {
+        uint32_t start = millis();
+
+        while(!m_wifi.available()) {
+            if(!m_wifi.connected())
+                return false;
+
+            if(millis() - start > CS_TIMEOUT) {
+                Debug_printv("timeout, dropping the connection");
+                m_wifi.stop();
+                backOff();
+                return false;
+            }
+            yield();
+        }
+
+        // server is responsive, reconnect right away next time
+        m_retryWait = 0;
+        return true;
     }
 
     int underflow() override {
         //_printv("In underflow");
-        if (!m_wifi.connected()) {
+        if (!m_wifi.connected() && !m_wifi.available()) {
             //Debug_printv("In connection closed");
             close();
             return std::char_traits<char>::eof();
         }
         else if (this->gptr() == this->egptr()) {
             int readCount = 0;
-            int attempts = 5;
-            int wait = 500;
-            
-            while(!(readCount = m_wifi.read((uint8_t*)gbuf, 512)) && (attempts--)>0 && m_wifi.connected()) {
-                //Debug_printv("read attempt");
-                delay(wait);
-                wait+=100;
-            } 
+
+            if(waitForData())
+                readCount = m_wifi.read((uint8_t*)gbuf, CS_BUFFER_SIZE);
+
             //Debug_printv("readcount: %d, %s", readCount, gbuf);
-            this->setg(gbuf, gbuf, gbuf + readCount);
+            this->setg(gbuf, gbuf, gbuf + (readCount > 0 ? readCount : 0));
         }
 
         return this->gptr() == this->egptr()
@@ -115,7 +171,7 @@ public:
         } else if ( ch == EOF ) {
             ch = 0;
         }
-        setp(pbuf, pbuf+512);
+        setp(pbuf, pbuf+CS_BUFFER_SIZE);
         
         return ch;
     };
@@ -124,7 +180,7 @@ public:
 
         if (!m_wifi.connected()) {
             close();
-            return 0;
+            return -1;
         }
         if(pptr() == pbase()) {
             return 0;
@@ -133,11 +189,31 @@ public:
             //Debug_printv("in sync, written %d", pptr()-pbase());
             uint8_t* buffer = (uint8_t*)pbase();
             auto result = m_wifi.write(buffer, pptr()-pbase()); 
-            setp(pbuf, pbuf+512);
+            setp(pbuf, pbuf+CS_BUFFER_SIZE);
             return (result != 0) ? 0 : -1;  
         }  
     };
 
+    // Raw access for binary transfers, drains whatever is already buffered first
+    size_t read(uint8_t* buffer, size_t size) {
+        size_t count = 0;
+
+        if(gptr() < egptr()) {
+            count = std::min(size, (size_t)(egptr() - gptr()));
+            memcpy(buffer, gptr(), count);
+            gbump(count);
+        }
+
+        while(count < size && waitForData()) {
+            int rc = m_wifi.read(buffer + count, size - count);
+            if(rc <= 0)
+                break;
+            count += rc;
+        }
+
+        return count;
+    }
+
     friend class CServerSessionMgr;
 };
 
@@ -145,17 +221,47 @@ public:
  * Session manager
  ********************************************************/
 
+// Listing of a directory or mounted image, kept so browsing back and forth
+// doesn't cost a round trip to the server every time
+struct CServerDirEntry {
+    std::string name;
+    size_t size;
+};
+
+struct CServerDirCache {
+    bool complete = false;      // ended on its terminator, only those are cached
+    std::string media_header;
+    std::string media_id;
+    std::string media_image;
+    uint16_t media_blocks_free = 65535;
+    bool isImage = false;
+    std::vector<CServerDirEntry> entries;
+};
+
+#define CS_DIR_CACHE_MAX 8
+
 class CServerSessionMgr : public std::iostream {
     std::string m_user;
     std::string m_pass;
     csstreambuf buf;
 
+    // path parts the server session currently points at
+    std::vector<std::string> m_currentParts;
+    bool m_pathKnown = false;
+    uint16_t m_reconnects = 0;
+
+    bool walkPath(MFile* path);
+
+    std::unordered_map<std::string, CServerDirCache> m_dirCache;
+    std::vector<std::string> m_dirCacheOrder;
+
 protected:
     std::string currentDir;
 
     bool establishSession();
 
     bool sendCommand(std::string);
+    bool sendCommands(const std::vector<std::string>& commands);
     
     bool traversePath(MFile* path);
 
@@ -163,6 +269,10 @@ protected:
 
     std::string readLn();
 
+    CServerDirCache* cachedDir(std::string url);
+    CServerDirCache* cacheDir(std::string url, CServerDirCache& dir);
+    void invalidateDir(std::string url);
+
 public:
     CServerSessionMgr(std::string user = "", std::string pass = "") : std::iostream(&buf), m_user(user), m_pass(pass)
     {};
@@ -173,8 +283,8 @@ public:
 
     // read/write are used only by MStreams
     size_t receive(uint8_t* buffer, size_t size) {
-        if(buf.is_open())
-            return buf.m_wifi.read(buffer, size);
+        if(buf.is_open() || buf.in_avail() > 0)
+            return buf.read(buffer, size);
         else
             return 0;
     }
@@ -237,6 +347,12 @@ public:
 private:
     bool dirIsImage = false;
     size_t m_size;
+
+    CServerDirCache* m_dir = nullptr;
+    CServerDirCache m_listing;  // one cut short, not cached
+    size_t m_dirIndex = 0;
+
+    bool readDirectory(CServerDirCache& dir);
 };
 
 /********************************************************
@@ -269,8 +385,8 @@ public:
 
 protected:
     std::string url;
-    bool m_isOpen;
-    size_t m_length;
+    bool m_isOpen = false;
+    size_t m_length = 0;
     size_t m_bytesAvailable = 0;
     size_t m_position = 0;
 };
@@ -297,7 +413,11 @@ public:
 
 protected:
     std::string url;
-    bool m_isOpen;
+    bool m_isOpen = false;
+
+    std::vector<uint8_t> m_buffer;
+
+    bool upload();
 };
 
 
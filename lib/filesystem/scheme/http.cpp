@@ -114,38 +114,55 @@ bool HttpIStream::seek(size_t pos) {
 
     if(isFriendlySkipper) {
         char str[40];
-        // Range: bytes=91536-(91536+255)
-        snprintf(str, sizeof str, "bytes=%lu-%lu", (unsigned long)pos, ((unsigned long)pos + 255));
+        // Range: bytes=91536- (open ended, so the rest can be streamed)
+        snprintf(str, sizeof str, "bytes=%lu-", (unsigned long)pos);
         m_http.addHeader("range",str);
         int httpCode = m_http.GET(); //Send the request
         Debug_printv("httpCode[%d] str[%s]", httpCode, str);
-        if(httpCode != 200 || httpCode != 206)
+        if(httpCode != 200 && httpCode != 206)
             return false;
 
         Debug_printv("stream opened[%s]", url.c_str());
         m_file = m_http.getStream();  //Get the response payload as Stream
-        m_position = pos;
-        m_bytesAvailable = m_length-pos;
-        return true;
-
-    } else {
-        if(pos<m_position) {
-            // skipping backward and range not supported, let's simply reopen the stream...
-            m_http.end();
-            bool op = open();
-            if(!op)
-                return false;
+        if(httpCode == 206) {
+            m_position = pos;
+            m_bytesAvailable = m_length-pos;
+            return true;
         }
 
+        // range was ignored and the whole body is coming again, skip up to pos below
         m_position = 0;
-        // ... and then read until we reach pos
-        // while(m_position < pos) {
-        //  m_position+=m_file.readBytes(buffer, size);  <----------- trurn this on!!!!
-        // }
-        m_bytesAvailable = m_length-pos;
+        m_bytesAvailable = m_length;
+    }
 
-        return true;
+    if(pos<m_position) {
+        // skipping backward and range not supported, let's simply reopen the stream...
+        m_http.end();
+        bool op = open();
+        if(!op)
+            return false;
+
+        m_position = 0;
+    }
+
+    // ... and then read until we reach pos
+    uint8_t buffer[256];
+    uint32_t start = millis();
+    while(m_position < pos) {
+        if(read(buffer, std::min(sizeof(buffer), pos - m_position)) > 0) {
+            start = millis();
+            continue;
+        }
+
+        if(millis() - start > HTTP_SKIP_TIMEOUT) {
+            Debug_printv("timeout at position[%d] of [%d]", m_position, pos);
+            return false;
+        }
+        yield();
     }
+    m_bytesAvailable = m_length-pos;
+
+    return true;
 }
 
 size_t HttpIStream::position() {
@@ -201,7 +218,11 @@ size_t HttpIStream::size() {
 };
 
 size_t HttpIStream::read(uint8_t* buf, size_t size) {
-    auto bytesRead= m_file.read((char *) buf, size);
+    // -1 when nothing came in yet or the connection is gone
+    int bytesRead= m_file.read((char *) buf, size);
+    if(bytesRead <= 0)
+        return 0;
+
     m_bytesAvailable = m_file.available();
     m_position+=bytesRead;
     return bytesRead;
@@ -13,6 +13,9 @@
 #include <ESP8266HTTPClient.h>
 #endif
 
+// Skipping forward gives up when no data came in for this long
+#define HTTP_SKIP_TIMEOUT 5000
+
 /********************************************************
  * File implementations
  ********************************************************/
@@ -1,6 +1,10 @@
 #include "littlefs.h"
 #include "flash_hal.h"
 #include "MIOException.h"
+#include "media/p00.h"
+
+#define ARDUINOJSON_ENABLE_STD_STRING 1
+#include <ArduinoJson.h>
 /********************************************************
  * MFileSystem implementations
  ********************************************************/
@@ -89,6 +93,92 @@ bool LittleFileSystem::format() {
     return true;
 }
 
+// littlefs requires cache_size to be a multiple of read and prog size and a
+// factor of block size, lookahead has to be a multiple of 8
+bool LittleFileSystem::applyProfile(const LittleFSProfile& profile) {
+    if(!profile.cache_size || !profile.lookahead_size
+        || profile.cache_size % _lfs_cfg.read_size || profile.cache_size % _lfs_cfg.prog_size
+        || (_blockSize && _blockSize % profile.cache_size) || profile.lookahead_size % 8) {
+        Debug_printv("invalid littlefs profile cache[%d] lookahead[%d]",
+            profile.cache_size, profile.lookahead_size);
+        return false;
+    }
+
+    _lfs_cfg.cache_size = profile.cache_size;
+    _lfs_cfg.lookahead_size = profile.lookahead_size;
+    _lfs_cfg.block_cycles = profile.block_cycles;
+    return true;
+}
+
+LittleFSProfile LittleFileSystem::profile() {
+    return {
+        (uint16_t)_lfs_cfg.cache_size,
+        (uint16_t)_lfs_cfg.lookahead_size,
+        _lfs_cfg.block_cycles
+    };
+}
+
+bool LittleFileSystem::configure(std::string config_file) {
+    if(!m_isMounted)
+        return false;
+
+    std::string json;
+    {
+        auto handle = std::make_unique<LittleHandle>();
+        handle->obtain(LFS_O_RDONLY, config_file);
+        if(handle->rc < 0)
+            return false; // no overrides, keep the board profile
+
+        char buffer[64];
+        int count;
+        while((count = lfs_file_read(&lfsStruct, &handle->lfsFile, buffer, sizeof(buffer))) > 0)
+            json.append(buffer, count);
+    }
+
+    StaticJsonDocument<256> config;
+    if(deserializeJson(config, json)) {
+        Debug_printv("can't parse [%s]", config_file.c_str());
+        return false;
+    }
+
+    // read_size and prog_size are the geometry on flash, they stay
+    if(config.containsKey("read_size") || config.containsKey("prog_size"))
+        Debug_printv("read_size and prog_size are fixed by the format, ignored");
+
+    LittleFSProfile current = profile();
+    LittleFSProfile wanted = current;
+    wanted.cache_size = config["cache_size"] | current.cache_size;
+    wanted.lookahead_size = config["lookahead_size"] | current.lookahead_size;
+    wanted.block_cycles = config["block_cycles"] | current.block_cycles;
+
+    // Read-ahead windows are aligned on their size, it has to be a power
+    // of two no smaller than a read
+    size_t readahead = config["readahead"] | LittleIStream::readAheadSize;
+    size_t window = LITTLEFS_READ_SIZE;
+    while(window < readahead && window < LITTLEFS_READAHEAD_MAX)
+        window <<= 1;
+    LittleIStream::readAheadSize = window;
+
+    if(wanted.cache_size == current.cache_size && wanted.lookahead_size == current.lookahead_size
+        && wanted.block_cycles == current.block_cycles)
+        return true;
+
+    // none of these are stored on flash, so a remount is enough. It never
+    // formats, a failed mount goes back to the settings that worked.
+    if(!applyProfile(wanted))
+        return false;
+
+    Debug_printv("remounting cache[%d] lookahead[%d] cycles[%d]",
+        wanted.cache_size, wanted.lookahead_size, wanted.block_cycles);
+
+    if(_tryMount())
+        return true;
+
+    // fall back to what worked before
+    applyProfile(current);
+    return _tryMount();
+}
+
 int LittleFileSystem::lfs_flash_read(const struct lfs_config *c,
     lfs_block_t block, lfs_off_t off, void *dst, lfs_size_t size) {
     LittleFileSystem *me = reinterpret_cast<LittleFileSystem*>(c->context); // nie wiem, czy ten reinterpret prawidlowo zadziala
@@ -293,6 +383,11 @@ bool LittleFile::rename(std::string pathTo) {
     if(pathTo.empty())
         return false;
 
+    // lfs_rename replaces what is there, DOS doesn't
+    struct lfs_info info;
+    if(lfs_stat(&LittleFileSystem::lfsStruct, pathTo.c_str(), &info) >= 0)
+        return false;
+
     int rc = lfs_rename(&LittleFileSystem::lfsStruct, path.c_str(), pathTo.c_str());
     if (rc != 0) {
         return false;
@@ -364,8 +459,15 @@ MFile* LittleFile::getNextFileInDir()
         closeDir();
         return nullptr;
     }
-    else
-        return new LittleFile(this->path + ((this->path == "/") ? "" : "/") + std::string(_dirent.name)); // due to EdUrlParser shittiness
+    else {
+        std::string entryPath = this->path + ((this->path == "/") ? "" : "/") + std::string(_dirent.name); // due to EdUrlParser shittiness
+
+        // PC64 files are listed under the CBM name from their header
+        if(P00FileSystem::isPC64Name(_dirent.name))
+            return MFSOwner::File(entryPath);
+
+        return new LittleFile(entryPath);
+    }
 }
 
 
@@ -423,28 +525,45 @@ size_t LittleOStream::write(const uint8_t *buf, size_t size) {
     return result;
 };
 
+bool LittleOStream::seek(size_t pos) {
+    if (!isOpen()) {
+        return false;
+    }
+
+    return lfs_file_seek(&LittleFileSystem::lfsStruct, &handle->lfsFile, pos, LFS_SEEK_SET) >= 0;
+};
+
 
 
 /********************************************************
  * MIStreams implementations
  ********************************************************/
 
+size_t LittleIStream::readAheadSize = LITTLEFS_READAHEAD_SIZE;
+
 bool LittleIStream::isOpen() {
     return handle->rc >= 0;
 }
 
 size_t LittleIStream::position() {
     if(!isOpen()) return 0;
-    else return lfs_file_tell(&LittleFileSystem::lfsStruct, &handle->lfsFile);
+    else return m_position;
 };
 
 void LittleIStream::close() {
     if(isOpen()) handle->dispose();
+    m_buffer.reset();
+    m_bufferLength = 0;
 };
 
 bool LittleIStream::open() {
     if(!isOpen()) {
         handle->obtain(LFS_O_RDONLY, localPath);
+        if(isOpen()) {
+            m_length = lfs_file_size(&LittleFileSystem::lfsStruct, &handle->lfsFile);
+            m_position = 0;
+            m_bufferLength = 0;
+        }
     }
     return isOpen();
 };
@@ -452,30 +571,79 @@ bool LittleIStream::open() {
 // MIStream methods
 size_t LittleIStream::available() {
     if(!isOpen()) return 0;
-    return lfs_file_size(&LittleFileSystem::lfsStruct, &handle->lfsFile) - position();
+    return m_length - m_position;
 };
 
 size_t LittleIStream::size() {
-    return available();
+    return m_length;
 };
 
 // uint8_t LittleIStream::read() {
 //     return 0;
 // };
 
+// Load the window containing pos. Windows are aligned, so jumping back and
+// forth between nearby sectors of an image stays inside the same one
+bool LittleIStream::fill(size_t pos) {
+    if(m_buffer == nullptr)
+        m_buffer = std::unique_ptr<uint8_t[]>(new uint8_t[m_bufferSize]);
+
+    m_bufferStart = pos - (pos % m_bufferSize);
+    m_bufferLength = 0;
+
+    if(lfs_file_seek(&LittleFileSystem::lfsStruct, &handle->lfsFile, m_bufferStart, LFS_SEEK_SET) < 0)
+        return false;
+
+    int result = lfs_file_read(&LittleFileSystem::lfsStruct, &handle->lfsFile, (void*) m_buffer.get(), m_bufferSize);
+    if (result < 0) {
+        DEBUGV("lfs_read rc=%d\n", result);
+        return false;
+    }
+
+    m_bufferLength = result;
+    return true;
+}
+
 size_t LittleIStream::read(uint8_t* buf, size_t size) {
     if (!isOpen() || !buf) {
         Debug_printv("Not open");
         return 0;
     }
-    
-    int result = lfs_file_read(&LittleFileSystem::lfsStruct, &handle->lfsFile, (void*) buf, size);
-    if (result < 0) {
-        DEBUGV("lfs_read rc=%d\n", result);
-        return 0;
+
+    if(size > available())
+        size = available();
+
+    size_t count = 0;
+    while(count < size) {
+        size_t pos = m_position + count;
+
+        if(pos < m_bufferStart || pos >= m_bufferStart + m_bufferLength) {
+            // Big aligned reads don't need the window, let them go to flash directly
+            if(size - count >= m_bufferSize && (pos % m_bufferSize) == 0) {
+                size_t len = (size - count) - ((size - count) % m_bufferSize);
+                if(lfs_file_seek(&LittleFileSystem::lfsStruct, &handle->lfsFile, pos, LFS_SEEK_SET) < 0)
+                    break;
+                int result = lfs_file_read(&LittleFileSystem::lfsStruct, &handle->lfsFile, (void*) (buf + count), len);
+                if (result <= 0) {
+                    DEBUGV("lfs_read rc=%d\n", result);
+                    break;
+                }
+                count += result;
+                continue;
+            }
+
+            if(!fill(pos) || m_bufferLength == 0)
+                break;
+        }
+
+        size_t offset = pos - m_bufferStart;
+        size_t len = std::min(size - count, m_bufferLength - offset);
+        memcpy(buf + count, m_buffer.get() + offset, len);
+        count += len;
     }
 
-    return result;
+    m_position += count;
+    return count;
 };
 
 bool LittleIStream::seek(size_t pos) {
@@ -489,7 +657,20 @@ bool LittleIStream::seek(size_t pos, SeekMode mode) {
         Debug_printv("Not open");
         return false;
     }
-    return (lfs_file_seek(&LittleFileSystem::lfsStruct, &handle->lfsFile, pos, mode))? true: false;
+
+    // Seeking only moves our position, flash is touched on the next read
+    // and only if the new position is outside the window
+    size_t newPos = pos;
+    if(mode == SeekMode::SeekCur)
+        newPos = m_position + pos;
+    else if(mode == SeekMode::SeekEnd)
+        newPos = m_length - pos;
+
+    if(newPos > m_length)
+        return false;
+
+    m_position = newPos;
+    return true;
 }
 
 
@@ -18,6 +18,37 @@
  * MFileSystem
  ********************************************************/
 
+// Geometry the filesystem was formatted with. littlefs lays out its
+// metadata in prog_size units, so these can't change on an existing
+// filesystem without reformatting it.
+#define LITTLEFS_READ_SIZE 64
+#define LITTLEFS_PROG_SIZE 64
+
+// littlefs cache settings, none of these are stored on flash. Bigger caches
+// trade RAM for fewer flash transactions. block_cycles sets how often
+// metadata is moved for wear leveling, higher means less overhead but less
+// even wear
+struct LittleFSProfile {
+    uint16_t cache_size;
+    uint16_t lookahead_size;
+    int32_t block_cycles;
+};
+
+// Per-board defaults, ESP8266 has little RAM to spare, ESP32 modules with
+// big flash chips benefit from larger caches
+#if defined(ESP32)
+#define LITTLEFS_PROFILE_DEFAULT { 512, 128, 512 }
+#define LITTLEFS_PROFILE_LARGE   { 2048, 512, 1000 }
+#else
+#define LITTLEFS_PROFILE_DEFAULT { 64, 64, 16 }
+#define LITTLEFS_PROFILE_LARGE   { 256, 128, 100 }
+#endif
+// Filesystems at least this big get the large profile
+#define LITTLEFS_LARGE_SIZE (8 * 1024 * 1024)
+
+// Optional overrides, JSON with any of the profile keys plus "readahead"
+#define LITTLEFS_CONFIG SYSTEM_DIR "littlefs.conf"
+
 class LittleFileSystem: public MFileSystem 
 {
     MFile* getFile(std::string path) override;
@@ -36,25 +67,32 @@ public:
         _lfs_cfg.prog = lfs_flash_prog;
         _lfs_cfg.erase = lfs_flash_erase;
         _lfs_cfg.sync = lfs_flash_sync;
-        _lfs_cfg.read_size = 64;
-        _lfs_cfg.prog_size = 64;
+        _lfs_cfg.read_size = LITTLEFS_READ_SIZE;
+        _lfs_cfg.prog_size = LITTLEFS_PROG_SIZE;
         _lfs_cfg.block_size =  _blockSize;
         _lfs_cfg.block_count =_blockSize? _size / _blockSize: 0;
-        _lfs_cfg.block_cycles = 16; // TODO - need better explanation
-        _lfs_cfg.cache_size = 64;
-        _lfs_cfg.lookahead_size = 64;
         _lfs_cfg.read_buffer = nullptr;
         _lfs_cfg.prog_buffer = nullptr;
         _lfs_cfg.lookahead_buffer = nullptr;
         _lfs_cfg.name_max = 0;
         _lfs_cfg.file_max = 0;
         _lfs_cfg.attr_max = 0;
+
+        LittleFSProfile profile = LITTLEFS_PROFILE_DEFAULT;
+        LittleFSProfile large = LITTLEFS_PROFILE_LARGE;
+        applyProfile((_size >= LITTLEFS_LARGE_SIZE) ? large : profile);
+
         m_isMounted = false;
         mount();
     }
 
     bool handles(std::string path);
 
+    // Read LITTLEFS_CONFIG and remount if it asks for different settings.
+    // Call it before any file is opened.
+    bool configure(std::string config_file = LITTLEFS_CONFIG);
+    LittleFSProfile profile();
+
     static lfs_t lfsStruct;
 
 private:
@@ -67,6 +105,7 @@ private:
 
     bool format();
     bool _tryMount();
+    bool applyProfile(const LittleFSProfile& profile);
 
     lfs_config  _lfs_cfg;
     uint32_t _start;
@@ -76,7 +115,7 @@ private:
     uint32_t _maxOpenFds;
 };
 
-
+extern LittleFileSystem defaultFS;
 
 
 
@@ -174,6 +213,7 @@ public:
     // MOStream methods
     //size_t write(uint8_t) override;
     size_t write(const uint8_t *buf, size_t size) override;
+    bool seek(size_t pos) override;
     bool isOpen();
 
 protected:
@@ -188,6 +228,25 @@ protected:
  ********************************************************/
 
 
+// Reads are served from a read-ahead window. Refills are done as one big
+// lfs_file_read, which littlefs passes straight to flash instead of
+// chopping it up into cache_size transactions. "readahead" in the config
+// is rounded up to a power of two and kept at or below the maximum.
+#ifndef LITTLEFS_READAHEAD_SIZE
+#if defined(ESP32)
+#define LITTLEFS_READAHEAD_SIZE 4096
+#else
+#define LITTLEFS_READAHEAD_SIZE 1024
+#endif
+#endif
+#ifndef LITTLEFS_READAHEAD_MAX
+#if defined(ESP32)
+#define LITTLEFS_READAHEAD_MAX 16384
+#else
+#define LITTLEFS_READAHEAD_MAX 4096
+#endif
+#endif
+
 class LittleIStream: public MIStream {
 public:
     LittleIStream(std::string& path) {
@@ -211,10 +270,23 @@ public:
     virtual bool seek(size_t pos) override;
     virtual bool seek(size_t pos, SeekMode mode) override;
 
+    static size_t readAheadSize;
+
 protected:
     std::string localPath;
 
     std::unique_ptr<LittleHandle> handle;    
+
+private:
+    bool fill(size_t pos);
+
+    std::unique_ptr<uint8_t[]> m_buffer;
+    size_t m_bufferSize = readAheadSize;
+    size_t m_bufferStart = 0;
+    size_t m_bufferLength = 0;
+
+    size_t m_position = 0;
+    size_t m_length = 0;
 };
 
 
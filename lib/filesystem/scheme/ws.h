@@ -11,10 +11,19 @@
 #include <ArduinoWebsockets.h>
 #include "string_utils.h"
 
+#include <deque>
+
 /********************************************************
  * Streams
  ********************************************************/
 
+// Received frames are queued as they are, reads copy straight out of them.
+// Once this many bytes are waiting we stop polling the socket, so a fast
+// sender is throttled by TCP instead of filling up the heap
+#define WS_QUEUE_LIMIT 4096
+// Writes larger than this are sent as a fragmented message
+#define WS_FRAGMENT_SIZE 1024
+
 class CSIOStream: public MIStream, public MOStream {
 public:
     CSIOStream(MFile* file, bool isServer) : m_isServer(isServer) {
@@ -29,7 +38,10 @@ public:
     }
 
     void close() override {
-        client.close();        
+        client.close();
+        m_frames.clear();
+        m_frameOffset = 0;
+        m_queued = 0;
     }
 
     bool open() override {
@@ -49,8 +61,9 @@ public:
     };
 
     // MStream methods
-    size_t position() override { return 0; };
-    size_t available() override { return INT_MAX; };
+    size_t position() override { return m_position; };
+    // bytes already received, or "unknown" while the socket is still open
+    size_t available() override { return m_queued ? m_queued : (m_isOpen ? INT_MAX : 0); };
     bool isOpen() { return m_isOpen; };
     bool seek(size_t pos) { return false; };
     size_t size() { return INT_MAX; };
@@ -58,51 +71,83 @@ public:
     size_t read(uint8_t* buf, size_t size) override {
         //auto msg = client.readBlocking(); // we don't want to block. We'll store a message from callback in msg
 
-        if(!m_isOpen)
-            return 0;
-
-        if(!lastMsg.isEmpty()) {
-            auto maxLen = (size < lastMsg.length()) ? size : lastMsg.length();
-            strncpy((char *)buf, lastMsg.c_str(), maxLen);
-            Debug_printv("Sending last msg and polling!");
-            lastMsg = "";
+        // only ask for more when there is room for it
+        if(m_isOpen && m_queued < WS_QUEUE_LIMIT)
             client.poll();
-            return maxLen;
-        }
-        else {
-            Debug_printv("Polling!");
-            client.poll();
-            return 0;
+
+        size_t count = 0;
+        while(count < size && !m_frames.empty()) {
+            auto& frame = m_frames.front();
+
+            // frames may be consumed partially, the rest stays for the next read
+            size_t len = std::min(size - count, frame.length() - m_frameOffset);
+            memcpy(buf + count, frame.data() + m_frameOffset, len);
+            count += len;
+            m_frameOffset += len;
+
+            if(m_frameOffset == frame.length()) {
+                m_frames.pop_front();
+                m_frameOffset = 0;
+            }
         }
+
+        m_queued -= count;
+        m_position += count;
+        return count;
     }
+
     size_t write(const uint8_t *buf, size_t size) override {
-        if(!m_isOpen)
+        if(!m_isOpen || size == 0)
+            return 0;
+
+        // binary frames, data may contain anything including zeroes
+        if(size <= WS_FRAGMENT_SIZE)
+            return client.sendBinary((const char *)buf, size) ? size : 0;
+
+        // big chunks go out as a fragmented message, so neither side has to
+        // hold the whole thing in one frame buffer
+        if(!client.streamBinary())
             return 0;
 
-        websockets::WSInterfaceString message((char *)buf);
-        client.send(message);
-        return message.length();
+        size_t sent = 0;
+        while(sent < size) {
+            size_t len = std::min((size_t)WS_FRAGMENT_SIZE, size - sent);
+            if(!client.sendBinary((const char *)buf + sent, len))
+                break;
+            sent += len;
+        }
+        client.end();
+
+        return sent;
     }
 
 protected:
     websockets::WSInterfaceString address; // format: www.myserver.com:8080
     uint16_t port = 80;
-    bool m_isOpen;
+    bool m_isOpen = false;
     bool m_isServer;
     websockets::WebsocketsClient client;
     websockets::WebsocketsServer server;
-    websockets::WSInterfaceString lastMsg;
+
+    std::deque<std::string> m_frames;
+    size_t m_frameOffset = 0;
+    size_t m_queued = 0;
+    size_t m_position = 0;
 
     void prepareClientCallbacks() {
+        // deliver fragments as they arrive instead of collecting the whole
+        // message in memory first
+        client.setFragmentsPolicy(websockets::FragmentsPolicy_Notify);
+
         client.onMessage([this](websockets::WebsocketsMessage msg){
             //
             // I think this get called only if you do client.poll()
             //
-            Debug_printv("Got message: %s", msg.data().c_str());
+            Debug_printv("Got message: len[%d] binary[%d]", msg.length(), msg.isBinary());
 
-            if(msg.isText()) {
-                //(*msgPtr) = (std::string)msg.data();    
-                this->lastMsg = msg.data();
+            if(msg.length()) {
+                this->m_frames.push_back(msg.rawData());
+                this->m_queued += msg.length();
             }
         });
 
@@ -0,0 +1,92 @@
+// Offset view over another stream
+//
+// Presents the part of a stream starting at offset as a stream of its own,
+// for formats that are only a header in front of another one (P00, X64)
+// or hold several images back to back (CMD partitions). A length limits
+// the view, 0 runs to the end of the stream. Reads, writes and seeks go
+// straight through, nothing is buffered or copied.
+//
+// Writing a view needs a stream that seeks. One that can't would take the
+// view's bytes from its own start and lose everything around it, so such
+// a view doesn't open for writing at all.
+//
+
+#ifndef MEATFILESYSTEM_WRAPPERS_OFFSET_STREAM
+#define MEATFILESYSTEM_WRAPPERS_OFFSET_STREAM
+
+#include "meat_io.h"
+
+
+class OffsetIStream : public MIStream {
+
+public:
+    OffsetIStream(std::shared_ptr<MIStream> is, size_t offset, size_t length = 0) : containerStream(is), m_offset(offset), m_length(length) {
+        containerStream->seek(m_offset);
+    };
+
+    // MStream methods
+    size_t position() override {
+        size_t pos = containerStream->position();
+        return (pos > m_offset) ? pos - m_offset : 0;
+    };
+    void close() override { containerStream->close(); };
+    bool open() override { return containerStream->open(); };
+    bool isOpen() override { return containerStream->isOpen(); };
+
+    // MIStream methods
+    bool seek(size_t pos) override {
+        if ( m_length && pos > m_length )
+            return false;
+        return containerStream->seek(m_offset + pos);
+    };
+    size_t available() override {
+        size_t pos = position();
+        return (size() > pos) ? size() - pos : 0;
+    };
+    size_t size() override {
+        size_t size = containerStream->size();
+        size = (size > m_offset) ? size - m_offset : 0;
+        return m_length ? std::min(size, m_length) : size;
+    };
+    size_t read(uint8_t* buf, size_t size) override {
+        return containerStream->read(buf, m_length ? std::min(size, available()) : size);
+    };
+    bool isRandomAccess() override { return containerStream->isRandomAccess(); };
+
+protected:
+    std::shared_ptr<MIStream> containerStream;
+    size_t m_offset;
+    size_t m_length;
+};
+
+
+class OffsetOStream : public MOStream {
+
+public:
+    OffsetOStream(std::shared_ptr<MOStream> os, size_t offset) : containerStream(os), m_offset(offset) {
+        m_seekable = containerStream->seek(m_offset);
+    };
+
+    // MStream methods
+    size_t position() override {
+        size_t pos = containerStream->position();
+        return (pos > m_offset) ? pos - m_offset : 0;
+    };
+    void close() override { containerStream->close(); };
+    bool open() override { return m_seekable && containerStream->open(); };
+    bool isOpen() override { return m_seekable && containerStream->isOpen(); };
+
+    // MOStream methods
+    size_t write(const uint8_t *buf, size_t size) override {
+        return m_seekable ? containerStream->write(buf, size) : 0;
+    };
+    bool seek(size_t pos) override { return m_seekable && containerStream->seek(m_offset + pos); };
+
+protected:
+    std::shared_ptr<MOStream> containerStream;
+    size_t m_offset;
+    bool m_seekable;
+};
+
+
+#endif /* MEATFILESYSTEM_WRAPPERS_OFFSET_STREAM */
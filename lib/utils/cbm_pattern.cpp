@@ -0,0 +1,109 @@
+#include "cbm_pattern.h"
+
+#include <cctype>
+
+
+static bool isPadding(char c)
+{
+    return c == '\xA0' || c == ' ' || c == '\0';
+}
+
+void CBMPattern::clear()
+{
+    m_count = 0;
+    m_type = 0;
+    m_wildcard = false;
+}
+
+void CBMPattern::set(const std::string &pattern)
+{
+    clear();
+
+    // "=P", the type of file
+    size_t end = pattern.size();
+    size_t equals = pattern.rfind('=');
+    if ( equals != std::string::npos )
+    {
+        if ( equals + 1 < end )
+            m_type = toupper(pattern[equals + 1]);
+        end = equals;
+    }
+
+    size_t used = 0;
+    size_t start = 0;
+    while ( start < end && m_count < CBM_PATTERN_NAMES )
+    {
+        size_t comma = pattern.find(',', start);
+        if ( comma == std::string::npos || comma > end )
+            comma = end;
+
+        size_t length = comma - start;
+        while ( length && isPadding(pattern[start + length - 1]) )
+            length--;
+        if ( length > sizeof(m_text) - used )
+            length = sizeof(m_text) - used;
+
+        if ( length )
+        {
+            pattern.copy(&m_text[used], length, start);
+            m_start[m_count] = used;
+            m_length[m_count] = length;
+            m_count++;
+
+            if ( pattern.find_first_of("*?", start) < start + length )
+                m_wildcard = true;
+
+            used += length;
+        }
+
+        start = comma + 1;
+    }
+
+    if ( m_count > 1 || m_type )
+        m_wildcard = true;
+}
+
+bool CBMPattern::matchName(const char *pattern, size_t pattern_length, const char *name, size_t length)
+{
+    // Like the 1541, '*' takes the rest of the name and whatever follows
+    // it in the pattern is never looked at, "AB*CD" is "AB*"
+    size_t p = 0;
+    for ( size_t n = 0; n < length; n++, p++ )
+    {
+        if ( p == pattern_length )
+            return false;
+        if ( pattern[p] == '*' )
+            return true;
+        if ( pattern[p] != '?' && pattern[p] != name[n] )
+            return false;
+    }
+
+    return p == pattern_length || pattern[p] == '*';
+}
+
+bool CBMPattern::matches(const char *name, size_t length, char type) const
+{
+    if ( m_count == 0 || name == nullptr )
+        return false;
+
+    if ( m_type && type && toupper(type) != m_type )
+        return false;
+
+    while ( length && isPadding(name[length - 1]) )
+        length--;
+
+    for ( uint8_t i = 0; i < m_count; i++ )
+    {
+        if ( matchName(&m_text[m_start[i]], m_length[i], name, length) )
+            return true;
+    }
+
+    return false;
+}
+
+char CBMPattern::fileType(uint8_t file_type)
+{
+    static const char types[] = "DSPURCD";
+    file_type &= 0b00000111;
+    return ( file_type < sizeof(types) - 1 ) ? types[file_type] : 0;
+}
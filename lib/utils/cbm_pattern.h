@@ -0,0 +1,63 @@
+// CBM DOS file name patterns
+//
+// "NAME", "NA*", "N?ME" or several of them separated by commas, with an
+// optional file type after '=' ("*=P", "GAME*,DEMO?=S"). '?' stands for any
+// one character and '*' for the rest of the name. As on the 1541 anything
+// after a '*' is ignored, "AB*CD" matches "ABXYZ". Names are compared byte
+// for byte, padding at the end of a name (shifted spaces, spaces, NULs) is
+// ignored, so the 16 byte names of directory entries are matched where
+// they are.
+//
+// The pattern is split up once when it is set, matching doesn't allocate.
+//
+
+#ifndef MEATLOAF_UTILS_CBM_PATTERN
+#define MEATLOAF_UTILS_CBM_PATTERN
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+#define CBM_PATTERN_NAMES   5       // as many as the 1541 takes in one command
+#define CBM_PATTERN_LENGTH  64
+
+class CBMPattern
+{
+public:
+    CBMPattern() {};
+    explicit CBMPattern(const std::string &pattern) { set(pattern); };
+
+    void set(const std::string &pattern);
+    void clear();
+
+    bool empty() const { return m_count == 0; };
+
+    // Anything but one plain name
+    bool wildcard() const { return m_wildcard; };
+
+    // First letter of the file type asked for, 0 for any
+    char type() const { return m_type; };
+
+    // type is the first letter of the file's type, 0 if it isn't known
+    bool matches(const char *name, size_t length, char type = 0) const;
+    bool matches(const std::string &name, char type = 0) const {
+        return matches(name.data(), name.size(), type);
+    };
+
+    // Type letter of a directory entry's type byte
+    static char fileType(uint8_t file_type);
+
+private:
+    static bool matchName(const char *pattern, size_t pattern_length, const char *name, size_t length);
+
+    char m_text[CBM_PATTERN_LENGTH];
+    uint8_t m_start[CBM_PATTERN_NAMES];
+    uint8_t m_length[CBM_PATTERN_NAMES];
+    uint8_t m_count = 0;
+    char m_type = 0;
+    bool m_wildcard = false;
+};
+
+
+#endif /* MEATLOAF_UTILS_CBM_PATTERN */
@@ -17,11 +17,8 @@
 
 #include "device_db.h"
 
-DeviceDB::DeviceDB(uint8_t device)
+DeviceDB::DeviceDB(uint8_t device) : m_id(device)
 {
-    select(device);
-    m_dirty = false;
-
     // Create .sys folder if it doesn't exist
     std::unique_ptr<MFile> file(MFSOwner::File(SYSTEM_DIR));
     if ( !file->exists() )
@@ -33,75 +30,139 @@ DeviceDB::DeviceDB(uint8_t device)
 
 DeviceDB::~DeviceDB()
 {
-
+    save();
 } // destructor
 
 
-bool DeviceDB::select(uint8_t new_device_id)
+std::string DeviceDB::configFile(uint8_t device)
 {
-    uint8_t device_id = m_device["id"];
+    return SYSTEM_DIR "device." + std::to_string(device) + ".conf";
+}
 
-    Debug_printv("cur[%d] new[%d]", device_id, new_device_id);
-    if ( device_id == new_device_id )
-    {
-        return false;
-    }
+DeviceDB::Device& DeviceDB::load(uint8_t device_id)
+{
+    auto found = m_devices.find(device_id);
+    if ( found != m_devices.end() )
+        return found->second;
 
-    // Save current config
-    save();
+    Device &device = m_devices[device_id];
+    device.id = device_id;
 
-    config_file = SYSTEM_DIR "device." + std::to_string(new_device_id) + ".conf";
+    std::string config_file = configFile(device_id);
     std::unique_ptr<MFile> file(MFSOwner::File(config_file));
 
     Debug_printv("config_file[%s]", config_file.c_str());
     if ( file->exists() )
     {
         // Load Device Settings
+        StaticJsonDocument<RECORD_SIZE> settings;
         Meat::ifstream istream(config_file);
         istream.open();
-        deserializeJson(m_device, istream);
-        Debug_printv("loaded id[%d]", (uint8_t)m_device["id"]);
+        deserializeJson(settings, istream);
+
+        device.media = settings["media"] | 0;
+        device.partition = settings["partition"] | 0;
+        device.url = settings["url"] | "";
+        device.path = settings["path"] | "/";
+        device.archive = settings["archive"] | "";
+        device.image = settings["image"] | "";
+        Debug_printv("loaded id[%d]", device.id);
     }
     else
     {
-        // Create New Settings
-        deserializeJson(m_device, F("{\"id\":0,\"media\":0,\"partition\":0,\"url\":\"\",\"path\":\"/\",\"archive\":\"\",\"image\":\"\"}"));
-        m_device["id"] = new_device_id;
-        Debug_printv("created id[%d]", (uint8_t)m_device["id"]);
+        Debug_printv("created id[%d]", device.id);
+    }
+
+    return device;
+}
+
+bool DeviceDB::write(Device &device)
+{
+    StaticJsonDocument<RECORD_SIZE> settings;
+    settings["id"] = device.id;
+    settings["media"] = device.media;
+    settings["partition"] = device.partition;
+    settings["url"] = device.url;
+    settings["path"] = device.path;
+    settings["archive"] = device.archive;
+    settings["image"] = device.image;
+
+    std::unique_ptr<MFile> file(MFSOwner::File(configFile(device.id)));
+    if ( file->exists() )
+        file->remove();
+
+    Meat::ofstream ostream(file.get()->url);
+    ostream.open();
+    if ( !ostream.is_open() )
+        return false;
+
+    serializeJson(settings, ostream);
+    device.dirty = false;
+
+    Debug_printv("saved [%s]", file->url.c_str());
+    return true;
+}
+
+DeviceDB::Device& DeviceDB::current()
+{
+    // Devices are created before the file system is up, read on first use
+    if ( m_current == nullptr )
+        m_current = &load(m_id);
+
+    return *m_current;
+}
+
+void DeviceDB::changed()
+{
+    current().dirty = true;
+    m_dirty = true;
+    m_changed = millis();
+}
+
+
+bool DeviceDB::select(uint8_t new_device_id)
+{
+    Debug_printv("cur[%d] new[%d]", m_current ? m_current->id : 0, new_device_id);
+    if ( m_current != nullptr && m_current->id == new_device_id )
+    {
+        return false;
     }
 
+    m_current = &load(new_device_id);
+    m_id = new_device_id;
     return true;
 }
 
 bool DeviceDB::save()
 {
     // Only save if dirty
-    if ( m_dirty )
+    if ( !m_dirty )
+        return false;
+
+    bool saved = true;
+    for ( auto &device : m_devices )
     {
-        Debug_printv("saved [%s]", config_file.c_str());
-        std::unique_ptr<MFile> file(MFSOwner::File(config_file));
-        if ( file->exists() )
-            file->remove();
-
-        Meat::ofstream ostream(file.get()->url);
-        ostream.open();
-        if(ostream.is_open())
-        {
-            serializeJson(m_device, ostream);
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        if ( device.second.dirty && !write(device.second) )
+            saved = false;
     }
 
-    return false;
+    m_dirty = !saved;
+    return saved;
+}
+
+void DeviceDB::service()
+{
+    if ( m_dirty && (millis() - m_changed) >= DEVICE_DB_FLUSH_DELAY )
+    {
+        // Try again later if it didn't work
+        if ( !save() )
+            m_changed = millis();
+    }
 }
 
 uint8_t DeviceDB::id()
 {
-    return m_device["id"];
+    return current().id;
 }
 void DeviceDB::id(uint8_t id)
 {
@@ -110,66 +171,73 @@ void DeviceDB::id(uint8_t id)
 
 uint8_t DeviceDB::media()
 {
-    return m_device["media"];
+    return current().media;
 }
 void DeviceDB::media(uint8_t media)
 {
-    m_device["media"] = media;
+    if (media != current().media)
+    {
+        current().media = media;
+        changed();
+    }
 }
 uint8_t DeviceDB::partition()
 {
-    return m_device["partition"];
+    return current().partition;
 }
 void DeviceDB::partition(uint8_t partition)
 {
-    m_device["partition"] = partition;
+    if (partition != current().partition)
+    {
+        current().partition = partition;
+        changed();
+    }
 }
 std::string DeviceDB::url()
 {
-    return m_device["url"];
+    return current().url;
 }
 void DeviceDB::url(std::string url)
 {
-    if (url != m_device["url"])
+    if (url != current().url)
     {
-        m_device["url"] = url;
-        m_dirty = true;
+        current().url = url;
+        changed();
     }
 }
 std::string DeviceDB::path()
 {
-    return m_device["path"];
+    return current().path;
 }
 void DeviceDB::path(std::string path)
 {
-    if (path != m_device["path"])
+    if (path != current().path)
     {
-        m_device["path"] = path;
-        m_dirty = true;
+        current().path = path;
+        changed();
     }
 }
 std::string DeviceDB::archive()
 {
-    return m_device["archive"];
+    return current().archive;
 }
 void DeviceDB::archive(std::string archive)
 {
-    if (archive != m_device["archive"])
+    if (archive != current().archive)
     {
-        m_device["archive"] = archive;
-        m_dirty = true;
+        current().archive = archive;
+        changed();
     }
 }
 std::string DeviceDB::image()
 {
-    return m_device["image"];
+    return current().image;
 }
 void DeviceDB::image(std::string image)
 {
-    if (image != m_device["image"])
+    if (image != current().image)
     {
-        m_device["image"] = image;
-        m_dirty = true;
+        current().image = image;
+        changed();
     }
 }
-
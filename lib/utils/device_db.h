@@ -24,8 +24,18 @@
 #define ARDUINOJSON_ENABLE_STD_STRING 1
 #include <ArduinoJson.h>
 
+#include <unordered_map>
+
 #define RECORD_SIZE 512
 
+// How long settings have to stay unchanged before they are written to flash
+#define DEVICE_DB_FLUSH_DELAY 5000
+
+// Settings of the emulated devices. Each device's settings are read from
+// flash the first time they are used and kept, so switching devices is a
+// lookup. Changes are only marked and written out together once nothing
+// changed for DEVICE_DB_FLUSH_DELAY ms (service), or right away by save.
+
 class DeviceDB
 {
 public:
@@ -33,8 +43,7 @@ public:
     ~DeviceDB();
 
     bool save();
-
-    std::string config_file;
+    void service();
 
     uint8_t id();
     void id(uint8_t device);
@@ -54,8 +63,30 @@ public:
     bool select(uint8_t device);
 
 private:
-    bool m_dirty;
-    StaticJsonDocument<RECORD_SIZE> m_device;
+    struct Device
+    {
+        uint8_t id = 0;
+        uint8_t media = 0;
+        uint8_t partition = 0;
+        bool dirty = false;
+        std::string url;
+        std::string path = "/";
+        std::string archive;
+        std::string image;
+    };
+
+    std::string configFile(uint8_t device);
+    Device& load(uint8_t device);
+    Device& current();
+    bool write(Device &device);
+    void changed();
+
+    std::unordered_map<uint8_t, Device> m_devices;
+    Device* m_current = nullptr;
+    uint8_t m_id;
+
+    bool m_dirty = false;
+    uint32_t m_changed = 0;     // millis() of the last change not on flash
 };
 
 #endif
@@ -290,65 +290,6 @@ std::string util_ellipsize(std::string longString, int maxLength)
 }
 */
 
-// Function that matches input string against given wildcard pattern
-bool util_wildcard_match(const char *str, const char *pattern)
-{
-    if (str == nullptr || pattern == nullptr)
-        return false;
-
-    int m = strlen(pattern);
-    int n = strlen(str);
-
-    // Empty pattern can only match with empty string
-    if (m == 0)
-        return (n == 0);
-
-    // Lookup table for storing results of subproblems
-    bool lookup[n + 1][m + 1];
-
-    // Initailze lookup table to false
-    memset(lookup, false, sizeof(lookup));
-
-    // Empty pattern can match with empty string
-    lookup[0][0] = true;
-
-    // Only '*' can match with empty string
-    for (int j = 1; j <= m; j++)
-        if (pattern[j - 1] == '*')
-            lookup[0][j] = lookup[0][j - 1];
-
-    // Fill the table in bottom-up fashion
-    for (int i = 1; i <= n; i++)
-    {
-        for (int j = 1; j <= m; j++)
-        {
-            // Two cases if we see a '*':
-            // a) We ignore '*' character and move to next character in the pattern,
-            //     i.e., '*' indicates an empty sequence.
-            // b) '*' character matches with i-th character in input
-            if (pattern[j - 1] == '*')
-            {
-                lookup[i][j] = lookup[i][j - 1] || lookup[i - 1][j];
-            }
-            // Current characters are considered as matching in two cases:
-            // (a) Current character of pattern is '?'
-            // (b) Characters actually match (case-insensitive)
-            else if (pattern[j - 1] == '?' ||
-                     str[i - 1] == pattern[j - 1] ||
-                     tolower(str[i - 1]) == tolower(pattern[j - 1]))
-            {
-                lookup[i][j] = lookup[i - 1][j - 1];
-            }
-            // If characters don't match
-            else
-                lookup[i][j] = false;
-        }
-    }
-
-    return lookup[n][m];
-}
-
-
 /*
  Concatenates two paths by taking the parent and adding the child at the end.
  If parent is not empty, then a '/' is confirmed to separate the parent and child.
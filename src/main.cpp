@@ -63,6 +63,9 @@ void setup()
     {
         Serial.println ( "Flash File System started" );
 
+        // Apply littlefs cache settings from the system config, if any
+        defaultFS.configure();
+
         // Start the Web Server with WebDAV
         #if defined(ML_WEB_SERVER)
             setupWWW();
@@ -145,10 +148,14 @@ void loop()
     if ( bus_state != statemachine::idle )
     {
         //Debug_printv("before[%d]", bus_state);
-        if( drive.service() == IEC::BUS_IDLE)
+        if( iecDevice::service(iec) == IEC::BUS_IDLE)
             bus_state = statemachine::idle;
         //Debug_printv("after[%d]", bus_state);
     }
+    else
+    {
+        iecDevice::idle();
+    }
 
 
 #ifdef DEBUG_TIMING
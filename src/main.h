@@ -68,6 +68,7 @@ SDFSConfig fileSystemConfig = SDFSConfig();
 
 
 #include "meat_io.h"
+#include "scheme/littlefs.h"
 
 #include "iec.h"
 #include "iec_device.h"
@@ -88,7 +89,11 @@ String statusMessage;
 bool initFailed = false;
 
 static IEC iec;
-static devDrive drive ( iec );
+// One drive per device number in DEVICE_MASK
+static devDrive drive8 ( iec, 8 );
+static devDrive drive9 ( iec, 9 );
+static devDrive drive10 ( iec, 10 );
+static devDrive drive11 ( iec, 11 );
 
 
 //Zimodem modem;
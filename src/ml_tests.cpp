@@ -14,6 +14,10 @@
 #include "../../include/global_defines.h"
 #include "../../include/make_unique.h"
 #include "basic_config.h"
+#include "scheme/littlefs.h"
+#include "media/g64.h"
+#include "media/crt.h"
+#include "archive/7z.h"
 
 std::unique_ptr<MFile> m_mfile(MFSOwner::File(""));
 
@@ -457,6 +461,249 @@ void testBasicConfig() {
 
 }
 
+void testLittleFSBenchmark(size_t fileSize = 256 * 1024) {
+    testHeader("LittleFS benchmark");
+
+    auto profile = defaultFS.profile();
+    Serial.printf("read[%d] prog[%d] cache[%d] lookahead[%d] cycles[%d] readahead[%d]\n",
+        LITTLEFS_READ_SIZE, LITTLEFS_PROG_SIZE, profile.cache_size, profile.lookahead_size,
+        profile.block_cycles, LittleIStream::readAheadSize);
+    Serial.printf("free heap: %d\n", ESP.getFreeHeap());
+
+    std::string benchFile = SYSTEM_DIR "bench.tmp";
+    std::string benchDir = SYSTEM_DIR "bench";
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[4096]);
+    for(size_t i = 0; i < 4096; i++)
+        buffer[i] = i;
+
+    // Sequential write
+    std::unique_ptr<MFile> file(MFSOwner::File(benchFile));
+    file->remove();
+    uint32_t start = millis();
+    {
+        std::unique_ptr<MOStream> os(file->outputStream());
+        for(size_t done = 0; done < fileSize; done += 4096)
+            os->write(buffer.get(), 4096);
+    }
+    uint32_t elapsed = millis() - start;
+    Serial.printf("sequential write: %d bytes in %dms (%d KB/s)\n", fileSize, elapsed, elapsed ? fileSize / elapsed : 0);
+
+    // Sequential read
+    start = millis();
+    {
+        std::unique_ptr<MIStream> is(file->inputStream());
+        while(is->read(buffer.get(), 4096));
+    }
+    elapsed = millis() - start;
+    Serial.printf("sequential read: %d bytes in %dms (%d KB/s)\n", fileSize, elapsed, elapsed ? fileSize / elapsed : 0);
+
+    // Sector sized reads all over the file, like browsing a disk image
+    start = millis();
+    {
+        std::unique_ptr<MIStream> is(file->inputStream());
+        for(size_t i = 0; i < 683; i++) {
+            is->seek(((i * 10) % (fileSize / 256)) * 256);
+            is->read(buffer.get(), 256);
+        }
+    }
+    elapsed = millis() - start;
+    Serial.printf("683 random sector reads: %dms\n", elapsed);
+
+    // Small file create
+    std::unique_ptr<MFile> dir(MFSOwner::File(benchDir));
+    dir->mkDir();
+    start = millis();
+    for(size_t i = 0; i < 32; i++) {
+        std::unique_ptr<MFile> small(MFSOwner::File(benchDir + "/file" + std::to_string(i)));
+        std::unique_ptr<MOStream> os(small->outputStream());
+        os->write(buffer.get(), 64);
+    }
+    elapsed = millis() - start;
+    Serial.printf("32 small files created: %dms\n", elapsed);
+
+    // Directory scan
+    start = millis();
+    size_t count = 0;
+    {
+        auto entry = std::unique_ptr<MFile>(dir->getNextFileInDir());
+        while(entry != nullptr) {
+            count++;
+            entry.reset(dir->getNextFileInDir());
+        }
+    }
+    elapsed = millis() - start;
+    Serial.printf("directory scan: %d entries in %dms\n", count, elapsed);
+
+    // Clean up
+    for(size_t i = 0; i < 32; i++) {
+        std::unique_ptr<MFile> small(MFSOwner::File(benchDir + "/file" + std::to_string(i)));
+        small->remove();
+    }
+    dir->remove();
+    file->remove();
+}
+
+void testG64Decode(std::string url) {
+    testHeader("G64 track decoding");
+
+    std::unique_ptr<MFile> file(MFSOwner::File(url));
+    std::shared_ptr<MIStream> raw(file->inputStream());
+    if(raw == nullptr || !raw->isOpen()) {
+        Serial.printf("can't open [%s]\n", url.c_str());
+        return;
+    }
+
+    // Decode every track once, this is the cost of a cold cache
+    G64GCRStream gcr(raw);
+    std::vector<uint8_t> sectors;
+    uint32_t start = millis();
+    size_t tracks = 0;
+    for(uint8_t track = 1; track <= 35; track++) {
+        if(gcr.decodeTrack(track, sectors))
+            tracks++;
+    }
+    uint32_t elapsed = millis() - start;
+    Serial.printf("decoded %d tracks in %dms (%dms per track)\n", tracks, elapsed, tracks ? elapsed / tracks : 0);
+
+    // Directory listing through the track cache
+    start = millis();
+    testDirectory(file.get());
+    Serial.printf("directory listing: %dms\n", millis() - start);
+}
+
+void testCRTListing(std::string url) {
+    testHeader("CRT EasyFS listing");
+
+    uint32_t heap = ESP.getFreeHeap();
+
+    // First listing pays for the CHIP index and the EasyFS directory
+    std::unique_ptr<MFile> file(MFSOwner::File(url));
+    uint32_t start = millis();
+    testDirectory(file.get());
+    Serial.printf("cold listing: %dms heap used[%d]\n", millis() - start, heap - ESP.getFreeHeap());
+
+    // Second one is served from the cached index
+    start = millis();
+    testDirectory(file.get());
+    Serial.printf("warm listing: %dms\n", millis() - start);
+
+    // Read the first file to see how fast bank data comes out of the container
+    file->rewindDirectory();
+    std::unique_ptr<MFile> entry(file->getNextFileInDir());
+    if(entry == nullptr)
+        return;
+
+    std::unique_ptr<MIStream> stream(entry->inputStream());
+    if(stream == nullptr)
+        return;
+
+    uint8_t buffer[256];
+    size_t total = 0;
+    start = millis();
+    size_t count;
+    while((count = stream->read(buffer, sizeof(buffer))) > 0)
+        total += count;
+    uint32_t elapsed = millis() - start;
+    Serial.printf("read [%s] %d bytes in %dms\n", entry->name.c_str(), total, elapsed);
+}
+
+void testArchiveBenchmark(std::string url) {
+    testHeader("Archive decompression");
+
+    uint32_t heap = ESP.getFreeHeap();
+    uint32_t lowest = heap;
+
+    std::unique_ptr<MFile> file(MFSOwner::File(url));
+    uint32_t start = millis();
+    std::unique_ptr<MIStream> stream(file->inputStream());
+    if(stream == nullptr || !stream->isOpen()) {
+        Serial.printf("can't open [%s]\n", url.c_str());
+        return;
+    }
+    Serial.printf("open: %dms heap used[%d]\n", millis() - start, heap - ESP.getFreeHeap());
+
+    // Sequential throughput, the way a LOAD reads it
+    uint8_t buffer[256];
+    size_t total = 0;
+    size_t count;
+    start = millis();
+    while((count = stream->read(buffer, sizeof(buffer))) > 0) {
+        total += count;
+        lowest = std::min(lowest, ESP.getFreeHeap());
+    }
+    uint32_t elapsed = millis() - start;
+    Serial.printf("read %u bytes in %dms (%u KB/s) peak heap used[%d]\n", (unsigned)total, elapsed, (unsigned)(elapsed ? total / elapsed : 0), heap - lowest);
+
+    // Short backward seeks come from the window, long ones restart
+    if(total > 0) {
+        start = millis();
+        for(int i = 0; i < 16; i++) {
+            stream->seek((total - 1) - (total - 1) * i / 16);
+            stream->read(buffer, 1);
+        }
+        Serial.printf("16 backward seeks: %dms\n", millis() - start);
+
+        start = millis();
+        for(int i = 0; i < 16; i++) {
+            int pos = (int)(total / 2) - i * 512;
+            stream->seek(std::max(pos, 0));
+            stream->read(buffer, sizeof(buffer));
+        }
+        Serial.printf("16 seeks inside the window: %dms\n", millis() - start);
+    }
+}
+
+void testSevenZipBenchmark(std::string url) {
+    testHeader("7z solid block reuse");
+
+    uint32_t heap = ESP.getFreeHeap();
+    uint32_t lowest = heap;
+
+    std::unique_ptr<MFile> archive(MFSOwner::File(url));
+    std::vector<std::string> names;
+    archive->rewindDirectory();
+    std::unique_ptr<MFile> entry(archive->getNextFileInDir());
+    while(entry != nullptr) {
+        names.push_back(entry->url);
+        entry.reset(archive->getNextFileInDir());
+    }
+    Serial.printf("files[%d] heap used[%d]\n", names.size(), heap - ESP.getFreeHeap());
+
+    // Files in archive order, each one continues from the parked decoder
+    // instead of decoding the solid block from its start
+    uint8_t buffer[256];
+    uint32_t total_time = 0;
+    for(auto& name: names) {
+        std::unique_ptr<MFile> file(MFSOwner::File(name));
+        uint32_t start = millis();
+        std::unique_ptr<MIStream> stream(file->inputStream());
+        if(stream == nullptr)
+            continue;
+        uint32_t opened = millis() - start;
+
+        size_t total = 0;
+        size_t count;
+        while((count = stream->read(buffer, sizeof(buffer))) > 0)
+            total += count;
+        lowest = std::min(lowest, ESP.getFreeHeap());
+
+        uint32_t elapsed = millis() - start;
+        total_time += elapsed;
+        Serial.printf("%s: %d bytes open %dms read %dms decoder memory[%d]\n", file->name.c_str(), total, opened, elapsed - opened, ((SevenZipIStream*)stream.get())->memoryUsage());
+    }
+    Serial.printf("all files: %dms peak heap used[%d]\n", total_time, heap - lowest);
+
+    // Same files backwards, every open has to start the folder over
+    uint32_t start = millis();
+    for(auto name = names.rbegin(); name != names.rend(); ++name) {
+        std::unique_ptr<MFile> file(MFSOwner::File(*name));
+        std::unique_ptr<MIStream> stream(file->inputStream());
+        if(stream != nullptr)
+            stream->read(buffer, sizeof(buffer));
+    }
+    Serial.printf("reverse order: %dms\n", millis() - start);
+}
+
 void runTestsSuite() {
     // working, uncomment if you want
     // runFSTest("/.sys", "README"); // TODO - let urlparser drop the last slash!
@@ -489,6 +736,11 @@ void runTestsSuite() {
     // Debug_printv("D64 Test");
     // testDirectory(MFSOwner::File("/games/arcade7.d64"), true);
     testBasicConfig();
+    //testLittleFSBenchmark();
+    //testG64Decode("/games/arcade7.g64");
+    //testCRTListing("/games/easyflash.crt");
+    //testArchiveBenchmark("/games/arcade7.zip/arcade7.d64");
+    //testSevenZipBenchmark("/games/collection.7z");
 
     Serial.println("*** All tests finished ***");
 